@@ -8,6 +8,148 @@
 #import <AudioToolbox/AudioToolbox.h>
 #import <AVFoundation/AVFoundation.h>
 
+// What a pad does with a note-on while it is still sounding, and with note-off
+typedef NS_ENUM(NSInteger, BeatMachinePadRetriggerMode) {
+    BeatMachinePadRetriggerModeGated = 0,      // note-off fades the pad out
+    BeatMachinePadRetriggerModeOneShot = 1,    // plays to the end regardless of note-off
+    BeatMachinePadRetriggerModeLegato = 2      // a held pad keeps playing instead of restarting
+};
+
 @interface BeatMachineExtensionAudioUnit : AUAudioUnit
 - (void)setupParameterTree:(AUParameterTree *)parameterTree;
+
+// Seconds the last allocateRenderResources took until the kernel was ready to render,
+// including any wait for the background preparation started when the unit was created
+@property (nonatomic, readonly) NSTimeInterval renderResourcesAllocationTime;
+
+// Commands below are safe to call from any thread while rendering; the kernel applies them
+// at the start of a render cycle, in the order they were sent.
+
+// Step sequencer pattern edits
+- (void)setSequencerStep:(NSInteger)step track:(NSInteger)track pattern:(NSInteger)pattern velocity:(NSInteger)velocity probability:(NSInteger)probability;
+- (void)setSequencerTrack:(NSInteger)track pattern:(NSInteger)pattern note:(NSInteger)note;
+- (void)setSequencerPattern:(NSInteger)pattern length:(NSInteger)length;
+- (void)clearSequencerPattern:(NSInteger)pattern;
+
+// Loops a pad between two sample positions of its take, with a crossfade across the seam.
+// Pass end <= start to play the take once.
+- (void)setLoopStart:(NSInteger)start end:(NSInteger)end forPad:(NSInteger)note;
+
+// Pads sharing a non-zero choke group cut each other off, e.g. open and closed hi-hats. 0 = none.
+- (void)setChokeGroup:(NSInteger)group forPad:(NSInteger)note;
+- (void)setRetriggerMode:(BeatMachinePadRetriggerMode)mode forPad:(NSInteger)note;
+// How many hits of one pad may ring at once, 1...8. Older hits fade out past the limit.
+- (void)setVoiceLimit:(NSInteger)voices forPad:(NSInteger)note;
+
+// How much of the pad goes to the shared reverb, 0...100 percent. The send is taken per
+// voice, before the pad effects; sounding voices glide to a new level.
+- (void)setReverbSend:(NSInteger)percent forPad:(NSInteger)note;
+
+- (void)clearPad:(NSInteger)note;
+// Loads a WAV file onto each pad in the background; pads switch over as their file is read.
+// Kits are shared read-only between every instance in the process; recording over a loaded
+// pad gives that pad its own copy.
+- (void)loadKit:(NSDictionary<NSNumber *, NSURL *> *)padURLs;
+
+/*
+ Loads a 16-bit WAV impulse response for the reverb pads send to, through the same cache as
+ loadKit:. Impulses are played mono, scaled to unit energy and cut off after six seconds.
+ The reverb starts once the impulse has been prepared in the background, tens of
+ milliseconds later; the Reverb Level parameter sets how loud it returns. The completion
+ handler runs on the main queue, with an error if the file couldn't be read.
+ */
+- (void)loadReverbImpulse:(NSURL *)url completionHandler:(void (^)(NSError * _Nullable error))completionHandler;
+
+/*
+ The process-wide sample cache behind loadKit:, loadReverbImpulse: and the metronome click.
+ Keys are entries, residentBytes, referencedBytes, deduplicatedBytes (memory saved by
+ sharing), budgetBytes and evictions. Samples no pad uses stay cached for reuse until the cache goes over budget.
+ */
++ (NSDictionary<NSString *, NSNumber *> *)sampleCacheStatistics;
++ (void)setSampleCacheBudget:(NSUInteger)bytes;
+
+/*
+ Measures how late input recorded along with the unit's output arrives: a short pulse is
+ played and timed until it comes back in, so the output has to reach the input, through a
+ loopback cable or a microphone near the speakers. On success the Input Latency parameter
+ is set to the result, so takes line up with what was played along to. Needs the unit to
+ be rendering; the completion handler runs on the main queue with the round trip in seconds.
+ */
+- (void)measureInputLatencyWithCompletionHandler:(void (^)(NSTimeInterval latency, NSError * _Nullable error))completionHandler;
+
+/*
+ Renders `bars` bars of the current pattern and loop at `tempo` BPM into a 16-bit WAV file,
+ as fast as the CPU allows, on a background queue. The unit must not be rendering: stop the
+ engine and deallocate render resources first. Until the bounce completes, allocating
+ render resources fails, and so does starting another bounce. The completion handler runs
+ on the main queue with how many times faster than real time the bounce ran.
+ */
+- (void)bounceBars:(NSInteger)bars tempo:(double)tempo toURL:(NSURL *)url completionHandler:(void (^)(NSError * _Nullable error, double realtimeMultiple))completionHandler;
+
+/*
+ Retrospective capture. While the Retrospective Capture parameter is on (it is off by
+ default, since it pulls input every cycle), the unit keeps the last ten seconds of its
+ input, so a take that was played without recording can still be kept. The commit methods
+ copy `length` seconds, starting `secondsAgo` seconds back from now, to a pad or to the
+ start of the loop; the loop is resized to the nearest whole number of bars. A range
+ longer than the pad or loop holds is cut short. The completion handler runs on the main
+ queue, with an error if the range is no longer (or not yet) captured.
+ */
+@property (nonatomic, readonly) NSTimeInterval capturedInputDuration;
+- (void)commitCaptureFrom:(NSTimeInterval)secondsAgo length:(NSTimeInterval)length toPad:(NSInteger)note completionHandler:(void (^)(NSError * _Nullable error))completionHandler;
+- (void)commitCaptureToLoopFrom:(NSTimeInterval)secondsAgo length:(NSTimeInterval)length completionHandler:(void (^)(NSError * _Nullable error))completionHandler;
+
+- (void)clearLoop;
+// Changes the loop length at its current tempo, keeping what is already recorded
+- (void)setLoopLengthInBars:(NSInteger)bars;
+
+/*
+ Scenes. A scene is a snapshot of the whole unit: every pad's take and settings, the loop
+ and the parameters other than Sampling Mode and Loop Record Mode. There are
+ BeatMachineSceneSlotCount slots, 0 for scene A, 1 for B and so on. Scenes keep their audio
+ in the same cache as loadKit:, so scenes sharing a kit or a loop, or a scene captured again
+ without changes, hold it once.
+
+ captureSceneToSlot: copies what is loaded now. While it copies, pads that start recording
+ get fresh buffers and the loop plays on without overdubbing, so nothing is captured part
+ old and part new. switchToScene: makes the switch on the next bar
+ line while the host is playing, or straight away while it isn't; pads whose take changes
+ are cut off, pads keeping theirs play on. Switching again before the bar line replaces the
+ waiting switch, whose handler then gets NSUserCancelledError. Both work in the background
+ and call their handler on the main queue; without render resources a switch is made when
+ rendering starts again, and its handler waits until then.
+
+ fullState saves the scenes and which one is active, and restoring it switches back to that
+ scene, keeping the restored parameter values. Pads recorded since the last capture are not
+ saved: capture before saving to keep them.
+ */
+static const NSInteger BeatMachineSceneSlotCount = 8;
+// The scene last captured or switched to, or -1
+@property (nonatomic, readonly) NSInteger activeScene;
+- (BOOL)hasSceneInSlot:(NSInteger)slot;
+- (void)captureSceneToSlot:(NSInteger)slot completionHandler:(void (^)(NSError * _Nullable error))completionHandler;
+- (void)switchToScene:(NSInteger)slot completionHandler:(void (^)(NSError * _Nullable error))completionHandler;
+
+/*
+ How much of its real-time budget rendering takes, measured every render cycle (including
+ offline bounces) since the last reset. Keys: cycles, overloads (cycles slower than real
+ time), averageLoad (smoothed), peakLoad, meanLoad, worstCycleSeconds, renderSeconds and
+ audioSeconds. A load of 1.0 means a cycle took as long as the audio it produced. The
+ dictionary holds only numbers, so it can be written out as JSON as is.
+ */
+@property (nonatomic, readonly) NSDictionary<NSString *, NSNumber *> *renderLoadStatistics;
+// Starts the statistics over from the next render cycle
+- (void)resetRenderLoadStatistics;
+
+// Levels of the last render cycle, linear. Cheap enough to poll every display frame.
+- (void)getLevelsForPad:(NSInteger)note peak:(float *)peak rms:(float *)rms;
+- (void)getLevelsForOutputChannel:(NSInteger)channel peak:(float *)peak rms:(float *)rms;
+
+/*
+ Fills `minimum` and `maximum` with one min/max pair per pixel for samples [start, end) of
+ the pad's take and returns how many pixels hold data. The overview follows a take while it
+ is being recorded; waveformLengthForPad: is how far it has got. Not for the render thread.
+ */
+- (NSInteger)readWaveformForPad:(NSInteger)note start:(NSInteger)start end:(NSInteger)end pixels:(NSInteger)pixels minimum:(float *)minimum maximum:(float *)maximum;
+- (NSInteger)waveformLengthForPad:(NSInteger)note;
 @end
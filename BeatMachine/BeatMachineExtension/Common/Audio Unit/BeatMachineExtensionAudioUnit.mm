@@ -10,12 +10,29 @@
 #import <AVFoundation/AVFoundation.h>
 #import <CoreAudioKit/AUViewController.h>
 
+#include <chrono>
+#include <mutex>
+#include <thread>
+
 #import "BeatMachineExtensionBufferedAudioBus.hpp"
 #import "BeatMachineExtensionAUProcessHelper.hpp"
 #import "BeatMachineExtensionDSPKernel.hpp"
+#import "OfflineBounce.hpp"
 
 // Define parameter addresses.
 
+// Stream formats the kernel handles; hosts may pick any rate in this range
+static const double kDefaultSampleRate = 44100.0;
+static const double kMinimumSampleRate = 44100.0;
+static const double kMaximumSampleRate = 192000.0;
+
+// fullState key the scene archive is saved under
+static NSString *const kScenesStateKey = @"scenes";
+
+// Who is rendering with the kernel: the host, between allocating and deallocating render
+// resources, or an offline bounce on its own thread. Only one may at a time.
+enum class KernelUser { None, Host, Bounce };
+
 @interface BeatMachineExtensionAudioUnit ()
 
 @property (nonatomic, readwrite) AUParameterTree *parameterTree;
@@ -29,7 +46,25 @@
     // C++ members need to be ivars; they would be copied on access if they were properties.
     BeatMachineExtensionDSPKernel _kernel;
     BufferedInputBus _inputBus;
+    BufferedInputBus _sidechainBus;
     std::unique_ptr<AUProcessHelper> _processHelper;
+    dispatch_group_t _kernelPreparation;
+    std::atomic<KernelUser> _kernelUser;
+    
+    // scene slots only change on _sceneQueue, which also keeps captures and switches in order;
+    // _scenesLock guards them against readers elsewhere, which copy them rather than wait
+    // behind a capture
+    SceneArchive::Slots _scenes;
+    std::mutex _scenesLock;
+    std::atomic<NSInteger> _activeScene;
+    dispatch_queue_t _sceneQueue;
+    
+    // the one switch waiting to be made; a newer switch replaces it, as in the kernel. It is
+    // completed from the kernel's scene switch handler rather than waited for.
+    std::mutex _switchLock;
+    uint64_t _switchSequence;
+    std::shared_ptr<const Scene> _switchScene;
+    void (^_switchCompletion)(NSError * _Nullable error);
 }
 
 @synthesize parameterTree = _parameterTree;
@@ -40,25 +75,54 @@
     if (self == nil) { return nil; }
     
     [self setupAudioBuses];
+    [self prepareKernel];
+    _sceneQueue = dispatch_queue_create("BeatMachineExtension.scenes", DISPATCH_QUEUE_SERIAL);
+    _activeScene = -1;
+    _kernelUser = KernelUser::None;
     
     return self;
 }
 
+- (void)dealloc {
+    // the preparation block uses the kernel, which goes away with self
+    dispatch_group_wait(_kernelPreparation, DISPATCH_TIME_FOREVER);
+}
+
+// Pad buffers, the loop buffer and the metronome click don't depend on the stream format,
+// so they are allocated and read from disk in the background while the host sets us up.
+// allocateRenderResources waits for this to finish.
+- (void)prepareKernel {
+    NSString *clickPath = [[NSBundle mainBundle] pathForResource:@"click" ofType:@"wav"];
+    std::string path = clickPath != nil ? std::string(clickPath.UTF8String) : std::string();
+    BeatMachineExtensionDSPKernel *kernel = &_kernel;
+    __weak BeatMachineExtensionAudioUnit *weakSelf = self;
+    _kernel.setSceneSwitchHandler([weakSelf](uint64_t applied) {
+        [weakSelf sceneSwitchMade:applied];
+    });
+    
+    _kernelPreparation = dispatch_group_create();
+    dispatch_group_async(_kernelPreparation, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        kernel->prepare(path);
+    });
+}
+
 #pragma mark - AUAudioUnit Setup
 
 - (void)setupAudioBuses {
     // Create the output bus first
-    AVAudioFormat *format = [[AVAudioFormat alloc] initStandardFormatWithSampleRate:44100 channels:2];
+    AVAudioFormat *format = [[AVAudioFormat alloc] initStandardFormatWithSampleRate:kDefaultSampleRate channels:2];
     _outputBus = [[AUAudioUnitBus alloc] initWithFormat:format error:nil];
     _outputBus.maximumChannelCount = 8;
     
-    // Create the input and output busses.
+    // Create the input and output busses. The second input is a sidechain for ducking.
     _inputBus.init(format, 8);
+    _sidechainBus.init(format, 8);
+    _sidechainBus.bus.name = @"Sidechain";
     
     // Create the input and output bus arrays.
     _inputBusArray  = [[AUAudioUnitBusArray alloc] initWithAudioUnit:self
                                                              busType:AUAudioUnitBusTypeInput
-                                                              busses: @[_inputBus.bus]];
+                                                              busses: @[_inputBus.bus, _sidechainBus.bus]];
     // then an array with it
     _outputBusArray = [[AUAudioUnitBusArray alloc] initWithAudioUnit:self
                                                              busType:AUAudioUnitBusTypeOutput
@@ -132,36 +196,592 @@
     return _kernel.isBypassed();
 }
 
+// Every time-based quantity in the kernel is derived from the negotiated rate, so any rate
+// the kernel is sized for is fine
+- (BOOL)shouldChangeToFormat:(AVAudioFormat *)format forBus:(AUAudioUnitBus *)bus {
+    if (format.sampleRate < kMinimumSampleRate || format.sampleRate > kMaximumSampleRate) {
+        return NO;
+    }
+    return [super shouldChangeToFormat:format forBus:bus];
+}
+
+// The kernel renders as it receives, with no lookahead, so it adds no latency of its own.
+// Input latency compensation only moves where takes start and end inside the kernel.
+- (NSTimeInterval)latency {
+    return 0.0;
+}
+
+// After its input stops, the unit can still be playing a one-shot pad to the end of a full take
+- (NSTimeInterval)tailTime {
+    return _kernel.tailSeconds();
+}
+
+// The kernel mixes its input down to its own buffer before writing any output, and Sample
+// mode's monitoring only scales each channel onto itself, so the host may hand us the same
+// buffers for input and output.
+- (BOOL)canProcessInPlace {
+    return YES;
+}
+
 // Allocate resources required to render.
 // Subclassers should call the superclass implementation.
 - (BOOL)allocateRenderResourcesAndReturnError:(NSError **)outError {
+    const auto allocationStart = std::chrono::steady_clock::now();
     const auto inputChannelCount = [self.inputBusses objectAtIndexedSubscript:0].format.channelCount;
     const auto outputChannelCount = [self.outputBusses objectAtIndexedSubscript:0].format.channelCount;
     
-    if (inputChannelCount != outputChannelCount) {
+    const double inputSampleRate = [self.inputBusses objectAtIndexedSubscript:0].format.sampleRate;
+    const double outputSampleRate = [self.outputBusses objectAtIndexedSubscript:0].format.sampleRate;
+    
+    // The sidechain may have any channel count. At another rate than the output it is
+    // ignored rather than failing hosts that never configured it.
+    const auto sidechainChannelCount = _sidechainBus.bus.format.sampleRate == outputSampleRate ? _sidechainBus.bus.format.channelCount : 0;
+    
+    // A bounce in progress is rendering with the kernel; reinitializing it would resize
+    // the buffers under that render
+    KernelUser user = KernelUser::None;
+    if (!_kernelUser.compare_exchange_strong(user, KernelUser::Host) && user != KernelUser::Host) {
+        if (outError) {
+            *outError = [NSError errorWithDomain:NSOSStatusErrorDomain code:kAudioUnitErr_CannotDoInCurrentContext userInfo:nil];
+        }
+        self.renderResourcesAllocated = NO;
+        
+        return NO;
+    }
+    
+    if (inputChannelCount != outputChannelCount || inputSampleRate != outputSampleRate) {
         if (outError) {
             *outError = [NSError errorWithDomain:NSOSStatusErrorDomain code:kAudioUnitErr_FailedInitialization userInfo:nil];
         }
         // Notify superclass that initialization was not successful
         self.renderResourcesAllocated = NO;
+        _kernelUser = KernelUser::None;
         
         return NO;
     }
     _inputBus.allocateRenderResources(self.maximumFramesToRender);
+    _sidechainBus.allocateRenderResources(self.maximumFramesToRender);
     _kernel.setMusicalContextBlock(self.musicalContextBlock);
+    _kernel.setTransportStateBlock(self.transportStateBlock);
+    dispatch_group_wait(_kernelPreparation, DISPATCH_TIME_FOREVER);
     _kernel.initialize(inputChannelCount, outputChannelCount, _outputBus.format.sampleRate);
-    _processHelper = std::make_unique<AUProcessHelper>(_kernel, inputChannelCount, outputChannelCount);
-    return [super allocateRenderResourcesAndReturnError:outError];
+    _processHelper = std::make_unique<AUProcessHelper>(_kernel, inputChannelCount, outputChannelCount, sidechainChannelCount);
+    
+    const std::chrono::duration<double> allocationTime = std::chrono::steady_clock::now() - allocationStart;
+    _renderResourcesAllocationTime = allocationTime.count();
+    const BOOL allocated = [super allocateRenderResourcesAndReturnError:outError];
+    if (!allocated) {
+        _kernelUser = KernelUser::None;
+    }
+    return allocated;
 }
 
 // Deallocate resources allocated in allocateRenderResourcesAndReturnError:
 // Subclassers should call the superclass implementation.
 - (void)deallocateRenderResources {
+    _kernel.deInitialize();
+    _inputBus.deallocateRenderResources();
+    _sidechainBus.deallocateRenderResources();
+    _kernelUser = KernelUser::None;
     
-    // Deallocate your resources.
     [super deallocateRenderResources];
 }
 
+#pragma mark - Sequencer
+
+- (void)setSequencerStep:(NSInteger)step track:(NSInteger)track pattern:(NSInteger)pattern velocity:(NSInteger)velocity probability:(NSInteger)probability {
+    StepSequencer::Edit edit;
+    edit.type = StepSequencer::Edit::Type::SetStep;
+    edit.pattern = (uint8_t)pattern;
+    edit.track = (uint8_t)track;
+    edit.step = (uint8_t)step;
+    edit.velocity = (uint8_t)std::clamp<NSInteger>(velocity, 0, 127);
+    edit.probability = (uint8_t)std::clamp<NSInteger>(probability, 0, 100);
+    _kernel.postCommand(KernelCommand::sequencerEditCommand(edit));
+}
+
+- (void)setSequencerTrack:(NSInteger)track pattern:(NSInteger)pattern note:(NSInteger)note {
+    StepSequencer::Edit edit;
+    edit.type = StepSequencer::Edit::Type::SetTrackNote;
+    edit.pattern = (uint8_t)pattern;
+    edit.track = (uint8_t)track;
+    edit.value = (uint8_t)std::clamp<NSInteger>(note, 0, 127);
+    _kernel.postCommand(KernelCommand::sequencerEditCommand(edit));
+}
+
+- (void)setSequencerPattern:(NSInteger)pattern length:(NSInteger)length {
+    StepSequencer::Edit edit;
+    edit.type = StepSequencer::Edit::Type::SetLength;
+    edit.pattern = (uint8_t)pattern;
+    edit.value = (uint8_t)std::clamp<NSInteger>(length, StepSequencer::minimumSteps, StepSequencer::maximumSteps);
+    _kernel.postCommand(KernelCommand::sequencerEditCommand(edit));
+}
+
+- (void)clearSequencerPattern:(NSInteger)pattern {
+    StepSequencer::Edit edit;
+    edit.type = StepSequencer::Edit::Type::Clear;
+    edit.pattern = (uint8_t)pattern;
+    _kernel.postCommand(KernelCommand::sequencerEditCommand(edit));
+}
+
+#pragma mark - Pads
+
+- (void)setLoopStart:(NSInteger)start end:(NSInteger)end forPad:(NSInteger)note {
+    _kernel.postCommand(KernelCommand::padSettingCommand((int)note, KernelCommand::PadSetting::Kind::Loop, (int)start, (int)end));
+}
+
+- (void)setChokeGroup:(NSInteger)group forPad:(NSInteger)note {
+    _kernel.postCommand(KernelCommand::padSettingCommand((int)note, KernelCommand::PadSetting::Kind::ChokeGroup, (int)group));
+}
+
+- (void)setRetriggerMode:(BeatMachinePadRetriggerMode)mode forPad:(NSInteger)note {
+    _kernel.postCommand(KernelCommand::padSettingCommand((int)note, KernelCommand::PadSetting::Kind::RetriggerMode, (int)mode));
+}
+
+- (void)setVoiceLimit:(NSInteger)voices forPad:(NSInteger)note {
+    _kernel.postCommand(KernelCommand::padSettingCommand((int)note, KernelCommand::PadSetting::Kind::VoiceLimit, (int)voices));
+}
+
+- (void)setReverbSend:(NSInteger)percent forPad:(NSInteger)note {
+    _kernel.postCommand(KernelCommand::padSettingCommand((int)note, KernelCommand::PadSetting::Kind::ReverbSend, (int)percent));
+}
+
+- (void)clearPad:(NSInteger)note {
+    _kernel.postCommand(KernelCommand::clearPadCommand((int)note));
+}
+
+- (void)loadKit:(NSDictionary<NSNumber *, NSURL *> *)padURLs {
+    // Read the files off the calling thread through the shared cache, so instances loading
+    // the same kit share one copy, then hand each take to the kernel whole
+    __weak BeatMachineExtensionAudioUnit *weakSelf = self;
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        [padURLs enumerateKeysAndObjectsUsingBlock:^(NSNumber *note, NSURL *url, BOOL *stop) {
+            BeatMachineExtensionAudioUnit *strongSelf = weakSelf;
+            if (strongSelf == nil) {
+                *stop = YES;
+                return;
+            }
+            const SampleCache::Sample sample = SampleCache::shared().acquireFile(std::string(url.fileSystemRepresentation));
+            if (sample.samples == nullptr) {
+                return;
+            }
+            const int count = std::min(sample.length, SoundBuffer::capacity);
+            if (!strongSelf->_kernel.postCommand(KernelCommand::loadSharedPadCommand(note.intValue, sample.samples, count))) {
+                SampleCache::shared().release(sample.samples);
+            }
+        }];
+    });
+}
+
+- (void)loadReverbImpulse:(NSURL *)url completionHandler:(void (^)(NSError * _Nullable error))completionHandler {
+    // Read through the shared cache like a kit; the kernel's worker thread transforms the
+    // impulse once it arrives
+    __weak BeatMachineExtensionAudioUnit *weakSelf = self;
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        BeatMachineExtensionAudioUnit *strongSelf = weakSelf;
+        if (strongSelf == nil) {
+            return;
+        }
+        OSStatus status = noErr;
+        const SampleCache::Sample sample = SampleCache::shared().acquireFile(std::string(url.fileSystemRepresentation));
+        if (sample.samples == nullptr) {
+            status = kAudioUnitErr_InvalidFile;
+        } else if (!strongSelf->_kernel.postCommand(KernelCommand::loadImpulseCommand(sample.samples, sample.length, sample.sampleRate))) {
+            SampleCache::shared().release(sample.samples);
+            status = kAudioUnitErr_CannotDoInCurrentContext;
+        }
+        NSError *error = status == noErr ? nil : [NSError errorWithDomain:NSOSStatusErrorDomain code:status userInfo:nil];
+        dispatch_async(dispatch_get_main_queue(), ^{ completionHandler(error); });
+    });
+}
+
+#pragma mark - Retrospective Capture
+
+- (NSTimeInterval)capturedInputDuration {
+    const InputRing::Range range = _kernel.capturedInput();
+    return double(range.end - range.start) / _outputBus.format.sampleRate;
+}
+
+- (void)commitCaptureFrom:(NSTimeInterval)secondsAgo length:(NSTimeInterval)length toPad:(NSInteger)note completionHandler:(void (^)(NSError * _Nullable error))completionHandler {
+    const int padNote = (int)note;
+    [self commitCaptureFrom:secondsAgo length:length bufferSize:SoundBuffer::capacity command:^(float *samples, int count) {
+        return KernelCommand::loadPadCommand(padNote, samples, count);
+    } completionHandler:completionHandler];
+}
+
+- (void)commitCaptureToLoopFrom:(NSTimeInterval)secondsAgo length:(NSTimeInterval)length completionHandler:(void (^)(NSError * _Nullable error))completionHandler {
+    // one sample of the loop buffer is kept spare for passes that run a sample long
+    const int loopSize = _kernel.loopAllocation();
+    [self commitCaptureFrom:secondsAgo length:length bufferSize:loopSize command:^(float *samples, int count) {
+        return KernelCommand::loadLoopCommand(samples, std::min(count, loopSize - 1));
+    } completionHandler:completionHandler];
+}
+
+/*
+ The range is pinned to capture positions here, on the calling thread, so it is the one the
+ caller meant however long the copy waits. The copy is made into a new buffer on a background
+ queue; the render thread only swaps the buffer in.
+ */
+- (void)commitCaptureFrom:(NSTimeInterval)secondsAgo length:(NSTimeInterval)length bufferSize:(int)bufferSize command:(KernelCommand (^)(float *samples, int count))command completionHandler:(void (^)(NSError * _Nullable error))completionHandler {
+    const double sampleRate = _outputBus.format.sampleRate;
+    const int64_t start = _kernel.capturedInput().end - (int64_t)std::llround(std::max(secondsAgo, 0.0) * sampleRate);
+    const int count = (int)std::min<int64_t>(std::llround(std::max(length, 0.0) * sampleRate), bufferSize);
+    __weak BeatMachineExtensionAudioUnit *weakSelf = self;
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        BeatMachineExtensionAudioUnit *strongSelf = weakSelf;
+        if (strongSelf == nil) {
+            return;
+        }
+        float *samples = new float[bufferSize]();
+        OSStatus status = noErr;
+        if (!strongSelf->_kernel.copyCapturedInput(start, count, samples)) {
+            // the range is older than the capture reaches, or hasn't happened yet
+            status = kAudioUnitErr_InvalidParameterValue;
+        } else if (!strongSelf->_kernel.postCommand(command(samples, count))) {
+            status = kAudioUnitErr_CannotDoInCurrentContext;
+        }
+        if (status != noErr) {
+            delete[] samples;
+        }
+        NSError *error = status == noErr ? nil : [NSError errorWithDomain:NSOSStatusErrorDomain code:status userInfo:nil];
+        dispatch_async(dispatch_get_main_queue(), ^{ completionHandler(error); });
+    });
+}
+
+#pragma mark - Loop
+
+- (void)clearLoop {
+    _kernel.postCommand(KernelCommand::clearLoopCommand());
+}
+
+- (void)setLoopLengthInBars:(NSInteger)bars {
+    _kernel.postCommand(KernelCommand::setLoopLengthCommand((double)bars));
+}
+
+#pragma mark - Scenes
+
+- (NSInteger)activeScene {
+    return _activeScene.load();
+}
+
+- (BOOL)hasSceneInSlot:(NSInteger)slot {
+    if (slot < 0 || slot >= BeatMachineSceneSlotCount) {
+        return NO;
+    }
+    std::lock_guard<std::mutex> lock(_scenesLock);
+    return _scenes[slot] != nullptr;
+}
+
+- (void)captureSceneToSlot:(NSInteger)slot completionHandler:(void (^)(NSError * _Nullable error))completionHandler {
+    if (slot < 0 || slot >= BeatMachineSceneSlotCount) {
+        NSError *error = [NSError errorWithDomain:NSOSStatusErrorDomain code:kAudioUnitErr_InvalidParameterValue userInfo:nil];
+        dispatch_async(dispatch_get_main_queue(), ^{ completionHandler(error); });
+        return;
+    }
+    __weak BeatMachineExtensionAudioUnit *weakSelf = self;
+    dispatch_async(_sceneQueue, ^{
+        BeatMachineExtensionAudioUnit *strongSelf = weakSelf;
+        if (strongSelf == nil) {
+            return;
+        }
+        const OSStatus status = [strongSelf performCaptureToSlot:slot];
+        NSError *error = status == noErr ? nil : [NSError errorWithDomain:NSOSStatusErrorDomain code:status userInfo:nil];
+        dispatch_async(dispatch_get_main_queue(), ^{ completionHandler(error); });
+    });
+}
+
+/*
+ On _sceneQueue. The render thread fills the capture at the start of a cycle, so pads and
+ loop are taken as they were between two cycles, then copied into the cache here while
+ rendering carries on. Without render resources there is no render thread to wait for.
+ */
+- (OSStatus)performCaptureToSlot:(NSInteger)slot {
+    dispatch_group_wait(_kernelPreparation, DISPATCH_TIME_FOREVER);
+    if (!_kernel.requestSceneCapture()) {
+        return kAudioUnitErr_CannotDoInCurrentContext;
+    }
+    if (!self.renderResourcesAllocated) {
+        _kernel.fillSceneCapture();
+    }
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    const SceneCapture *capture = _kernel.sceneCapture();
+    while (capture == nullptr && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        capture = _kernel.sceneCapture();
+    }
+    if (capture == nullptr) {
+        _kernel.finishSceneCapture();
+        return kAudioUnitErr_CannotDoInCurrentContext;
+    }
+    
+    // the record switches are left as they are when switching scenes
+    std::vector<Scene::Parameter> parameters;
+    for (AUParameter *parameter in _parameterTree.allParameters) {
+        if (parameter.address != BeatMachineExtensionParameterAddress::samplingMode &&
+            parameter.address != BeatMachineExtensionParameterAddress::loopRecordMode) {
+            parameters.push_back({ parameter.address, parameter.value });
+        }
+    }
+    std::shared_ptr<const Scene> scene = Scene::capture(*capture, std::move(parameters));
+    _kernel.finishSceneCapture();
+    {
+        std::lock_guard<std::mutex> lock(_scenesLock);
+        _scenes[slot] = std::move(scene);
+    }
+    _activeScene = slot;
+    return noErr;
+}
+
+- (void)switchToScene:(NSInteger)slot completionHandler:(void (^)(NSError * _Nullable error))completionHandler {
+    if (slot < 0 || slot >= BeatMachineSceneSlotCount) {
+        NSError *error = [NSError errorWithDomain:NSOSStatusErrorDomain code:kAudioUnitErr_InvalidParameterValue userInfo:nil];
+        dispatch_async(dispatch_get_main_queue(), ^{ completionHandler(error); });
+        return;
+    }
+    __weak BeatMachineExtensionAudioUnit *weakSelf = self;
+    dispatch_async(_sceneQueue, ^{
+        BeatMachineExtensionAudioUnit *strongSelf = weakSelf;
+        if (strongSelf == nil) {
+            return;
+        }
+        const std::shared_ptr<const Scene> scene = strongSelf->_scenes[slot];
+        if (scene == nullptr) {
+            NSError *error = [NSError errorWithDomain:NSOSStatusErrorDomain code:kAudioUnitErr_InvalidParameterValue userInfo:nil];
+            dispatch_async(dispatch_get_main_queue(), ^{ completionHandler(error); });
+            return;
+        }
+        dispatch_group_wait(strongSelf->_kernelPreparation, DISPATCH_TIME_FOREVER);
+        const uint64_t sequence = strongSelf->_kernel.queueSceneChange(scene, true);
+        strongSelf->_activeScene = slot;
+        
+        // the switch this one replaces was either made already or dropped by the kernel
+        uint64_t replaced = 0;
+        std::shared_ptr<const Scene> replacedScene;
+        void (^replacedCompletion)(NSError * _Nullable error) = nil;
+        {
+            std::lock_guard<std::mutex> lock(strongSelf->_switchLock);
+            replaced = strongSelf->_switchSequence;
+            replacedScene = std::move(strongSelf->_switchScene);
+            replacedCompletion = strongSelf->_switchCompletion;
+            strongSelf->_switchSequence = sequence;
+            strongSelf->_switchScene = scene;
+            strongSelf->_switchCompletion = completionHandler;
+        }
+        if (replacedCompletion != nil) {
+            [strongSelf finishSceneSwitch:replacedScene made:strongSelf->_kernel.appliedSceneChange() == replaced completionHandler:replacedCompletion];
+        }
+        // made before it was waited for, and reported already; otherwise the handler finishes
+        // it once rendering reaches the bar line
+        [strongSelf sceneSwitchMade:strongSelf->_kernel.appliedSceneChange()];
+    });
+}
+
+// Any thread; called by the kernel's worker with the last switch made
+- (void)sceneSwitchMade:(uint64_t)applied {
+    std::shared_ptr<const Scene> scene;
+    void (^completionHandler)(NSError * _Nullable error) = nil;
+    uint64_t sequence = 0;
+    {
+        std::lock_guard<std::mutex> lock(_switchLock);
+        if (_switchCompletion == nil || applied < _switchSequence) {
+            return;
+        }
+        sequence = _switchSequence;
+        scene = std::move(_switchScene);
+        completionHandler = _switchCompletion;
+        _switchSequence = 0;
+        _switchCompletion = nil;
+    }
+    [self finishSceneSwitch:scene made:applied == sequence completionHandler:completionHandler];
+}
+
+// A switch overtaken by a later one before it was made is reported as cancelled
+- (void)finishSceneSwitch:(std::shared_ptr<const Scene>)scene made:(BOOL)made completionHandler:(void (^)(NSError * _Nullable error))completionHandler {
+    __weak BeatMachineExtensionAudioUnit *weakSelf = self;
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        NSError *error = nil;
+        if (!made) {
+            error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSUserCancelledError userInfo:nil];
+        } else {
+            // the kernel has its values already; this tells the host and the UI
+            AUParameterTree *parameterTree = weakSelf.parameterTree;
+            for (const Scene::Parameter& parameter : scene->parameters) {
+                [parameterTree parameterWithAddress:parameter.address].value = parameter.value;
+            }
+        }
+        dispatch_async(dispatch_get_main_queue(), ^{ completionHandler(error); });
+    });
+}
+
+// Scenes travel as one SceneArchive blob next to the parameter values
+- (NSDictionary<NSString *, id> *)fullState {
+    NSMutableDictionary<NSString *, id> *state = [NSMutableDictionary dictionaryWithDictionary:[super fullState] ?: @{}];
+    // the slots as the last capture left them; one still being copied isn't waited for
+    SceneArchive::Slots slots;
+    {
+        std::lock_guard<std::mutex> lock(_scenesLock);
+        slots = _scenes;
+    }
+    const std::vector<uint8_t> archive = SceneArchive::write(slots, (int)_activeScene.load());
+    state[kScenesStateKey] = [NSData dataWithBytes:archive.data() length:archive.size()];
+    return state;
+}
+
+- (void)setFullState:(NSDictionary<NSString *, id> *)fullState {
+    [super setFullState:fullState];
+    NSData *scenes = fullState[kScenesStateKey];
+    if (![scenes isKindOfClass:[NSData class]]) {
+        return;
+    }
+    __weak BeatMachineExtensionAudioUnit *weakSelf = self;
+    dispatch_async(_sceneQueue, ^{
+        BeatMachineExtensionAudioUnit *strongSelf = weakSelf;
+        SceneArchive::Slots slots;
+        int active = -1;
+        if (strongSelf == nil || !SceneArchive::read(static_cast<const uint8_t *>(scenes.bytes), scenes.length, slots, active)) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(strongSelf->_scenesLock);
+            strongSelf->_scenes = slots;
+        }
+        strongSelf->_activeScene = active;
+        
+        // the parameters just restored are newer than the scene's
+        if (active >= 0 && slots[active] != nullptr) {
+            dispatch_group_wait(strongSelf->_kernelPreparation, DISPATCH_TIME_FOREVER);
+            strongSelf->_kernel.queueSceneChange(slots[active], false);
+        }
+    });
+}
+
+#pragma mark - Sample Cache
+
++ (NSDictionary<NSString *, NSNumber *> *)sampleCacheStatistics {
+    const SampleCache::Statistics statistics = SampleCache::shared().statistics();
+    return @{
+        @"entries": @(statistics.entries),
+        @"residentBytes": @(statistics.residentBytes),
+        @"referencedBytes": @(statistics.referencedBytes),
+        @"deduplicatedBytes": @(statistics.deduplicatedBytes),
+        @"budgetBytes": @(statistics.budgetBytes),
+        @"evictions": @(statistics.evictions)
+    };
+}
+
++ (void)setSampleCacheBudget:(NSUInteger)bytes {
+    SampleCache::shared().setBudget(bytes);
+}
+
+#pragma mark - Metering
+
+- (NSDictionary<NSString *, NSNumber *> *)renderLoadStatistics {
+    const RenderLoad::Snapshot load = _kernel.renderLoad();
+    return @{
+        @"cycles": @(load.cycles),
+        @"overloads": @(load.overloads),
+        @"averageLoad": @(load.averageLoad),
+        @"peakLoad": @(load.peakLoad),
+        @"meanLoad": @(load.meanLoad()),
+        @"worstCycleSeconds": @(load.worstCycleSeconds),
+        @"renderSeconds": @(load.renderSeconds),
+        @"audioSeconds": @(load.audioSeconds)
+    };
+}
+
+- (void)resetRenderLoadStatistics {
+    _kernel.resetRenderLoad();
+}
+
+- (void)getLevelsForPad:(NSInteger)note peak:(float *)peak rms:(float *)rms {
+    const LevelMeter& meter = _kernel.padMeter((int)note);
+    *peak = meter.peak();
+    *rms = meter.rms();
+}
+
+- (void)getLevelsForOutputChannel:(NSInteger)channel peak:(float *)peak rms:(float *)rms {
+    const LevelMeter& meter = _kernel.outputMeter((int)channel);
+    *peak = meter.peak();
+    *rms = meter.rms();
+}
+
+- (NSInteger)readWaveformForPad:(NSInteger)note start:(NSInteger)start end:(NSInteger)end pixels:(NSInteger)pixels minimum:(float *)minimum maximum:(float *)maximum {
+    return _kernel.readWaveform((int)note, (int)start, (int)end, (int)pixels, minimum, maximum);
+}
+
+- (NSInteger)waveformLengthForPad:(NSInteger)note {
+    return _kernel.waveformLength((int)note);
+}
+
+#pragma mark - Input Latency
+
+- (void)measureInputLatencyWithCompletionHandler:(void (^)(NSTimeInterval latency, NSError * _Nullable error))completionHandler {
+    if (!self.renderResourcesAllocated) {
+        NSError *error = [NSError errorWithDomain:NSOSStatusErrorDomain code:kAudioUnitErr_Uninitialized userInfo:nil];
+        dispatch_async(dispatch_get_main_queue(), ^{ completionHandler(0.0, error); });
+        return;
+    }
+    
+    const double sampleRate = _outputBus.format.sampleRate;
+    _kernel.measureInputLatency();
+    __weak BeatMachineExtensionAudioUnit *weakSelf = self;
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        // the probe gives up after LatencyProbe::timeoutSeconds of rendering; allow for a
+        // host that starts rendering a little late
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(LatencyProbe::timeoutSeconds + 1.0);
+        int result = LatencyProbe::pending;
+        while (result == LatencyProbe::pending && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            BeatMachineExtensionAudioUnit *strongSelf = weakSelf;
+            if (strongSelf == nil) {
+                return;
+            }
+            result = strongSelf->_kernel.measuredInputLatency();
+        }
+        
+        NSError *error = nil;
+        NSTimeInterval latency = 0.0;
+        if (result >= 0) {
+            latency = result / sampleRate;
+            AUParameter *parameter = [weakSelf.parameterTree parameterWithAddress:BeatMachineExtensionParameterAddress::inputLatency];
+            parameter.value = std::clamp(AUValue(latency * 1000.0), parameter.minValue, parameter.maxValue);
+        } else {
+            error = [NSError errorWithDomain:NSOSStatusErrorDomain code:kAudioUnitErr_NoConnection userInfo:nil];
+        }
+        dispatch_async(dispatch_get_main_queue(), ^{ completionHandler(latency, error); });
+    });
+}
+
+#pragma mark - Bounce
+
+- (void)bounceBars:(NSInteger)bars tempo:(double)tempo toURL:(NSURL *)url completionHandler:(void (^)(NSError * _Nullable error, double realtimeMultiple))completionHandler {
+    // Claimed until the bounce finishes, so the host can't allocate render resources and
+    // reinitialize the kernel under it
+    KernelUser user = KernelUser::None;
+    if (!_kernelUser.compare_exchange_strong(user, KernelUser::Bounce)) {
+        const OSStatus status = user == KernelUser::Host ? kAudioUnitErr_Initialized : kAudioUnitErr_CannotDoInCurrentContext;
+        NSError *error = [NSError errorWithDomain:NSOSStatusErrorDomain code:status userInfo:nil];
+        dispatch_async(dispatch_get_main_queue(), ^{ completionHandler(error, 0.0); });
+        return;
+    }
+    
+    const int channelCount = (int)_outputBus.format.channelCount;
+    const double sampleRate = _outputBus.format.sampleRate;
+    const std::string path(url.fileSystemRepresentation);
+    __weak BeatMachineExtensionAudioUnit *weakSelf = self;
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        BeatMachineExtensionAudioUnit *strongSelf = weakSelf;
+        if (strongSelf == nil) {
+            return;
+        }
+        dispatch_group_wait(strongSelf->_kernelPreparation, DISPATCH_TIME_FOREVER);
+        const OfflineBounce::Result result = OfflineBounce::render(strongSelf->_kernel, channelCount, sampleRate, tempo, (double)bars, path);
+        strongSelf->_kernelUser = KernelUser::None;
+        NSError *error = result.succeeded ? nil : [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileWriteUnknownError userInfo:nil];
+        dispatch_async(dispatch_get_main_queue(), ^{ completionHandler(error, result.realtimeMultiple()); });
+    });
+}
+
 #pragma mark - MIDI
 
 - (MIDIProtocolID)AudioUnitMIDIProtocol {
@@ -180,6 +800,7 @@
     __block BeatMachineExtensionDSPKernel *kernel = &_kernel;
     __block std::unique_ptr<AUProcessHelper> &processHelper = _processHelper;
     __block BufferedInputBus *input = &_inputBus;
+    __block BufferedInputBus *sidechain = &_sidechainBus;
     
     return ^AUAudioUnitStatus(AudioUnitRenderActionFlags 				*actionFlags,
                               const AudioTimeStamp       				*timestamp,
@@ -195,12 +816,6 @@
             return kAudioUnitErr_TooManyFramesToProcess;
         }
         
-        AUAudioUnitStatus err = input->pullInput(&pullFlags, timestamp, frameCount, 0, pullInputBlock);
-        
-        if (err != 0) { return err; }
-        
-        AudioBufferList *inAudioBufferList = input->mutableAudioBufferList;
-        
         /*
          Important:
          If the caller passed non-null output pointers (outputData->mBuffers[x].mData), use those.
@@ -210,21 +825,52 @@
          The Audio Unit is responsible for preserving the validity of this memory until the next call to render,
          or deallocateRenderResources is called.
          
-         If your algorithm cannot process in-place, you will need to preallocate an output buffer
-         and use it here.
-         
          See the description of the canProcessInPlace property.
          */
-        
-        // If passed null output buffer pointers, process in-place in the input buffer.
         AudioBufferList *outAudioBufferList = outputData;
-        if (outAudioBufferList->mBuffers[0].mData == nullptr) {
-            for (UInt32 i = 0; i < outAudioBufferList->mNumberBuffers; ++i) {
-                outAudioBufferList->mBuffers[i].mData = inAudioBufferList->mBuffers[i].mData;
+        AudioBufferList *inAudioBufferList = nullptr;
+        
+        // Events in this cycle may arm recording part way through, so only skip the pull
+        // when the kernel is idle on its input for the whole block. An instrument with
+        // nothing connected to its input fails to pull; it then renders as if it hadn't
+        // needed any, rather than failing the whole cycle and silencing the pads.
+        bool inputPulled = false;
+        if (kernel->needsInput() || realtimeEventListHead != nullptr) {
+            inputPulled = input->pullInput(&pullFlags, timestamp, frameCount, 0, pullInputBlock) == noErr;
+        }
+        if (inputPulled) {
+            inAudioBufferList = input->mutableAudioBufferList;
+            kernel->setInputAvailable(true);
+            
+            // If passed null output buffer pointers, process in-place in the input buffer.
+            if (outAudioBufferList->mBuffers[0].mData == nullptr) {
+                for (UInt32 i = 0; i < outAudioBufferList->mNumberBuffers; ++i) {
+                    outAudioBufferList->mBuffers[i].mData = inAudioBufferList->mBuffers[i].mData;
+                }
+            }
+        } else {
+            // No input this cycle, so render straight into the output buffers, borrowing
+            // our own input memory if the caller didn't provide any.
+            if (outAudioBufferList->mBuffers[0].mData == nullptr) {
+                input->prepareInputBufferList(frameCount);
+                for (UInt32 i = 0; i < outAudioBufferList->mNumberBuffers; ++i) {
+                    outAudioBufferList->mBuffers[i].mData = input->mutableAudioBufferList->mBuffers[i].mData;
+                }
+            }
+            inAudioBufferList = outAudioBufferList;
+            kernel->setInputAvailable(false);
+        }
+        
+        // An unconnected sidechain fails to pull; the kernel then hears it as silence
+        AudioBufferList *sidechainBufferList = nullptr;
+        if (kernel->needsSidechain() && processHelper->hasSidechain()) {
+            AudioUnitRenderActionFlags sidechainFlags = 0;
+            if (sidechain->pullInput(&sidechainFlags, timestamp, frameCount, 1, pullInputBlock) == noErr) {
+                sidechainBufferList = sidechain->mutableAudioBufferList;
             }
         }
         
-        processHelper->processWithEvents(inAudioBufferList, outAudioBufferList, timestamp, frameCount, realtimeEventListHead);
+        processHelper->processWithEvents(inAudioBufferList, outAudioBufferList, timestamp, frameCount, realtimeEventListHead, sidechainBufferList);
         return noErr;
     };
     
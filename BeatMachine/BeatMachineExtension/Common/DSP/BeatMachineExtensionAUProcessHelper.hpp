@@ -12,28 +12,35 @@
 
 #include <vector>
 #include "BeatMachineExtensionDSPKernel.hpp"
+#include "DenormalGuard.hpp"
 
 //MARK:- AUProcessHelper Utility Class
 class AUProcessHelper
 {
 public:
-    AUProcessHelper(BeatMachineExtensionDSPKernel& kernel, UInt32 inputChannelCount, UInt32 outputChannelCount)
+    AUProcessHelper(BeatMachineExtensionDSPKernel& kernel, UInt32 inputChannelCount, UInt32 outputChannelCount, UInt32 sidechainChannelCount = 0)
     : mKernel{kernel},
     mInputBuffers(inputChannelCount),
-    mOutputBuffers(outputChannelCount) {
+    mOutputBuffers(outputChannelCount),
+    mSidechainBuffers(sidechainChannelCount) {
     }
     
     /**
      This function handles the event list processing and rendering loop for you.
-     Call it inside your internalRenderBlock.
+     Call it inside your internalRenderBlock. `sidechainBufferList` is null when the
+     sidechain bus wasn't pulled this cycle.
      */
-    void processWithEvents(AudioBufferList* inBufferList, AudioBufferList* outBufferList, AudioTimeStamp const *timestamp, AUAudioFrameCount frameCount, AURenderEvent const *events) {
+    void processWithEvents(AudioBufferList* inBufferList, AudioBufferList* outBufferList, AudioTimeStamp const *timestamp, AUAudioFrameCount frameCount, AURenderEvent const *events, AudioBufferList const* sidechainBufferList = nullptr) {
+        // Decaying loops and effect tails would otherwise grind through denormals
+        DenormalGuard denormals;
         
         AUEventSampleTime now = AUEventSampleTime(timestamp->mSampleTime);
         AUAudioFrameCount framesRemaining = frameCount;
         AURenderEvent const *nextEvent = events; // events is a linked list, at the beginning, the nextEvent is the first event
         
-        auto callProcess = [this] (AudioBufferList* inBufferListPtr, AudioBufferList* outBufferListPtr, AUEventSampleTime now, AUAudioFrameCount frameCount, AUAudioFrameCount const frameOffset) {
+        const size_t sidechainChannels = sidechainBufferList != nullptr ? std::min<size_t>(sidechainBufferList->mNumberBuffers, mSidechainBuffers.size()) : 0;
+        
+        auto callProcess = [this, sidechainBufferList, sidechainChannels] (AudioBufferList* inBufferListPtr, AudioBufferList* outBufferListPtr, AUEventSampleTime now, AUAudioFrameCount frameCount, AUAudioFrameCount const frameOffset) {
             for (int channel = 0; channel < inBufferListPtr->mNumberBuffers; ++channel) {
                 mInputBuffers[channel] = (const float*)inBufferListPtr->mBuffers[channel].mData  + frameOffset;
             }
@@ -41,21 +48,30 @@ public:
             for (int channel = 0; channel < outBufferListPtr->mNumberBuffers; ++channel) {
                 mOutputBuffers[channel] = (float*)outBufferListPtr->mBuffers[channel].mData + frameOffset;
             }
-            mKernel.process(mInputBuffers, mOutputBuffers, now, frameCount);
+            for (size_t channel = 0; channel < sidechainChannels; ++channel) {
+                mSidechainBuffers[channel] = (const float*)sidechainBufferList->mBuffers[channel].mData + frameOffset;
+            }
+            mKernel.process(mInputBuffers, mOutputBuffers, std::span<float const*>(mSidechainBuffers.data(), sidechainChannels), now, frameCount);
         };
         
+        mKernel.beginRenderCycle(now, frameCount);
+        
         while (framesRemaining > 0) {
-            // If there are no more events, we can process the entire remaining segment and exit.
-            if (nextEvent == nullptr) {
-                AUAudioFrameCount const frameOffset = frameCount - framesRemaining;
-                callProcess(inBufferList, outBufferList, now, framesRemaining, frameOffset);
-                return;
-            }
+            // Fire any quantized events the kernel has queued for this sample.
+            mKernel.performScheduledEvents(now);
             
             // **** start late events late.
+            // A segment ends at the next host event or the next kernel-scheduled event, whichever comes first.
             auto timeZero = AUEventSampleTime(0);
-            auto headEventTime = nextEvent->head.eventSampleTime;
-            AUAudioFrameCount framesThisSegment = AUAudioFrameCount(std::max(timeZero, headEventTime - now));
+            auto segmentEnd = now + AUEventSampleTime(framesRemaining);
+            if (nextEvent != nullptr) {
+                segmentEnd = std::min(segmentEnd, nextEvent->head.eventSampleTime);
+            }
+            AUEventSampleTime scheduledTime;
+            if (mKernel.nextScheduledEventTime(scheduledTime)) {
+                segmentEnd = std::min(segmentEnd, scheduledTime);
+            }
+            AUAudioFrameCount framesThisSegment = AUAudioFrameCount(std::max(timeZero, segmentEnd - now));
             
             // Compute everything before the next event.
             if (framesThisSegment > 0) {
@@ -70,8 +86,16 @@ public:
                 now += AUEventSampleTime(framesThisSegment);
             }
             
-            nextEvent = performAllSimultaneousEvents(now, nextEvent);
+            if (nextEvent != nullptr && nextEvent->head.eventSampleTime <= now) {
+                nextEvent = performAllSimultaneousEvents(now, nextEvent);
+            }
         }
+        
+        mKernel.endRenderCycle(frameCount);
+    }
+    
+    bool hasSidechain() const {
+        return !mSidechainBuffers.empty();
     }
     
     AURenderEvent const * performAllSimultaneousEvents(AUEventSampleTime now, AURenderEvent const *event) {
@@ -89,4 +113,5 @@ private:
     BeatMachineExtensionDSPKernel& mKernel;
     std::vector<const float*> mInputBuffers;
     std::vector<float*> mOutputBuffers;
+    std::vector<const float*> mSidechainBuffers;
 };
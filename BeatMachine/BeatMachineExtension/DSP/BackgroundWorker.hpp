@@ -0,0 +1,59 @@
+//
+//  BackgroundWorker.hpp
+//  BeatMachineExtension
+//
+
+#pragma once
+
+#import <atomic>
+#import <chrono>
+#import <functional>
+#import <thread>
+#include "DenormalGuard.hpp"
+
+/*
+ BackgroundWorker
+ One low-priority thread per kernel that periodically calls a tick function. Work that
+ must stay off the render thread (take analysis, loop analysis, ...) is queued by the
+ render thread through lock-free queues and picked up here, so the render thread never
+ has to wake anything up.
+ */
+class BackgroundWorker {
+private:
+    std::thread mThread;
+    std::atomic<bool> mRunning { false };
+    std::function<void()> mTick;
+
+public:
+    static constexpr std::chrono::milliseconds interval { 10 };
+
+    ~BackgroundWorker() {
+        stop();
+    }
+
+    // Not realtime safe. Does nothing if already running.
+    void start(std::function<void()> tick) {
+        if (mRunning.load()) {
+            return;
+        }
+        mTick = std::move(tick);
+        mRunning.store(true);
+        mThread = std::thread([this] {
+            DenormalGuard denormals;
+            while (mRunning.load(std::memory_order_relaxed)) {
+                mTick();
+                std::this_thread::sleep_for(interval);
+            }
+        });
+    }
+
+    void stop() {
+        if (mRunning.exchange(false) && mThread.joinable()) {
+            mThread.join();
+        }
+    }
+
+    bool isRunning() const {
+        return mRunning.load();
+    }
+};
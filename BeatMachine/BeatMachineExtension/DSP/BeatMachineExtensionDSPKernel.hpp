@@ -13,12 +13,35 @@
 #import <algorithm>
 #import <vector>
 #import <span>
+#import <atomic>
+#import <bitset>
+#import <functional>
+#import <mutex>
 #include <iostream>
 #include <unordered_map>
 #include <set>
 #include "WavUtil.hpp"
 #include <fstream>
 #include "SoundBuffer.hpp"
+#include "SampleCache.hpp"
+#include "VoiceAllocator.hpp"
+#include "PadEffectChain.hpp"
+#include "TakeAnalyzer.hpp"
+#include "LoopStretcher.hpp"
+#include "BackgroundWorker.hpp"
+#include "ScheduledEventQueue.hpp"
+#include "StepSequencer.hpp"
+#include "SPSCQueue.hpp"
+#include "MPSCQueue.hpp"
+#include "KernelCommand.hpp"
+#include "LevelMeter.hpp"
+#include "WaveformOverview.hpp"
+#include "RenderLoad.hpp"
+#include "InputRing.hpp"
+#include "LatencyProbe.hpp"
+#include "SidechainDucker.hpp"
+#include "ConvolutionReverb.hpp"
+#include "Scene.hpp"
 
 #import "BeatMachineExtension-Swift.h"
 #import "BeatMachineExtensionParameterAddresses.h"
@@ -30,12 +53,12 @@
 class BeatMachineExtensionDSPKernel {
 private:
     AUHostMusicalContextBlock mMusicalContextBlock;
+    AUHostTransportStateBlock mTransportStateBlock;
     
     // configuration parameters
     double mSampleRate = 44100.0;
     double mGain = 1.0;
     double mNoteEnvelope = 0.0;
-    double crossfadeSamples = 0.01 * 44100.0;
     bool mBypassed = false;
     AUAudioFrameCount mMaxFramesToRender = 1024;
     static const int bufferCount = 128; //128 MIDI notes
@@ -43,61 +66,342 @@ private:
     // sampling member variables
     std::array<SoundBuffer, bufferCount> soundBuffers;
     float samplingMode = 0.0;
+    float autoSlice = 0.0;
     int MIDINote = 0;
     int RECORD_NOTE = 0x0;
     int MUTE_NOTE = 0x1;
     bool isMuted = false;
-    std::set<int> currentNotes;
+    std::bitset<bufferCount> currentNotes;  // pads held from MIDI; fixed size, so holding one never allocates
+    
+    // Input latency compensation. Input arrives inputLatency late, so a take covers the
+    // input from inputLatency after its note-on until inputLatency after its note-off,
+    // reaching takePreRoll further back at the start. The pre-roll comes out of
+    // mInputRing; the end of the take is recorded after the note-off, as the pad's tail.
+    float inputLatency = 0.0;      // ms
+    float takePreRoll = 0.0;       // ms
+    static constexpr double maximumInputOffsetSeconds = 0.25;
+    
+    // Retrospective capture: with retrospectiveCapture on, input is pulled every cycle and
+    // the last captureSeconds of it stay in mInputRing, to be committed to a pad or the
+    // loop after the fact. Off by default, so playback alone never pulls input.
+    float retrospectiveCapture = 0.0;
+    static constexpr double captureSeconds = 10.0;
+    InputRing mInputRing;
+    std::vector<float> mInputMix;
+    bool mInputAvailable = true;                    // the audio unit pulled input this cycle
+    std::array<int, bufferCount> mTakeSkip {};      // input samples a new take still passes over
+    std::array<int, bufferCount> mTakeTail {};      // input samples a released take still records
+    int mFinishingTakes = 0;                        // pads with a tail left to record
+    LatencyProbe mLatencyProbe;
+    
+    // every sounding pad plays through a voice from this pool; voices fade in, out and
+    // across loop seams with mCrossfade, 10 ms long
+    VoiceAllocator mVoices;
+    static constexpr double crossfadeSeconds = 0.01;
+    CrossfadeTable mCrossfade;
+    std::vector<float> mVoiceScratch;
+    
+    // MIDI 2.0 per-note expression, kept per pad and handed to that pad's voices every block
+    struct NoteExpression {
+        float bend = 0.0f;          // semitones, from per-note pitch bend
+        float volume = 1.0f;        // per-note registered controller 7
+        float pressure = 0.0f;      // poly pressure, 0...1; swells the pad by up to +6 dB
+        float brightness = 1.0f;    // per-note assignable controller 74; 1 = lowpass open
+    };
+    std::array<NoteExpression, bufferCount> mNoteExpression {};
+    static constexpr float perNoteBendRange = 12.0f;        // semitones at full per-note bend
+    static constexpr double expressionGlideSeconds = 0.005; // time constant voices glide to new expression with
+    static const uint8_t volumeController = 7;
+    static const uint8_t brightnessController = 74;
+    
+    // structured commands from the UI and other threads, drained at the start of each
+    // render cycle, at most commandBudget per cycle so a burst can't blow one cycle's deadline
+    static const int commandBudget = 32;
+    MPSCQueue<KernelCommand, 256> mCommands;
+    KernelCommand mDeferredCommand;         // popped but waiting for room in mRetiredTakes
+    bool mHasDeferredCommand = false;
+    SPSCQueue<float*, 128> mRetiredTakes;   // take buffers replaced on the render thread, freed by mWorker
+    std::vector<float*> mTakesToFree;       // worker-owned: retired takes waiting for the end of a tick
+    
+    // private take buffers mWorker keeps ready, so a pad holding a shared SampleCache take,
+    // or one the TakeAnalyzer is reading, can start recording without allocating on the
+    // render thread
+    static const int spareTakeCount = 2;
+    SPSCQueue<float*, 8> mSpareTakes;
+    std::atomic<int> mSpareTakesQueued { 0 };
+    float* mSpareTake = nullptr;            // popped by the render thread, not used yet
+    
+    // levels for the UI, gathered over every segment of a render cycle and published at its end
+    static const int maximumOutputChannels = 8;
+    std::array<LevelMeter, bufferCount> mPadMeters;
+    std::array<LevelMeter, maximumOutputChannels> mOutputMeters;
+    std::array<float, bufferCount> mPadPeaks {};
+    std::array<float, bufferCount> mPadSquareSums {};          // mean square times frames
+    std::array<float, maximumOutputChannels> mOutputPeaks {};
+    std::array<float, maximumOutputChannels> mOutputSquareSums {};
+    size_t mMeteredChannels = 0;
+    AUAudioFrameCount mMeteredFrames = 0;
+    
+    // waveform overviews, extended by mWorker as takes grow or are replaced
+    struct TakeProgress {
+        int note = 0;
+        uint32_t takeId = 0;
+        const float* samples = nullptr;
+        int length = 0;
+    };
+    SPSCQueue<TakeProgress, 512> mTakeProgress;
+    std::array<WaveformOverview, bufferCount> mOverviews;
     std::unordered_map<AUParameterAddress, AUParameter*> paramRefs;
     
+    // pad bus: every sounding pad is summed here once per frame, run through the
+    // insert chain, then copied to each output channel
+    std::vector<float> mPadBus;
+    PadEffectChain mPadEffects;
+    
+    // pad voices send to one shared convolution reverb, which returns into the pad bus
+    // after the insert chain
+    ConvolutionReverb mReverb;
+    std::vector<float> mReverbSend;
+    float reverbLevel = 100.0;     // percent of the reverb return
+    
+    // the pad and loop mix ducks under the sidechain, the second input bus
+    SidechainDucker mDucker;
+    std::vector<float> mSidechainMix;
+    std::span<float const*> mSidechainBuffers;  // this segment's sidechain; empty when none was pulled
+    
+    // finished takes are trimmed and sliced off the render thread
+    TakeAnalyzer mTakeAnalyzer;
+    std::array<uint64_t, bufferCount> mAnalysisTickets {};  // each pad's last TakeAnalyzer job
+    
+    // quantization: pad notes (and so record start/stop) wait for the next grid line
+    float quantizeGrid = 0.0;      // 0 = off, 1..4 = 1/4, 1/8, 1/16, 1/32
+    float swing = 50.0;            // percent of a step pair given to its first step; 50 = straight
+    static constexpr double quantizeTolerance = 0.005; // seconds late that still count as on the grid
+    ScheduledEventQueue mScheduledEvents;
+    std::array<AUEventSampleTime, bufferCount> mLastNoteOnTime {};
+    AUEventSampleTime mMIDIEventTime = 0;   // time of the MIDI event list being visited
+    AUEventSampleTime mCycleStartTime = 0;  // host position at the start of this render cycle
+    double mCycleStartBeat = 0.0;
+    bool mTransportMoving = false;
+    
+    // offline bounce: the kernel runs its own clock instead of asking the host
+    double mOfflineTempo = 0.0;             // 0 = follow the host
+    AUEventSampleTime mOfflineStartTime = 0;// sample time of beat 0
+    
+    // built-in sequencer; its steps go through mScheduledEvents like quantized notes
+    StepSequencer mSequencer;
+    float sequencerEnabled = 0.0;
+    float sequencerPattern = 0.0;
+    
+    // scenes: a capture is copied out through mSceneCapture while mWorker holds back freeing
+    // retired takes; a switch is prepared whole off the render thread, left in mPendingScene
+    // and taken from there on the next bar line
+    enum SceneCaptureState : int {
+        SceneCaptureIdle,
+        SceneCaptureRequested,
+        SceneCaptureFilled
+    };
+    SceneCapture mSceneCapture;
+    std::atomic<int> mSceneCaptureState { SceneCaptureIdle };
+    std::atomic<SceneChange*> mPendingScene { nullptr };
+    std::atomic<uint64_t> mSceneSequence { 0 };     // last switch queued
+    std::atomic<uint64_t> mAppliedScene { 0 };      // last switch made
+    uint64_t mReportedScene = 0;                    // worker-owned: last switch passed to the handler
+    std::function<void(uint64_t)> mSceneSwitchHandler;
+    std::mutex mSceneSwitchHandlerLock;
+    SPSCQueue<SceneChange*, 8> mRetiredScenes;      // switches made, holding what they replaced, freed by mWorker
+    SceneChange* mUnretiredScene = nullptr;         // made, waiting for room in mRetiredScenes
+    std::vector<SceneChange*> mScenesToFree;        // worker-owned, like mTakesToFree
+    
     // looping member variables
-    int loopBufferSize;        // Size of our loop buffer (in samples)
-    float* loopBuffer;         // The loop buffer itself
-    int loopSampleIndex;           // Current position in the loop buffer
-    bool loopRecordMode;           // Whether we're currently recording
-    double beatsPerBar;        // Number of beats per bar (usually 4)
-    double tempo;              // The tempo (in BPM)
-    double loopLengthBars;     // The length of the loop (in bars)
+    int loopBufferAllocated = 0;   // Allocated size of the loop buffer, enough for maximumSampleRate
+    int loopBufferCapacity = 0;    // Usable size at the current rate, enough for minimumLoopTempo
+    int loopBufferSize = 0;        // Size of our loop buffer (in whole samples)
+    double loopLengthSamples = 0.0;// Exact loop length; passes alternate between loopBufferSize and one more
+    int loopPassLength = 0;        // Length of the pass being played
+    double loopPassRemainder = 0.0;// Fraction of a sample the passes so far have fallen behind loopLengthSamples
+    float* loopBuffer = nullptr;   // The loop buffer itself
+    int loopSampleIndex = 0;       // Current position in the loop buffer
+    bool loopRecordMode = false;   // Whether we're currently recording
+    float loopFeedback = 100.0;    // Percent of each pass kept under the next overdub; 100 = plain overdub
+    static constexpr float loopHeadroom = 4.0f; // Overdubs saturate here (+12 dBFS) instead of growing forever
+    double beatsPerBar = 4.0;      // Number of beats per bar (usually 4)
+    double tempo = 144.0;          // The tempo the loop is recorded at (in BPM)
+    double loopLengthBars = 4.0;   // The length of the loop (in bars)
+    static constexpr double maximumLoopBars = 4.0;
+    static constexpr double maximumSampleRate = SoundBuffer::maximumSampleRate;
+    bool loopHasContent = false;   // Anything has been overdubbed since the loop was sized
+    bool loopAnalysisStale = false;// The stretcher's analysis predates the latest overdub
+    bool loopStretching = false;   // Last block came from the stretcher
+    double mHostTempo = 0.0;       // From the musical context block; 0 when the host doesn't say
+    static constexpr double minimumLoopTempo = 60.0;
+    std::vector<float> mLoopBus;
+    LoopStretcher mLoopStretcher;
     
     // metronome member variables
-    double metronomeFrequency;  // Frequency of the metronome click (in Hz)
-    double metronomeDuration;   // Duration of the metronome click (in seconds)
-    int metronomeSampleIndex;   // Current position in the metronome click
-    int metronomeSamplesPerBeat;// Number of samples per beat
-    std::vector<float> clickSound;
+    double metronomeFrequency = 1000.0;    // Frequency of the metronome click (in Hz)
+    double metronomeDuration = 0.1;        // Duration of the metronome click (in seconds)
+    int metronomeSampleIndex = 0;          // Current position in the metronome click
+    int metronomeBeat = -1;                // Loop beat the current click belongs to
+    std::vector<float> clickSound;         // at mSampleRate
+    SampleCache::Sample mClickSource;      // shared by every instance, at mClickSourceRate
+    double mClickSourceRate = 44100.0;
+    
+    // prepare() has built everything that doesn't depend on the stream format
+    std::atomic<bool> mPrepared { false };
+    
+    // time each render cycle takes against the audio it renders
+    RenderLoad mRenderLoad;
+    
+    // render functions specialized per channel count, indexed by RenderMode
+    enum RenderMode {
+        Play,       // pads only
+        Sample,     // record held pads, monitor the input
+        Loop,       // pads overdubbed into the loop
+        RenderModeCount
+    };
+    
+    using RenderFunction = void (BeatMachineExtensionDSPKernel::*)(std::span<float const*>, std::span<float *>, AUAudioFrameCount);
+    std::array<RenderFunction, RenderModeCount> mRenderFunctions {};
+    bool mSpecializedRendering = true;
+    
+    // declared last so its thread stops before anything it polls is destroyed
+    BackgroundWorker mWorker;
     
 public:
+    ~BeatMachineExtensionDSPKernel() {
+        mWorker.stop();
+        freeRetiredTakes();
+        for (float* take : mTakesToFree) {
+            freeTake(take);
+        }
+        delete[] mSpareTake;
+        float* spare = nullptr;
+        while (mSpareTakes.pop(spare)) {
+            delete[] spare;
+        }
+        delete[] loopBuffer;
+        if (mClickSource.samples != nullptr) {
+            SampleCache::shared().release(mClickSource.samples);
+        }
+        
+        // loaded takes that never reached a pad
+        KernelCommand command;
+        while (mCommands.pop(command)) {
+            if (command.carriesSamples()) {
+                freeTake(command.samples);
+            }
+        }
+        if (mHasDeferredCommand && mDeferredCommand.carriesSamples()) {
+            freeTake(mDeferredCommand.samples);
+        }
+        
+        delete mPendingScene.exchange(nullptr);
+        delete mUnretiredScene;
+        SceneChange* change = nullptr;
+        while (mRetiredScenes.pop(change)) {
+            delete change;
+        }
+        for (SceneChange* retired : mScenesToFree) {
+            delete retired;
+        }
+    }
+    
+    /*
+     Builds everything that doesn't depend on the stream format: the pad take buffers,
+     the loop buffer (sized for maximumSampleRate), the metronome click read from
+     `clickPath`, the loop analysis and reverb buffers and the background worker. This is
+     the slow, allocating part of start-up, so the audio unit runs it on a background queue
+     as soon as it is created. Only the first call does anything. Not realtime safe, and not to be
+     called from two threads at once.
+     */
+    void prepare(const std::string& clickPath) {
+        if (mPrepared.load(std::memory_order_acquire)) {
+            return;
+        }
+        for (auto &buffer : soundBuffers) {
+            buffer.initialize();
+        }
+        loopBufferAllocated = (int)((maximumSampleRate * 60.0 / minimumLoopTempo) * beatsPerBar * maximumLoopBars);
+        loopBuffer = new float[loopBufferAllocated]();
+        if (!clickPath.empty()) {
+            mClickSource = SampleCache::shared().acquireFile(clickPath);
+            mClickSourceRate = mClickSource.sampleRate > 0 ? mClickSource.sampleRate : mClickSourceRate;
+        }
+        mLoopStretcher.prepare();
+        mReverb.prepare();
+        for (auto &overview : mOverviews) {
+            overview.prepare(SoundBuffer::capacity);
+        }
+        mTakesToFree.reserve(128);
+        mScenesToFree.reserve(8);
+        topUpSpareTakes();
+        mWorker.start([this] {
+            workerTick();
+        });
+        mPrepared.store(true, std::memory_order_release);
+    }
+    
+    bool isPrepared() const {
+        return mPrepared.load(std::memory_order_acquire);
+    }
+    
+    /*
+     Sizes what depends on the stream format. Runs on every allocateRenderResources, so a
+     new sample rate or maximum frame count only resizes the per-block buffers: recorded
+     pads and the click stay loaded. A loop recorded at another sample rate would play at
+     the wrong speed, so the loop starts empty when the rate changes.
+     */
     void initialize(int inputChannelCount, int outputChannelCount, double inSampleRate) {
+        // normally a no-op: the audio unit prepares the kernel before allocating
+        prepare(std::string());
+        
+        const bool sampleRateChanged = inSampleRate != mSampleRate;
         mSampleRate = inSampleRate;
-        // Initialize all soundBuffers
+        mPadBus.assign(mMaxFramesToRender, 0.0f);
+        mInputMix.assign(mMaxFramesToRender, 0.0f);
+        mSidechainMix.assign(mMaxFramesToRender, 0.0f);
+        mReverbSend.assign(mMaxFramesToRender, 0.0f);
+        mReverb.reset(mSampleRate);
+        mDucker.prepare(mSampleRate);
+        mInputRing.prepare((int)std::ceil(std::max(captureSeconds, maximumInputOffsetSeconds) * mSampleRate), (int)mMaxFramesToRender);
+        selectRenderFunctions(mSpecializedRendering ? outputChannelCount : 0);
+        mCrossfade.prepare((int)std::lround(crossfadeSeconds * mSampleRate));
+        mVoiceScratch.assign(PadVoice::scratchLength(mMaxFramesToRender), 0.0f);
+        mVoices.stopAll();
+        mPadEffects.allocate(mMaxFramesToRender, mSampleRate);
+        mScheduledEvents.clear();
+        mTakeAnalyzer.prepare(mSampleRate);
         for (auto &buffer : soundBuffers) {
-            buffer.initialize();
+            buffer.setSampleRate(mSampleRate);
         }
+        mLoopBus.assign(mMaxFramesToRender, 0.0f);
         
-        // initialize loop variables
-        beatsPerBar = 4.0;
-        loopLengthBars = 4.0;
-        tempo = 144.0;  // Default to 120 BPM. You may want to make this configurable.
-
-        // Calculate how many samples make up our loop
-        loopBufferSize = (int)((mSampleRate * 60.0 / tempo) * beatsPerBar * loopLengthBars);
-
-        // Allocate the loop buffer
-        loopBuffer = new float[loopBufferSize];
+        resampleClick();
         
-        // initialize metronome variables
-        metronomeFrequency = 1000.0;  // 1000 Hz
-        metronomeDuration = 0.1;     // 100 ms
+        // The usable part of the loop buffer holds maximumLoopBars at the slowest tempo we
+        // accept, so an empty loop can follow the host tempo without allocating. One sample
+        // is kept spare for passes that run a sample long.
+        loopBufferCapacity = std::min(loopBufferAllocated - 1, (int)((mSampleRate * 60.0 / minimumLoopTempo) * beatsPerBar * maximumLoopBars));
+        if (sampleRateChanged) {
+            clearLoop();
+        }
+        loopSampleIndex = 0;
+        loopStretching = false;
         metronomeSampleIndex = 0;
-        metronomeSamplesPerBeat = (int)(mSampleRate * 60.0 / tempo);
-        
-        NSString *path = [[NSBundle mainBundle] pathForResource:@"click" ofType:@"wav"];
-        std::string pathStr = [path UTF8String];
-        clickSound = load_wav_file(pathStr);
+        metronomeBeat = -1;
+        setLoopTempo(tempo);
     }
     
+    // Called from deallocateRenderResources. Silences everything in flight; buffers are kept
+    // for the next initialize() and freed by the destructor.
     void deInitialize() {
-        delete[] loopBuffer;
+        mVoices.stopAll();
+        mScheduledEvents.clear();
+        currentNotes.reset();
+        finishTakeTails();
+        mLatencyProbe.cancel();
+        loopStretching = false;
     }
     
     // MARK: - Bypass
@@ -123,6 +427,60 @@ public:
             case BeatMachineExtensionParameterAddress::loopRecordMode:
                 loopRecordMode = value;
                 break;
+            case BeatMachineExtensionParameterAddress::loopFeedback:
+                loopFeedback = std::clamp(value, 0.0f, 100.0f);
+                break;
+            case BeatMachineExtensionParameterAddress::autoSlice:
+                autoSlice = value;
+                break;
+            case BeatMachineExtensionParameterAddress::filterCutoff:
+                mPadEffects.setCutoff(value);
+                break;
+            case BeatMachineExtensionParameterAddress::filterResonance:
+                mPadEffects.setResonance(value);
+                break;
+            case BeatMachineExtensionParameterAddress::drive:
+                mPadEffects.setDrive(value);
+                break;
+            case BeatMachineExtensionParameterAddress::compressorThreshold:
+                mPadEffects.setThreshold(value);
+                break;
+            case BeatMachineExtensionParameterAddress::compressorRatio:
+                mPadEffects.setRatio(value);
+                break;
+            case BeatMachineExtensionParameterAddress::quantizeGrid:
+                quantizeGrid = value;
+                break;
+            case BeatMachineExtensionParameterAddress::swing:
+                swing = value;
+                break;
+            case BeatMachineExtensionParameterAddress::sequencerEnabled:
+                sequencerEnabled = value;
+                break;
+            case BeatMachineExtensionParameterAddress::sequencerPattern:
+                sequencerPattern = value;
+                break;
+            case BeatMachineExtensionParameterAddress::inputLatency:
+                inputLatency = value;
+                break;
+            case BeatMachineExtensionParameterAddress::takePreRoll:
+                takePreRoll = value;
+                break;
+            case BeatMachineExtensionParameterAddress::retrospectiveCapture:
+                retrospectiveCapture = value;
+                break;
+            case BeatMachineExtensionParameterAddress::duckDepth:
+                mDucker.setDepth(value);
+                break;
+            case BeatMachineExtensionParameterAddress::duckThreshold:
+                mDucker.setThreshold(value);
+                break;
+            case BeatMachineExtensionParameterAddress::duckRelease:
+                mDucker.setRelease(value);
+                break;
+            case BeatMachineExtensionParameterAddress::reverbLevel:
+                reverbLevel = value;
+                break;
         }
     }
     
@@ -139,13 +497,69 @@ public:
             case BeatMachineExtensionParameterAddress::loopRecordMode:
                 return (AUValue)loopRecordMode;
                 break;
+            case BeatMachineExtensionParameterAddress::loopFeedback:
+                return (AUValue)loopFeedback;
+                break;
+            case BeatMachineExtensionParameterAddress::autoSlice:
+                return (AUValue)autoSlice;
+                break;
+            case BeatMachineExtensionParameterAddress::filterCutoff:
+                return (AUValue)mPadEffects.cutoff();
+                break;
+            case BeatMachineExtensionParameterAddress::filterResonance:
+                return (AUValue)mPadEffects.resonance();
+                break;
+            case BeatMachineExtensionParameterAddress::drive:
+                return (AUValue)mPadEffects.drive();
+                break;
+            case BeatMachineExtensionParameterAddress::compressorThreshold:
+                return (AUValue)mPadEffects.threshold();
+                break;
+            case BeatMachineExtensionParameterAddress::compressorRatio:
+                return (AUValue)mPadEffects.ratio();
+                break;
+            case BeatMachineExtensionParameterAddress::quantizeGrid:
+                return (AUValue)quantizeGrid;
+                break;
+            case BeatMachineExtensionParameterAddress::swing:
+                return (AUValue)swing;
+                break;
+            case BeatMachineExtensionParameterAddress::sequencerEnabled:
+                return (AUValue)sequencerEnabled;
+                break;
+            case BeatMachineExtensionParameterAddress::sequencerPattern:
+                return (AUValue)sequencerPattern;
+                break;
+            case BeatMachineExtensionParameterAddress::inputLatency:
+                return (AUValue)inputLatency;
+                break;
+            case BeatMachineExtensionParameterAddress::takePreRoll:
+                return (AUValue)takePreRoll;
+                break;
+            case BeatMachineExtensionParameterAddress::retrospectiveCapture:
+                return (AUValue)retrospectiveCapture;
+                break;
+            case BeatMachineExtensionParameterAddress::duckDepth:
+                return (AUValue)mDucker.depth();
+                break;
+            case BeatMachineExtensionParameterAddress::duckThreshold:
+                return (AUValue)mDucker.threshold();
+                break;
+            case BeatMachineExtensionParameterAddress::duckRelease:
+                return (AUValue)mDucker.release();
+                break;
+            case BeatMachineExtensionParameterAddress::reverbLevel:
+                return (AUValue)reverbLevel;
+                break;
 
             default: return 0.f;
         }
     }
     
     void addParameterRef(AUParameter *param) {
+#ifdef __OBJC__
         paramRefs[param.address] = param;
+#endif
     }
     
     
@@ -153,11 +567,150 @@ public:
     // implementorValueObserver picks up on the change. We're changing the C++ object that it's listening for.
     // note how paramRefs is an std::unordered_map<AUParameterAddress, AUParameter*>
     void setParameterRef(AUParameterAddress address, AUValue value) {
+#ifdef __OBJC__
         if (paramRefs.find(address) == paramRefs.end()) {
           // error
         } else {
             paramRefs[address].value = value;
         }
+#else
+        // The plain C++ build used by the Linux tests has no parameter tree to notify
+        setParameter(address, value);
+#endif
+    }
+    
+    // MARK: - Input
+    // Only sampling mode reads the input bus; sampler playback and looping generate
+    // their output from the sound buffers alone. Retrospective capture, takes still
+    // recording their latency tail and a running latency measurement need it too.
+    bool needsInput() const {
+        return samplingMode == 1.0 || retrospectiveCapture == 1.0 || mFinishingTakes > 0 || mLatencyProbe.isActive();
+    }
+    
+    // The sidechain bus is only pulled while it can duck anything
+    bool needsSidechain() const {
+        return mDucker.isActive();
+    }
+    
+    // Render thread, once per cycle: whether the input buffers hold input pulled from the
+    // host, rather than the output memory they borrow when no input was needed
+    void setInputAvailable(bool available) {
+        mInputAvailable = available;
+    }
+    
+    // Any thread. Starts measuring the output-to-input round trip; see LatencyProbe.
+    void measureInputLatency() {
+        mLatencyProbe.arm();
+    }
+    
+    // Any thread. The last measurement in samples, or LatencyProbe::pending or failed.
+    int measuredInputLatency() const {
+        return mLatencyProbe.result();
+    }
+    
+    // Any thread. Positions of the input retrospective capture holds, in samples.
+    InputRing::Range capturedInput() const {
+        return mInputRing.available();
+    }
+    
+    // Any thread but the render thread; see InputRing::copy
+    bool copyCapturedInput(int64_t start, int count, float* destination) const {
+        return mInputRing.copy(start, count, destination);
+    }
+    
+    // Size of the buffer a LoadLoop command has to hand over
+    int loopAllocation() const {
+        return loopBufferAllocated;
+    }
+    
+    // Longest a pad can sound after its note: a one-shot playing a full take to its end
+    double tailSeconds() const {
+        return SoundBuffer::takeSeconds + (mCrossfade.length() + ConvolutionReverb::partitionLength) / mSampleRate + mReverb.tailSeconds();
+    }
+    
+    // MARK: - Scenes
+    
+    /*
+     Any thread. Asks the render thread to fill the scene capture at the start of its next
+     cycle; a kernel that isn't rendering can be filled with fillSceneCapture() instead.
+     Until finishSceneCapture(), nothing the capture points at is freed. Returns false while
+     another capture is in progress.
+     */
+    bool requestSceneCapture() {
+        int expected = SceneCaptureIdle;
+        return mSceneCaptureState.compare_exchange_strong(expected, SceneCaptureRequested, std::memory_order_acq_rel);
+    }
+    
+    // The filled capture, or null until the render thread has got to it
+    const SceneCapture* sceneCapture() const {
+        return mSceneCaptureState.load(std::memory_order_acquire) == SceneCaptureFilled ? &mSceneCapture : nullptr;
+    }
+    
+    // Any thread. Ends a capture, filled or not, letting retired takes be freed again.
+    void finishSceneCapture() {
+        mSceneCaptureState.store(SceneCaptureIdle, std::memory_order_release);
+    }
+    
+    // Whether a capture may be reading the pads' and loop's own buffers, which are then not
+    // recorded over in place: a new take goes into a spare buffer and the loop stops
+    // overdubbing until finishSceneCapture()
+    bool isCapturingScene() const {
+        return mSceneCaptureState.load(std::memory_order_acquire) != SceneCaptureIdle;
+    }
+    
+    // Render thread, or any thread while the kernel isn't rendering. Slices are only kept
+    // while the take they cut up is still current.
+    void fillSceneCapture() {
+        for (int note = 0; note < bufferCount; ++note) {
+            const SoundBuffer& pad = soundBuffers[note];
+            const SoundBuffer::Slice& slice = pad.slice;
+            const bool sliced = slice.sourceNote >= 0 && soundBuffers[slice.sourceNote].currentTakeId() == slice.sourceTakeId;
+            Scene::Pad& captured = mSceneCapture.pads[note];
+            captured.take = { pad.data(), pad.recordedLength(), uint32_t(mSampleRate) };
+            captured.loopStart = pad.loopStart;
+            captured.loopEnd = pad.loopEnd;
+            captured.retriggerMode = int(pad.retriggerMode);
+            captured.chokeGroup = pad.chokeGroup;
+            captured.voiceLimit = pad.voiceLimit;
+            captured.reverbSend = pad.reverbSend;
+            captured.sliceSource = sliced ? slice.sourceNote : -1;
+            captured.sliceStart = slice.start;
+            captured.sliceEnd = slice.end;
+            mSceneCapture.shared[note] = pad.isShared();
+        }
+        mSceneCapture.loop = loopHasContent ? Scene::Take { loopBuffer, loopBufferSize, uint32_t(mSampleRate) } : Scene::Take();
+        mSceneCapture.loopTempo = tempo;
+        
+        // a capture given up on meanwhile stays given up
+        int expected = SceneCaptureRequested;
+        mSceneCaptureState.compare_exchange_strong(expected, SceneCaptureFilled, std::memory_order_acq_rel);
+    }
+    
+    /*
+     Any thread but the render thread, and not from two threads at once. Prepares the switch
+     to `scene` and leaves it for the render thread, which makes it on the next bar line
+     while the host transport is running, or at the start of its next cycle otherwise. A
+     switch still waiting for its bar is dropped in favour of this one. Returns the switch's
+     sequence number; see appliedSceneChange().
+     */
+    uint64_t queueSceneChange(std::shared_ptr<const Scene> scene, bool includeParameters) {
+        SceneChange* change = SceneChange::create(std::move(scene), loopBufferAllocated, mSampleRate, includeParameters);
+        const uint64_t sequence = mSceneSequence.fetch_add(1, std::memory_order_relaxed) + 1;
+        change->sequence = sequence;
+        delete mPendingScene.exchange(change, std::memory_order_acq_rel);
+        return sequence;
+    }
+    
+    // Any thread. Sequence number of the last scene switch made, 0 before the first.
+    uint64_t appliedSceneChange() const {
+        return mAppliedScene.load(std::memory_order_acquire);
+    }
+    
+    // Any thread. `handler` is called on the background worker with appliedSceneChange()
+    // whenever it has moved on; switches made within one worker tick are reported once.
+    void setSceneSwitchHandler(std::function<void(uint64_t)> handler) {
+        std::lock_guard<std::mutex> lock(mSceneSwitchHandlerLock);
+        mSceneSwitchHandler = std::move(handler);
     }
     
     // MARK: - Max Frames
@@ -169,11 +722,155 @@ public:
         mMaxFramesToRender = maxFrames;
     }
     
+    // Clearing this renders every layout through the generic path from the next
+    // initialize(), for measuring what the specializations save
+    void setSpecializedRendering(bool specialized) {
+        mSpecializedRendering = specialized;
+    }
+    
+    // MARK: - Metering
+    // Any thread
+    RenderLoad::Snapshot renderLoad() const {
+        return mRenderLoad.snapshot();
+    }
+    
+    void resetRenderLoad() {
+        mRenderLoad.requestReset();
+    }
+    
+    // Any thread. Levels of the last render cycle.
+    const LevelMeter& padMeter(int note) const {
+        return mPadMeters[std::clamp(note, 0, bufferCount - 1)];
+    }
+    
+    const LevelMeter& outputMeter(int channel) const {
+        return mOutputMeters[std::clamp(channel, 0, maximumOutputChannels - 1)];
+    }
+    
+    // Any thread but the render thread; see WaveformOverview::read
+    int readWaveform(int note, int start, int end, int pixels, float* minimum, float* maximum) const {
+        if (note < 0 || note >= bufferCount) {
+            return 0;
+        }
+        return mOverviews[note].read(start, end, pixels, minimum, maximum);
+    }
+    
+    // Samples of the pad's take the waveform overview covers so far
+    int waveformLength(int note) const {
+        return note >= 0 && note < bufferCount ? mOverviews[note].length() : 0;
+    }
+    
     // MARK: - Musical Context
     void setMusicalContextBlock(AUHostMusicalContextBlock contextBlock) {
         mMusicalContextBlock = contextBlock;
     }
     
+    void setTransportStateBlock(AUHostTransportStateBlock transportStateBlock) {
+        mTransportStateBlock = transportStateBlock;
+    }
+    
+    // For offline rendering: plays as if the host were rolling at `bpm` from beat 0 at
+    // `startTime`. A tempo of 0 goes back to the host's musical context.
+    void setOfflineClock(double bpm, AUEventSampleTime startTime) {
+        mOfflineTempo = std::max(bpm, 0.0);
+        mOfflineStartTime = startTime;
+    }
+    
+    // Called once per render cycle, before any event or process() call. The host's musical
+    // context describes the start of the cycle, so it is read here rather than per segment.
+    void beginRenderCycle(AUEventSampleTime now, AUAudioFrameCount frameCount) {
+        mRenderLoad.begin();
+        mCycleStartTime = now;
+        resetLevels();
+        
+        bool hasBeatPosition = false;
+        if (mOfflineTempo > 0.0) {
+            mHostTempo = mOfflineTempo;
+            mCycleStartBeat = double(now - mOfflineStartTime) * mOfflineTempo / (60.0 * mSampleRate);
+            hasBeatPosition = true;
+        } else if (mMusicalContextBlock) {
+            hasBeatPosition = mMusicalContextBlock(&mHostTempo /* currentTempo */,
+                                                   nullptr /* timeSignatureNumerator */,
+                                                   nullptr /* timeSignatureDenominator */,
+                                                   &mCycleStartBeat /* currentBeatPosition */,
+                                                   nullptr /* sampleOffsetToNextBeat */,
+                                                   nullptr /* currentMeasureDownbeatPosition */);
+        }
+        
+        // Without a transport block, trust a host that reports a beat position to be playing
+        mTransportMoving = hasBeatPosition;
+        if (hasBeatPosition && mOfflineTempo <= 0.0 && mTransportStateBlock) {
+            AUHostTransportStateFlags flags = 0;
+            if (mTransportStateBlock(&flags, nullptr, nullptr, nullptr)) {
+                mTransportMoving = (flags & AUHostTransportStateMoving) != 0;
+            }
+        }
+        
+        applyAnalyzedSlices();
+        performCommands();
+        if (mSceneCaptureState.load(std::memory_order_relaxed) == SceneCaptureRequested) {
+            fillSceneCapture();
+        }
+        scheduleSceneSwitch(frameCount);
+        
+        mSequencer.selectPattern(int(sequencerPattern));
+        if (sequencerEnabled == 1.0 && samplingMode != 1.0 && mTransportMoving && mHostTempo > 0.0) {
+            scheduleSequencerSteps(frameCount);
+        }
+    }
+    
+    // Called once per render cycle, after its last process() call
+    void endRenderCycle(AUAudioFrameCount frameCount) {
+        publishLevels();
+        mRenderLoad.end(frameCount, mSampleRate);
+    }
+    
+    // MARK: - Sequencer
+    
+    // Queues every step that starts inside this render cycle at its exact sample, with the
+    // end of its gate one step later
+    void scheduleSequencerSteps(AUAudioFrameCount frameCount) {
+        const double samplesPerBeat = mSampleRate * 60.0 / mHostTempo;
+        const double endBeat = mCycleStartBeat + frameCount / samplesPerBeat;
+        const AUEventSampleTime gate = std::max<AUEventSampleTime>(1, std::llround(StepSequencer::stepBeats * samplesPerBeat));
+        mSequencer.generate(mCycleStartBeat, endBeat, swingOffset(StepSequencer::stepBeats),
+                            [this, samplesPerBeat, gate] (double beat, int note, float velocity) {
+            if (note == RECORD_NOTE || note == MUTE_NOTE) {
+                return;
+            }
+            ScheduledEventQueue::Event event;
+            event.sampleTime = mCycleStartTime + AUEventSampleTime(std::llround((beat - mCycleStartBeat) * samplesPerBeat));
+            event.type = ScheduledEventQueue::Type::StepOn;
+            event.note = (uint8_t)note;
+            event.velocity = velocity;
+            // without room for the gate's end, the step would never be released
+            if (mScheduledEvents.schedule({ event.sampleTime + gate, ScheduledEventQueue::Type::StepOff, event.note })) {
+                if (!mScheduledEvents.schedule(event)) {
+                    stepNoteOn(note, velocity);
+                }
+            }
+        });
+    }
+    
+    // Steps play pads without holding them: they never join currentNotes, so they can't
+    // record into a pad after a switch to sampling, and each ends with its own StepOff
+    void stepNoteOn(int note, float velocity) {
+        if (samplingMode == 1.0) {
+            return;
+        }
+        if (mTakeTail[note] > 0) {
+            completeTake(note);
+        }
+        triggerPad(note, velocity);
+    }
+    
+    // A pad held from MIDI as well keeps sounding until its own note-off
+    void stepNoteOff(int note) {
+        if (!currentNotes.test(note)) {
+            releasePad(note);
+        }
+    }
+    
     // MARK: - MIDI Protocol
     MIDIProtocolID AudioUnitMIDIProtocol() const {
         return kMIDIProtocol_2_0;
@@ -185,73 +882,1106 @@ public:
      This function does the core siginal processing.
      Do your custom DSP here.
      */
-    void process(std::span<float const*> inputBuffers, std::span<float *> outputBuffers, AUEventSampleTime bufferStartTime, AUAudioFrameCount frameCount) {
+    void process(std::span<float const*> inputBuffers, std::span<float *> outputBuffers, std::span<float const*> sidechainBuffers, AUEventSampleTime bufferStartTime, AUAudioFrameCount frameCount) {
         /*
          Note: For an Audio Unit with 'n' input channels to 'n' output channels, remove the assert below and
          modify the check in [BeatMachineExtensionAudioUnit allocateRenderResourcesAndReturnError]
          */
         assert(inputBuffers.size() == outputBuffers.size());
+        
+        mSidechainBuffers = sidechainBuffers;
+        const RenderMode mode = samplingMode == 1.0 ? RenderMode::Sample
+                              : loopRecordMode == 1.0 ? RenderMode::Loop
+                              : RenderMode::Play;
+        (this->*mRenderFunctions[mode])(inputBuffers, outputBuffers, frameCount);
+    }
     
-        // Use this to get Musical context info from the Plugin Host,
-        // Replace nullptr with &memberVariable according to the AUHostMusicalContextBlock function signature
-        if (mMusicalContextBlock) {
-            mMusicalContextBlock(nullptr /* currentTempo */,
-                                 nullptr /* timeSignatureNumerator */,
-                                 nullptr /* timeSignatureDenominator */,
-                                 nullptr /* currentBeatPosition */,
-                                 nullptr /* sampleOffsetToNextBeat */,
-                                 nullptr /* currentMeasureDownbeatPosition */);
-        }
-        
-        // Perform per sample dsp on the incoming float in before assigning it to out
-        for (UInt32 channel = 0; channel < inputBuffers.size(); ++channel) {
-            for (UInt32 frameIndex = 0; frameIndex < frameCount; ++frameIndex) {
-                if (samplingMode == 1.0) {
-                    outputBuffers[channel][frameIndex] = inputBuffers[channel][frameIndex] * 1.0 * mGain;
-                    if (this->currentNotes.size() != 0) {
-                        for (auto currentNote = currentNotes.begin(); currentNote != currentNotes.end(); ++currentNote) {
-                            this->soundBuffers[*currentNote].recordSample(inputBuffers[channel][frameIndex]);
-                        }
+    // MARK: - Render Functions
+    
+    /*
+     process() is specialized at compile time for the common channel counts and for each
+     mode, so the channel loops below have constant trip counts and the mode checks fold
+     away. initialize() picks the row for the bus's channel count; process() picks the
+     mode each block. Channels == 0 is the generic fallback for any other layout.
+     */
+    template <int Channels>
+    void selectRenderFunctions() {
+        mRenderFunctions[RenderMode::Play] = &BeatMachineExtensionDSPKernel::render<Channels, RenderMode::Play>;
+        mRenderFunctions[RenderMode::Sample] = &BeatMachineExtensionDSPKernel::render<Channels, RenderMode::Sample>;
+        mRenderFunctions[RenderMode::Loop] = &BeatMachineExtensionDSPKernel::render<Channels, RenderMode::Loop>;
+    }
+    
+    void selectRenderFunctions(int channelCount) {
+        switch (channelCount) {
+            case 1: selectRenderFunctions<1>(); break;
+            case 2: selectRenderFunctions<2>(); break;
+            case 4: selectRenderFunctions<4>(); break;
+            case 6: selectRenderFunctions<6>(); break;
+            case 8: selectRenderFunctions<8>(); break;
+            default: selectRenderFunctions<0>(); break;
+        }
+    }
+    
+    template <int Channels, RenderMode Mode>
+    void render(std::span<float const*> inputBuffers, std::span<float *> outputBuffers, AUAudioFrameCount frameCount) {
+        // The input is mixed down before anything is written, since it may share memory
+        // with the output when processing in place
+        const float* inputMix = captureInput<Channels>(inputBuffers, frameCount);
+        
+        if constexpr (Mode == RenderMode::Sample) {
+            // Record the mono mix of the input into every held pad
+            if (inputMix != nullptr && this->currentNotes.any()) {
+                float peak = 0.0f;
+                float meanSquare = 0.0f;
+                vDSP_maxmgv(inputMix, 1, &peak, frameCount);
+                vDSP_measqv(inputMix, 1, &meanSquare, frameCount);
+                for (int note = 0; note < bufferCount; ++note) {
+                    if (!currentNotes.test(note)) {
+                        continue;
                     }
+                    recordTake(note, inputMix, (int)frameCount);
+                    mPadPeaks[note] = std::max(mPadPeaks[note], peak);
+                    mPadSquareSums[note] += meanSquare * float(frameCount);
+                }
+            }
+            
+            // Without input the input buffers are the output buffers, holding whatever was
+            // last left in them, so there is nothing to monitor
+            const float monitorGain = (float)mGain;
+            const size_t channelCount = Channels > 0 ? Channels : outputBuffers.size();
+            for (size_t channel = 0; channel < channelCount; ++channel) {
+                if (mInputAvailable) {
+                    vDSP_vsmul(inputBuffers[channel], 1, &monitorGain, outputBuffers[channel], 1, frameCount);
                 } else {
-                    // reset outputBuffers
-                    outputBuffers[channel][frameIndex] = 0;
-                    if (this->currentNotes.size() != 0) {
-                        for (auto currentNote = currentNotes.begin(); currentNote != currentNotes.end(); ++currentNote) {
-                            outputBuffers[channel][frameIndex] += this->soundBuffers[*currentNote].playSample() * mGain;
-                        }
-                    }
-                    if (this->isMuted) {
-                        outputBuffers[channel][frameIndex] = 0;
-                    }
-                    
-                    if (loopRecordMode == 1.0) {
-                        // Check if it's time for a metronome click
-                        if (metronomeSampleIndex % metronomeSamplesPerBeat == 0) {
-                            metronomeSampleIndex = 0;
-                        }
-                        
-                        // Apply the metronome click to the output
-                        if (metronomeSampleIndex < clickSound.size()) {
-                            float metronomeClick = clickSound[metronomeSampleIndex];
-                            outputBuffers[channel][frameIndex] += metronomeClick;
-                        }
-                        
-                        // Loop around to the start if we're at the end
-                        if (loopSampleIndex >= loopBufferSize) {
-                            loopSampleIndex = 0;
-                        }
-                        
-                        // Record our output into the loop buffer
-                        loopBuffer[loopSampleIndex] += outputBuffers[channel][frameIndex];
-                        
-                        // Replace the outputBuffer with the loop Buffer
-                        outputBuffers[channel][frameIndex] = loopBuffer[loopSampleIndex];
-                        
-                        metronomeSampleIndex++;
-                        loopSampleIndex++;
+                    vDSP_vclr(outputBuffers[channel], 1, frameCount);
+                }
+            }
+        } else {
+            // Sum every sounding pad into the mono pad bus, and into the reverb send while
+            // there is an impulse to play it through
+            float* padBus = mPadBus.data();
+            vDSP_vclr(padBus, 1, frameCount);
+            float* reverbSend = mReverb.update() ? mReverbSend.data() : nullptr;
+            if (reverbSend != nullptr) {
+                vDSP_vclr(reverbSend, 1, frameCount);
+            }
+            applyNoteExpression();
+            const float glide = 1.0f - std::exp(-float(frameCount) / float(expressionGlideSeconds * mSampleRate));
+            mVoices.render(padBus, reverbSend, (int)frameCount, mVoiceScratch.data(), mCrossfade, glide, [this, frameCount] (int note, const PadVoice& voice) {
+                mPadPeaks[note] = std::max(mPadPeaks[note], voice.lastPeak());
+                mPadSquareSums[note] += voice.lastMeanSquare() * float(frameCount);
+            });
+            
+            // Insert effects run once on the bus rather than per channel
+            mPadEffects.process(padBus, frameCount);
+            if (reverbSend != nullptr) {
+                mReverb.process(reverbSend, padBus, (int)frameCount, reverbLevel * 0.01f);
+            }
+            
+            const float busGain = this->isMuted ? 0.0f : (float)mGain;
+            vDSP_vsmul(padBus, 1, &busGain, outputBuffers[0], 1, frameCount);
+            
+            if constexpr (Mode == RenderMode::Loop) {
+                // the loop reads the pads from the first channel and fans its own bus out
+                processLoop(outputBuffers[0], frameCount);
+                duck(mLoopBus.data(), frameCount);
+                fanOut<Channels>(mLoopBus.data(), outputBuffers, frameCount);
+            } else {
+                duck(outputBuffers[0], frameCount);
+                fanOut<Channels>(outputBuffers[0], outputBuffers, frameCount);
+            }
+        }
+        
+        if (mFinishingTakes > 0) {
+            recordTakeTails(inputMix, (int)frameCount);
+        }
+        if (mLatencyProbe.isActive()) {
+            addLatencyPulse<Channels>(inputMix, outputBuffers, frameCount);
+        }
+        
+        measureLevels<Channels>(outputBuffers, frameCount);
+    }
+    
+    // Ducks the pad or loop mix under a mono mix of the sidechain. Only the output ducks;
+    // the loop has already recorded the pads at full level.
+    void duck(float* bus, AUAudioFrameCount frameCount) {
+        if (!mDucker.isActive()) {
+            return;
+        }
+        const float* sidechain = mSidechainBuffers.empty() ? nullptr : mixToMono<0>(mSidechainBuffers, mSidechainMix.data(), frameCount);
+        mDucker.process(sidechain, bus, (int)frameCount);
+    }
+    
+    // Mixes the input to mono in mInputMix and keeps it in mInputRing for pre-roll and
+    // retrospective capture. Returns null, and forgets the ring, when there is no input this
+    // cycle: neither ever reaches back across a gap.
+    template <int Channels>
+    const float* captureInput(std::span<float const*> inputBuffers, AUAudioFrameCount frameCount) {
+        if (!mInputAvailable) {
+            mInputRing.clear();
+            return nullptr;
+        }
+        const float* mix = mixToMono<Channels>(inputBuffers, mInputMix.data(), frameCount);
+        if (mix != mInputMix.data()) {
+            std::copy_n(mix, frameCount, mInputMix.data());
+        }
+        mInputRing.write(mInputMix.data(), (int)frameCount);
+        return mInputMix.data();
+    }
+    
+    // Adds the probe's pulse to every output channel while a latency measurement runs
+    template <int Channels>
+    void addLatencyPulse(const float* inputMix, std::span<float *> outputBuffers, AUAudioFrameCount frameCount) {
+        float* pulse = mPadBus.data();
+        vDSP_vclr(pulse, 1, frameCount);
+        mLatencyProbe.process(inputMix, pulse, (int)frameCount, mSampleRate);
+        const size_t channelCount = Channels > 0 ? Channels : outputBuffers.size();
+        for (size_t channel = 0; channel < channelCount; ++channel) {
+            vDSP_vadd(outputBuffers[channel], 1, pulse, 1, outputBuffers[channel], 1, frameCount);
+        }
+    }
+    
+    // Pads are metered before the insert effects and bus gain, outputs as they leave. A
+    // cycle split by events is measured a segment at a time and published once, as a whole.
+    void resetLevels() {
+        mPadPeaks.fill(0.0f);
+        mPadSquareSums.fill(0.0f);
+        mOutputPeaks.fill(0.0f);
+        mOutputSquareSums.fill(0.0f);
+        mMeteredFrames = 0;
+    }
+    
+    template <int Channels>
+    void measureLevels(std::span<float *> outputBuffers, AUAudioFrameCount frameCount) {
+        mMeteredChannels = std::min<size_t>(Channels > 0 ? Channels : outputBuffers.size(), maximumOutputChannels);
+        for (size_t channel = 0; channel < mMeteredChannels; ++channel) {
+            float peak = 0.0f;
+            float meanSquare = 0.0f;
+            vDSP_maxmgv(outputBuffers[channel], 1, &peak, frameCount);
+            vDSP_measqv(outputBuffers[channel], 1, &meanSquare, frameCount);
+            mOutputPeaks[channel] = std::max(mOutputPeaks[channel], peak);
+            mOutputSquareSums[channel] += meanSquare * float(frameCount);
+        }
+        mMeteredFrames += frameCount;
+    }
+    
+    void publishLevels() {
+        const float perFrame = mMeteredFrames > 0 ? 1.0f / float(mMeteredFrames) : 0.0f;
+        for (int note = 0; note < bufferCount; ++note) {
+            mPadMeters[note].publish(mPadPeaks[note], std::sqrt(mPadSquareSums[note] * perFrame));
+        }
+        for (size_t channel = 0; channel < mMeteredChannels; ++channel) {
+            mOutputMeters[channel].publish(mOutputPeaks[channel], std::sqrt(mOutputSquareSums[channel] * perFrame));
+        }
+    }
+    
+    // Averages the input channels into `scratch`. A mono input is used as is.
+    template <int Channels>
+    const float* mixToMono(std::span<float const*> inputBuffers, float* scratch, AUAudioFrameCount frameCount) {
+        if constexpr (Channels == 1) {
+            return inputBuffers[0];
+        } else if constexpr (Channels == 2) {
+            const float half = 0.5f;
+            vDSP_vasm(inputBuffers[0], 1, inputBuffers[1], 1, &half, scratch, 1, frameCount);
+            return scratch;
+        } else {
+            const size_t channelCount = Channels > 0 ? Channels : inputBuffers.size();
+            const float channelScale = 1.0f / (float)channelCount;
+            vDSP_vsmul(inputBuffers[0], 1, &channelScale, scratch, 1, frameCount);
+            for (size_t channel = 1; channel < channelCount; ++channel) {
+                vDSP_vsma(inputBuffers[channel], 1, &channelScale, scratch, 1, scratch, 1, frameCount);
+            }
+            return scratch;
+        }
+    }
+    
+    // Copies a mono bus to every output channel; `bus` may be the first channel itself
+    template <int Channels>
+    void fanOut(const float* bus, std::span<float *> outputBuffers, AUAudioFrameCount frameCount) {
+        const size_t channelCount = Channels > 0 ? Channels : outputBuffers.size();
+        for (size_t channel = 0; channel < channelCount; ++channel) {
+            if (outputBuffers[channel] != bus) {
+                std::copy_n(bus, frameCount, outputBuffers[channel]);
+            }
+        }
+    }
+    
+    // MARK: - Loop
+    
+    // Only valid while the loop is empty; sizes the loop for `bpm`
+    void setLoopTempo(double bpm) {
+        tempo = std::max(bpm, minimumLoopTempo);
+        
+        // Calculate how many samples make up our loop. It rarely comes out whole, so the
+        // fraction is carried from pass to pass instead of being truncated away.
+        loopLengthSamples = std::min(double(loopBufferCapacity), (mSampleRate * 60.0 / tempo) * beatsPerBar * loopLengthBars);
+        loopBufferSize = std::max(1, (int)loopLengthSamples);
+        loopPassLength = loopBufferSize;
+        loopPassRemainder = 0.0;
+        loopSampleIndex = loopSampleIndex % loopBufferSize;
+        mLoopStretcher.invalidate();
+    }
+    
+    // Resizes the loop to `bars` bars at its current tempo, as far as the buffer allows.
+    // Audio in the part of the loop that is kept stays; a grown loop is extended with silence.
+    void setLoopLength(double bars) {
+        const double samplesPerBar = (mSampleRate * 60.0 / tempo) * beatsPerBar;
+        loopLengthBars = std::clamp(std::round(bars), 1.0, std::floor(loopBufferCapacity / samplesPerBar));
+        const int previousSize = loopBufferSize;
+        setLoopTempo(tempo);
+        if (loopBufferSize > previousSize) {
+            vDSP_vclr(loopBuffer + previousSize, 1, loopBufferSize + 1 - previousSize);
+        }
+        loopAnalysisStale = loopHasContent;
+    }
+    
+    /*
+     Swaps in a loop buffer filled elsewhere, `length` samples from its start, the rest
+     silent. The loop is resized to the nearest whole number of bars at its tempo, so
+     committing the last two bars gives a two bar loop; the play position carries on.
+     The caller retires the old buffer.
+     */
+    void loadLoop(float* samples, int length) {
+        loopBuffer = samples;
+        // sized directly rather than through setLoopLength, which would silence the new
+        // buffer past the old loop's end
+        const double samplesPerBar = (mSampleRate * 60.0 / tempo) * beatsPerBar;
+        loopLengthBars = std::clamp(std::round(length / samplesPerBar), 1.0, std::max(1.0, std::floor(loopBufferCapacity / samplesPerBar)));
+        setLoopTempo(tempo);
+        loopHasContent = length > 0;
+        loopAnalysisStale = loopHasContent;
+        loopStretching = false;
+        mLoopStretcher.invalidate();
+    }
+    
+    // Empties the loop; the next pass is recorded at the host tempo again
+    void clearLoop() {
+        vDSP_vclr(loopBuffer, 1, loopBufferCapacity + 1);
+        loopSampleIndex = 0;
+        loopPassLength = loopBufferSize;
+        loopPassRemainder = 0.0;
+        loopHasContent = false;
+        loopAnalysisStale = false;
+        loopStretching = false;
+        metronomeBeat = -1;
+        mLoopStretcher.invalidate();
+    }
+    
+    /*
+     At the tempo the loop was recorded at, the pad bus is overdubbed straight into the loop
+     buffer and the loop is played back sample for sample. When the host tempo differs the
+     loop is played through the LoopStretcher instead, keeping its pitch; overdubbing pauses
+     while stretched, and the live pads are heard on top. It also pauses while a scene
+     capture copies the loop: the pass is then mixed in the loop bus alone, so it sounds
+     the same and the buffer is left as captured.
+     */
+    void processLoop(const float* dry, AUAudioFrameCount frameCount) {
+        // An empty loop follows the host, so the first pass is recorded at the host tempo
+        if (!loopHasContent && mHostTempo > 0.0 && mHostTempo != tempo) {
+            setLoopTempo(mHostTempo);
+        }
+        
+        const double speed = mHostTempo > 0.0 ? mHostTempo / tempo : 1.0;
+        const bool wantsStretch = std::fabs(speed - 1.0) > 1e-3;
+        
+        // The loop is static while stretched, so one analysis request covers it
+        if (wantsStretch && loopAnalysisStale && !mLoopStretcher.isAnalysisPending()) {
+            mLoopStretcher.requestAnalysis(loopBuffer, loopBufferSize);
+            loopAnalysisStale = false;
+        }
+        
+        // `dry` is the pads after effects and gain
+        float* loopBus = mLoopBus.data();
+        const double startPosition = loopSampleIndex;
+        
+        if (wantsStretch && mLoopStretcher.isReady()) {
+            if (!loopStretching) {
+                mLoopStretcher.seek(loopSampleIndex);
+                loopStretching = true;
+            }
+            mLoopStretcher.render(loopBus, frameCount, speed);
+            vDSP_vadd(loopBus, 1, dry, 1, loopBus, 1, frameCount);
+            loopSampleIndex = (int)mLoopStretcher.position();
+        } else {
+            loopStretching = false;
+            
+            const bool frozen = isCapturingScene();
+            float dryPeak = 0.0f;
+            vDSP_maxmgv(dry, 1, &dryPeak, frameCount);
+            if (dryPeak > 0.0f && !frozen) {
+                loopHasContent = true;
+                loopAnalysisStale = true;
+            }
+            
+            // Record our output into the loop buffer and play the loop back, a segment at a time.
+            // What was there fades by the feedback amount each pass, and the sum is clipped at
+            // loopHeadroom, so however long the overdub runs the loop stays bounded.
+            const float feedback = loopFeedback / 100.0f;
+            const float lowest = -loopHeadroom;
+            const float highest = loopHeadroom;
+            AUAudioFrameCount done = 0;
+            while (done < frameCount) {
+                const AUAudioFrameCount count = std::min<AUAudioFrameCount>(frameCount - done, loopPassLength - loopSampleIndex);
+                float* loopSegment = loopBuffer + loopSampleIndex;
+                float* mixed = frozen ? loopBus + done : loopSegment;
+                if (feedback < 1.0f) {
+                    vDSP_vsmul(loopSegment, 1, &feedback, mixed, 1, count);
+                } else if (frozen) {
+                    std::copy_n(loopSegment, count, mixed);
+                }
+                vDSP_vadd(mixed, 1, dry + done, 1, mixed, 1, count);
+                vDSP_vclip(mixed, 1, &lowest, &highest, mixed, 1, count);
+                if (!frozen) {
+                    std::copy_n(loopSegment, count, loopBus + done);
+                }
+                done += count;
+                loopSampleIndex += count;
+                
+                // Loop around to the start if we're at the end
+                if (loopSampleIndex >= loopPassLength) {
+                    loopSampleIndex = 0;
+                    startLoopPass();
+                }
+            }
+        }
+        
+        addMetronome(loopBus, frameCount, startPosition, wantsStretch && loopStretching ? speed : 1.0);
+    }
+    
+    // Passes are whole samples long; a pass runs one sample long whenever the fractions left
+    // over so far add up to a sample, so on average the loop lasts exactly loopLengthSamples
+    void startLoopPass() {
+        loopPassRemainder += loopLengthSamples - loopBufferSize;
+        loopPassLength = loopBufferSize;
+        if (loopPassRemainder >= 1.0) {
+            loopPassLength += 1;
+            loopPassRemainder -= 1.0;
+        }
+    }
+    
+    // Not realtime safe. Converts the click to the stream rate with linear interpolation,
+    // so it keeps its pitch and length at any sample rate.
+    void resampleClick() {
+        const float* source = mClickSource.samples;
+        const size_t sourceLength = (size_t)mClickSource.length;
+        const double step = mClickSourceRate / mSampleRate;
+        const size_t length = sourceLength == 0 ? 0 : (size_t)std::floor((sourceLength - 1) / step) + 1;
+        clickSound.resize(length);
+        for (size_t i = 0; i < length; ++i) {
+            const double position = i * step;
+            const size_t index = std::min((size_t)position, sourceLength - 1);
+            const size_t next = std::min(index + 1, sourceLength - 1);
+            const float fraction = float(position - double(index));
+            clickSound[i] = source[index] + (source[next] - source[index]) * fraction;
+        }
+    }
+    
+    // Clicks on every beat of the loop, following the loop's position so they stay on the
+    // beat while it is stretched
+    void addMetronome(float* output, AUAudioFrameCount frameCount, double startPosition, double speed) {
+        const double samplesPerBeat = loopLengthSamples / (beatsPerBar * loopLengthBars);
+        double position = startPosition;
+        for (UInt32 frameIndex = 0; frameIndex < frameCount; ++frameIndex) {
+            // Check if it's time for a metronome click
+            const int beat = (int)(position / samplesPerBeat);
+            if (beat != metronomeBeat) {
+                metronomeBeat = beat;
+                metronomeSampleIndex = 0;
+            }
+            
+            // Apply the metronome click to the output
+            if (metronomeSampleIndex < clickSound.size()) {
+                output[frameIndex] += clickSound[metronomeSampleIndex];
+            }
+            metronomeSampleIndex++;
+            
+            position += speed;
+            if (position >= loopPassLength) {
+                position -= loopPassLength;
+            }
+        }
+    }
+    
+    // MARK: - Pads
+    
+    // Picks up slice points published by the TakeAnalyzer, ignoring any computed for a take
+    // that has since been recorded over.
+    void applyAnalyzedSlices() {
+        TakeAnalyzer::Result result;
+        while (mTakeAnalyzer.nextResult(result)) {
+            if (soundBuffers[result.sourceNote].currentTakeId() != result.sourceTakeId) {
+                continue;
+            }
+            SoundBuffer::Slice& slice = soundBuffers[result.targetNote].slice;
+            slice.sourceNote = result.sourceNote;
+            slice.sourceTakeId = result.sourceTakeId;
+            slice.start = result.start;
+            slice.end = result.end;
+        }
+    }
+    
+    // MARK: - Scene Switching
+    
+    // Render thread. A pending scene is switched to on the first bar line inside this cycle,
+    // ahead of any note on it, or right away when there is no running transport to follow.
+    void scheduleSceneSwitch(AUAudioFrameCount frameCount) {
+        if (mPendingScene.load(std::memory_order_relaxed) == nullptr) {
+            return;
+        }
+        AUEventSampleTime when = mCycleStartTime;
+        if (mTransportMoving && mHostTempo > 0.0) {
+            // half a sample of slack, so a cycle starting on the bar line doesn't miss it
+            const double samplesPerBeat = mSampleRate * 60.0 / mHostTempo;
+            const double barBeat = std::ceil((mCycleStartBeat - 0.5 / samplesPerBeat) / beatsPerBar) * beatsPerBar;
+            when = std::max(mCycleStartTime, mCycleStartTime + AUEventSampleTime(std::llround((barBeat - mCycleStartBeat) * samplesPerBeat)));
+            if (when >= mCycleStartTime + AUEventSampleTime(frameCount)) {
+                return;
+            }
+        }
+        ScheduledEventQueue::Event event;
+        event.sampleTime = when;
+        event.type = ScheduledEventQueue::Type::SceneSwitch;
+        if (when == mCycleStartTime || !mScheduledEvents.schedule(event)) {
+            switchScene();
+        }
+    }
+    
+    // Render thread. Takes the pending scene change, once the last one has been handed back.
+    void switchScene() {
+        if (mUnretiredScene != nullptr) {
+            if (!mRetiredScenes.push(mUnretiredScene)) {
+                return;
+            }
+            mUnretiredScene = nullptr;
+        }
+        SceneChange* change = mPendingScene.exchange(nullptr, std::memory_order_acq_rel);
+        if (change == nullptr) {
+            return;
+        }
+        applySceneChange(*change);
+        mAppliedScene.store(change->sequence, std::memory_order_release);
+        if (!mRetiredScenes.push(change)) {
+            mUnretiredScene = change;
+        }
+    }
+    
+    /*
+     Render thread. Swaps every pad's take for the change's and keeps what it replaced in the
+     change. A pad already holding the scene's take keeps playing and the spare reference
+     goes back with the change; other pads have their voices cut, like a loaded take. Empty
+     pads of the scene just clear a pad's own buffer, keeping it to record into.
+     */
+    void applySceneChange(SceneChange& change) {
+        const Scene& scene = *change.scene;
+        for (int note = 0; note < bufferCount; ++note) {
+            SoundBuffer& pad = soundBuffers[note];
+            const Scene::Pad& entry = scene.pads[note];
+            float* take = change.takes[note];
+            const bool unchanged = pad.isShared() && pad.data() == take && pad.recordedLength() == entry.take.length;
+            if (!unchanged && (pad.isShared() || entry.take.samples != nullptr)) {
+                float* previous = const_cast<float*>(pad.data());
+                mVoices.stopVoicesReading(previous, previous + pad.takeSize());
+                dropTakeTail(note);
+                pad.replaceTake(take, entry.take.length, true);
+                change.takes[note] = previous;
+                publishTakeProgress(note);
+            } else if (!unchanged && pad.recordedLength() > 0) {
+                mVoices.stopVoicesReading(pad.data(), pad.data() + pad.takeSize());
+                dropTakeTail(note);
+                // a take still being captured is swapped out rather than recorded over
+                if (!isCapturingScene() || !swapInSpareTake(note)) {
+                    pad.clear();
+                }
+                publishTakeProgress(note);
+            }
+            pad.loopStart = entry.loopStart;
+            pad.loopEnd = entry.loopEnd;
+            pad.retriggerMode = (SoundBuffer::RetriggerMode)std::clamp(entry.retriggerMode, 0, 2);
+            pad.chokeGroup = std::max(entry.chokeGroup, 0);
+            pad.voiceLimit = std::clamp(entry.voiceLimit, 1, SoundBuffer::maximumVoicesPerPad);
+            pad.reverbSend = std::clamp(entry.reverbSend, 0.0f, 1.0f);
+        }
+        
+        // slices refer to take ids, which the scene's takes only have now
+        for (int note = 0; note < bufferCount; ++note) {
+            const Scene::Pad& entry = scene.pads[note];
+            SoundBuffer::Slice& slice = soundBuffers[note].slice;
+            slice = SoundBuffer::Slice();
+            if (entry.sliceSource >= 0 && entry.sliceSource < bufferCount) {
+                const SoundBuffer& source = soundBuffers[entry.sliceSource];
+                const int end = std::min(entry.sliceEnd, source.recordedLength());
+                if (entry.sliceStart >= 0 && entry.sliceStart < end) {
+                    slice = { entry.sliceSource, source.currentTakeId(), entry.sliceStart, end };
+                }
+            }
+        }
+        
+        if (change.loop != nullptr && change.sampleRate == mSampleRate) {
+            float* previous = loopBuffer;
+            setLoopTempo(scene.loopTempo);
+            loadLoop(change.loop, std::min(scene.loop.length, loopBufferAllocated - 1));
+            change.loop = previous;
+        } else {
+            clearLoop();
+        }
+        
+        if (change.includeParameters) {
+            for (const Scene::Parameter& parameter : scene.parameters) {
+                setParameter(parameter.address, parameter.value);
+            }
+        }
+    }
+    
+    // MARK: - Commands
+    
+    // Any thread. Returns false when the queue is full; a LoadPad command's samples then
+    // still belong to the caller.
+    bool postCommand(const KernelCommand& command) {
+        return mCommands.push(command);
+    }
+    
+    void performCommands() {
+        for (int performed = 0; performed < commandBudget; ++performed) {
+            KernelCommand command;
+            if (mHasDeferredCommand) {
+                command = mDeferredCommand;
+                mHasDeferredCommand = false;
+            } else if (!mCommands.pop(command)) {
+                return;
+            }
+            if (!performCommand(command)) {
+                mDeferredCommand = command;
+                mHasDeferredCommand = true;
+                return;
+            }
+        }
+    }
+    
+    // Returns false if the command has to wait for a later cycle
+    bool performCommand(const KernelCommand& command) {
+        const bool hasPad = command.note >= 0 && command.note < bufferCount;
+        switch (command.type) {
+            case KernelCommand::Type::PadSetting:
+                if (hasPad) {
+                    applyPadSetting(soundBuffers[command.note], command.padSetting);
+                }
+                return true;
+            case KernelCommand::Type::SequencerEdit:
+                mSequencer.apply(command.sequencerEdit);
+                return true;
+            case KernelCommand::Type::ClearPad:
+                if (hasPad) {
+                    SoundBuffer& pad = soundBuffers[command.note];
+                    dropTakeTail(command.note);
+                    // An emptied pad doesn't need to keep its shared take alive
+                    if (!pad.isShared() || !swapInSpareTake(command.note)) {
+                        mVoices.stopVoicesReading(pad.data(), pad.data() + pad.takeSize());
+                        pad.clear();
                     }
+                    publishTakeProgress(command.note);
                 }
+                return true;
+            case KernelCommand::Type::ClearLoop:
+                clearLoop();
+                return true;
+            case KernelCommand::Type::SetLoopLength:
+                setLoopLength(command.loopBars);
+                return true;
+            case KernelCommand::Type::LoadPad: {
+                if (!hasPad) {
+                    return mRetiredTakes.push(command.samples);
+                }
+                SoundBuffer& pad = soundBuffers[command.note];
+                float* previous = const_cast<float*>(pad.data());
+                if (!mRetiredTakes.push(previous)) {
+                    return false;
+                }
+                mVoices.stopVoicesReading(previous, previous + pad.takeSize());
+                dropTakeTail(command.note);
+                pad.replaceTake(command.samples, command.length, command.sharedSamples);
+                publishTakeProgress(command.note);
+                return true;
+            }
+            case KernelCommand::Type::LoadLoop:
+                if (!mRetiredTakes.push(loopBuffer)) {
+                    return false;
+                }
+                loadLoop(command.samples, command.length);
+                return true;
+            case KernelCommand::Type::LoadImpulse:
+                // the reverb takes over the cache reference, or it goes back to the cache
+                if (!mReverb.load({ command.samples, command.length, command.sampleRate })) {
+                    return mRetiredTakes.push(command.samples);
+                }
+                return true;
+        }
+        return true;
+    }
+    
+    void applyPadSetting(SoundBuffer& pad, const KernelCommand::PadSetting& setting) {
+        switch (setting.kind) {
+            case KernelCommand::PadSetting::Kind::Loop:
+                pad.loopStart = setting.first;
+                pad.loopEnd = setting.second;
+                break;
+            case KernelCommand::PadSetting::Kind::ChokeGroup:
+                pad.chokeGroup = std::max(setting.first, 0);
+                break;
+            case KernelCommand::PadSetting::Kind::RetriggerMode:
+                pad.retriggerMode = (SoundBuffer::RetriggerMode)std::clamp(setting.first, 0, 2);
+                break;
+            case KernelCommand::PadSetting::Kind::VoiceLimit:
+                pad.voiceLimit = std::clamp(setting.first, 1, SoundBuffer::maximumVoicesPerPad);
+                break;
+            case KernelCommand::PadSetting::Kind::ReverbSend:
+                pad.reverbSend = float(std::clamp(setting.first, 0, 100)) * 0.01f;
+                break;
+        }
+    }
+    
+    /*
+     Background thread, every BackgroundWorker interval. Takes retired before the tick
+     starts are only freed once the analysis and overview work that may still read them
+     has run.
+     */
+    void workerTick() {
+        float* take = nullptr;
+        while (mRetiredTakes.pop(take)) {
+            mTakesToFree.push_back(take);
+        }
+        SceneChange* change = nullptr;
+        while (mRetiredScenes.pop(change)) {
+            mScenesToFree.push_back(change);
+        }
+        reportSceneSwitch();
+        mTakeAnalyzer.poll();
+        mLoopStretcher.poll();
+        mReverb.poll();
+        updateOverviews();
+        
+        // a scene capture being copied may still read retired takes; they wait until it is done
+        if (mSceneCaptureState.load(std::memory_order_acquire) != SceneCaptureFilled) {
+            for (float* retired : mTakesToFree) {
+                mLoopStretcher.forget(retired);
+                freeTake(retired);
+            }
+            mTakesToFree.clear();
+            for (SceneChange* retired : mScenesToFree) {
+                mLoopStretcher.forget(retired->loop);
+                delete retired;
+            }
+            mScenesToFree.clear();
+        }
+        topUpSpareTakes();
+    }
+    
+    // Background thread
+    void reportSceneSwitch() {
+        const uint64_t applied = mAppliedScene.load(std::memory_order_acquire);
+        if (applied == mReportedScene) {
+            return;
+        }
+        mReportedScene = applied;
+        std::lock_guard<std::mutex> lock(mSceneSwitchHandlerLock);
+        if (mSceneSwitchHandler) {
+            mSceneSwitchHandler(applied);
+        }
+    }
+    
+    // Background thread
+    void topUpSpareTakes() {
+        while (mSpareTakesQueued.load(std::memory_order_relaxed) < spareTakeCount) {
+            float* spare = new float[SoundBuffer::capacity]();
+            if (!mSpareTakes.push(spare)) {
+                delete[] spare;
+                return;
+            }
+            mSpareTakesQueued.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    
+    // Background thread. A retired take is either the kernel's own or a SampleCache reference.
+    static void freeTake(float* take) {
+        if (!SampleCache::shared().release(take)) {
+            delete[] take;
+        }
+    }
+    
+    /*
+     Render thread. Copy-on-write for takes the pad can't record over in place: a shared
+     SampleCache take, or one the TakeAnalyzer is still reading. Swaps it for an empty
+     private buffer from the worker's spares and retires it. Returns false, leaving the pad
+     alone, if no spare is ready yet.
+     */
+    bool swapInSpareTake(int note) {
+        if (mSpareTake == nullptr && mSpareTakes.pop(mSpareTake)) {
+            mSpareTakesQueued.fetch_sub(1, std::memory_order_relaxed);
+        }
+        SoundBuffer& pad = soundBuffers[note];
+        float* previous = const_cast<float*>(pad.data());
+        if (mSpareTake == nullptr || !mRetiredTakes.push(previous)) {
+            return false;
+        }
+        mVoices.stopVoicesReading(previous, previous + pad.takeSize());
+        pad.replaceTake(mSpareTake, 0);
+        mSpareTake = nullptr;
+        return true;
+    }
+    
+    // Background thread. Only the latest progress of each pad matters.
+    void updateOverviews() {
+        std::array<TakeProgress, bufferCount> latest;
+        std::array<bool, bufferCount> changed {};
+        TakeProgress progress;
+        while (mTakeProgress.pop(progress)) {
+            latest[progress.note] = progress;
+            changed[progress.note] = true;
+        }
+        for (int note = 0; note < bufferCount; ++note) {
+            if (!changed[note]) {
+                continue;
+            }
+            WaveformOverview& overview = mOverviews[note];
+            if (overview.takeId() != latest[note].takeId || latest[note].length < overview.length()) {
+                overview.reset(latest[note].takeId);
+            }
+            overview.extend(latest[note].samples, latest[note].length);
+        }
+    }
+    
+    // Render thread. Tells the worker how far the pad's take has got.
+    void publishTakeProgress(int note) {
+        const SoundBuffer& pad = soundBuffers[note];
+        mTakeProgress.push({ note, pad.currentTakeId(), pad.data(), pad.recordedLength() });
+    }
+    
+    // Background thread
+    void freeRetiredTakes() {
+        float* take = nullptr;
+        while (mRetiredTakes.pop(take)) {
+            freeTake(take);
+        }
+    }
+    
+    /*
+     Starts a voice for the pad: its slice if the slice is still current, otherwise its own
+     take. Pads in the same choke group are faded out first. A legato pad that is still
+     held just takes the new velocity. Otherwise the pad's oldest voices are released until
+     a new one fits under its voice limit, so a retrigger fades the old hit out underneath.
+     */
+    void triggerPad(int note, float velocity) {
+        SoundBuffer& pad = soundBuffers[note];
+        
+        if (pad.chokeGroup > 0) {
+            mVoices.forEachHeldVoice([this, note, &pad] (int voiceNote, PadVoice& voice) {
+                if (voiceNote != note && soundBuffers[voiceNote].chokeGroup == pad.chokeGroup) {
+                    voice.release();
+                }
+            });
+        }
+        
+        if (pad.retriggerMode == SoundBuffer::RetriggerMode::Legato && mVoices.heldVoiceCount(note) > 0) {
+            mVoices.forEachHeldVoice(note, [velocity] (PadVoice& voice) { voice.setGain(velocity); });
+            return;
+        }
+        mVoices.releaseOldest(note, pad.voiceLimit - 1);
+        
+        PadVoice& voice = mVoices.allocate(note);
+        const SoundBuffer::Slice& slice = pad.slice;
+        if (slice.sourceNote >= 0 && soundBuffers[slice.sourceNote].currentTakeId() == slice.sourceTakeId) {
+            voice.start(soundBuffers[slice.sourceNote].data() + slice.start, slice.end - slice.start, velocity, 0, 0, mCrossfade);
+        } else {
+            voice.start(pad.data(), pad.recordedLength(), velocity, pad.loopStart, pad.loopEnd, mCrossfade);
+        }
+        applyNoteExpression(note, voice, true);
+    }
+    
+    // MARK: - Per-Note Expression
+    
+    void applyNoteExpression(int note, PadVoice& voice, bool immediately = false) {
+        const NoteExpression& expression = mNoteExpression[note];
+        const float rate = std::exp2(expression.bend / 12.0f);
+        const float gain = expression.volume * (1.0f + expression.pressure);
+        // brightness spreads the cutoff over 20 Hz...20 kHz on a log scale
+        const float cutoff = 20.0f * std::pow(1000.0f, expression.brightness);
+        const float lowpass = expression.brightness >= 1.0f ? 1.0f : 1.0f - std::exp(-2.0f * float(M_PI) * cutoff / float(mSampleRate));
+        voice.setExpression(rate, gain, lowpass, immediately);
+        // a change to the pad's send reaches its sounding voices along with expression
+        voice.setSend(soundBuffers[note].reverbSend, immediately);
+    }
+    
+    void applyNoteExpression() {
+        mVoices.forEachActiveVoice([this] (int note, PadVoice& voice) {
+            applyNoteExpression(note, voice);
+        });
+    }
+    
+    // Messages carry 32-bit values; these map them to the ranges above
+    static float unipolar(uint32_t value) {
+        return float(double(value) / double(UINT32_MAX));
+    }
+    
+    static float bipolar(uint32_t value) {
+        return float((double(value) - 2147483648.0) / 2147483648.0);
+    }
+    
+    void handlePerNoteMessage(const MIDIUniversalMessage& message) {
+        switch (message.channelVoice2.status) {
+            case kMIDICVStatusPerNotePitchBend: {
+                const auto& bend = message.channelVoice2.perNotePitchBend;
+                mNoteExpression[bend.noteNumber & 0x7F].bend = bipolar(bend.data) * perNoteBendRange;
+            }
+                break;
+                
+            case kMIDICVStatusPolyPressure: {
+                const auto& pressure = message.channelVoice2.polyPressure;
+                mNoteExpression[pressure.noteNumber & 0x7F].pressure = unipolar(pressure.pressure);
+            }
+                break;
+                
+            case kMIDICVStatusRegisteredPNC:
+            case kMIDICVStatusAssignablePNC: {
+                const auto& controller = message.channelVoice2.perNoteController;
+                NoteExpression& expression = mNoteExpression[controller.noteNumber & 0x7F];
+                const bool registered = message.channelVoice2.status == kMIDICVStatusRegisteredPNC;
+                if (registered && controller.index == volumeController) {
+                    expression.volume = unipolar(controller.data);
+                } else if (!registered && controller.index == brightnessController) {
+                    expression.brightness = unipolar(controller.data);
+                }
+            }
+                break;
+                
+            case kMIDICVStatusPerNoteMgmt: {
+                const auto& management = message.channelVoice2.perNoteManagement;
+                if (management.resetControllers) {
+                    mNoteExpression[management.note & 0x7F] = NoteExpression();
+                }
+            }
+                break;
+                
+            default:
+                break;
+        }
+    }
+    
+    void releasePad(int note) {
+        if (soundBuffers[note].retriggerMode != SoundBuffer::RetriggerMode::OneShot) {
+            mVoices.releaseNote(note);
+            return;
+        }
+        // a one-shot plays out, unless it loops and would never end
+        mVoices.forEachHeldVoice(note, [] (PadVoice& voice) {
+            if (voice.isLooping()) {
+                voice.release();
+            }
+        });
+    }
+    
+    void finishTake(int note) {
+        SoundBuffer& pad = soundBuffers[note];
+        TakeAnalyzer::Job job;
+        job.note = note;
+        job.takeId = pad.currentTakeId();
+        job.samples = pad.data();
+        job.length = pad.recordedLength();
+        job.slice = autoSlice == 1.0;
+        mAnalysisTickets[note] = mTakeAnalyzer.submit(job);
+    }
+    
+    void padNoteOn(int note, float velocity = 1.0f) {
+        // the pad's last take ends short rather than run into this note
+        if (mTakeTail[note] > 0) {
+            completeTake(note);
+        }
+        if (samplingMode == 1.0) {
+            // Neither a shared take nor one still being analyzed or captured is recorded over
+            // in place
+            const bool inUse = soundBuffers[note].isShared() || mTakeAnalyzer.isReading(mAnalysisTickets[note]) || isCapturingScene();
+            if (inUse && !swapInSpareTake(note)) {
+                return;
+            }
+            mVoices.stopNote(note);
+            soundBuffers[note].startRecording();
+            startTakeWindow(note);
+            publishTakeProgress(note);
+        } else {
+            triggerPad(note, velocity);
+        }
+        currentNotes.set(note);
+    }
+    
+    void padNoteOff(int note) {
+        if (samplingMode == 1.0 && currentNotes.test(note)) {
+            const int latency = millisecondsToSamples(inputLatency);
+            if (latency > 0) {
+                // the input played up to this note is still on its way
+                mTakeTail[note] = latency;
+                mFinishingTakes += 1;
+            } else {
+                finishTake(note);
+            }
+        }
+        currentNotes.reset(note);
+        if (mTakeTail[note] == 0) {
+            soundBuffers[note].reset();
+        }
+        releasePad(note);
+    }
+    
+    // MARK: - Input Latency
+    
+    int millisecondsToSamples(float milliseconds) const {
+        return (int)std::lround(std::clamp(double(milliseconds) * 0.001, 0.0, maximumInputOffsetSeconds) * mSampleRate);
+    }
+    
+    // Lines a new take up with the input: when the pre-roll reaches back further than the
+    // input is late, the difference comes out of the ring now; otherwise the take passes
+    // over the input that arrives before its start
+    void startTakeWindow(int note) {
+        const int latency = millisecondsToSamples(inputLatency);
+        const int preRoll = millisecondsToSamples(takePreRoll);
+        mTakeSkip[note] = std::max(latency - preRoll, 0);
+        if (preRoll > latency) {
+            SoundBuffer& pad = soundBuffers[note];
+            mInputRing.readLatest(preRoll - latency, [&pad] (const float* samples, int count) {
+                pad.recordBlock(samples, count);
+            });
+        }
+    }
+    
+    // Records a block of input into a pad's take, minus what the start of the take still
+    // passes over and, once released, whatever lies beyond the end of its tail
+    void recordTake(int note, const float* input, int frameCount) {
+        const int count = mTakeTail[note] > 0 ? std::min(frameCount, mTakeTail[note]) : frameCount;
+        const int skip = std::min(mTakeSkip[note], count);
+        mTakeSkip[note] -= skip;
+        soundBuffers[note].recordBlock(input + skip, count - skip);
+        publishTakeProgress(note);
+    }
+    
+    // Takes whose input is late are finished once their tail is in. Without input the
+    // tail can't come in, so the takes finish as they stand.
+    void recordTakeTails(const float* input, int frameCount) {
+        for (int note = 0; note < bufferCount && mFinishingTakes > 0; ++note) {
+            if (mTakeTail[note] <= 0) {
+                continue;
+            }
+            const int remaining = input != nullptr ? mTakeTail[note] - std::min(frameCount, mTakeTail[note]) : 0;
+            if (input != nullptr) {
+                recordTake(note, input, frameCount);
+            }
+            if (remaining == 0) {
+                completeTake(note);
+            } else {
+                mTakeTail[note] = remaining;
+            }
+        }
+    }
+    
+    void completeTake(int note) {
+        dropTakeTail(note);
+        finishTake(note);
+        soundBuffers[note].reset();
+    }
+    
+    // Forgets a released take's tail without finishing it, e.g. when the take is replaced
+    void dropTakeTail(int note) {
+        if (mTakeTail[note] > 0) {
+            mFinishingTakes -= 1;
+        }
+        mTakeTail[note] = 0;
+        mTakeSkip[note] = 0;
+    }
+    
+    void finishTakeTails() {
+        for (int note = 0; note < bufferCount && mFinishingTakes > 0; ++note) {
+            if (mTakeTail[note] > 0) {
+                completeTake(note);
+            }
+        }
+    }
+    
+    // MARK: - Quantization
+    
+    // The first grid line at or after `time`, as a sample time. Every second step is pushed
+    // late by the swing amount. Returns `time` unchanged when quantization is off or the
+    // host transport isn't running.
+    AUEventSampleTime quantizedTime(AUEventSampleTime time) const {
+        if (quantizeGrid < 1.0 || !mTransportMoving || mHostTempo <= 0.0) {
+            return time;
+        }
+        const double samplesPerBeat = mSampleRate * 60.0 / mHostTempo;
+        const double step = 1.0 / double(1 << (std::min(int(quantizeGrid), 4) - 1));
+        const double tolerance = quantizeTolerance * mSampleRate / samplesPerBeat;
+        const double beat = mCycleStartBeat + double(time - mCycleStartTime) / samplesPerBeat - tolerance;
+        
+        const double pairStart = std::floor(beat / (2.0 * step)) * 2.0 * step;
+        double gridBeat = pairStart;
+        if (gridBeat < beat) {
+            gridBeat = pairStart + step + swingOffset(step);
+        }
+        if (gridBeat < beat) {
+            gridBeat = pairStart + 2.0 * step;
+        }
+        const double gridTime = double(mCycleStartTime) + (gridBeat - mCycleStartBeat) * samplesPerBeat;
+        return std::max(time, AUEventSampleTime(std::llround(gridTime)));
+    }
+    
+    // How late every second step of a `step`-beat grid lands
+    double swingOffset(double step) const {
+        return (std::clamp(double(swing), 50.0, 75.0) / 50.0 - 1.0) * step;
+    }
+    
+    // Runs a pad note now, or queues it for the next grid line. A note-off never lands on
+    // the same grid line as its note-on, so a short press still sounds for one step.
+    void schedulePadNote(ScheduledEventQueue::Type type, int note, float velocity = 1.0f) {
+        AUEventSampleTime when = quantizedTime(mMIDIEventTime);
+        if (type == ScheduledEventQueue::Type::NoteOn) {
+            mLastNoteOnTime[note] = when;
+        } else if (when > mMIDIEventTime && when <= mLastNoteOnTime[note]) {
+            when = quantizedTime(mLastNoteOnTime[note] + 1);
+        }
+        
+        if (when > mMIDIEventTime && mScheduledEvents.schedule({ when, type, (uint8_t)note, velocity })) {
+            return;
+        }
+        if (type == ScheduledEventQueue::Type::NoteOn) {
+            padNoteOn(note, velocity);
+        } else {
+            padNoteOff(note);
+        }
+    }
+    
+    // Used by AUProcessHelper to end a render segment at the next scheduled event
+    bool nextScheduledEventTime(AUEventSampleTime& time) const {
+        if (mScheduledEvents.empty()) {
+            return false;
+        }
+        time = mScheduledEvents.front().sampleTime;
+        return true;
+    }
+    
+    void performScheduledEvents(AUEventSampleTime now) {
+        while (!mScheduledEvents.empty() && mScheduledEvents.front().sampleTime <= now) {
+            const ScheduledEventQueue::Event event = mScheduledEvents.front();
+            mScheduledEvents.pop();
+            switch (event.type) {
+                case ScheduledEventQueue::Type::NoteOn:
+                    padNoteOn(event.note, event.velocity);
+                    break;
+                case ScheduledEventQueue::Type::NoteOff:
+                    padNoteOff(event.note);
+                    break;
+                case ScheduledEventQueue::Type::StepOn:
+                    stepNoteOn(event.note, event.velocity);
+                    break;
+                case ScheduledEventQueue::Type::StepOff:
+                    stepNoteOff(event.note);
+                    break;
+                case ScheduledEventQueue::Type::SceneSwitch:
+                    switchScene();
+                    break;
             }
         }
     }
@@ -280,29 +2010,35 @@ public:
     void handleMIDIEventList(AUEventSampleTime now, AUMIDIEventList const* midiEvent) {
         auto visitor = [] (void* context, MIDITimeStamp timeStamp, MIDIUniversalMessage message) {
             auto thisObject = static_cast<BeatMachineExtensionDSPKernel *>(context);
+            if (message.type != kMIDIMessageTypeChannelVoice2) {
+                return;
+            }
 
             if (message.channelVoice2.status == kMIDICVStatusNoteOn) {
-                UInt32 noteNumber = message.channelVoice2.note.number;
+                UInt32 noteNumber = message.channelVoice2.note.number & 0x7F;
                 if (noteNumber == thisObject->RECORD_NOTE) {
                     thisObject->setParameterRef(BeatMachineExtensionParameterAddress::samplingMode, 1.0);
                 } else if (noteNumber == thisObject->MUTE_NOTE) {
                     thisObject->isMuted = true;
                 } else {
-                    thisObject->currentNotes.insert(noteNumber);
+                    const float velocity = float(message.channelVoice2.note.velocity) / float(UINT16_MAX);
+                    thisObject->schedulePadNote(ScheduledEventQueue::Type::NoteOn, noteNumber, velocity);
                 }
             } else if (message.channelVoice2.status == kMIDICVStatusNoteOff) {
-                UInt32 noteNumber = message.channelVoice2.note.number;
+                UInt32 noteNumber = message.channelVoice2.note.number & 0x7F;
                 if (noteNumber == thisObject->RECORD_NOTE) {
                     thisObject->setParameterRef(BeatMachineExtensionParameterAddress::samplingMode, 0.0);
                 } else if (noteNumber == thisObject->MUTE_NOTE) {
                     thisObject->isMuted = false;
                 } else {
-                    thisObject->currentNotes.erase(noteNumber);
-                    thisObject->soundBuffers[noteNumber].reset();
+                    thisObject->schedulePadNote(ScheduledEventQueue::Type::NoteOff, noteNumber);
                 }
+            } else {
+                thisObject->handlePerNoteMessage(message);
             }
         };
         
+        mMIDIEventTime = now;
         MIDIEventListForEachEvent(&midiEvent->eventList, visitor, this);
     }
     
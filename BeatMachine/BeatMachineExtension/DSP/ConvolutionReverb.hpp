@@ -0,0 +1,310 @@
+//
+//  ConvolutionReverb.hpp
+//  BeatMachineExtension
+//
+
+#pragma once
+
+#import <Accelerate/Accelerate.h>
+#import <algorithm>
+#import <atomic>
+#import <vector>
+#include <cmath>
+#include "SPSCQueue.hpp"
+#include "SampleCache.hpp"
+
+/*
+ ConvolutionReverb
+ Convolves the reverb send with an impulse response by uniformly partitioned overlap-save.
+ The impulse is cut into partitionLength pieces whose spectra are computed once. After that,
+ every partitionLength samples of send cost one forward FFT, one complex multiply-add per
+ partition against the spectra of past send blocks, and one inverse FFT. The reverb comes
+ out partitionLength samples late, a fixed pre-delay rather than added latency.
+
+ Impulses are prepared on the background thread the way the LoopStretcher's analyses are:
+ the worker fills the slot the render thread isn't reading, spectra and delay line
+ included, and publishes it with one atomic store. The render thread picks the slot up
+ between blocks, so switching impulses allocates nothing. An impulse prepared for another
+ sample rate stays silent until the worker has redone it.
+ */
+class ConvolutionReverb {
+public:
+    static const int partitionLog2n = 8;
+    static const int partitionLength = 1 << partitionLog2n;
+    static const int fftLog2n = partitionLog2n + 1;
+    static constexpr double maximumImpulseSeconds = 6.0;
+
+    // An impulse response as the SampleCache holds it; the reverb keeps one reference
+    struct Source {
+        const float* samples = nullptr;
+        int length = 0;
+        uint32_t sampleRate = 0;
+    };
+
+private:
+    struct Impulse {
+        double sampleRate = 0.0;
+        int partitionCount = 0;             // 0 = silent
+        std::vector<float> real;            // partitionCount x partitionLength, packed like vDSP_fft_zrip
+        std::vector<float> imag;
+        std::vector<float> historyReal;     // spectra of the last partitionCount send blocks
+        std::vector<float> historyImag;
+        int historyPosition = 0;            // where the newest of them is
+    };
+
+    FFTSetup mFFTSetup = nullptr;
+
+    // preparation, worker side
+    Impulse mImpulses[2];
+    std::atomic<int> mPublished { -1 };
+    std::atomic<int> mInUse { -1 };
+    std::atomic<double> mTargetSampleRate { 0.0 };
+    std::atomic<double> mTailSeconds { 0.0 };
+    SPSCQueue<Source, 8> mSources;
+    Source mSource;                         // the impulse being played, or about to be
+    bool mSourceChanged = false;
+    double mPreparedRate = 0.0;             // the rate the published impulse was prepared for
+    std::vector<float> mResampled;
+    std::vector<float> mPreparationFrame;
+
+    // convolution, render side
+    int mSlot = -1;
+    double mSampleRate = 0.0;
+    std::vector<float> mInput;              // the previous send block, then the one being filled
+    std::vector<float> mOutput;             // reverb of the last complete block, played during this one
+    std::vector<float> mSumReal;
+    std::vector<float> mSumImag;
+    std::vector<float> mFrame;
+    int mFill = 0;                          // samples of the current block received so far
+    int mSilentBlocks = 0;                  // complete blocks in a row without any send
+    bool mOutputAudible = false;
+
+public:
+    ~ConvolutionReverb() {
+        if (mFFTSetup != nullptr) {
+            vDSP_destroy_fftsetup(mFFTSetup);
+        }
+        Source source;
+        while (mSources.pop(source)) {
+            release(source);
+        }
+        release(mSource);
+    }
+
+    // Not realtime safe: allocates the fixed-size FFT buffers.
+    void prepare() {
+        if (mFFTSetup != nullptr) {
+            return;
+        }
+        mFFTSetup = vDSP_create_fftsetup(fftLog2n, kFFTRadix2);
+        mPreparationFrame.resize(2 * partitionLength);
+        mInput.assign(2 * partitionLength, 0.0f);
+        mOutput.assign(partitionLength, 0.0f);
+        mSumReal.resize(partitionLength);
+        mSumImag.resize(partitionLength);
+        mFrame.resize(2 * partitionLength);
+    }
+
+    // Not realtime safe. Starts the stream over at `sampleRate`; an impulse prepared for
+    // another rate is prepared again.
+    void reset(double sampleRate) {
+        mSampleRate = sampleRate;
+        mTargetSampleRate.store(sampleRate, std::memory_order_relaxed);
+        std::fill(mInput.begin(), mInput.end(), 0.0f);
+        std::fill(mOutput.begin(), mOutput.end(), 0.0f);
+        mFill = 0;
+        mSilentBlocks = 0;
+        mOutputAudible = false;
+    }
+
+    // Any thread. How long the reverb keeps ringing after the send stops.
+    double tailSeconds() const {
+        return mTailSeconds.load(std::memory_order_relaxed);
+    }
+
+    // MARK: - Preparation
+
+    /*
+     Render thread. Hands `source` to the background thread, which takes over its
+     SampleCache reference. Returns false when the queue is full; the reference then
+     still belongs to the caller. A source without samples clears the impulse.
+     */
+    bool load(const Source& source) {
+        return mSources.push(source);
+    }
+
+    // Background thread
+    void poll() {
+        Source source;
+        while (mSources.pop(source)) {
+            // only the latest impulse matters
+            release(mSource);
+            mSource = source;
+            mSourceChanged = true;
+        }
+        const double sampleRate = mTargetSampleRate.load(std::memory_order_relaxed);
+        if (mFFTSetup == nullptr || sampleRate <= 0.0 || (!mSourceChanged && sampleRate == mPreparedRate)) {
+            return;
+        }
+
+        // As in the LoopStretcher: fill the slot the render thread isn't reading, or try
+        // again next tick if it hasn't let go of it yet
+        const int published = mPublished.load();
+        const int target = published == 0 ? 1 : 0;
+        if (mInUse.load() == target) {
+            return;
+        }
+        mSourceChanged = false;
+        mPreparedRate = sampleRate;
+        prepareImpulse(mSource, sampleRate, mImpulses[target]);
+        mPublished.store(target);
+        mTailSeconds.store(double(mImpulses[target].partitionCount * partitionLength) / sampleRate, std::memory_order_relaxed);
+    }
+
+private:
+    static void release(Source& source) {
+        if (source.samples != nullptr) {
+            SampleCache::shared().release(source.samples);
+        }
+        source = Source();
+    }
+
+    void prepareImpulse(const Source& source, double sampleRate, Impulse& impulse) {
+        // Linear interpolation to the stream rate, as for the metronome click
+        const double step = source.sampleRate > 0 ? source.sampleRate / sampleRate : 1.0;
+        const size_t sourceLength = source.samples != nullptr ? (size_t)std::max(source.length, 0) : 0;
+        size_t length = sourceLength == 0 ? 0 : (size_t)std::floor((sourceLength - 1) / step) + 1;
+        length = std::min(length, (size_t)(maximumImpulseSeconds * sampleRate));
+        mResampled.resize(length);
+        for (size_t i = 0; i < length; ++i) {
+            const double position = i * step;
+            const size_t index = std::min((size_t)position, sourceLength - 1);
+            const size_t next = std::min(index + 1, sourceLength - 1);
+            const float fraction = float(position - double(index));
+            mResampled[i] = source.samples[index] + (source.samples[next] - source.samples[index]) * fraction;
+        }
+
+        // Impulses are recorded at any level; unit energy keeps the send and the return
+        // about as loud as each other. vDSP's forward/inverse pair scales each product by
+        // 4 * fftSize, which is taken out here too.
+        float energy = 0.0f;
+        if (length > 0) {
+            vDSP_svesq(mResampled.data(), 1, &energy, length);
+        }
+        const float scale = energy > 0.0f ? 1.0f / (std::sqrt(energy) * 4.0f * float(2 * partitionLength)) : 0.0f;
+
+        impulse.sampleRate = sampleRate;
+        impulse.partitionCount = energy > 0.0f ? int((length + partitionLength - 1) / partitionLength) : 0;
+        const size_t spectrumLength = size_t(impulse.partitionCount) * partitionLength;
+        impulse.real.resize(spectrumLength);
+        impulse.imag.resize(spectrumLength);
+        impulse.historyReal.assign(spectrumLength, 0.0f);
+        impulse.historyImag.assign(spectrumLength, 0.0f);
+        impulse.historyPosition = 0;
+
+        // Each partition is zero-padded to the FFT size, so a block convolves without wrapping
+        for (int partition = 0; partition < impulse.partitionCount; ++partition) {
+            const size_t start = size_t(partition) * partitionLength;
+            const size_t count = std::min<size_t>(partitionLength, length - start);
+            std::fill(mPreparationFrame.begin(), mPreparationFrame.end(), 0.0f);
+            std::copy_n(mResampled.data() + start, count, mPreparationFrame.begin());
+            DSPSplitComplex split { impulse.real.data() + start, impulse.imag.data() + start };
+            vDSP_ctoz(reinterpret_cast<const DSPComplex*>(mPreparationFrame.data()), 2, &split, 1, partitionLength);
+            vDSP_fft_zrip(mFFTSetup, &split, 1, fftLog2n, kFFTDirection_Forward);
+            vDSP_vsmul(split.realp, 1, &scale, split.realp, 1, partitionLength);
+            vDSP_vsmul(split.imagp, 1, &scale, split.imagp, 1, partitionLength);
+        }
+    }
+
+    // MARK: - Convolution
+public:
+    /*
+     Render thread, once per block before process(). Picks up a newly published impulse
+     and returns whether there is one to play at the current rate.
+     */
+    bool update() {
+        int slot = mPublished.load();
+        // Claim the slot, then make sure it is still the published one: the worker only
+        // writes a slot that is neither published nor claimed
+        while (mSlot != slot) {
+            mInUse.store(slot);
+            mSlot = slot;
+            slot = mPublished.load();
+        }
+        return mSlot >= 0 && mImpulses[mSlot].partitionCount > 0 && mImpulses[mSlot].sampleRate == mSampleRate;
+    }
+
+    // Render thread. Adds the reverb of `send`, times `level`, to `output`.
+    void process(const float* send, float* output, int frameCount, float level) {
+        int done = 0;
+        while (done < frameCount) {
+            const int count = std::min(frameCount - done, partitionLength - mFill);
+            std::copy_n(send + done, count, mInput.data() + partitionLength + mFill);
+            if (mOutputAudible) {
+                vDSP_vsma(mOutput.data() + mFill, 1, &level, output + done, 1, output + done, 1, count);
+            }
+            mFill += count;
+            done += count;
+            if (mFill == partitionLength) {
+                convolveBlock();
+                mFill = 0;
+            }
+        }
+    }
+
+private:
+    void convolveBlock() {
+        float peak = 0.0f;
+        vDSP_maxmgv(mInput.data() + partitionLength, 1, &peak, partitionLength);
+        mSilentBlocks = peak > 0.0f ? 0 : mSilentBlocks + 1;
+
+        // Once the send has been silent for longer than the impulse, every spectrum in the
+        // delay line is zero and so is the output; there is nothing to compute until it returns
+        Impulse* impulse = update() ? &mImpulses[mSlot] : nullptr;
+        if (impulse == nullptr || mSilentBlocks > impulse->partitionCount) {
+            if (mOutputAudible) {
+                std::fill(mOutput.begin(), mOutput.end(), 0.0f);
+                mOutputAudible = false;
+            }
+            std::copy_n(mInput.data() + partitionLength, partitionLength, mInput.data());
+            return;
+        }
+
+        // The spectrum of the previous and current block goes into the delay line
+        const int partitionCount = impulse->partitionCount;
+        const int newest = (impulse->historyPosition + 1) % partitionCount;
+        impulse->historyPosition = newest;
+        DSPSplitComplex input { impulse->historyReal.data() + size_t(newest) * partitionLength,
+                                impulse->historyImag.data() + size_t(newest) * partitionLength };
+        vDSP_ctoz(reinterpret_cast<const DSPComplex*>(mInput.data()), 2, &input, 1, partitionLength);
+        vDSP_fft_zrip(mFFTSetup, &input, 1, fftLog2n, kFFTDirection_Forward);
+
+        // Partition p meets the send from p blocks ago. The packed DC and Nyquist bins are
+        // real and are summed on their own; vDSP_zvma would mix them up as one complex bin.
+        DSPSplitComplex sum { mSumReal.data(), mSumImag.data() };
+        vDSP_vclr(sum.realp, 1, partitionLength);
+        vDSP_vclr(sum.imagp, 1, partitionLength);
+        float dc = 0.0f;
+        float nyquist = 0.0f;
+        for (int partition = 0; partition < partitionCount; ++partition) {
+            int block = newest - partition;
+            block += block < 0 ? partitionCount : 0;
+            const size_t history = size_t(block) * partitionLength;
+            const size_t spectrum = size_t(partition) * partitionLength;
+            DSPSplitComplex past { impulse->historyReal.data() + history, impulse->historyImag.data() + history };
+            DSPSplitComplex response { impulse->real.data() + spectrum, impulse->imag.data() + spectrum };
+            dc += past.realp[0] * response.realp[0];
+            nyquist += past.imagp[0] * response.imagp[0];
+            vDSP_zvma(&past, 1, &response, 1, &sum, 1, &sum, 1, partitionLength);
+        }
+        sum.realp[0] = dc;
+        sum.imagp[0] = nyquist;
+
+        // Overlap-save: the second half of the circular convolution is the new output
+        vDSP_fft_zrip(mFFTSetup, &sum, 1, fftLog2n, kFFTDirection_Inverse);
+        vDSP_ztoc(&sum, 1, reinterpret_cast<DSPComplex*>(mFrame.data()), 2, partitionLength);
+        std::copy_n(mFrame.data() + partitionLength, partitionLength, mOutput.data());
+        mOutputAudible = true;
+        std::copy_n(mInput.data() + partitionLength, partitionLength, mInput.data());
+    }
+};
@@ -0,0 +1,47 @@
+//
+//  CrossfadeTable.hpp
+//  BeatMachineExtension
+//
+
+#pragma once
+
+#import <vector>
+#include <cmath>
+
+/*
+ CrossfadeTable
+ Precomputed equal-power fade curves shared by every pad voice: fadeIn rises as
+ sin(pi/2 * x) and fadeOut falls as cos(pi/2 * x), so fadeIn^2 + fadeOut^2 == 1 at every
+ step and a crossfade between uncorrelated material keeps its loudness. Built once in
+ prepare(); the render thread only reads it.
+ */
+class CrossfadeTable {
+private:
+    std::vector<float> mFadeIn;
+    std::vector<float> mFadeOut;
+
+public:
+    // Not realtime safe
+    void prepare(int length) {
+        length = std::max(length, 1);
+        mFadeIn.resize(length);
+        mFadeOut.resize(length);
+        for (int i = 0; i < length; ++i) {
+            const double x = 0.5 * M_PI * double(i) / double(length);
+            mFadeIn[i] = (float)std::sin(x);
+            mFadeOut[i] = (float)std::cos(x);
+        }
+    }
+
+    int length() const {
+        return (int)mFadeIn.size();
+    }
+
+    const float* fadeIn() const {
+        return mFadeIn.data();
+    }
+
+    const float* fadeOut() const {
+        return mFadeOut.data();
+    }
+};
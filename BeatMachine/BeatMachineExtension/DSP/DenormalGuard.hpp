@@ -0,0 +1,53 @@
+//
+//  DenormalGuard.hpp
+//  BeatMachineExtension
+//
+
+#pragma once
+
+#include <cstdint>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/*
+ DenormalGuard
+ Flushes denormal floats to zero for as long as it lives on the stack. Decaying signals
+ (feedback, filter tails, a loop fading out) pass through the denormal range on their way
+ to silence, and on x86 every operation on a denormal takes a slow path that can cost a
+ render cycle its deadline. On x86 this sets FTZ and DAZ in MXCSR, on arm64 FZ in FPCR;
+ the previous mode is restored on destruction, so the host's thread is left as found.
+ Cheap enough to construct once per render cycle.
+ */
+class DenormalGuard {
+private:
+#if defined(__x86_64__) || defined(__i386__)
+    static constexpr unsigned int flushBits = 0x8040;   // FTZ | DAZ
+    unsigned int mPrevious = 0;
+#elif defined(__aarch64__)
+    static constexpr uint64_t flushBits = uint64_t(1) << 24;   // FZ
+    uint64_t mPrevious = 0;
+#endif
+
+public:
+    DenormalGuard() {
+#if defined(__x86_64__) || defined(__i386__)
+        mPrevious = _mm_getcsr();
+        _mm_setcsr(mPrevious | flushBits);
+#elif defined(__aarch64__)
+        mPrevious = __builtin_arm_rsr64("fpcr");
+        __builtin_arm_wsr64("fpcr", mPrevious | flushBits);
+#endif
+    }
+
+    ~DenormalGuard() {
+#if defined(__x86_64__) || defined(__i386__)
+        _mm_setcsr(mPrevious);
+#elif defined(__aarch64__)
+        __builtin_arm_wsr64("fpcr", mPrevious);
+#endif
+    }
+
+    DenormalGuard(const DenormalGuard&) = delete;
+    DenormalGuard& operator=(const DenormalGuard&) = delete;
+};
@@ -0,0 +1,131 @@
+//
+//  InputRing.hpp
+//  BeatMachineExtension
+//
+
+#pragma once
+
+#import <algorithm>
+#import <atomic>
+#import <mutex>
+#import <vector>
+#include <cstdint>
+#include <cstring>
+
+/*
+ InputRing
+ The most recent input, kept in a preallocated ring so a take can reach back to before the
+ note that started it, or be cut out of the input after the fact. The render thread is the
+ only writer. Positions are absolute sample counts that only ever grow, so a range stays
+ addressable until it has been overwritten. Other threads copy ranges out without holding
+ up the writer: a copy is checked afterwards against how far the writer got meanwhile, and
+ fails rather than return samples that were overwritten under it.
+ */
+class InputRing {
+public:
+    struct Range {
+        int64_t start = 0;
+        int64_t end = 0;
+    };
+
+private:
+    std::vector<float> mSamples;
+    int mCapacity = 0;                      // samples that can be read back
+    int mSize = 0;                          // allocated: mCapacity plus room for the block being written
+    std::atomic<int64_t> mWritten { 0 };    // samples written so far
+    std::atomic<int64_t> mStart { 0 };      // first position after the last gap
+    mutable std::mutex mAllocation;         // keeps prepare() and copy() apart; never taken by the writer
+
+public:
+    /*
+     Not realtime safe. `blockLength` is the longest write; the ring keeps that much extra
+     room so the block being written never lands on the `capacity` samples readers may copy.
+     */
+    void prepare(int capacity, int blockLength) {
+        std::lock_guard<std::mutex> lock(mAllocation);
+        mCapacity = std::max(capacity, 1);
+        mSize = mCapacity + std::max(blockLength, 0);
+        mSamples.assign(mSize, 0.0f);
+        mWritten.store(0, std::memory_order_release);
+        mStart.store(0, std::memory_order_release);
+    }
+
+    int capacity() const {
+        return mCapacity;
+    }
+
+    // Any thread. The positions that can be read right now.
+    Range available() const {
+        const int64_t written = mWritten.load(std::memory_order_acquire);
+        return { std::max(mStart.load(std::memory_order_acquire), written - mCapacity), written };
+    }
+
+    // Render thread. Forgets what was written so far: input after a gap doesn't follow on from it.
+    void clear() {
+        mStart.store(mWritten.load(std::memory_order_relaxed), std::memory_order_release);
+    }
+
+    // Render thread. At most one copy, or two where the ring wraps.
+    void write(const float* samples, int count) {
+        const int limit = mSize - mCapacity;
+        if (count > limit) {
+            // longer than prepare() allowed for: only the end is kept, after a gap
+            mWritten.store(mWritten.load(std::memory_order_relaxed) + count - limit, std::memory_order_release);
+            clear();
+            samples += count - limit;
+            count = limit;
+        }
+        const int64_t written = mWritten.load(std::memory_order_relaxed);
+        const int start = int(written % mSize);
+        const int first = std::min(count, mSize - start);
+        std::memcpy(mSamples.data() + start, samples, first * sizeof(float));
+        std::memcpy(mSamples.data(), samples + first, (count - first) * sizeof(float));
+        mWritten.store(written + count, std::memory_order_release);
+    }
+
+    /*
+     Render thread. Hands the last `count` samples to `sink(const float*, int)` in order,
+     as one or two pieces straight out of the ring, and returns how many it had.
+     */
+    template <typename F>
+    int readLatest(int count, F&& sink) const {
+        const Range range = available();
+        count = (int)std::min<int64_t>(count, range.end - range.start);
+        if (count <= 0) {
+            return 0;
+        }
+        return read(range.end - count, count, sink);
+    }
+
+    /*
+     Any thread but the render thread. Copies [start, start + count) to `destination`.
+     Returns false if any of it wasn't available, or was overwritten during the copy.
+     */
+    bool copy(int64_t start, int count, float* destination) const {
+        std::lock_guard<std::mutex> lock(mAllocation);
+        const Range range = available();
+        if (count <= 0 || start < range.start || start + count > range.end) {
+            return false;
+        }
+        read(start, count, [&destination] (const float* samples, int length) {
+            std::memcpy(destination, samples, length * sizeof(float));
+            destination += length;
+        });
+        // Writes the copy may have raced with are only the ones published since; if they
+        // reached the range, the copy can't be trusted
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return mWritten.load(std::memory_order_relaxed) - mCapacity <= start;
+    }
+
+private:
+    template <typename F>
+    int read(int64_t position, int count, F&& sink) const {
+        const int start = int(position % mSize);
+        const int first = std::min(count, mSize - start);
+        sink(mSamples.data() + start, first);
+        if (count > first) {
+            sink(mSamples.data(), count - first);
+        }
+        return count;
+    }
+};
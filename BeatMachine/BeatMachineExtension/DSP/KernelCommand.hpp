@@ -0,0 +1,127 @@
+//
+//  KernelCommand.hpp
+//  BeatMachineExtension
+//
+
+#pragma once
+
+#include "StepSequencer.hpp"
+
+/*
+ KernelCommand
+ A structured request from the UI (or any other non-render thread) to the kernel. Every
+ command is the same fixed-size plain struct, so it can travel through the kernel's
+ lock-free command queue; only the fields for its type are read. Build commands with the
+ static functions below.
+ */
+struct KernelCommand {
+    enum class Type : uint8_t {
+        PadSetting,         // padSetting
+        SequencerEdit,      // sequencerEdit
+        ClearPad,           // note
+        ClearLoop,
+        SetLoopLength,      // loopBars
+        LoadPad,            // note, samples, length, sharedSamples
+        LoadLoop,           // samples, length
+        LoadImpulse         // samples, length, sampleRate
+    };
+
+    struct PadSetting {
+        enum class Kind : uint8_t {
+            Loop,
+            ChokeGroup,
+            RetriggerMode,
+            VoiceLimit,
+            ReverbSend
+        };
+        Kind kind = Kind::Loop;
+        int first = 0;      // loop start, choke group, mode, voice count or send percent
+        int second = 0;     // loop end
+    };
+
+    Type type = Type::ClearLoop;
+    int note = 0;
+    PadSetting padSetting;
+    StepSequencer::Edit sequencerEdit;
+    double loopBars = 0.0;
+    float* samples = nullptr;   // LoadPad: a new[]'d buffer of SoundBuffer::capacity floats, LoadLoop: of the
+                                // kernel's loopAllocation() floats; the kernel takes ownership
+    int length = 0;
+    bool sharedSamples = false; // LoadPad: samples come from the SampleCache; the kernel takes over one reference
+    uint32_t sampleRate = 0;    // LoadImpulse: the rate of samples, which always come from the SampleCache
+
+    // Whether `samples` belongs to the command, to be freed if it is never performed
+    bool carriesSamples() const {
+        return type == Type::LoadPad || type == Type::LoadLoop || type == Type::LoadImpulse;
+    }
+
+    static KernelCommand padSettingCommand(int note, PadSetting::Kind kind, int first, int second = 0) {
+        KernelCommand command;
+        command.type = Type::PadSetting;
+        command.note = note;
+        command.padSetting = { kind, first, second };
+        return command;
+    }
+
+    static KernelCommand sequencerEditCommand(const StepSequencer::Edit& edit) {
+        KernelCommand command;
+        command.type = Type::SequencerEdit;
+        command.sequencerEdit = edit;
+        return command;
+    }
+
+    static KernelCommand clearPadCommand(int note) {
+        KernelCommand command;
+        command.type = Type::ClearPad;
+        command.note = note;
+        return command;
+    }
+
+    static KernelCommand clearLoopCommand() {
+        KernelCommand command;
+        command.type = Type::ClearLoop;
+        return command;
+    }
+
+    static KernelCommand setLoopLengthCommand(double bars) {
+        KernelCommand command;
+        command.type = Type::SetLoopLength;
+        command.loopBars = bars;
+        return command;
+    }
+
+    static KernelCommand loadPadCommand(int note, float* samples, int length) {
+        KernelCommand command;
+        command.type = Type::LoadPad;
+        command.note = note;
+        command.samples = samples;
+        command.length = length;
+        return command;
+    }
+
+    // The pad never writes to a shared take, so the cast only lets it travel in `samples`
+    static KernelCommand loadSharedPadCommand(int note, const float* samples, int length) {
+        KernelCommand command = loadPadCommand(note, const_cast<float*>(samples), length);
+        command.sharedSamples = true;
+        return command;
+    }
+
+    static KernelCommand loadLoopCommand(float* samples, int length) {
+        KernelCommand command;
+        command.type = Type::LoadLoop;
+        command.samples = samples;
+        command.length = length;
+        return command;
+    }
+
+    // Takes over one SampleCache reference to `samples`, like loadSharedPadCommand
+    static KernelCommand loadImpulseCommand(const float* samples, int length, uint32_t sampleRate) {
+        KernelCommand command;
+        command.type = Type::LoadImpulse;
+        command.samples = const_cast<float*>(samples);
+        command.length = length;
+        command.sharedSamples = true;
+        command.sampleRate = sampleRate;
+        return command;
+    }
+};
@@ -0,0 +1,99 @@
+//
+//  LatencyProbe.hpp
+//  BeatMachineExtension
+//
+
+#pragma once
+
+#import <algorithm>
+#import <atomic>
+#include <cmath>
+
+/*
+ LatencyProbe
+ Measures the round trip from the unit's output back to its input: once armed, it adds a
+ short pulse to the output and counts samples until the input crosses `threshold`. With
+ the output looped back to the input (a cable, or a microphone in front of the speakers)
+ that count is how late input recorded along with the unit's output arrives. Any thread
+ arms the probe and reads the result; only the render thread runs it.
+ */
+class LatencyProbe {
+public:
+    static constexpr int pulseLength = 48;
+    static constexpr float pulseLevel = 0.5f;
+    static constexpr float threshold = 0.1f;
+    static constexpr double timeoutSeconds = 1.0;
+
+    // result() before a measurement has finished, and after one that heard nothing
+    static constexpr int pending = -1;
+    static constexpr int failed = -2;
+
+private:
+    std::atomic<bool> mArmed { false };
+    std::atomic<int> mResult { failed };
+    bool mRunning = false;
+    int mElapsed = 0;
+
+public:
+    // Any thread. Starts a measurement at the next render cycle.
+    void arm() {
+        mResult.store(pending, std::memory_order_relaxed);
+        mArmed.store(true, std::memory_order_release);
+    }
+
+    // Any thread. The round trip in samples, or pending / failed.
+    int result() const {
+        return mResult.load(std::memory_order_acquire);
+    }
+
+    // Render thread. Whether process() has anything to do this cycle.
+    bool isActive() const {
+        return mRunning || mArmed.load(std::memory_order_acquire);
+    }
+
+    // Render thread. Abandons a measurement, e.g. when the stream stops.
+    void cancel() {
+        if (mRunning || mArmed.exchange(false, std::memory_order_acquire)) {
+            mResult.store(failed, std::memory_order_release);
+        }
+        mRunning = false;
+    }
+
+    /*
+     Render thread. Adds the pulse to `output` and listens to `input`, which is null when no
+     input was pulled this cycle; the measurement fails rather than miss the pulse.
+     */
+    void process(const float* input, float* output, int frameCount, double sampleRate) {
+        if (mArmed.exchange(false, std::memory_order_acquire)) {
+            mRunning = true;
+            mElapsed = 0;
+        }
+        if (!mRunning) {
+            return;
+        }
+        if (input == nullptr) {
+            cancel();
+            return;
+        }
+        const int timeout = (int)std::lround(timeoutSeconds * sampleRate);
+        for (int frame = 0; frame < frameCount; ++frame, ++mElapsed) {
+            if (mElapsed < pulseLength) {
+                output[frame] += pulseLevel;
+            }
+            if (mElapsed > 0 && std::fabs(input[frame]) >= threshold) {
+                finish(mElapsed);
+                return;
+            }
+            if (mElapsed >= timeout) {
+                finish(failed);
+                return;
+            }
+        }
+    }
+
+private:
+    void finish(int result) {
+        mRunning = false;
+        mResult.store(result, std::memory_order_release);
+    }
+};
@@ -0,0 +1,35 @@
+//
+//  LevelMeter.hpp
+//  BeatMachineExtension
+//
+
+#pragma once
+
+#import <atomic>
+
+/*
+ LevelMeter
+ Peak and RMS of the last render cycle, published by the render thread with relaxed
+ atomic stores so any thread can read them without locking. Values are linear; the UI
+ applies its own ballistics and dB scaling.
+ */
+class LevelMeter {
+private:
+    std::atomic<float> mPeak { 0.0f };
+    std::atomic<float> mRMS { 0.0f };
+
+public:
+    // Render thread
+    void publish(float peak, float rms) {
+        mPeak.store(peak, std::memory_order_relaxed);
+        mRMS.store(rms, std::memory_order_relaxed);
+    }
+
+    float peak() const {
+        return mPeak.load(std::memory_order_relaxed);
+    }
+
+    float rms() const {
+        return mRMS.load(std::memory_order_relaxed);
+    }
+};
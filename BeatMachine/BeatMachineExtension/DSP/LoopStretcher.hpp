@@ -0,0 +1,358 @@
+//
+//  LoopStretcher.hpp
+//  BeatMachineExtension
+//
+
+#pragma once
+
+#import <AudioToolbox/AudioToolbox.h>
+#import <Accelerate/Accelerate.h>
+#import <algorithm>
+#import <atomic>
+#import <vector>
+#include <cmath>
+#include "SPSCQueue.hpp"
+
+/*
+ LoopStretcher
+ Phase-vocoder time stretch for the loop buffer, so the loop follows the host tempo
+ without changing pitch.
+
+ The loop is analysed off the render thread into a circular STFT (magnitude, phase and
+ per-bin phase advance for every analysis frame). Two analysis slots are kept; the
+ worker fills the one the render thread isn't reading and publishes it with a single
+ atomic store. At render time each synthesis hop only interpolates magnitudes, advances
+ phases, and runs one inverse FFT plus an overlap-add.
+
+ Analyses are numbered by the invalidate() they followed. A request made before the loop
+ last changed is dropped rather than published, and when a new analysis lands mid-stretch
+ the synthesis is restarted on it at the same place in the loop, since its frames need
+ not line up with the old one's.
+ */
+class LoopStretcher {
+public:
+    static const int fftLog2n = 10;
+    static const int fftSize = 1 << fftLog2n;
+    static constexpr int hopSize = fftSize / 4;
+    static const int binCount = fftSize / 2;
+    // Synthesis frames that must overlap before an output hop is complete
+    static const int prerollHops = fftSize / hopSize - 1;
+
+private:
+    struct Analysis {
+        int frameCount = 0;
+        int loopLength = 0;
+        double hop = hopSize;               // analysis hop in samples (loopLength / frameCount)
+        std::vector<float> magnitude;       // frameCount x binCount
+        std::vector<float> phase;
+        std::vector<float> phaseAdvance;    // unwrapped phase change from this frame to the next
+    };
+
+    struct Job {
+        const float* loop = nullptr;
+        int length = 0;
+        uint32_t generation = 0;
+    };
+
+    FFTSetup mFFTSetup = nullptr;
+    std::vector<float> mWindow;
+
+    // analysis, worker side
+    Analysis mAnalyses[2];
+    std::atomic<int> mPublished { -1 };
+    std::atomic<int> mInUse { -1 };
+    std::atomic<uint32_t> mGeneration { 0 };
+    SPSCQueue<Job, 8> mJobs;
+    Job mPendingJob;
+    bool mHasPendingJob = false;
+    std::atomic<bool> mAnalysisPending { false };
+    std::vector<float> mAnalysisFrame;
+    std::vector<float> mAnalysisReal;
+    std::vector<float> mAnalysisImag;
+
+    // synthesis, render side
+    int mSlot = -1;                         // the analysis the synthesis state belongs to
+    std::vector<float> mSynthesisPhase;
+    std::vector<float> mSynthesisMagnitude;
+    std::vector<float> mReal;
+    std::vector<float> mImag;
+    std::vector<float> mSin;
+    std::vector<float> mCos;
+    std::vector<float> mTwoPi;
+    std::vector<float> mFrame;
+    std::vector<float> mOverlap;
+    std::vector<float> mOutput;
+    int mOutputRead = hopSize;
+    double mFramePosition = 0.0;            // fractional analysis frame of the next synthesis hop
+    double mOutputPosition = 0.0;           // loop sample of the next output sample
+
+    static float principalArgument(float phase) {
+        return phase - 2.0f * float(M_PI) * std::round(phase / (2.0f * float(M_PI)));
+    }
+
+public:
+    ~LoopStretcher() {
+        if (mFFTSetup != nullptr) {
+            vDSP_destroy_fftsetup(mFFTSetup);
+        }
+    }
+
+    // Not realtime safe: allocates the fixed-size FFT buffers.
+    void prepare() {
+        if (mFFTSetup != nullptr) {
+            return;
+        }
+        mFFTSetup = vDSP_create_fftsetup(fftLog2n, kFFTRadix2);
+        mWindow.resize(fftSize);
+        vDSP_hann_window(mWindow.data(), fftSize, vDSP_HANN_DENORM);
+        mAnalysisFrame.resize(fftSize);
+        mAnalysisReal.resize(binCount);
+        mAnalysisImag.resize(binCount);
+        mSynthesisPhase.resize(binCount);
+        mSynthesisMagnitude.resize(binCount);
+        mReal.resize(binCount);
+        mImag.resize(binCount);
+        mSin.resize(binCount);
+        mCos.resize(binCount);
+        mTwoPi.assign(binCount, 2.0f * float(M_PI));
+        mFrame.resize(fftSize);
+        mOverlap.assign(fftSize, 0.0f);
+        mOutput.assign(hopSize, 0.0f);
+    }
+
+    // MARK: - Analysis
+
+    // Render thread. The loop must stay allocated; it may keep changing while analysed,
+    // in which case the caller simply asks again once it has settled.
+    void requestAnalysis(const float* loop, int length) {
+        if (mJobs.push({ loop, length, mGeneration.load(std::memory_order_relaxed) })) {
+            mAnalysisPending.store(true, std::memory_order_relaxed);
+        }
+    }
+
+    bool isAnalysisPending() const {
+        return mAnalysisPending.load(std::memory_order_relaxed);
+    }
+
+    // Render thread: true once some analysis of the loop has been published
+    bool isReady() const {
+        return mPublished.load(std::memory_order_acquire) >= 0;
+    }
+
+    // Render thread, or while rendering is stopped. Withdraws the published analysis and
+    // any still being made; the next one has to be requested after this.
+    void invalidate() {
+        mGeneration.fetch_add(1, std::memory_order_relaxed);
+        mPublished.store(-1);
+        mInUse.store(-1);
+        mSlot = -1;
+    }
+
+    // Background thread. Drops a pending analysis of `loop`, which is about to be freed.
+    void forget(const float* loop) {
+        if (mHasPendingJob && mPendingJob.loop == loop) {
+            mHasPendingJob = false;
+            mAnalysisPending.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    // Background thread
+    void poll() {
+        Job job;
+        while (mJobs.pop(job)) {
+            // only the latest request matters
+            mPendingJob = job;
+            mHasPendingJob = true;
+        }
+        if (mHasPendingJob && isStale(mPendingJob)) {
+            mHasPendingJob = false;
+            mAnalysisPending.store(false, std::memory_order_relaxed);
+        }
+        if (!mHasPendingJob || mFFTSetup == nullptr) {
+            return;
+        }
+
+        // Write into the slot that is neither published nor claimed by the render thread.
+        // If it still holds the other one, the previous publish hasn't been picked up yet;
+        // try again next tick.
+        const int published = mPublished.load();
+        const int inUse = mInUse.load();
+        const int target = published == 0 || (published < 0 && inUse == 0) ? 1 : 0;
+        if (inUse == target) {
+            return;
+        }
+        mHasPendingJob = false;
+        analyze(mPendingJob, mAnalyses[target]);
+        // the loop may have changed while it was analysed
+        if (!isStale(mPendingJob)) {
+            mPublished.store(target);
+        }
+        mAnalysisPending.store(false, std::memory_order_relaxed);
+    }
+
+private:
+    bool isStale(const Job& job) const {
+        return job.generation != mGeneration.load(std::memory_order_relaxed);
+    }
+
+    void analyze(const Job& job, Analysis& analysis) {
+        const int length = job.length;
+        analysis.loopLength = length;
+        analysis.frameCount = std::max(1, (int)std::lround(double(length) / hopSize));
+        analysis.hop = double(length) / analysis.frameCount;
+        analysis.magnitude.resize(size_t(analysis.frameCount) * binCount);
+        analysis.phase.resize(size_t(analysis.frameCount) * binCount);
+        analysis.phaseAdvance.resize(size_t(analysis.frameCount) * binCount);
+
+        DSPSplitComplex split { mAnalysisReal.data(), mAnalysisImag.data() };
+        for (int frame = 0; frame < analysis.frameCount; ++frame) {
+            // Frames wrap around the loop end, so the analysis is seamless across the loop point
+            const int start = (int)std::lround(frame * analysis.hop);
+            for (int i = 0; i < fftSize; ++i) {
+                mAnalysisFrame[i] = job.loop[(start + i) % length];
+            }
+            vDSP_vmul(mAnalysisFrame.data(), 1, mWindow.data(), 1, mAnalysisFrame.data(), 1, fftSize);
+            vDSP_ctoz(reinterpret_cast<const DSPComplex*>(mAnalysisFrame.data()), 2, &split, 1, binCount);
+            vDSP_fft_zrip(mFFTSetup, &split, 1, fftLog2n, kFFTDirection_Forward);
+            split.imagp[0] = 0.0f;  // drop the packed Nyquist bin
+            vDSP_zvabs(&split, 1, &analysis.magnitude[size_t(frame) * binCount], 1, binCount);
+            vDSP_zvphas(&split, 1, &analysis.phase[size_t(frame) * binCount], 1, binCount);
+        }
+
+        // Instantaneous phase advance per bin between neighbouring frames
+        for (int frame = 0; frame < analysis.frameCount; ++frame) {
+            const float* current = &analysis.phase[size_t(frame) * binCount];
+            const float* next = &analysis.phase[size_t((frame + 1) % analysis.frameCount) * binCount];
+            float* advance = &analysis.phaseAdvance[size_t(frame) * binCount];
+            for (int bin = 0; bin < binCount; ++bin) {
+                const float expected = 2.0f * float(M_PI) * bin * float(analysis.hop) / fftSize;
+                advance[bin] = expected + principalArgument(next[bin] - current[bin] - expected);
+            }
+        }
+    }
+
+    // MARK: - Synthesis
+public:
+    // Render thread. Restarts synthesis so that the next output sample is `loopSample`.
+    void seek(double loopSample) {
+        const int slot = claim();
+        if (slot >= 0) {
+            seek(slot, loopSample);
+        }
+    }
+
+    // Render thread. `speed` is host tempo / loop tempo.
+    void render(float* output, AUAudioFrameCount frameCount, double speed) {
+        const int slot = claim();
+        if (slot < 0) {
+            std::fill_n(output, frameCount, 0.0f);
+            return;
+        }
+        if (slot != mSlot) {
+            // A newer analysis, possibly of a shorter loop; carry on from the same place
+            seek(slot, std::fmod(mOutputPosition, double(mAnalyses[slot].loopLength)));
+        }
+        const Analysis& analysis = mAnalyses[slot];
+
+        AUAudioFrameCount written = 0;
+        while (written < frameCount) {
+            if (mOutputRead == hopSize) {
+                synthesizeHop(analysis, speed);
+                mOutputRead = 0;
+            }
+            const AUAudioFrameCount count = std::min<AUAudioFrameCount>(frameCount - written, hopSize - mOutputRead);
+            std::copy_n(mOutput.data() + mOutputRead, count, output + written);
+            mOutputRead += count;
+            written += count;
+        }
+        mOutputPosition = std::fmod(mOutputPosition + speed * frameCount, double(analysis.loopLength));
+    }
+
+    // Loop sample the next rendered sample corresponds to
+    double position() const {
+        return mOutputPosition;
+    }
+
+private:
+    // Claims the published slot, then makes sure it is still the published one, as in
+    // ConvolutionReverb::update(): the worker only writes a slot that is neither
+    int claim() {
+        int slot = mPublished.load();
+        int claimed = mInUse.load(std::memory_order_relaxed);
+        while (claimed != slot) {
+            mInUse.store(slot);
+            claimed = slot;
+            slot = mPublished.load();
+        }
+        if (slot < 0) {
+            mSlot = -1;
+        }
+        return slot;
+    }
+
+    void seek(int slot, double loopSample) {
+        mSlot = slot;
+        const Analysis& analysis = mAnalyses[slot];
+        mOutputPosition = loopSample;
+
+        // Start on a whole analysis frame so the initial phases match the magnitudes, run
+        // the frames that overlap the first output hop (their own output is incomplete),
+        // then skip forward to the exact sample.
+        const double prerollFrames = prerollHops * hopSize / analysis.hop;
+        const double firstFrame = std::floor(loopSample / analysis.hop - prerollFrames);
+        const double skip = loopSample - (firstFrame + prerollFrames) * analysis.hop;
+        mFramePosition = wrapFrame(firstFrame, analysis);
+        std::copy_n(&analysis.phase[size_t(mFramePosition) * binCount], binCount, mSynthesisPhase.begin());
+        std::fill(mOverlap.begin(), mOverlap.end(), 0.0f);
+
+        for (int hop = 0; hop < prerollHops; ++hop) {
+            synthesizeHop(analysis, 1.0);
+        }
+        synthesizeHop(analysis, 1.0);
+        mOutputRead = std::clamp((int)std::lround(skip), 0, hopSize);
+    }
+
+    static double wrapFrame(double frame, const Analysis& analysis) {
+        frame = std::fmod(frame, double(analysis.frameCount));
+        return frame < 0.0 ? frame + analysis.frameCount : frame;
+    }
+
+    void synthesizeHop(const Analysis& analysis, double speed) {
+        const int frame = (int)mFramePosition;
+        const int nextFrame = (frame + 1) % analysis.frameCount;
+        const float fraction = float(mFramePosition - frame);
+
+        // Interpolate magnitudes between the two nearest analysis frames
+        vDSP_vintb(&analysis.magnitude[size_t(frame) * binCount], 1,
+                   &analysis.magnitude[size_t(nextFrame) * binCount], 1,
+                   &fraction, mSynthesisMagnitude.data(), 1, binCount);
+
+        // Build the frame from the running phase, then advance it for the next hop. The
+        // advance is scaled from the analysis hop to the fixed synthesis hop.
+        const int count = binCount;
+        vvsincosf(mSin.data(), mCos.data(), mSynthesisPhase.data(), &count);
+        vDSP_vmul(mSynthesisMagnitude.data(), 1, mCos.data(), 1, mReal.data(), 1, binCount);
+        vDSP_vmul(mSynthesisMagnitude.data(), 1, mSin.data(), 1, mImag.data(), 1, binCount);
+        mImag[0] = 0.0f;
+
+        const float hopScale = float(hopSize / analysis.hop);
+        vDSP_vsma(&analysis.phaseAdvance[size_t(frame) * binCount], 1, &hopScale,
+                  mSynthesisPhase.data(), 1, mSynthesisPhase.data(), 1, binCount);
+        vvremainderf(mSynthesisPhase.data(), mSynthesisPhase.data(), mTwoPi.data(), &count);
+
+        DSPSplitComplex split { mReal.data(), mImag.data() };
+        vDSP_fft_zrip(mFFTSetup, &split, 1, fftLog2n, kFFTDirection_Inverse);
+        vDSP_ztoc(&split, 1, reinterpret_cast<DSPComplex*>(mFrame.data()), 2, binCount);
+
+        // vDSP's forward/inverse pair scales by 2N, and squared Hann windows at 75% overlap sum to 1.5
+        const float scale = 1.0f / (2.0f * fftSize * 1.5f);
+        vDSP_vmul(mFrame.data(), 1, mWindow.data(), 1, mFrame.data(), 1, fftSize);
+        vDSP_vsma(mFrame.data(), 1, &scale, mOverlap.data(), 1, mOverlap.data(), 1, fftSize);
+
+        std::copy_n(mOverlap.data(), hopSize, mOutput.data());
+        std::copy(mOverlap.begin() + hopSize, mOverlap.end(), mOverlap.begin());
+        std::fill(mOverlap.end() - hopSize, mOverlap.end(), 0.0f);
+
+        mFramePosition = wrapFrame(mFramePosition + speed * hopSize / analysis.hop, analysis);
+    }
+};
@@ -0,0 +1,73 @@
+//
+//  MPSCQueue.hpp
+//  BeatMachineExtension
+//
+
+#pragma once
+
+#import <array>
+#import <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ MPSCQueue
+ Fixed-capacity, lock-free multi-producer/single-consumer ring. Any number of threads may
+ push; only the render thread pops. Every slot carries a sequence number, so a producer
+ claims a slot with one compare-and-swap on the tail and publishes it by bumping the
+ slot's sequence; the consumer never waits on a producer that is halfway through a write,
+ it just sees the slot as not ready yet. Holds exactly Capacity items.
+ */
+template <typename T, size_t Capacity>
+class MPSCQueue {
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T item;
+    };
+    std::array<Cell, Capacity> mCells;
+    alignas(64) std::atomic<size_t> mTail { 0 };   // next position to claim, shared by producers
+    alignas(64) size_t mHead = 0;                   // next position to read, owned by the consumer
+
+public:
+    MPSCQueue() {
+        for (size_t i = 0; i < Capacity; ++i) {
+            mCells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Any thread. Returns false (and drops the item) when the queue is full.
+    bool push(const T& item) {
+        size_t position = mTail.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = mCells[position & (Capacity - 1)];
+            const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            const intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+            if (difference == 0) {
+                if (mTail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    cell.item = item;
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = mTail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Consumer side. Returns false when nothing is ready to read.
+    bool pop(T& item) {
+        Cell& cell = mCells[mHead & (Capacity - 1)];
+        if (cell.sequence.load(std::memory_order_acquire) != mHead + 1) {
+            return false;
+        }
+        item = cell.item;
+        cell.sequence.store(mHead + Capacity, std::memory_order_release);
+        ++mHead;
+        return true;
+    }
+};
@@ -0,0 +1,117 @@
+//
+//  MixKernels.hpp
+//  BeatMachineExtension
+//
+
+#pragma once
+
+#import <Accelerate/Accelerate.h>
+#import <algorithm>
+#include <cmath>
+#include <cstdint>
+
+/*
+ MixKernels
+ The block primitives the sampler mixes with. Each one is a thin wrapper over vDSP,
+ which already picks the widest vector unit the CPU has at runtime (NEON on Apple
+ silicon, SSE/AVX on Intel), so there is no ISA dispatch of our own to maintain.
+ MixKernels::Reference holds plain scalar versions with identical semantics, for
+ checking results against and for reading what each kernel does.
+ */
+namespace MixKernels {
+
+// dst[i] += src[i] * gain
+inline void accumulateWithGain(const float* src, float gain, float* dst, int count) {
+    vDSP_vsma(src, 1, &gain, dst, 1, dst, 1, count);
+}
+
+// dst[i] += src[i] * (startGain + i * gainStep). Returns the gain the next sample would get.
+inline float accumulateWithRamp(const float* src, float startGain, float gainStep, float* dst, int count) {
+    vDSP_vrampmuladd(src, 1, &startGain, &gainStep, dst, 1, count);
+    return startGain;
+}
+
+// dst[i] = src[i] * (startGain + i * gainStep). `dst` may be `src`. Returns the next gain.
+inline float gainRamp(const float* src, float startGain, float gainStep, float* dst, int count) {
+    vDSP_vrampmul(src, 1, &startGain, &gainStep, dst, 1, count);
+    return startGain;
+}
+
+// dst[i] = from[i] + (to[i] - from[i]) * (startMix + i * mixStep), as from[i] * (1 - mix)
+// + to[i] * mix. `dst` may be either input: that one is scaled in place first, and the
+// other added onto it.
+inline void crossfade(const float* from, const float* to, float startMix, float mixStep, float* dst, int count) {
+    float toGain = startMix;
+    float fromGain = 1.0f - startMix;
+    const float fromStep = -mixStep;
+    if (dst == to) {
+        vDSP_vrampmul(to, 1, &toGain, &mixStep, dst, 1, count);
+        vDSP_vrampmuladd(from, 1, &fromGain, &fromStep, dst, 1, count);
+    } else {
+        vDSP_vrampmul(from, 1, &fromGain, &fromStep, dst, 1, count);
+        vDSP_vrampmuladd(to, 1, &toGain, &mixStep, dst, 1, count);
+    }
+}
+
+// dst[i] = src[i] / 32768
+inline void int16ToFloat(const int16_t* src, float* dst, int count) {
+    const float scale = 1.0f / 32768.0f;
+    vDSP_vflt16(src, 1, dst, 1, count);
+    vDSP_vsmul(dst, 1, &scale, dst, 1, count);
+}
+
+// dst[i * dstStride] = round(clamp(src[i], -1, 1) * 32767). `scratch` must hold count samples.
+inline void floatToInt16(const float* src, int16_t* dst, int dstStride, float* scratch, int count) {
+    const float low = -1.0f;
+    const float high = 1.0f;
+    const float scale = 32767.0f;
+    vDSP_vclip(src, 1, &low, &high, scratch, 1, count);
+    vDSP_vsmul(scratch, 1, &scale, scratch, 1, count);
+    vDSP_vfixr16(scratch, 1, dst, dstStride, count);
+}
+
+namespace Reference {
+
+inline void accumulateWithGain(const float* src, float gain, float* dst, int count) {
+    for (int i = 0; i < count; ++i) {
+        dst[i] += src[i] * gain;
+    }
+}
+
+inline float accumulateWithRamp(const float* src, float startGain, float gainStep, float* dst, int count) {
+    for (int i = 0; i < count; ++i) {
+        dst[i] += src[i] * (startGain + i * gainStep);
+    }
+    return startGain + count * gainStep;
+}
+
+inline float gainRamp(const float* src, float startGain, float gainStep, float* dst, int count) {
+    for (int i = 0; i < count; ++i) {
+        dst[i] = src[i] * (startGain + i * gainStep);
+    }
+    return startGain + count * gainStep;
+}
+
+inline void crossfade(const float* from, const float* to, float startMix, float mixStep, float* dst, int count) {
+    for (int i = 0; i < count; ++i) {
+        const float mix = startMix + i * mixStep;
+        dst[i] = from[i] + (to[i] - from[i]) * mix;
+    }
+}
+
+inline void int16ToFloat(const int16_t* src, float* dst, int count) {
+    for (int i = 0; i < count; ++i) {
+        dst[i] = src[i] / 32768.0f;
+    }
+}
+
+// vDSP rounds halves to even, in the default rounding mode, as lrint does. Needs no scratch.
+inline void floatToInt16(const float* src, int16_t* dst, int dstStride, int count) {
+    for (int i = 0; i < count; ++i) {
+        dst[i * dstStride] = (int16_t)std::lrint(std::clamp(src[i], -1.0f, 1.0f) * 32767.0f);
+    }
+}
+
+} // namespace Reference
+
+} // namespace MixKernels
@@ -0,0 +1,99 @@
+//
+//  OfflineBounce.hpp
+//  BeatMachineExtension
+//
+
+#pragma once
+
+#import <AudioToolbox/AudioToolbox.h>
+#import <algorithm>
+#import <chrono>
+#import <vector>
+#include <cmath>
+#include <string>
+#include "BeatMachineExtensionAUProcessHelper.hpp"
+#include "WavWriter.hpp"
+
+/*
+ OfflineBounce
+ Renders the kernel straight to a WAV file as fast as the CPU allows. The kernel keeps its
+ own clock (see setOfflineClock), so the sequencer and the loop play as if a host were
+ rolling at the given tempo from beat 0, and it is driven through the same AUProcessHelper
+ as live rendering, in blocks of blockSize frames. The kernel must be prepared and must
+ not be rendering anywhere else while a bounce runs; it is left deinitialized afterwards.
+ */
+class OfflineBounce {
+public:
+    static constexpr AUAudioFrameCount blockSize = 4096;
+
+    struct Result {
+        bool succeeded = false;
+        AUAudioFrameCount frames = 0;
+        double audioSeconds = 0.0;
+        double renderSeconds = 0.0;     // wall-clock time spent rendering and writing
+
+        // How many times faster than real time the bounce ran
+        double realtimeMultiple() const {
+            return renderSeconds > 0.0 ? audioSeconds / renderSeconds : 0.0;
+        }
+    };
+
+    static Result render(BeatMachineExtensionDSPKernel& kernel, int channelCount, double sampleRate,
+                         double bpm, double bars, const std::string& path) {
+        Result result;
+        channelCount = std::max(channelCount, 1);
+        bpm = std::max(bpm, 1.0);
+        const auto start = std::chrono::steady_clock::now();
+
+        WavWriter writer;
+        if (!writer.open(path, channelCount, sampleRate)) {
+            return result;
+        }
+
+        const AUAudioFrameCount previousMaxFrames = kernel.maximumFramesToRender();
+        kernel.setMaximumFramesToRender(blockSize);
+        kernel.initialize(channelCount, channelCount, sampleRate);
+        kernel.setOfflineClock(bpm, 0);
+        AUProcessHelper helper(kernel, channelCount, channelCount);
+
+        // Silent input, one output buffer per channel
+        std::vector<float> input(size_t(blockSize) * channelCount, 0.0f);
+        std::vector<float> output(size_t(blockSize) * channelCount, 0.0f);
+        const size_t listSize = sizeof(AudioBufferList) + (channelCount - 1) * sizeof(AudioBuffer);
+        std::vector<uint8_t> inputListStorage(listSize);
+        std::vector<uint8_t> outputListStorage(listSize);
+        AudioBufferList* inputList = reinterpret_cast<AudioBufferList*>(inputListStorage.data());
+        AudioBufferList* outputList = reinterpret_cast<AudioBufferList*>(outputListStorage.data());
+        inputList->mNumberBuffers = channelCount;
+        outputList->mNumberBuffers = channelCount;
+        std::vector<const float*> channels(channelCount);
+        for (int channel = 0; channel < channelCount; ++channel) {
+            inputList->mBuffers[channel] = { 1, blockSize * (UInt32)sizeof(float), input.data() + size_t(channel) * blockSize };
+            outputList->mBuffers[channel] = { 1, blockSize * (UInt32)sizeof(float), output.data() + size_t(channel) * blockSize };
+            channels[channel] = output.data() + size_t(channel) * blockSize;
+        }
+
+        const double beatsPerBar = 4.0;
+        const AUAudioFrameCount totalFrames = (AUAudioFrameCount)std::lround(bars * beatsPerBar * 60.0 / bpm * sampleRate);
+        bool written = true;
+        AudioTimeStamp timestamp {};
+        for (AUAudioFrameCount done = 0; done < totalFrames && written; ) {
+            const AUAudioFrameCount frameCount = std::min(blockSize, totalFrames - done);
+            timestamp.mSampleTime = double(done);
+            helper.processWithEvents(inputList, outputList, &timestamp, frameCount, nullptr);
+            written = writer.write(channels.data(), (int)frameCount);
+            done += frameCount;
+        }
+        written = writer.close() && written;
+
+        kernel.setOfflineClock(0.0, 0);
+        kernel.deInitialize();
+        kernel.setMaximumFramesToRender(previousMaxFrames);
+
+        result.succeeded = written;
+        result.frames = totalFrames;
+        result.audioSeconds = double(totalFrames) / sampleRate;
+        result.renderSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return result;
+    }
+};
@@ -0,0 +1,234 @@
+//
+//  PadEffectChain.hpp
+//  BeatMachineExtension
+//
+
+#pragma once
+
+#import <AudioToolbox/AudioToolbox.h>
+#import <Accelerate/Accelerate.h>
+#import <algorithm>
+#import <vector>
+#include <cmath>
+#include "MixKernels.hpp"
+
+/*
+ PadEffectChain
+ Insert chain for the pad bus: state-variable lowpass -> soft-clip drive -> feed-forward compressor.
+ Everything works on whole blocks. Parameter targets are set from any thread and the chain
+ glides towards them once per block, so nothing here allocates after allocate() has run.
+ The filter and drive are switched in and out by crossfading from the dry signal rather
+ than at a threshold, since a lowpass or a soft clip is never quite transparent.
+ */
+class PadEffectChain {
+private:
+    double mSampleRate = 44100.0;
+
+    // targets, written by setParameter
+    float mCutoffTarget = 20000.0f;     // Hz
+    float mResonanceTarget = 0.707f;    // Q
+    float mDriveTarget = 0.0f;          // dB
+    float mThresholdTarget = 0.0f;      // dBFS
+    float mRatioTarget = 1.0f;          // n:1
+
+    // per-block smoothed values
+    float mCutoff = 20000.0f;
+    float mResonance = 0.707f;
+    float mDriveGain = 1.0f;
+    float mThreshold = 1.0f;            // linear
+    float mRatio = 1.0f;
+    float mFilterMix = 0.0f;            // 0 = dry, 1 = filtered
+    float mDriveMix = 0.0f;             // 0 = dry, 1 = saturated
+    float mSmoothing = 0.0f;            // one-pole coefficient applied once per block
+
+    // filter state (trapezoidal SVF integrators)
+    float mIc1eq = 0.0f;
+    float mIc2eq = 0.0f;
+
+    // compressor state
+    float mEnvelope = 0.0f;
+    float mAttackCoeff = 0.0f;
+    float mReleaseCoeff = 0.0f;
+
+    std::vector<float> mScratch;
+    std::vector<float> mGainCurve;
+
+    static float dbToGain(float db) {
+        return std::pow(10.0f, db / 20.0f);
+    }
+
+    // Move `current` a block's worth towards `target`, snapping once close enough
+    // so the bypass checks below can become true again.
+    float glide(float current, float target) const {
+        float next = current + (target - current) * mSmoothing;
+        return std::fabs(next - target) < 1e-4f * std::max(1.0f, std::fabs(target)) ? target : next;
+    }
+
+    // The cutoff at and above which the filter is switched out
+    float filterLimit() const {
+        return std::min(float(mSampleRate * 0.49), 20000.0f);
+    }
+
+    bool filterEnabled() const {
+        return mCutoffTarget < filterLimit();
+    }
+
+    bool driveEnabled() const {
+        return mDriveTarget != 0.0f;
+    }
+
+    // Ramps `samples` from `startMix` to `endMix` of the way to `wet` across the block,
+    // or takes `wet` as is while fully mixed in
+    static void mixIn(float* samples, const float* wet, float startMix, float endMix, AUAudioFrameCount frameCount) {
+        if (startMix == 1.0f && endMix == 1.0f) {
+            std::copy_n(wet, frameCount, samples);
+        } else {
+            MixKernels::crossfade(samples, wet, startMix, (endMix - startMix) / float(frameCount), samples, (int)frameCount);
+        }
+    }
+
+public:
+    void allocate(AUAudioFrameCount maxFrames, double sampleRate) {
+        mSampleRate = sampleRate;
+        mScratch.assign(maxFrames, 0.0f);
+        mGainCurve.assign(maxFrames, 0.0f);
+
+        // ~10 ms attack, ~120 ms release on the detector
+        mAttackCoeff = 1.0f - std::exp(-1.0f / float(0.010 * sampleRate));
+        mReleaseCoeff = 1.0f - std::exp(-1.0f / float(0.120 * sampleRate));
+        reset();
+    }
+
+    void reset() {
+        mIc1eq = mIc2eq = 0.0f;
+        mEnvelope = 0.0f;
+        mCutoff = mCutoffTarget;
+        mResonance = mResonanceTarget;
+        mDriveGain = dbToGain(mDriveTarget);
+        mThreshold = dbToGain(mThresholdTarget);
+        mRatio = mRatioTarget;
+        mFilterMix = filterEnabled() ? 1.0f : 0.0f;
+        mDriveMix = driveEnabled() ? 1.0f : 0.0f;
+    }
+
+    void setCutoff(float hz) { mCutoffTarget = hz; }
+    void setResonance(float q) { mResonanceTarget = std::max(q, 0.1f); }
+    void setDrive(float db) { mDriveTarget = db; }
+    void setThreshold(float db) { mThresholdTarget = db; }
+    void setRatio(float ratio) { mRatioTarget = std::max(ratio, 1.0f); }
+
+    float cutoff() const { return mCutoffTarget; }
+    float resonance() const { return mResonanceTarget; }
+    float drive() const { return mDriveTarget; }
+    float threshold() const { return mThresholdTarget; }
+    float ratio() const { return mRatioTarget; }
+
+    // Process `frameCount` samples of a mono bus in place.
+    void process(float* samples, AUAudioFrameCount frameCount) {
+        if (frameCount == 0) {
+            return;
+        }
+        frameCount = std::min<AUAudioFrameCount>(frameCount, (AUAudioFrameCount)mScratch.size());
+
+        // ~20 ms time constant regardless of block size
+        mSmoothing = 1.0f - std::exp(-float(frameCount) / float(0.020 * mSampleRate));
+
+        processFilter(samples, frameCount);
+        processDrive(samples, frameCount);
+        processCompressor(samples, frameCount);
+    }
+
+private:
+    void processFilter(float* samples, AUAudioFrameCount frameCount) {
+        mCutoff = glide(mCutoff, mCutoffTarget);
+        mResonance = glide(mResonance, mResonanceTarget);
+
+        // Opened all the way, the filter fades out rather than stopping mid-signal; its
+        // integrators are only cleared once nothing of it is heard
+        const float startMix = mFilterMix;
+        mFilterMix = glide(mFilterMix, filterEnabled() ? 1.0f : 0.0f);
+        if (startMix == 0.0f && mFilterMix == 0.0f) {
+            mIc1eq = mIc2eq = 0.0f;
+            return;
+        }
+
+        // Coefficients are computed once per block from the smoothed cutoff.
+        const float cutoff = std::clamp(mCutoff, 20.0f, filterLimit());
+        const float g = std::tan(float(M_PI) * cutoff / float(mSampleRate));
+        const float k = 1.0f / mResonance;
+        const float a1 = 1.0f / (1.0f + g * (g + k));
+        const float a2 = g * a1;
+        const float a3 = g * a2;
+
+        // The integrators carry state sample to sample, so this is the one scalar loop in the chain.
+        float* filtered = mScratch.data();
+        float ic1eq = mIc1eq;
+        float ic2eq = mIc2eq;
+        for (AUAudioFrameCount i = 0; i < frameCount; ++i) {
+            const float v3 = samples[i] - ic2eq;
+            const float v1 = a1 * ic1eq + a2 * v3;
+            const float v2 = ic2eq + a2 * ic1eq + a3 * v3;
+            ic1eq = 2.0f * v1 - ic1eq;
+            ic2eq = 2.0f * v2 - ic2eq;
+            filtered[i] = v2;
+        }
+        mIc1eq = ic1eq;
+        mIc2eq = ic2eq;
+        mixIn(samples, filtered, startMix, mFilterMix, frameCount);
+    }
+
+    void processDrive(float* samples, AUAudioFrameCount frameCount) {
+        // Any drive but 0 dB fades the saturated signal in, and 0 dB fades it back out,
+        // so loud pad sums don't start or stop clipping from one block to the next
+        const float targetGain = dbToGain(mDriveTarget);
+        const float startMix = mDriveMix;
+        mDriveMix = glide(mDriveMix, driveEnabled() ? 1.0f : 0.0f);
+        if (startMix == 0.0f && mDriveMix == 0.0f) {
+            mDriveGain = targetGain;
+            return;
+        }
+
+        // Ramp the pre-gain across the block, then saturate the whole block at once.
+        float* driven = mScratch.data();
+        float start = mDriveGain;
+        mDriveGain = glide(mDriveGain, targetGain);
+        const float step = (mDriveGain - start) / float(frameCount);
+        vDSP_vrampmul(samples, 1, &start, &step, driven, 1, frameCount);
+
+        const int count = (int)frameCount;
+        vvtanhf(driven, driven, &count);
+        mixIn(samples, driven, startMix, mDriveMix, frameCount);
+    }
+
+    void processCompressor(float* samples, AUAudioFrameCount frameCount) {
+        mThreshold = glide(mThreshold, dbToGain(mThresholdTarget));
+        mRatio = glide(mRatio, mRatioTarget);
+        if (mRatio <= 1.0f) {
+            mEnvelope = 0.0f;
+            return;
+        }
+
+        // Peak detector; one-pole attack/release is inherently sequential.
+        float envelope = mEnvelope;
+        float* detector = mScratch.data();
+        vDSP_vabs(samples, 1, detector, 1, frameCount);
+        for (AUAudioFrameCount i = 0; i < frameCount; ++i) {
+            const float coeff = detector[i] > envelope ? mAttackCoeff : mReleaseCoeff;
+            envelope += (detector[i] - envelope) * coeff;
+            detector[i] = envelope;
+        }
+        mEnvelope = envelope;
+
+        // gain = (max(env, threshold) / threshold) ^ -(1 - 1/ratio), evaluated as exp(k * log(x)).
+        float* gain = mGainCurve.data();
+        const int count = (int)frameCount;
+        const float inverseThreshold = 1.0f / mThreshold;
+        const float exponent = -(1.0f - 1.0f / mRatio);
+        vDSP_vthres(detector, 1, &mThreshold, gain, 1, frameCount);
+        vDSP_vsmul(gain, 1, &inverseThreshold, gain, 1, frameCount);
+        vvlogf(gain, gain, &count);
+        vDSP_vsmul(gain, 1, &exponent, gain, 1, frameCount);
+        vvexpf(gain, gain, &count);
+        vDSP_vmul(samples, 1, gain, 1, samples, 1, frameCount);
+    }
+};
@@ -0,0 +1,319 @@
+//
+//  PadVoice.hpp
+//  BeatMachineExtension
+//
+
+#pragma once
+
+#import <Accelerate/Accelerate.h>
+#import <algorithm>
+#include <cmath>
+#include "CrossfadeTable.hpp"
+#include "MixKernels.hpp"
+
+/*
+ PadVoice
+ One playhead over a region of recorded audio. A voice fades in when it starts, can loop
+ between two points with an equal-power crossfade across the seam, and fades out when
+ released or cut off. render() works a block at a time: it splits the block where the
+ playhead crosses a region boundary and runs vector operations inside each piece, so
+ there is no per-sample branching.
+
+ Per-note expression (MIDI 2.0 pitch bend, volume, brightness) arrives as targets that
+ the voice glides towards once per block. The first bend switches the voice to reading
+ through a linear interpolator, which it keeps until it stops. The reverb send level
+ glides the same way.
+ */
+class PadVoice {
+private:
+    const float* mData = nullptr;
+    int mLength = 0;
+    int mIndex = 0;
+    int mLoopStart = 0;
+    int mLoopEnd = 0;
+    bool mLooping = false;
+    int mFadeInIndex = 0;       // position in the fade-in curve; done once it reaches the table length
+    int mReleaseIndex = -1;     // position in the fade-out curve, -1 until released
+    float mGain = 1.0f;
+    bool mActive = false;
+
+    // expression: playback rate, a gain on top of mGain and a one-pole lowpass coefficient
+    // (1 = open), each with the target it glides to
+    float mRate = 1.0f;
+    float mTargetRate = 1.0f;
+    float mExpressionGain = 1.0f;
+    float mTargetExpressionGain = 1.0f;
+    float mLowpass = 1.0f;
+    float mTargetLowpass = 1.0f;
+    float mLowpassState = 0.0f;
+    float mSend = 0.0f;         // how much of the voice goes to the reverb send
+    float mTargetSend = 0.0f;
+    bool mResampling = false;
+    bool mPrimedCarry = false;
+    double mPhase = 0.0;        // playhead position past mCarry[0], in source samples
+    float mCarry[2] = {};       // the two source samples around the playhead
+
+    // what the last render() added, for metering
+    float mLastPeak = 0.0f;
+    float mLastMeanSquare = 0.0f;
+
+public:
+    // Bends play the take at most this much faster
+    static constexpr float maximumRate = 2.0f;
+
+    // Scratch render() needs for a block of frameCount
+    static int scratchLength(int frameCount) {
+        return frameCount * 2 + int(std::ceil(frameCount * maximumRate)) + 2;
+    }
+
+    /*
+     Starts playing `length` samples of `data` from the top. A loop is only kept if it
+     leaves room for a full crossfade: loopStart must be at least one table length into the
+     region, and the loop at least two table lengths long. Otherwise the voice plays once.
+     */
+    void start(const float* data, int length, float gain, int loopStart, int loopEnd, const CrossfadeTable& table) {
+        const int fadeLength = table.length();
+        mData = data;
+        mLength = std::max(length, 0);
+        mIndex = 0;
+        mGain = gain;
+        mLoopStart = loopStart;
+        mLoopEnd = std::min(loopEnd, mLength);
+        mLooping = mLoopStart >= fadeLength && mLoopEnd - mLoopStart >= 2 * fadeLength;
+        mFadeInIndex = 0;
+        mReleaseIndex = -1;
+        mActive = data != nullptr && mLength > 0;
+        mLowpassState = 0.0f;
+        mResampling = false;
+        mPrimedCarry = false;
+        mPhase = 0.0;
+        setExpression(1.0f, 1.0f, 1.0f, true);
+    }
+
+    // Sets the targets render() glides to; `immediately` jumps there, e.g. right after start()
+    void setExpression(float rate, float gain, float lowpass, bool immediately = false) {
+        mTargetRate = std::clamp(rate, 1.0f / maximumRate, maximumRate);
+        mTargetExpressionGain = gain;
+        mTargetLowpass = std::clamp(lowpass, 0.0f, 1.0f);
+        if (immediately) {
+            mRate = mTargetRate;
+            mExpressionGain = mTargetExpressionGain;
+            mLowpass = mTargetLowpass;
+        }
+    }
+
+    void setSend(float level, bool immediately = false) {
+        mTargetSend = std::max(level, 0.0f);
+        if (immediately) {
+            mSend = mTargetSend;
+        }
+    }
+
+    // Fades out over one table length, then stops
+    void release() {
+        if (mActive && mReleaseIndex < 0) {
+            mReleaseIndex = 0;
+        }
+    }
+
+    void stop() {
+        mActive = false;
+    }
+
+    bool isActive() const {
+        return mActive;
+    }
+
+    bool isReleased() const {
+        return mReleaseIndex >= 0;
+    }
+
+    // Whether this voice plays from memory in [begin, end)
+    bool reads(const float* begin, const float* end) const {
+        return mActive && mData >= begin && mData < end;
+    }
+
+    bool isLooping() const {
+        return mLooping;
+    }
+
+    void setGain(float gain) {
+        mGain = gain;
+    }
+
+    // Peak and mean square of what the last render() added to the bus
+    float lastPeak() const {
+        return mLastPeak;
+    }
+
+    float lastMeanSquare() const {
+        return mLastMeanSquare;
+    }
+
+    /*
+     Adds the next `frameCount` samples into `bus`, and at the send level into `send` unless
+     that is null. `scratch` must hold scratchLength(frameCount) samples. `glide` is how far
+     expression moves towards its targets in this block, 0...1.
+     */
+    void render(float* bus, float* send, int frameCount, float* scratch, const CrossfadeTable& table, float glide) {
+        if (!mActive) {
+            return;
+        }
+        const int fadeLength = table.length();
+        const float startGain = mGain * mExpressionGain;
+        const float startSend = mSend;
+        mRate = approach(mRate, mTargetRate, glide);
+        mSend = approach(mSend, mTargetSend, glide);
+        mExpressionGain = approach(mExpressionGain, mTargetExpressionGain, glide);
+        mLowpass = approach(mLowpass, mTargetLowpass, glide);
+        mResampling = mResampling || mRate != 1.0f;
+
+        const int produced = mResampling ? readResampled(scratch, frameCount, scratch + frameCount, table)
+                                         : readSource(scratch, frameCount, table);
+        if (produced < frameCount) {
+            vDSP_vclr(scratch + produced, 1, frameCount - produced);
+        }
+
+        if (mFadeInIndex < fadeLength) {
+            const int count = std::min(produced, fadeLength - mFadeInIndex);
+            vDSP_vmul(scratch, 1, table.fadeIn() + mFadeInIndex, 1, scratch, 1, count);
+            mFadeInIndex += count;
+        }
+
+        int audible = produced;
+        if (mReleaseIndex >= 0) {
+            audible = std::min(produced, fadeLength - mReleaseIndex);
+            vDSP_vmul(scratch, 1, table.fadeOut() + mReleaseIndex, 1, scratch, 1, audible);
+            mReleaseIndex += audible;
+            if (mReleaseIndex >= fadeLength) {
+                mActive = false;
+            }
+        }
+
+        if (mLowpass < 1.0f) {
+            // one pole: y += a * (x - y)
+            float state = mLowpassState;
+            for (int i = 0; i < audible; ++i) {
+                state += mLowpass * (scratch[i] - state);
+                scratch[i] = state;
+            }
+            mLowpassState = state;
+        }
+
+        const float endGain = mGain * mExpressionGain;
+        mLastPeak = 0.0f;
+        mLastMeanSquare = 0.0f;
+        if (audible > 0) {
+            vDSP_maxmgv(scratch, 1, &mLastPeak, audible);
+            vDSP_measqv(scratch, 1, &mLastMeanSquare, audible);
+            mLastPeak *= std::max(std::fabs(startGain), std::fabs(endGain));
+            mLastMeanSquare *= endGain * endGain * float(audible) / float(frameCount);
+        }
+        if (endGain == startGain || audible == 0) {
+            MixKernels::accumulateWithGain(scratch, endGain, bus, audible);
+        } else {
+            MixKernels::accumulateWithRamp(scratch, startGain, (endGain - startGain) / audible, bus, audible);
+        }
+        if (send != nullptr && (startSend > 0.0f || mSend > 0.0f) && audible > 0) {
+            const float startSendGain = startGain * startSend;
+            const float endSendGain = endGain * mSend;
+            MixKernels::accumulateWithRamp(scratch, startSendGain, (endSendGain - startSendGain) / audible, send, audible);
+        }
+        if (produced < frameCount) {
+            mActive = false;
+        }
+    }
+
+private:
+    static float approach(float value, float target, float glide) {
+        value += (target - value) * glide;
+        return std::fabs(target - value) < 1e-5f ? target : value;
+    }
+
+    /*
+     Plays the region at mRate. Source samples come from readSource, so loop seams are
+     crossfaded exactly as at the original pitch; the two samples around the playhead carry
+     over between blocks. `work` holds the output positions followed by the source samples.
+     Returns how many output samples still lie within the region.
+     */
+    int readResampled(float* output, int frameCount, float* work, const CrossfadeTable& table) {
+        float* positions = work;
+        float* source = work + frameCount;
+        int available = 2;
+        if (!mPrimedCarry) {
+            // first block through the interpolator: the playhead sits on the next unread sample
+            available = readSource(mCarry, 2, table);
+            std::fill(mCarry + available, mCarry + 2, 0.0f);
+            mPhase = 0.0;
+            mPrimedCarry = true;
+        }
+
+        const double end = mPhase + double(frameCount) * mRate;
+        const int advance = (int)end;
+        source[0] = mCarry[0];
+        source[1] = mCarry[1];
+        const int read = readSource(source + 2, advance, table);
+        if (read < advance) {
+            vDSP_vclr(source + 2 + read, 1, advance - read);
+        }
+
+        const float start = (float)mPhase;
+        const float step = mRate;
+        vDSP_vramp(&start, &step, positions, 1, frameCount);
+        vDSP_vlint(source, positions, 1, output, 1, frameCount, advance + 2);
+
+        mCarry[0] = source[advance];
+        mCarry[1] = source[advance + 1];
+        const double startPhase = mPhase;
+        mPhase = end - advance;
+
+        // A one-shot ran out: only positions before the last real sample count
+        const int valid = std::min(available, 2) + read - 1;
+        if (read < advance || available < 2) {
+            return std::clamp((int)std::ceil((valid - startPhase) / mRate), 0, frameCount);
+        }
+        return frameCount;
+    }
+
+    // Copies the region into `output`, crossfading across the loop seam. Returns how many
+    // samples were available before a one-shot region ran out.
+    int readSource(float* output, int frameCount, const CrossfadeTable& table) {
+        const int fadeLength = table.length();
+        int produced = 0;
+        while (produced < frameCount) {
+            const int remaining = frameCount - produced;
+            if (!mLooping) {
+                const int count = std::min(remaining, mLength - mIndex);
+                if (count <= 0) {
+                    break;
+                }
+                std::copy_n(mData + mIndex, count, output + produced);
+                mIndex += count;
+                produced += count;
+                continue;
+            }
+
+            // The last fadeLength samples before loopEnd fade out while the same stretch
+            // leading up to loopStart fades in, so the jump back lands on matching audio.
+            const int seamStart = mLoopEnd - fadeLength;
+            if (mIndex < seamStart) {
+                const int count = std::min(remaining, seamStart - mIndex);
+                std::copy_n(mData + mIndex, count, output + produced);
+                mIndex += count;
+                produced += count;
+            } else {
+                const int k = mIndex - seamStart;
+                const int count = std::min(remaining, fadeLength - k);
+                float* out = output + produced;
+                vDSP_vmul(mData + mIndex, 1, table.fadeOut() + k, 1, out, 1, count);
+                vDSP_vma(mData + mLoopStart - fadeLength + k, 1, table.fadeIn() + k, 1, out, 1, out, 1, count);
+                mIndex += count;
+                produced += count;
+                if (mIndex >= mLoopEnd) {
+                    mIndex = mLoopStart;
+                }
+            }
+        }
+        return produced;
+    }
+};
@@ -0,0 +1,114 @@
+//
+//  RenderLoad.hpp
+//  BeatMachineExtension
+//
+
+#pragma once
+
+#import <algorithm>
+#import <atomic>
+#import <chrono>
+#include <cstdint>
+
+/*
+ RenderLoad
+ How much of each render cycle's real-time budget the kernel spends. A cycle's load is the
+ wall time it took over the duration of the audio it rendered, so 1.0 means it took as long
+ as it plays for and anything above is a dropout waiting to happen. The render thread
+ measures with the steady clock and publishes through relaxed atomics; any thread can read
+ a Snapshot or request a reset, which the render thread applies at the start of its next
+ cycle so the statistics only ever have one writer.
+ */
+class RenderLoad {
+public:
+    struct Snapshot {
+        uint64_t cycles = 0;
+        uint64_t overloads = 0;         // cycles that took longer than the audio they rendered
+        double averageLoad = 0.0;       // smoothed over roughly smoothingCycles cycles
+        double peakLoad = 0.0;
+        double worstCycleSeconds = 0.0;
+        double renderSeconds = 0.0;     // wall time spent in render cycles
+        double audioSeconds = 0.0;      // audio those cycles produced
+
+        // Load over everything measured since the last reset
+        double meanLoad() const {
+            return audioSeconds > 0.0 ? renderSeconds / audioSeconds : 0.0;
+        }
+    };
+
+    static constexpr double smoothingCycles = 64.0;
+
+private:
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point mCycleStart;
+    std::atomic<bool> mResetRequested { false };
+
+    std::atomic<uint64_t> mCycles { 0 };
+    std::atomic<uint64_t> mOverloads { 0 };
+    std::atomic<double> mAverageLoad { 0.0 };
+    std::atomic<double> mPeakLoad { 0.0 };
+    std::atomic<double> mWorstCycleSeconds { 0.0 };
+    std::atomic<double> mRenderSeconds { 0.0 };
+    std::atomic<double> mAudioSeconds { 0.0 };
+
+public:
+    // Render thread, first thing in a cycle
+    void begin() {
+        if (mResetRequested.exchange(false, std::memory_order_acquire)) {
+            clear();
+        }
+        mCycleStart = Clock::now();
+    }
+
+    // Render thread, last thing in a cycle that rendered `frameCount` frames
+    void end(uint32_t frameCount, double sampleRate) {
+        const double seconds = std::chrono::duration<double>(Clock::now() - mCycleStart).count();
+        const double budget = sampleRate > 0.0 ? frameCount / sampleRate : 0.0;
+        if (budget <= 0.0) {
+            return;
+        }
+        const double load = seconds / budget;
+        const uint64_t cycles = mCycles.load(std::memory_order_relaxed) + 1;
+        const double average = mAverageLoad.load(std::memory_order_relaxed);
+        const double weight = std::max(1.0 / smoothingCycles, 1.0 / double(cycles));
+
+        mCycles.store(cycles, std::memory_order_relaxed);
+        if (load > 1.0) {
+            mOverloads.store(mOverloads.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+        mAverageLoad.store(average + (load - average) * weight, std::memory_order_relaxed);
+        mPeakLoad.store(std::max(mPeakLoad.load(std::memory_order_relaxed), load), std::memory_order_relaxed);
+        mWorstCycleSeconds.store(std::max(mWorstCycleSeconds.load(std::memory_order_relaxed), seconds), std::memory_order_relaxed);
+        mRenderSeconds.store(mRenderSeconds.load(std::memory_order_relaxed) + seconds, std::memory_order_relaxed);
+        mAudioSeconds.store(mAudioSeconds.load(std::memory_order_relaxed) + budget, std::memory_order_relaxed);
+    }
+
+    // Any thread. Takes effect at the start of the next render cycle.
+    void requestReset() {
+        mResetRequested.store(true, std::memory_order_release);
+    }
+
+    // Any thread. Fields are read one by one, so a snapshot taken mid-cycle may mix two cycles.
+    Snapshot snapshot() const {
+        Snapshot snapshot;
+        snapshot.cycles = mCycles.load(std::memory_order_relaxed);
+        snapshot.overloads = mOverloads.load(std::memory_order_relaxed);
+        snapshot.averageLoad = mAverageLoad.load(std::memory_order_relaxed);
+        snapshot.peakLoad = mPeakLoad.load(std::memory_order_relaxed);
+        snapshot.worstCycleSeconds = mWorstCycleSeconds.load(std::memory_order_relaxed);
+        snapshot.renderSeconds = mRenderSeconds.load(std::memory_order_relaxed);
+        snapshot.audioSeconds = mAudioSeconds.load(std::memory_order_relaxed);
+        return snapshot;
+    }
+
+private:
+    void clear() {
+        mCycles.store(0, std::memory_order_relaxed);
+        mOverloads.store(0, std::memory_order_relaxed);
+        mAverageLoad.store(0.0, std::memory_order_relaxed);
+        mPeakLoad.store(0.0, std::memory_order_relaxed);
+        mWorstCycleSeconds.store(0.0, std::memory_order_relaxed);
+        mRenderSeconds.store(0.0, std::memory_order_relaxed);
+        mAudioSeconds.store(0.0, std::memory_order_relaxed);
+    }
+};
@@ -0,0 +1,54 @@
+//
+//  SPSCQueue.hpp
+//  BeatMachineExtension
+//
+
+#pragma once
+
+#import <array>
+#import <atomic>
+#include <cstddef>
+
+/*
+ SPSCQueue
+ Fixed-capacity, wait-free single-producer/single-consumer ring. Used to pass plain
+ message structs between the render thread and a background thread without locks or
+ allocation. One slot is kept empty to tell full from empty, so it holds Capacity - 1 items.
+ */
+template <typename T, size_t Capacity>
+class SPSCQueue {
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+private:
+    std::array<T, Capacity> mSlots;
+    alignas(64) std::atomic<size_t> mHead { 0 };   // next slot to read, owned by the consumer
+    alignas(64) std::atomic<size_t> mTail { 0 };   // next slot to write, owned by the producer
+
+public:
+    // Producer side. Returns false (and drops the item) when the queue is full.
+    bool push(const T& item) {
+        const size_t tail = mTail.load(std::memory_order_relaxed);
+        const size_t next = (tail + 1) & (Capacity - 1);
+        if (next == mHead.load(std::memory_order_acquire)) {
+            return false;
+        }
+        mSlots[tail] = item;
+        mTail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Returns false when there is nothing to read.
+    bool pop(T& item) {
+        const size_t head = mHead.load(std::memory_order_relaxed);
+        if (head == mTail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = mSlots[head];
+        mHead.store((head + 1) & (Capacity - 1), std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return mHead.load(std::memory_order_acquire) == mTail.load(std::memory_order_acquire);
+    }
+};
@@ -32,7 +32,7 @@ public:
         AudioBuffer& buffer = bufferList->mBuffers[0];
         buffer.mNumberChannels = 1;
         buffer.mDataByteSize = 1024 * sizeof(float);
-        buffer.mData = new float[441000];
+        buffer.mData = new float[441000]();
 
         sampleIndex = 0;
         playIndex = 0;
@@ -0,0 +1,243 @@
+//
+//  SampleCache.hpp
+//  BeatMachineExtension
+//
+
+#pragma once
+
+#import <algorithm>
+#import <mutex>
+#import <vector>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <sys/stat.h>
+#include "WavUtil.hpp"
+
+/*
+ SampleCache
+ Process-wide store of read-only sample data shared by every kernel instance. Samples are
+ keyed by a hash of their content, so the same kit loaded by several instances, or the same
+ file under two names, is held once. Every acquire() takes a reference that release() must
+ give back; an entry nobody references stays resident for the next load until the cache is
+ over its budget, when the least recently used unreferenced entries are evicted. Entries
+ still referenced are never evicted, so the budget can be exceeded while they are in use.
+ Shared samples must never be written to: a pad that records over one swaps in a private
+ buffer first. All methods lock, so none of them may be called from the render thread.
+ */
+class SampleCache {
+public:
+    struct Sample {
+        const float* samples = nullptr;
+        int length = 0;
+        uint32_t sampleRate = 0;
+    };
+
+    struct Statistics {
+        size_t entries = 0;
+        size_t residentBytes = 0;       // everything the cache holds
+        size_t referencedBytes = 0;     // entries at least one pad or instance is using
+        size_t deduplicatedBytes = 0;   // what private copies of referenced entries would add
+        size_t budgetBytes = 0;
+        size_t evictions = 0;
+    };
+
+    static const size_t defaultBudgetBytes = 256 * 1024 * 1024;
+
+private:
+    struct Entry {
+        uint64_t hash = 0;
+        std::vector<float> samples;
+        uint32_t sampleRate = 0;
+        int references = 0;
+        uint64_t lastUse = 0;
+    };
+
+    // Remembers which entry a file decoded to, so an unchanged file isn't read twice
+    struct FileKey {
+        off_t size = 0;
+        time_t modified = 0;
+        const float* samples = nullptr;
+    };
+
+    std::unordered_multimap<uint64_t, Entry*> mEntries;
+    std::unordered_map<const float*, Entry*> mBySamples;
+    std::unordered_map<std::string, FileKey> mFiles;
+    size_t mBudgetBytes = defaultBudgetBytes;
+    size_t mResidentBytes = 0;
+    size_t mEvictions = 0;
+    uint64_t mUseCounter = 0;
+    mutable std::mutex mMutex;
+
+    SampleCache() = default;
+
+public:
+    SampleCache(const SampleCache&) = delete;
+    SampleCache& operator=(const SampleCache&) = delete;
+
+    ~SampleCache() {
+        for (auto& [hash, entry] : mEntries) {
+            delete entry;
+        }
+    }
+
+    static SampleCache& shared() {
+        static SampleCache cache;
+        return cache;
+    }
+
+    // Returns a shared copy of `length` samples, storing them if no entry holds the same data
+    Sample acquire(const float* samples, int length, uint32_t sampleRate) {
+        if (length <= 0) {
+            return {};
+        }
+        std::lock_guard<std::mutex> lock(mMutex);
+        return acquireLocked(samples, length, sampleRate);
+    }
+
+    // Reads a WAV file through the cache. An empty Sample means the file couldn't be read.
+    Sample acquireFile(const std::string& path) {
+        struct stat info {};
+        if (stat(path.c_str(), &info) != 0) {
+            return {};
+        }
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            auto file = mFiles.find(path);
+            if (file != mFiles.end() && file->second.size == info.st_size && file->second.modified == info.st_mtime) {
+                auto found = mBySamples.find(file->second.samples);
+                if (found != mBySamples.end()) {
+                    return reference(*found->second);
+                }
+            }
+        }
+
+        // Decode without holding the lock; another thread may add the same data meanwhile,
+        // which the content hash then folds into one entry
+        uint32_t sampleRate = 0;
+        const std::vector<float> decoded = load_wav_file(path, &sampleRate);
+        if (decoded.empty()) {
+            return {};
+        }
+        std::lock_guard<std::mutex> lock(mMutex);
+        const Sample sample = acquireLocked(decoded.data(), (int)decoded.size(), sampleRate);
+        mFiles[path] = { info.st_size, info.st_mtime, sample.samples };
+        return sample;
+    }
+
+    // Takes another reference to samples from an earlier acquire, without hashing them again.
+    // An empty Sample means `samples` doesn't belong to the cache.
+    Sample retain(const float* samples) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto found = mBySamples.find(samples);
+        if (found == mBySamples.end()) {
+            return {};
+        }
+        return reference(*found->second);
+    }
+
+    // Gives back a reference. Returns false if `samples` doesn't belong to the cache.
+    bool release(const float* samples) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto found = mBySamples.find(samples);
+        if (found == mBySamples.end()) {
+            return false;
+        }
+        Entry& entry = *found->second;
+        entry.references = std::max(entry.references - 1, 0);
+        evictOverBudget();
+        return true;
+    }
+
+    void setBudget(size_t bytes) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mBudgetBytes = bytes;
+        evictOverBudget();
+    }
+
+    Statistics statistics() const {
+        std::lock_guard<std::mutex> lock(mMutex);
+        Statistics statistics;
+        statistics.entries = mEntries.size();
+        statistics.residentBytes = mResidentBytes;
+        statistics.budgetBytes = mBudgetBytes;
+        statistics.evictions = mEvictions;
+        for (const auto& [hash, entry] : mEntries) {
+            if (entry->references > 0) {
+                const size_t bytes = byteSize(*entry);
+                statistics.referencedBytes += bytes;
+                statistics.deduplicatedBytes += bytes * (entry->references - 1);
+            }
+        }
+        return statistics;
+    }
+
+private:
+    static uint64_t contentHash(const float* samples, int length, uint32_t sampleRate) {
+        // FNV-1a over the raw sample words
+        uint64_t hash = 14695981039346656037ull ^ sampleRate;
+        for (int i = 0; i < length; ++i) {
+            uint32_t word;
+            std::memcpy(&word, samples + i, sizeof(word));
+            hash = (hash ^ word) * 1099511628211ull;
+        }
+        return hash ^ (uint64_t)length;
+    }
+
+    static size_t byteSize(const Entry& entry) {
+        return entry.samples.size() * sizeof(float);
+    }
+
+    Sample reference(Entry& entry) {
+        entry.references += 1;
+        entry.lastUse = ++mUseCounter;
+        return { entry.samples.data(), (int)entry.samples.size(), entry.sampleRate };
+    }
+
+    Sample acquireLocked(const float* samples, int length, uint32_t sampleRate) {
+        const uint64_t hash = contentHash(samples, length, sampleRate);
+        auto [first, last] = mEntries.equal_range(hash);
+        for (auto it = first; it != last; ++it) {
+            Entry& entry = *it->second;
+            if (entry.sampleRate == sampleRate && (int)entry.samples.size() == length &&
+                std::memcmp(samples, entry.samples.data(), size_t(length) * sizeof(float)) == 0) {
+                return reference(entry);
+            }
+        }
+
+        Entry* entry = new Entry;
+        entry->hash = hash;
+        entry->samples.assign(samples, samples + length);
+        entry->sampleRate = sampleRate;
+        mEntries.emplace(hash, entry);
+        mBySamples[entry->samples.data()] = entry;
+        mResidentBytes += byteSize(*entry);
+        const Sample sample = reference(*entry);
+        evictOverBudget();
+        return sample;
+    }
+
+    void evictOverBudget() {
+        while (mResidentBytes > mBudgetBytes) {
+            auto oldest = mEntries.end();
+            for (auto it = mEntries.begin(); it != mEntries.end(); ++it) {
+                if (it->second->references == 0 && (oldest == mEntries.end() || it->second->lastUse < oldest->second->lastUse)) {
+                    oldest = it;
+                }
+            }
+            if (oldest == mEntries.end()) {
+                return;
+            }
+            Entry* entry = oldest->second;
+            for (auto file = mFiles.begin(); file != mFiles.end(); ) {
+                file = file->second.samples == entry->samples.data() ? mFiles.erase(file) : std::next(file);
+            }
+            mBySamples.erase(entry->samples.data());
+            mResidentBytes -= byteSize(*entry);
+            mEntries.erase(oldest);
+            delete entry;
+            mEvictions += 1;
+        }
+    }
+};
@@ -0,0 +1,376 @@
+//
+//  Scene.hpp
+//  BeatMachineExtension
+//
+
+#pragma once
+
+#import <AudioToolbox/AudioToolbox.h>
+#import <algorithm>
+#import <array>
+#import <map>
+#import <memory>
+#import <vector>
+#include <cstdint>
+#include <cstring>
+#include "SampleCache.hpp"
+
+struct SceneCapture;
+
+/*
+ Scene
+ A snapshot of the whole instance: every pad's take and playing settings, the loop and the
+ parameter values. Takes and the loop are SampleCache references, so scenes built on the
+ same kit or loop, or a scene captured again without changes, hold their audio once. Scenes
+ are built and destroyed off the render thread and passed around as
+ std::shared_ptr<const Scene>; nothing changes a scene once it is built.
+ */
+struct Scene {
+    static const int padCount = 128;    // one per MIDI note
+    static const int slotCount = 8;     // scenes an instance keeps, A to H
+
+    struct Take {
+        const float* samples = nullptr; // a SampleCache reference; null when empty
+        int length = 0;
+        uint32_t sampleRate = 0;
+    };
+
+    struct Pad {
+        Take take;
+        int loopStart = 0;
+        int loopEnd = 0;
+        int retriggerMode = 0;
+        int chokeGroup = 0;
+        int voiceLimit = 1;
+        float reverbSend = 0.0f;
+        int sliceSource = -1;           // pad whose take the slice plays; -1 for none
+        int sliceStart = 0;
+        int sliceEnd = 0;
+    };
+
+    struct Parameter {
+        AUParameterAddress address = 0;
+        AUValue value = 0.0f;
+    };
+
+    std::array<Pad, padCount> pads;
+    Take loop;                          // at the rate it was recorded at
+    double loopTempo = 0.0;
+    std::vector<Parameter> parameters;
+
+    Scene() = default;
+    Scene(const Scene&) = delete;
+    Scene& operator=(const Scene&) = delete;
+
+    ~Scene() {
+        for (const Pad& pad : pads) {
+            if (pad.take.samples != nullptr) {
+                SampleCache::shared().release(pad.take.samples);
+            }
+        }
+        if (loop.samples != nullptr) {
+            SampleCache::shared().release(loop.samples);
+        }
+    }
+
+    // Copies a capture into the cache. Not realtime safe.
+    static std::shared_ptr<const Scene> capture(const SceneCapture& capture, std::vector<Parameter> parameters);
+
+    // A cache reference to `take`: another reference if it already is one, else a stored copy
+    static Take cached(const Take& take, bool isShared) {
+        if (take.samples == nullptr || take.length <= 0) {
+            return {};
+        }
+        if (isShared) {
+            const SampleCache::Sample sample = SampleCache::shared().retain(take.samples);
+            if (sample.samples != nullptr) {
+                return { sample.samples, std::min(take.length, sample.length), sample.sampleRate };
+            }
+        }
+        const SampleCache::Sample sample = SampleCache::shared().acquire(take.samples, take.length, take.sampleRate);
+        return { sample.samples, sample.length, sample.sampleRate };
+    }
+};
+
+/*
+ SceneCapture
+ The kernel's pads and loop as they were at the start of one render cycle, for
+ Scene::capture to copy. Takes point at the kernel's own buffers, which are cache references
+ only where `shared` says so, and stay readable until the kernel is told the capture is
+ finished.
+ */
+struct SceneCapture {
+    std::array<Scene::Pad, Scene::padCount> pads;
+    std::array<bool, Scene::padCount> shared {};
+    Scene::Take loop;
+    double loopTempo = 0.0;
+};
+
+inline std::shared_ptr<const Scene> Scene::capture(const SceneCapture& capture, std::vector<Parameter> parameters) {
+    auto scene = std::make_shared<Scene>();
+    for (int note = 0; note < padCount; ++note) {
+        scene->pads[note] = capture.pads[note];
+        scene->pads[note].take = cached(capture.pads[note].take, capture.shared[note]);
+    }
+    scene->loop = cached(capture.loop, false);
+    scene->loopTempo = capture.loopTempo;
+    scene->parameters = std::move(parameters);
+    return scene;
+}
+
+/*
+ SceneChange
+ A switch to a scene, prepared off the render thread so that switching only swaps pointers:
+ one more cache reference to each pad's take for the pad to hold (a one sample silent entry
+ for an empty pad), and a private copy of the loop to overdub into. The render thread trades
+ these for the buffers it was playing. Whatever the change holds when it is deleted is freed
+ with it, cache references given back and private buffers deleted, so it must be deleted
+ off the render thread.
+ */
+struct SceneChange {
+    std::shared_ptr<const Scene> scene;
+    std::array<float*, Scene::padCount> takes {};   // to install; once switched, what they replaced
+    float* loop = nullptr;                          // likewise; null empties the loop
+    double sampleRate = 0.0;                        // the stream rate `loop` was copied for
+    bool includeParameters = true;
+    uint64_t sequence = 0;
+
+    SceneChange() = default;
+    SceneChange(const SceneChange&) = delete;
+    SceneChange& operator=(const SceneChange&) = delete;
+
+    ~SceneChange() {
+        for (float* take : takes) {
+            if (take != nullptr && !SampleCache::shared().release(take)) {
+                delete[] take;
+            }
+        }
+        delete[] loop;
+    }
+
+    /*
+     `loopAllocation` is the size of the kernel's loop buffers. A loop recorded at another
+     rate than `sampleRate` would play at the wrong speed, so it is left out and the switch
+     empties the loop instead; so does a switch still pending when the stream changes to
+     another rate. Not realtime safe.
+     */
+    static SceneChange* create(std::shared_ptr<const Scene> scene, int loopAllocation, double sampleRate, bool includeParameters) {
+        SceneChange* change = new SceneChange;
+        static const float silence = 0.0f;
+        for (int note = 0; note < Scene::padCount; ++note) {
+            const Scene::Take& take = scene->pads[note].take;
+            const SampleCache::Sample sample = take.samples != nullptr ? SampleCache::shared().retain(take.samples)
+                                                                       : SampleCache::shared().acquire(&silence, 1, 0);
+            change->takes[note] = const_cast<float*>(sample.samples);
+        }
+        const Scene::Take& loop = scene->loop;
+        if (loop.samples != nullptr && loop.sampleRate == uint32_t(sampleRate) && loopAllocation > 1) {
+            change->loop = new float[loopAllocation]();
+            std::memcpy(change->loop, loop.samples, size_t(std::min(loop.length, loopAllocation - 1)) * sizeof(float));
+        }
+        change->sampleRate = sampleRate;
+        change->scene = std::move(scene);
+        change->includeParameters = includeParameters;
+        return change;
+    }
+};
+
+/*
+ SceneArchive
+ The scene slots as one flat blob, for the audio unit's fullState. Every distinct take is
+ written once, however many pads and scenes use it, and read back through the cache, so
+ recalling a session stores each take once and hashes it once. Native byte order; a blob
+ that is truncated or from another version reads back as nothing.
+ */
+class SceneArchive {
+public:
+    using Slots = std::array<std::shared_ptr<const Scene>, Scene::slotCount>;
+
+    static constexpr uint32_t magic = 0x6373424d;  // "MBsc"
+    static constexpr uint32_t version = 1;
+
+    static std::vector<uint8_t> write(const Slots& slots, int activeSlot) {
+        // distinct takes, in the order they are first used
+        std::map<std::pair<const float*, int>, int32_t> indices;
+        std::vector<Scene::Take> takes;
+        auto index = [&indices, &takes] (const Scene::Take& take) -> int32_t {
+            if (take.samples == nullptr) {
+                return -1;
+            }
+            auto [found, added] = indices.emplace(std::make_pair(take.samples, take.length), (int32_t)takes.size());
+            if (added) {
+                takes.push_back(take);
+            }
+            return found->second;
+        };
+        for (const auto& scene : slots) {
+            if (scene != nullptr) {
+                for (const Scene::Pad& pad : scene->pads) {
+                    index(pad.take);
+                }
+                index(scene->loop);
+            }
+        }
+
+        std::vector<uint8_t> bytes;
+        put(bytes, magic);
+        put(bytes, version);
+        put(bytes, int32_t(activeSlot));
+        put(bytes, uint32_t(takes.size()));
+        for (const Scene::Take& take : takes) {
+            put(bytes, take.sampleRate);
+            put(bytes, int32_t(take.length));
+            const uint8_t* samples = reinterpret_cast<const uint8_t*>(take.samples);
+            bytes.insert(bytes.end(), samples, samples + size_t(take.length) * sizeof(float));
+        }
+        put(bytes, uint32_t(slots.size()));
+        for (const auto& scene : slots) {
+            put(bytes, uint8_t(scene != nullptr));
+            if (scene == nullptr) {
+                continue;
+            }
+            for (const Scene::Pad& pad : scene->pads) {
+                put(bytes, index(pad.take));
+                put(bytes, int32_t(pad.loopStart));
+                put(bytes, int32_t(pad.loopEnd));
+                put(bytes, int32_t(pad.retriggerMode));
+                put(bytes, int32_t(pad.chokeGroup));
+                put(bytes, int32_t(pad.voiceLimit));
+                put(bytes, pad.reverbSend);
+                put(bytes, int32_t(pad.sliceSource));
+                put(bytes, int32_t(pad.sliceStart));
+                put(bytes, int32_t(pad.sliceEnd));
+            }
+            put(bytes, index(scene->loop));
+            put(bytes, scene->loopTempo);
+            put(bytes, uint32_t(scene->parameters.size()));
+            for (const Scene::Parameter& parameter : scene->parameters) {
+                put(bytes, uint64_t(parameter.address));
+                put(bytes, parameter.value);
+            }
+        }
+        return bytes;
+    }
+
+    // Returns false, leaving `slots` alone, if the blob can't be read. Not realtime safe.
+    static bool read(const uint8_t* bytes, size_t size, Slots& slots, int& activeSlot) {
+        Reader reader { bytes, bytes + size };
+        uint32_t header = 0;
+        uint32_t headerVersion = 0;
+        int32_t active = -1;
+        uint32_t takeCount = 0;
+        if (!reader.get(header) || header != magic || !reader.get(headerVersion) || headerVersion != version ||
+            !reader.get(active) || !reader.get(takeCount)) {
+            return false;
+        }
+
+        // The archive holds one reference to each take while the scenes take their own
+        std::vector<SampleCache::Sample> takes;
+        bool readable = true;
+        for (uint32_t index = 0; index < takeCount && readable; ++index) {
+            uint32_t sampleRate = 0;
+            int32_t length = 0;
+            const uint8_t* samples = nullptr;
+            readable = reader.get(sampleRate) && reader.get(length) && length > 0 && reader.skip(size_t(length) * sizeof(float), samples);
+            if (readable) {
+                // the blob need not be aligned for floats
+                std::vector<float> aligned(length);
+                std::memcpy(aligned.data(), samples, aligned.size() * sizeof(float));
+                takes.push_back(SampleCache::shared().acquire(aligned.data(), length, sampleRate));
+            }
+        }
+
+        Slots restored;
+        uint32_t slotCount = 0;
+        readable = readable && reader.get(slotCount) && slotCount <= Scene::slotCount;
+        for (uint32_t slot = 0; slot < slotCount && readable; ++slot) {
+            uint8_t present = 0;
+            readable = reader.get(present);
+            if (readable && present != 0) {
+                restored[slot] = readScene(reader, takes, readable);
+            }
+        }
+
+        for (const SampleCache::Sample& take : takes) {
+            SampleCache::shared().release(take.samples);
+        }
+        if (!readable) {
+            return false;
+        }
+        slots = std::move(restored);
+        activeSlot = std::clamp(int(active), -1, Scene::slotCount - 1);
+        return true;
+    }
+
+private:
+    struct Reader {
+        const uint8_t* position;
+        const uint8_t* end;
+
+        template <typename T>
+        bool get(T& value) {
+            if (size_t(end - position) < sizeof(T)) {
+                return false;
+            }
+            std::memcpy(&value, position, sizeof(T));
+            position += sizeof(T);
+            return true;
+        }
+
+        bool skip(size_t count, const uint8_t*& start) {
+            if (size_t(end - position) < count) {
+                return false;
+            }
+            start = position;
+            position += count;
+            return true;
+        }
+    };
+
+    template <typename T>
+    static void put(std::vector<uint8_t>& bytes, const T& value) {
+        const uint8_t* raw = reinterpret_cast<const uint8_t*>(&value);
+        bytes.insert(bytes.end(), raw, raw + sizeof(T));
+    }
+
+    static std::shared_ptr<const Scene> readScene(Reader& reader, const std::vector<SampleCache::Sample>& takes, bool& readable) {
+        auto scene = std::make_shared<Scene>();
+        auto take = [&takes, &readable] (int32_t index) -> Scene::Take {
+            if (index < -1 || index >= (int32_t)takes.size()) {
+                readable = false;
+            }
+            if (!readable || index < 0) {
+                return {};
+            }
+            const SampleCache::Sample sample = SampleCache::shared().retain(takes[index].samples);
+            return { sample.samples, sample.length, sample.sampleRate };
+        };
+        for (Scene::Pad& pad : scene->pads) {
+            int32_t takeIndex = -1;
+            int32_t fields[5] = {};
+            int32_t slice[3] = {};
+            readable = readable && reader.get(takeIndex) && reader.get(fields) && reader.get(pad.reverbSend) && reader.get(slice);
+            pad.take = take(takeIndex);
+            pad.loopStart = fields[0];
+            pad.loopEnd = fields[1];
+            pad.retriggerMode = fields[2];
+            pad.chokeGroup = fields[3];
+            pad.voiceLimit = fields[4];
+            pad.sliceSource = std::clamp(slice[0], -1, Scene::padCount - 1);
+            pad.sliceStart = slice[1];
+            pad.sliceEnd = slice[2];
+        }
+        int32_t loopIndex = -1;
+        uint32_t parameterCount = 0;
+        readable = readable && reader.get(loopIndex) && reader.get(scene->loopTempo) && reader.get(parameterCount);
+        scene->loop = take(loopIndex);
+        for (uint32_t index = 0; index < parameterCount && readable; ++index) {
+            uint64_t address = 0;
+            Scene::Parameter parameter;
+            readable = reader.get(address) && reader.get(parameter.value);
+            parameter.address = AUParameterAddress(address);
+            scene->parameters.push_back(parameter);
+        }
+        return scene;
+    }
+};
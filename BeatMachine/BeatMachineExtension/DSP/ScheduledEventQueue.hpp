@@ -0,0 +1,78 @@
+//
+//  ScheduledEventQueue.hpp
+//  BeatMachineExtension
+//
+
+#pragma once
+
+#import <AudioToolbox/AudioToolbox.h>
+#import <array>
+#include <cstddef>
+
+/*
+ ScheduledEventQueue
+ Kernel-internal events waiting for a sample time, kept sorted by time in a fixed array.
+ Events with equal times keep the order they were scheduled in, except that a scene switch
+ goes first, so notes on its bar line play the new scene. Only touched from the render
+ thread.
+ */
+class ScheduledEventQueue {
+public:
+    enum class Type : uint8_t {
+        NoteOn,
+        NoteOff,
+        StepOn,         // a sequencer step: plays the pad without holding it
+        StepOff,        // the end of a step's gate
+        SceneSwitch
+    };
+
+    struct Event {
+        AUEventSampleTime sampleTime = 0;
+        Type type = Type::NoteOn;
+        uint8_t note = 0;
+        float velocity = 1.0f;
+    };
+
+    static const size_t capacity = 256;
+
+private:
+    std::array<Event, capacity> mEvents;
+    size_t mCount = 0;
+
+public:
+    // Returns false when full; the caller should then act on the event immediately.
+    bool schedule(const Event& event) {
+        if (mCount == capacity) {
+            return false;
+        }
+        const bool first = event.type == Type::SceneSwitch;
+        size_t index = mCount;
+        while (index > 0 && (mEvents[index - 1].sampleTime > event.sampleTime ||
+                             (first && mEvents[index - 1].sampleTime == event.sampleTime))) {
+            mEvents[index] = mEvents[index - 1];
+            --index;
+        }
+        mEvents[index] = event;
+        ++mCount;
+        return true;
+    }
+
+    bool empty() const {
+        return mCount == 0;
+    }
+
+    const Event& front() const {
+        return mEvents[0];
+    }
+
+    void pop() {
+        for (size_t index = 1; index < mCount; ++index) {
+            mEvents[index - 1] = mEvents[index];
+        }
+        --mCount;
+    }
+
+    void clear() {
+        mCount = 0;
+    }
+};
@@ -0,0 +1,105 @@
+//
+//  SidechainDucker.hpp
+//  BeatMachineExtension
+//
+
+#pragma once
+
+#import <Accelerate/Accelerate.h>
+#import <algorithm>
+#include <cmath>
+
+/*
+ SidechainDucker
+ Turns a bus down while the sidechain is loud, e.g. the loop under a live singer. The
+ detector works on chunks of chunkLength samples rather than single samples: each chunk's
+ peak comes from one vectorized pass, the smoothing and the gain computation run once per
+ chunk, and the bus is ramped from one chunk's gain to the next with vDSP_vrampmul.
+ Reduction follows the sidechain 1:1 above the threshold, down to at most `depth` dB. It is
+ smoothed in dB: the attack closes in exponentially, and the release lets go at a steady
+ rate that takes the release time to come back from full depth, however loud the
+ sidechain was. Parameters are set from any thread and picked up at the next chunk;
+ nothing here allocates.
+ */
+class SidechainDucker {
+public:
+    static constexpr int chunkLength = 32;
+    static constexpr double attackSeconds = 0.005;
+
+private:
+    double mSampleRate = 44100.0;
+
+    // written by setParameter
+    float mDepth = 0.0f;            // dB of reduction at most; 0 = off
+    float mThreshold = -30.0f;      // dBFS
+    float mRelease = 150.0f;        // ms
+
+    float mAttackCoeff = 0.0f;      // per full chunk
+    float mReduction = 0.0f;        // dB, reached at the end of the last chunk
+    float mReleaseDepth = 0.0f;     // the depth when the reduction last grew
+    float mGain = 1.0f;             // the same, linear
+
+    static float chunkCoefficient(int length, double seconds, double sampleRate) {
+        return float(std::exp(-double(length) / std::max(seconds * sampleRate, 1.0)));
+    }
+
+public:
+    void prepare(double sampleRate) {
+        mSampleRate = sampleRate;
+        mAttackCoeff = chunkCoefficient(chunkLength, attackSeconds, mSampleRate);
+        mReduction = 0.0f;
+        mReleaseDepth = 0.0f;
+        mGain = 1.0f;
+    }
+
+    void setDepth(float db) { mDepth = std::max(db, 0.0f); }
+    void setThreshold(float db) { mThreshold = db; }
+    void setRelease(float milliseconds) { mRelease = std::max(milliseconds, 1.0f); }
+
+    float depth() const { return mDepth; }
+    float threshold() const { return mThreshold; }
+    float release() const { return mRelease; }
+
+    // Linear gain the bus was last left at
+    float gain() const { return mGain; }
+
+    // Whether process() has anything to do: ducking is on, or still letting go of the bus
+    bool isActive() const {
+        return mDepth > 0.0f || mGain < 1.0f;
+    }
+
+    // Render thread. Ducks `bus` in place by the mono `sidechain`; null means silence.
+    void process(const float* sidechain, float* bus, int frameCount) {
+        const float releaseSamples = float(mRelease * 0.001 * mSampleRate);
+        for (int done = 0; done < frameCount; done += chunkLength) {
+            const int length = std::min(chunkLength, frameCount - done);
+            float peak = 0.0f;
+            if (sidechain != nullptr) {
+                vDSP_maxmgv(sidechain + done, 1, &peak, length);
+            }
+
+            float wanted = 0.0f;
+            if (mDepth > 0.0f && peak > 0.0f) {
+                wanted = std::clamp(20.0f * std::log10(peak) - mThreshold, 0.0f, mDepth);
+            }
+            if (wanted > mReduction) {
+                // Partial chunks only happen at the end of a segment; they pay for their own coefficient
+                const float coefficient = length == chunkLength ? mAttackCoeff : chunkCoefficient(length, attackSeconds, mSampleRate);
+                mReduction = wanted + (mReduction - wanted) * coefficient;
+                mReleaseDepth = mDepth;
+            } else {
+                // A depth turned down while ducked, or off, lets go at the rate of the one that ducked
+                const float rate = std::max(mDepth, mReleaseDepth) / releaseSamples;
+                mReduction = std::max(wanted, mReduction - rate * float(length));
+            }
+
+            const float target = mReduction > 0.0f ? std::pow(10.0f, -mReduction / 20.0f) : 1.0f;
+            float start = mGain;
+            if (start != 1.0f || target != 1.0f) {
+                const float step = (target - start) / float(length);
+                vDSP_vrampmul(bus + done, 1, &start, &step, bus + done, 1, length);
+            }
+            mGain = target;
+        }
+    }
+};
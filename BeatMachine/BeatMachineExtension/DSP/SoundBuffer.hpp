@@ -14,62 +14,184 @@
 #include <iostream>
 #include <unordered_map>
 #include <set>
+#include "SampleCache.hpp"
 
 #ifndef SoundBuffer_h
 #define SoundBuffer_h
 
 class SoundBuffer {
 private:
-    AudioBufferList* bufferList;
-    int sampleIndex;
-    int playIndex;
+    AudioBufferList* bufferList = nullptr;
+    int sampleIndex = 0;
+    
+    // current take
+    int length = 0;
+    uint32_t takeId = 0;
+    bool sharedTake = false; // the take belongs to the SampleCache and must not be written
+    int size = 0;           // samples the take buffer holds
+    int limit = 0;          // samples a take may last at the current rate
     
 public:
+    // A take lasts up to takeSeconds at any rate; its buffer holds that much at
+    // maximumSampleRate, so changing rate never reallocates.
+    static constexpr double takeSeconds = 10.0;
+    static constexpr double maximumSampleRate = 192000.0;
+    static constexpr int capacity = int(takeSeconds * maximumSampleRate);
+    
+    // A region of some pad's take, published by the TakeAnalyzer. It only stays valid
+    // while that pad still holds the same take (see sourceTakeId).
+    struct Slice {
+        int sourceNote = -1;
+        uint32_t sourceTakeId = 0;
+        int start = 0;
+        int end = 0;
+    };
+    Slice slice;
+    
+    // Loop region of this pad's own take, in samples; loopEnd <= loopStart means no loop
+    int loopStart = 0;
+    int loopEnd = 0;
+    
+    // How a pad answers a note-on while it is still sounding, and to note-off
+    enum class RetriggerMode : int {
+        Gated = 0,      // note-off fades the pad out
+        OneShot = 1,    // plays to the end of the take; note-off only stops a looping pad
+        Legato = 2      // a note-on while held keeps the playhead going instead of restarting
+    };
+    
+    // Playing settings; they belong to the pad and survive re-recording
+    RetriggerMode retriggerMode = RetriggerMode::Gated;
+    int chokeGroup = 0;         // pads sharing a non-zero group cut each other off
+    int voiceLimit = 1;         // voices of this pad that may sound (unreleased) at once
+    float reverbSend = 0.0f;    // how much of the pad goes to the shared reverb, 0...1
+    static constexpr int maximumVoicesPerPad = 8;
+    
+    // Allocates the take buffer. Not realtime safe; only the first call allocates, later
+    // calls leave the take alone.
     void initialize() {
+        if (bufferList != nullptr) {
+            return;
+        }
         bufferList = new AudioBufferList;
         bufferList->mNumberBuffers = 1;
         
         AudioBuffer& buffer = bufferList->mBuffers[0];
         buffer.mNumberChannels = 1;
         buffer.mDataByteSize = 1024 * sizeof(float);
-        buffer.mData = new float[441000];
+        buffer.mData = new float[capacity]();
+        sharedTake = false;
+        size = capacity;
+        limit = capacity;
         
         sampleIndex = 0;
-        playIndex = 0;
+        length = 0;
+        slice = Slice();
+        loopStart = 0;
+        loopEnd = 0;
+    }
+    
+    // Not while rendering. A take already longer than the new rate allows is cut short.
+    void setSampleRate(double sampleRate) {
+        limit = std::clamp((int)(takeSeconds * sampleRate), 1, capacity);
+        sampleIndex = std::min(sampleIndex, limit);
+        length = std::min(length, limit);
+    }
+    
+    bool isInitialized() const {
+        return bufferList != nullptr;
     }
     
     ~SoundBuffer() {
         // Make sure to free the memory that we've allocated
-        delete [] static_cast<float*>(bufferList->mBuffers[0].mData);
-        delete bufferList;
+        if (bufferList != nullptr) {
+            float* take = static_cast<float*>(bufferList->mBuffers[0].mData);
+            if (!sharedTake || !SampleCache::shared().release(take)) {
+                delete [] take;
+            }
+            delete bufferList;
+        }
+    }
+    
+    const float* data() const {
+        return static_cast<const float*>(bufferList->mBuffers[0].mData);
+    }
+    
+    int recordedLength() const {
+        return length;
+    }
+    
+    uint32_t currentTakeId() const {
+        return takeId;
+    }
+    
+    // A shared take has to be swapped for a private buffer before the pad can record
+    bool isShared() const {
+        return sharedTake;
+    }
+    
+    int takeSize() const {
+        return size;
+    }
+    
+    // Begins a new take, discarding the previous one, its loop and any slice mapped onto this pad
+    void startRecording() {
+        sampleIndex = 0;
+        length = 0;
+        takeId += 1;
+        slice = Slice();
+        loopStart = 0;
+        loopEnd = 0;
     }
     
     // Records a single sample into the buffer and advances the sampleIndex
     void recordSample(float sample) {
+        if (sharedTake || sampleIndex >= limit) {
+            return;
+        }
         float* recordBufferChannel = static_cast<float*>(bufferList->mBuffers[0].mData) + sampleIndex;
         std::memcpy(recordBufferChannel, &sample, sizeof(float));
         sampleIndex += 1;
+        length = sampleIndex;
     }
     
-    // Plays a single sample from the buffer and advances the playIndex
-    float playSample() {
-        float gain = 1.0f;
-        if (playIndex < crossfadeSamples) {
-            // Fade in
-            gain = playIndex / crossfadeSamples;
+    // Records a block of samples, dropping whatever doesn't fit
+    void recordBlock(const float* samples, int count) {
+        count = std::min(count, limit - sampleIndex);
+        if (sharedTake || count <= 0) {
+            return;
         }
-        float sample = *((float*)bufferList->mBuffers[0].mData + playIndex) * gain;
-        playIndex += 1;
-        return sample;
+        std::memcpy(static_cast<float*>(bufferList->mBuffers[0].mData) + sampleIndex, samples, count * sizeof(float));
+        sampleIndex += count;
+        length = sampleIndex;
+    }
+    
+    // Empties the pad. Like a new take, this invalidates slices of the old one.
+    void clear() {
+        startRecording();
     }
     
-    // Resets the buffer for new recording
+    /*
+     Swaps in a take loaded elsewhere. `samples` is either a new[]'d buffer of `capacity`
+     floats holding `count` valid samples, which the pad takes ownership of, or, when
+     `isShared`, `count` samples from the SampleCache that the pad holds one reference to.
+     Only as much as a take may last at the current rate is played.
+     Hands back the old buffer, which the caller must free (or release to the cache) off
+     the render thread.
+     */
+    float* replaceTake(float* samples, int count, bool isShared = false) {
+        float* previous = static_cast<float*>(bufferList->mBuffers[0].mData);
+        bufferList->mBuffers[0].mData = samples;
+        startRecording();
+        sharedTake = isShared;
+        size = isShared ? std::clamp(count, 0, capacity) : capacity;
+        length = std::clamp(count, 0, limit);
+        return previous;
+    }
+    
+    // Resets the record position for a new take
     void reset() {
         sampleIndex = 0;
-        playIndex = 0;
     }
-    
-    double crossfadeSamples = 0.01 * 44100.0;
 };
 
 #endif /* SoundBuffer_h */
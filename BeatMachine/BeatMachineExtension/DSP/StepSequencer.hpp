@@ -0,0 +1,167 @@
+//
+//  StepSequencer.hpp
+//  BeatMachineExtension
+//
+
+#pragma once
+
+#import <algorithm>
+#import <array>
+#include <cmath>
+#include <cstdint>
+
+/*
+ StepSequencer
+ Pattern store for the built-in sequencer. Each pattern has trackCount tracks, each
+ bound to a pad note, and 16 to 64 sixteenth-note steps per track with a velocity and a
+ probability. The sequencer keeps no clock of its own: the kernel asks it which steps
+ fall inside a range of host beats and schedules the returned notes sample-accurately.
+ Edits arrive through the kernel's command queue and are applied by the render thread
+ at the start of a render cycle.
+ */
+class StepSequencer {
+public:
+    static const int patternCount = 8;
+    static const int trackCount = 16;
+    static constexpr int minimumSteps = 16;
+    static constexpr int maximumSteps = 64;
+    static constexpr double stepBeats = 0.25;   // one sixteenth note
+    static const int firstTrackNote = 36;        // tracks default to consecutive pads from C1
+
+    struct Step {
+        uint8_t velocity = 0;       // 0 is a rest, otherwise 1...127
+        uint8_t probability = 100;  // percent chance the step plays
+    };
+
+    struct Pattern {
+        int length = minimumSteps;
+        std::array<uint8_t, trackCount> notes;
+        std::array<std::array<Step, maximumSteps>, trackCount> steps;
+    };
+
+    struct Edit {
+        enum class Type : uint8_t {
+            SetStep,
+            SetTrackNote,
+            SetLength,
+            Clear
+        };
+        Type type = Type::SetStep;
+        uint8_t pattern = 0;
+        uint8_t track = 0;
+        uint8_t step = 0;
+        uint8_t velocity = 0;
+        uint8_t probability = 100;
+        uint8_t value = 0;          // note for SetTrackNote, step count for SetLength
+    };
+
+private:
+    std::array<Pattern, patternCount> mPatterns;
+    int mPattern = 0;               // pattern currently playing
+    int mRequestedPattern = 0;      // takes over when the current pattern wraps
+    int64_t mPatternStartStep = 0;  // host step the current pattern's first pass began on
+    uint32_t mRandomState = 0x9E3779B9;
+
+public:
+    StepSequencer() {
+        for (int pattern = 0; pattern < patternCount; ++pattern) {
+            clear(pattern);
+        }
+    }
+
+    // Render thread
+    void apply(const Edit& edit) {
+        if (edit.pattern >= patternCount || edit.track >= trackCount) {
+            return;
+        }
+        Pattern& pattern = mPatterns[edit.pattern];
+        switch (edit.type) {
+            case Edit::Type::SetStep:
+                if (edit.step < maximumSteps) {
+                    Step& step = pattern.steps[edit.track][edit.step];
+                    step.velocity = std::min<uint8_t>(edit.velocity, 127);
+                    step.probability = std::min<uint8_t>(edit.probability, 100);
+                }
+                break;
+            case Edit::Type::SetTrackNote:
+                pattern.notes[edit.track] = std::min<uint8_t>(edit.value, 127);
+                break;
+            case Edit::Type::SetLength:
+                pattern.length = std::clamp<int>(edit.value, minimumSteps, maximumSteps);
+                break;
+            case Edit::Type::Clear:
+                clear(edit.pattern);
+                break;
+        }
+    }
+
+    // Render thread. The switch is deferred to the first step of the next pass.
+    void selectPattern(int pattern) {
+        mRequestedPattern = std::clamp(pattern, 0, patternCount - 1);
+    }
+
+    int currentPattern() const {
+        return mPattern;
+    }
+
+    /*
+     Render thread. Calls trigger(beat, note, velocity) for every step that plays in
+     [startBeat, endBeat), in order. Odd steps are pushed late by swingOffset beats. Steps
+     are counted from beat 0 of the host timeline, so the pattern stays locked to the bar
+     after the host relocates.
+     */
+    template <typename Trigger>
+    void generate(double startBeat, double endBeat, double swingOffset, Trigger&& trigger) {
+        const int64_t firstStep = (int64_t)std::floor((startBeat - swingOffset) / stepBeats);
+        const int64_t lastStep = (int64_t)std::floor(endBeat / stepBeats);
+        for (int64_t stepIndex = firstStep; stepIndex <= lastStep; ++stepIndex) {
+            const double beat = stepIndex * stepBeats + ((stepIndex & 1) ? swingOffset : 0.0);
+            if (beat < startBeat || beat >= endBeat) {
+                continue;
+            }
+
+            int64_t position = stepPosition(stepIndex);
+            if (position == 0 && mRequestedPattern != mPattern) {
+                mPattern = mRequestedPattern;
+                mPatternStartStep = stepIndex;
+                position = 0;
+            }
+            const Pattern* pattern = &mPatterns[mPattern];
+
+            for (int track = 0; track < trackCount; ++track) {
+                const Step& step = pattern->steps[track][position];
+                if (step.velocity == 0) {
+                    continue;
+                }
+                if (step.probability < 100 && nextRandomPercent() >= step.probability) {
+                    continue;
+                }
+                trigger(beat, (int)pattern->notes[track], step.velocity / 127.0f);
+            }
+        }
+    }
+
+private:
+    int64_t stepPosition(int64_t stepIndex) const {
+        const int length = mPatterns[mPattern].length;
+        int64_t position = (stepIndex - mPatternStartStep) % length;
+        return position < 0 ? position + length : position;
+    }
+
+    void clear(int index) {
+        Pattern& pattern = mPatterns[index];
+        pattern.length = minimumSteps;
+        for (int track = 0; track < trackCount; ++track) {
+            pattern.notes[track] = (uint8_t)(firstTrackNote + track);
+            pattern.steps[track].fill(Step());
+        }
+    }
+
+    // xorshift32; good enough for step probabilities and safe on the render thread
+    uint32_t nextRandomPercent() {
+        mRandomState ^= mRandomState << 13;
+        mRandomState ^= mRandomState >> 17;
+        mRandomState ^= mRandomState << 5;
+        return mRandomState % 100;
+    }
+};
@@ -0,0 +1,222 @@
+//
+//  TakeAnalyzer.hpp
+//  BeatMachineExtension
+//
+
+#pragma once
+
+#import <Accelerate/Accelerate.h>
+#import <algorithm>
+#import <atomic>
+#import <vector>
+#include <cmath>
+#include "SPSCQueue.hpp"
+
+/*
+ TakeAnalyzer
+ Finds the transients in a finished take off the render thread. The kernel pushes a
+ Job when a pad stops recording; poll() (run on the BackgroundWorker) trims leading
+ silence, runs a spectral-flux onset detector over the take and pushes back one Result
+ per slice. The kernel drains results at the top of each render block, so slice points
+ change between blocks, never inside one.
+
+ A job reads the take where it is, so the kernel must neither write nor free a submitted
+ take until isReading() turns false for the ticket submit() gave it.
+ */
+class TakeAnalyzer {
+public:
+    struct Job {
+        int note = 0;
+        uint32_t takeId = 0;
+        const float* samples = nullptr;   // the pad's take buffer; see isReading()
+        int length = 0;
+        bool slice = false;         // spread the onsets over the following pads
+    };
+
+    struct Result {
+        int targetNote = 0;
+        int sourceNote = 0;
+        uint32_t sourceTakeId = 0;
+        int start = 0;
+        int end = 0;
+    };
+
+private:
+    static const int fftLog2n = 10;
+    static const int fftSize = 1 << fftLog2n;
+    static const int hopSize = fftSize / 4;
+    static constexpr float silenceThreshold = 0.003f;   // about -50 dBFS
+    static constexpr float minimumOnsetGap = 0.05f;     // seconds between two slices
+
+    SPSCQueue<Job, 64> mJobs;
+    SPSCQueue<Result, 512> mResults;
+    uint64_t mSubmittedJobs = 0;                // render thread
+    std::atomic<uint64_t> mCompletedJobs { 0 }; // jobs finish in the order they were submitted
+
+    // set by initialize() while the worker may be analysing a take from before
+    std::atomic<double> mSampleRate { 44100.0 };
+
+    // worker-owned analysis buffers
+    FFTSetup mFFTSetup = nullptr;
+    std::vector<float> mWindow;
+    std::vector<float> mFrame;
+    std::vector<float> mReal;
+    std::vector<float> mImag;
+    std::vector<float> mMagnitude;
+    std::vector<float> mPreviousMagnitude;
+    std::vector<float> mFlux;
+
+public:
+    ~TakeAnalyzer() {
+        if (mFFTSetup != nullptr) {
+            vDSP_destroy_fftsetup(mFFTSetup);
+        }
+    }
+
+    // Not realtime safe: allocates the analysis buffers on first use.
+    void prepare(double sampleRate) {
+        mSampleRate.store(sampleRate, std::memory_order_relaxed);
+        if (mFFTSetup != nullptr) {
+            return;
+        }
+        mFFTSetup = vDSP_create_fftsetup(fftLog2n, kFFTRadix2);
+        mWindow.resize(fftSize);
+        vDSP_hann_window(mWindow.data(), fftSize, vDSP_HANN_NORM);
+        mFrame.resize(fftSize);
+        mReal.resize(fftSize / 2);
+        mImag.resize(fftSize / 2);
+        mMagnitude.resize(fftSize / 2);
+        mPreviousMagnitude.resize(fftSize / 2);
+    }
+
+    // Background thread
+    void poll() {
+        Job job;
+        while (mJobs.pop(job)) {
+            analyze(job);
+            mCompletedJobs.fetch_add(1, std::memory_order_release);
+        }
+    }
+
+    // Render thread. Returns the job's ticket, or 0 if the queue is full and the take
+    // won't be analyzed.
+    uint64_t submit(const Job& job) {
+        if (!mJobs.push(job)) {
+            return 0;
+        }
+        mSubmittedJobs += 1;
+        return mSubmittedJobs;
+    }
+
+    // Render thread. Whether the job with `ticket` may still be reading its samples.
+    bool isReading(uint64_t ticket) const {
+        return ticket > mCompletedJobs.load(std::memory_order_acquire);
+    }
+
+    // Render thread
+    bool nextResult(Result& result) {
+        return mResults.pop(result);
+    }
+
+private:
+    void analyze(const Job& job) {
+        const float* samples = job.samples;
+        const int length = job.length;
+
+        // Trim leading silence
+        int start = 0;
+        while (start < length && std::fabs(samples[start]) < silenceThreshold) {
+            ++start;
+        }
+        if (start >= length) {
+            return;
+        }
+
+        std::vector<int> onsets;
+        onsets.push_back(start);
+        if (job.slice) {
+            detectOnsets(samples + start, length - start, onsets, start);
+        }
+
+        const int lastNote = std::min<int>((int)onsets.size(), 128 - job.note);
+        for (int i = 0; i < lastNote; ++i) {
+            Result result;
+            result.targetNote = job.note + i;
+            result.sourceNote = job.note;
+            result.sourceTakeId = job.takeId;
+            result.start = onsets[i];
+            result.end = (i + 1 < (int)onsets.size()) ? onsets[i + 1] : length;
+            mResults.push(result);
+        }
+    }
+
+    // Appends onset positions (absolute, via `offset`) found after the first hop of `samples`
+    void detectOnsets(const float* samples, int length, std::vector<int>& onsets, int offset) {
+        const int frameCount = length >= fftSize ? 1 + (length - fftSize) / hopSize : 0;
+        if (frameCount < 3) {
+            return;
+        }
+        mFlux.assign(frameCount, 0.0f);
+        std::fill(mPreviousMagnitude.begin(), mPreviousMagnitude.end(), 0.0f);
+
+        DSPSplitComplex split { mReal.data(), mImag.data() };
+        const float zero = 0.0f;
+        for (int frame = 0; frame < frameCount; ++frame) {
+            vDSP_vmul(samples + frame * hopSize, 1, mWindow.data(), 1, mFrame.data(), 1, fftSize);
+            vDSP_ctoz(reinterpret_cast<const DSPComplex*>(mFrame.data()), 2, &split, 1, fftSize / 2);
+            vDSP_fft_zrip(mFFTSetup, &split, 1, fftLog2n, kFFTDirection_Forward);
+            split.imagp[0] = 0.0f;  // drop the packed Nyquist bin
+            vDSP_zvabs(&split, 1, mMagnitude.data(), 1, fftSize / 2);
+
+            // flux = sum(max(0, |X_n| - |X_n-1|))
+            vDSP_vsub(mPreviousMagnitude.data(), 1, mMagnitude.data(), 1, mPreviousMagnitude.data(), 1, fftSize / 2);
+            vDSP_vthres(mPreviousMagnitude.data(), 1, &zero, mPreviousMagnitude.data(), 1, fftSize / 2);
+            vDSP_sve(mPreviousMagnitude.data(), 1, &mFlux[frame], fftSize / 2);
+            std::swap(mPreviousMagnitude, mMagnitude);
+        }
+
+        // Peak pick against a moving mean so quiet passages still slice
+        const int neighbourhood = 8;
+        const int minimumGap = std::max(1, int(minimumOnsetGap * mSampleRate.load(std::memory_order_relaxed)) / hopSize);
+        float peakFlux = 0.0f;
+        vDSP_maxv(mFlux.data(), 1, &peakFlux, frameCount);
+        const float floor = peakFlux * 0.1f;
+        int lastOnsetFrame = 0;
+
+        for (int frame = 1; frame < frameCount - 1; ++frame) {
+            const float value = mFlux[frame];
+            if (value < floor || value < mFlux[frame - 1] || value < mFlux[frame + 1]) {
+                continue;
+            }
+            const int from = std::max(0, frame - neighbourhood);
+            const int to = std::min(frameCount, frame + neighbourhood + 1);
+            float mean = 0.0f;
+            vDSP_meanv(mFlux.data() + from, 1, &mean, to - from);
+            if (value < mean * 1.5f || frame - lastOnsetFrame < minimumGap) {
+                continue;
+            }
+            lastOnsetFrame = frame;
+            onsets.push_back(offset + refineOnset(samples, length, frame));
+        }
+    }
+
+    // The flux peak only says which hop the new energy arrived in. Walk that hop for the
+    // first sample that rises above a fraction of the local peak, so playback starts on
+    // the attack instead of up to a hop early.
+    int refineOnset(const float* samples, int length, int frame) {
+        const int from = frame * hopSize + fftSize - 2 * hopSize;
+        const int to = std::min(length, from + 2 * hopSize);
+        if (from >= to) {
+            return std::min(length - 1, frame * hopSize);
+        }
+        float peak = 0.0f;
+        vDSP_maxmgv(samples + from, 1, &peak, to - from);
+        const float threshold = peak * 0.25f;
+        for (int i = from; i < to; ++i) {
+            if (std::fabs(samples[i]) >= threshold) {
+                return i;
+            }
+        }
+        return from;
+    }
+};
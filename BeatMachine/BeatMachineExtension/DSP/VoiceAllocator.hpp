@@ -0,0 +1,151 @@
+//
+//  VoiceAllocator.hpp
+//  BeatMachineExtension
+//
+
+#pragma once
+
+#import <array>
+#include <cstdint>
+#include "PadVoice.hpp"
+
+/*
+ VoiceAllocator
+ Fixed pool of pad voices shared by every pad. Each voice remembers the pad that started
+ it and when, so the kernel can release a pad's voices on note-off, cap how many voices
+ one pad holds, and choke whole groups. Nothing here allocates; when the pool is full the
+ oldest voice is stolen, preferring one that is already fading out.
+ */
+class VoiceAllocator {
+public:
+    static const int capacity = 64;
+
+private:
+    struct Slot {
+        PadVoice voice;
+        int note = -1;
+        uint64_t serial = 0;    // start order, for finding the oldest voice
+    };
+    std::array<Slot, capacity> mSlots;
+    uint64_t mNextSerial = 1;
+
+public:
+    // Returns a voice for `note`, stealing one if every slot is busy. Call start() on it.
+    PadVoice& allocate(int note) {
+        Slot* chosen = nullptr;
+        for (Slot& slot : mSlots) {
+            if (!slot.voice.isActive()) {
+                chosen = &slot;
+                break;
+            }
+            if (chosen == nullptr
+                || (slot.voice.isReleased() && !chosen->voice.isReleased())
+                || (slot.voice.isReleased() == chosen->voice.isReleased() && slot.serial < chosen->serial)) {
+                chosen = &slot;
+            }
+        }
+        chosen->voice.stop();
+        chosen->note = note;
+        chosen->serial = mNextSerial++;
+        return chosen->voice;
+    }
+
+    // Calls f(voice) for every sounding, unreleased voice of `note`
+    template <typename F>
+    void forEachHeldVoice(int note, F&& f) {
+        for (Slot& slot : mSlots) {
+            if (slot.note == note && slot.voice.isActive() && !slot.voice.isReleased()) {
+                f(slot.voice);
+            }
+        }
+    }
+
+    // Calls f(note, voice) for every sounding, unreleased voice
+    template <typename F>
+    void forEachHeldVoice(F&& f) {
+        for (Slot& slot : mSlots) {
+            if (slot.voice.isActive() && !slot.voice.isReleased()) {
+                f(slot.note, slot.voice);
+            }
+        }
+    }
+
+    // Calls f(note, voice) for every sounding voice, released or not
+    template <typename F>
+    void forEachActiveVoice(F&& f) {
+        for (Slot& slot : mSlots) {
+            if (slot.voice.isActive()) {
+                f(slot.note, slot.voice);
+            }
+        }
+    }
+
+    int heldVoiceCount(int note) const {
+        int count = 0;
+        for (const Slot& slot : mSlots) {
+            count += (slot.note == note && slot.voice.isActive() && !slot.voice.isReleased()) ? 1 : 0;
+        }
+        return count;
+    }
+
+    // Fades out the oldest held voices of `note` until at most `keep` remain
+    void releaseOldest(int note, int keep) {
+        int held = heldVoiceCount(note);
+        while (held > keep) {
+            Slot* oldest = nullptr;
+            for (Slot& slot : mSlots) {
+                if (slot.note == note && slot.voice.isActive() && !slot.voice.isReleased()
+                    && (oldest == nullptr || slot.serial < oldest->serial)) {
+                    oldest = &slot;
+                }
+            }
+            oldest->voice.release();
+            --held;
+        }
+    }
+
+    void releaseNote(int note) {
+        forEachHeldVoice(note, [] (PadVoice& voice) { voice.release(); });
+    }
+
+    // Cuts every voice of `note` without a fade, e.g. before its take is recorded over
+    void stopNote(int note) {
+        for (Slot& slot : mSlots) {
+            if (slot.note == note) {
+                slot.voice.stop();
+            }
+        }
+    }
+
+    // Cuts every voice playing from memory in [begin, end), before that memory goes away
+    void stopVoicesReading(const float* begin, const float* end) {
+        for (Slot& slot : mSlots) {
+            if (slot.voice.reads(begin, end)) {
+                slot.voice.stop();
+            }
+        }
+    }
+
+    void stopAll() {
+        for (Slot& slot : mSlots) {
+            slot.voice.stop();
+        }
+    }
+
+    // Adds every sounding voice into `bus`, and into `send` at each voice's send level unless
+    // that is null. `scratch` must hold PadVoice::scratchLength(frameCount).
+    // `rendered(note, voice)` is called after each voice, e.g. to meter it.
+    template <typename F>
+    void render(float* bus, float* send, int frameCount, float* scratch, const CrossfadeTable& table, float glide, F&& rendered) {
+        for (Slot& slot : mSlots) {
+            if (slot.voice.isActive()) {
+                slot.voice.render(bus, send, frameCount, scratch, table, glide);
+                rendered(slot.note, slot.voice);
+            }
+        }
+    }
+
+    void render(float* bus, float* send, int frameCount, float* scratch, const CrossfadeTable& table, float glide) {
+        render(bus, send, frameCount, scratch, table, glide, [] (int, const PadVoice&) {});
+    }
+};
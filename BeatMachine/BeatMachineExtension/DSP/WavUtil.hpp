@@ -4,7 +4,11 @@
 //
 //  Created by Austin Kang on 5/24/23.
 //
+#include <cstring>
 #include <fstream>
+#include <string>
+#include <vector>
+#include "MixKernels.hpp"
 
 #ifndef WavUtil_h
 #define WavUtil_h
@@ -29,67 +33,116 @@ struct FmtData {
     uint16_t bits_per_sample;// bits per sample, 8- 8bits, 16- 16 bits etc
 };
 
-std::vector<float> load_wav_file(const std::string &filename) {
-    std::ifstream file(filename, std::ios::binary);
-    if (!file) {
-        // Handle error
-        return {};
-    }
-
+/*
+ Reads 16-bit PCM WAV data from `file` as mono, averaging the channels of each frame of a
+ multichannel file; `sampleRate`, when given, receives the file's rate. Nothing in the file is trusted: chunk sizes are checked against what is left of the
+ stream, unknown chunks (and the padding byte after odd-sized ones) are skipped, and a
+ missing "fmt " or "data" chunk, a format other than 16-bit PCM or a truncated header
+ returns an empty vector. A data chunk running past the end of the file is cut short.
+ */
+inline std::vector<float> read_wav(std::istream &file, uint32_t *sampleRate = nullptr) {
     // Read RIFF Chunk
     RiffChunk riffChunk;
-    file.read(reinterpret_cast<char*>(&riffChunk), sizeof(RiffChunk));
-    
-    // Check RIFF Chunk
-    if (std::strncmp((const char *)riffChunk.riff, "RIFF", 4) != 0 ||
+    if (!file.read(reinterpret_cast<char*>(&riffChunk), sizeof(RiffChunk)) ||
+        std::strncmp((const char *)riffChunk.riff, "RIFF", 4) != 0 ||
         std::strncmp((const char *)riffChunk.wave, "WAVE", 4) != 0) {
-        // This is a very basic check and will not handle all kinds of .wav files
-        // In a real application, you would want to do a more thorough check
         return {};
     }
     
-    // Skip chunks until we find a "fmt " or "data" chunk
-    ChunkInfo chunkInfo;
-    FmtData fmtData;
+    // Bytes left after the RIFF header, to bound every size field against
+    const std::streampos chunksStart = file.tellg();
+    file.seekg(0, std::ios::end);
+    const std::streamoff fileSize = file.tellg() - chunksStart;
+    file.seekg(chunksStart);
+    if (!file || fileSize < 0) {
+        return {};
+    }
+    std::streamoff remaining = fileSize;
     
-    do {
-        // Read chunk ID and size
-        file.read(reinterpret_cast<char*>(&chunkInfo), sizeof(chunkInfo));
-
-        if(std::strncmp((const char *)chunkInfo.header_name, "fmt ", 4) != 0) {
-            file.seekg(chunkInfo.size, std::ios::cur);  // Skip chunk
+    // Walk the chunks until "data", reading "fmt " on the way
+    ChunkInfo chunkInfo;
+    FmtData fmtData {};
+    bool hasFormat = false;
+    while (true) {
+        if (remaining < (std::streamoff)sizeof(ChunkInfo) ||
+            !file.read(reinterpret_cast<char*>(&chunkInfo), sizeof(ChunkInfo))) {
+            return {};
+        }
+        remaining -= sizeof(ChunkInfo);
+        const std::streamoff chunkSize = std::min<std::streamoff>(chunkInfo.size, remaining);
+        
+        if (std::strncmp((const char *)chunkInfo.header_name, "data", 4) == 0) {
+            if (!hasFormat) {
+                return {};
+            }
+            chunkInfo.size = (uint32_t)chunkSize;
+            break;
+        }
+        
+        // Chunks are padded to an even length
+        const std::streamoff paddedSize = std::min<std::streamoff>(chunkSize + (chunkSize & 1), remaining);
+        if (std::strncmp((const char *)chunkInfo.header_name, "fmt ", 4) == 0) {
+            if (chunkSize < (std::streamoff)sizeof(FmtData) ||
+                !file.read(reinterpret_cast<char*>(&fmtData), sizeof(FmtData))) {
+                return {};
+            }
+            hasFormat = true;
+            file.seekg(paddedSize - (std::streamoff)sizeof(FmtData), std::ios::cur);  // skip any extension
         } else {
-            // Read format data
-            file.read(reinterpret_cast<char*>(&fmtData), sizeof(FmtData));
+            file.seekg(paddedSize, std::ios::cur);  // Skip chunk
         }
-    } while(std::strncmp((const char *)chunkInfo.header_name, "fmt ", 4) != 0);
-    
-    do {
-        // Read chunk ID and size
-        file.read(reinterpret_cast<char*>(&chunkInfo), sizeof(chunkInfo));
-
-        if(std::strncmp((const char *)chunkInfo.header_name, "data", 4) != 0) {
-            file.seekg(chunkInfo.size, std::ios::cur);  // Skip chunk
+        remaining -= paddedSize;
+        if (!file) {
+            return {};
         }
-    } while(std::strncmp((const char *)chunkInfo.header_name, "data", 4) != 0);
-
-    // Check Data Chunk
-    if (std::strncmp((const char *)chunkInfo.header_name, "data", 4) != 0) {
+    }
+    
+    // PCM or WAVE_FORMAT_EXTENSIBLE carrying PCM; anything else would need converting
+    const bool pcm = fmtData.format_type == 1 || fmtData.format_type == 0xFFFE;
+    if (!pcm || fmtData.bits_per_sample != 16 || fmtData.channels == 0) {
         return {};
     }
     
+    if (sampleRate != nullptr) {
+        *sampleRate = fmtData.sample_rate;
+    }
+    
     // Calculate number of samples
-    size_t num_samples = chunkInfo.size / (fmtData.bits_per_sample / 8);
+    size_t num_samples = chunkInfo.size / sizeof(int16_t);
 
-    // Read samples
-    std::vector<float> data(num_samples);
-    for (size_t i = 0; i < num_samples; ++i) {
-        short sample;
-        file.read(reinterpret_cast<char*>(&sample), sizeof(short));
-        data[i] = sample / 32768.0f;  // Convert to [-1, 1]
+    // Read samples in one go and convert to [-1, 1]
+    std::vector<int16_t> pcmSamples(num_samples);
+    file.read(reinterpret_cast<char*>(pcmSamples.data()), num_samples * sizeof(int16_t));
+    pcmSamples.resize(file.gcount() / sizeof(int16_t));
+    std::vector<float> data(pcmSamples.size());
+    MixKernels::int16ToFloat(pcmSamples.data(), data.data(), (int)pcmSamples.size());
+    if (fmtData.channels == 1) {
+        return data;
     }
 
+    // Downmix the interleaved frames in place; a partial frame at the end is dropped
+    const size_t channels = fmtData.channels;
+    const size_t frames = data.size() / channels;
+    const float scale = 1.0f / (float)channels;
+    for (size_t frame = 0; frame < frames; ++frame) {
+        float sum = 0.0f;
+        for (size_t channel = 0; channel < channels; ++channel) {
+            sum += data[frame * channels + channel];
+        }
+        data[frame] = sum * scale;
+    }
+    data.resize(frames);
     return data;
 }
 
+// Reads a 16-bit PCM file as mono; `sampleRate`, when given, receives the file's rate
+inline std::vector<float> load_wav_file(const std::string &filename, uint32_t *sampleRate = nullptr) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) {
+        // Handle error
+        return {};
+    }
+    return read_wav(file, sampleRate);
+}
+
 #endif /* WavUtil_h */
@@ -0,0 +1,128 @@
+//
+//  WavWriter.hpp
+//  BeatMachineExtension
+//
+
+#pragma once
+
+#import <algorithm>
+#import <vector>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include "WavUtil.hpp"
+#include "MixKernels.hpp"
+
+/*
+ WavWriter
+ Writes 16-bit PCM WAV files, the format load_wav_file reads back. Samples are converted
+ and interleaved into a fixed buffer and only go to disk when it fills, so a fast offline
+ render makes a few large writes instead of one per block. The RIFF and data sizes are
+ patched in by close(). Not realtime safe.
+ */
+class WavWriter {
+public:
+    static const int bufferFrames = 65536;
+
+private:
+    std::ofstream mFile;
+    int mChannelCount = 0;
+    uint32_t mFramesWritten = 0;
+    int mBufferedFrames = 0;
+    std::vector<int16_t> mBuffer;   // interleaved
+    std::vector<float> mScratch;
+    bool mFailed = false;
+
+public:
+    ~WavWriter() {
+        close();
+    }
+
+    bool open(const std::string& path, int channelCount, double sampleRate) {
+        close();
+        mFile.open(path, std::ios::binary | std::ios::trunc);
+        mChannelCount = std::max(channelCount, 1);
+        mFramesWritten = 0;
+        mBufferedFrames = 0;
+        mBuffer.assign(size_t(bufferFrames) * mChannelCount, 0);
+        mScratch.assign(bufferFrames, 0.0f);
+        mFailed = !mFile;
+        if (!mFailed) {
+            writeHeader((uint32_t)sampleRate);
+        }
+        return !mFailed;
+    }
+
+    bool isOpen() const {
+        return mFile.is_open();
+    }
+
+    // `channels` holds one deinterleaved buffer of `frameCount` samples per channel
+    bool write(const float* const* channels, int frameCount) {
+        int done = 0;
+        while (done < frameCount && !mFailed) {
+            const int count = std::min(frameCount - done, bufferFrames - mBufferedFrames);
+            int16_t* frame = mBuffer.data() + size_t(mBufferedFrames) * mChannelCount;
+            for (int channel = 0; channel < mChannelCount; ++channel) {
+                MixKernels::floatToInt16(channels[channel] + done, frame + channel, mChannelCount, mScratch.data(), count);
+            }
+            mBufferedFrames += count;
+            done += count;
+            if (mBufferedFrames == bufferFrames) {
+                flush();
+            }
+        }
+        return !mFailed;
+    }
+
+    // Writes what is buffered and fixes up the header. Returns false if anything failed.
+    bool close() {
+        if (!mFile.is_open()) {
+            return !mFailed;
+        }
+        flush();
+        const uint32_t dataSize = mFramesWritten * mChannelCount * sizeof(int16_t);
+        const uint32_t riffSize = 4 + sizeof(ChunkInfo) + sizeof(FmtData) + sizeof(ChunkInfo) + dataSize;
+        mFile.seekp(offsetof(RiffChunk, overall_size));
+        mFile.write(reinterpret_cast<const char*>(&riffSize), sizeof(riffSize));
+        mFile.seekp(sizeof(RiffChunk) + sizeof(ChunkInfo) + sizeof(FmtData) + offsetof(ChunkInfo, size));
+        mFile.write(reinterpret_cast<const char*>(&dataSize), sizeof(dataSize));
+        mFailed = mFailed || !mFile;
+        mFile.close();
+        return !mFailed;
+    }
+
+    uint32_t framesWritten() const {
+        return mFramesWritten + mBufferedFrames;
+    }
+
+private:
+    void writeHeader(uint32_t sampleRate) {
+        RiffChunk riff { { 'R', 'I', 'F', 'F' }, 0, { 'W', 'A', 'V', 'E' } };
+        ChunkInfo format { { 'f', 'm', 't', ' ' }, sizeof(FmtData) };
+        FmtData data;
+        data.format_type = 1;   // PCM
+        data.channels = (uint16_t)mChannelCount;
+        data.sample_rate = sampleRate;
+        data.bits_per_sample = 16;
+        data.block_align = (uint16_t)(mChannelCount * sizeof(int16_t));
+        data.byterate = sampleRate * data.block_align;
+        ChunkInfo samples { { 'd', 'a', 't', 'a' }, 0 };
+        mFile.write(reinterpret_cast<const char*>(&riff), sizeof(riff));
+        mFile.write(reinterpret_cast<const char*>(&format), sizeof(format));
+        mFile.write(reinterpret_cast<const char*>(&data), sizeof(data));
+        mFile.write(reinterpret_cast<const char*>(&samples), sizeof(samples));
+        mFailed = !mFile;
+    }
+
+    void flush() {
+        if (mBufferedFrames == 0 || mFailed) {
+            return;
+        }
+        mFile.write(reinterpret_cast<const char*>(mBuffer.data()), std::streamsize(mBufferedFrames) * mChannelCount * sizeof(int16_t));
+        mFramesWritten += mBufferedFrames;
+        mBufferedFrames = 0;
+        mFailed = !mFile;
+    }
+};
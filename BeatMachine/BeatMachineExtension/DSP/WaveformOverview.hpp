@@ -0,0 +1,152 @@
+//
+//  WaveformOverview.hpp
+//  BeatMachineExtension
+//
+
+#pragma once
+
+#import <Accelerate/Accelerate.h>
+#import <algorithm>
+#import <array>
+#import <mutex>
+#import <vector>
+#include <cstdint>
+
+/*
+ WaveformOverview
+ Min/max summaries of one take at several resolutions, for drawing. Level 0 holds one
+ min/max pair per baseBucket samples and every level above merges levelFactor buckets of
+ the one below. extend() is called on the background worker as the take grows and only
+ recomputes the buckets the new samples touch; read() fills one min/max pair per pixel
+ from the coarsest level that still resolves a pixel, so drawing costs O(pixels) at any
+ zoom. A mutex guards the summaries between the worker and the UI; the render thread
+ never touches them.
+ */
+class WaveformOverview {
+public:
+    static constexpr int baseBucket = 64;
+    static constexpr int levelFactor = 4;
+    static constexpr int levelCount = 6;
+
+private:
+    struct Level {
+        int bucketSize = 0;
+        int count = 0;              // buckets holding data, the last one possibly partial
+        std::vector<float> minimum;
+        std::vector<float> maximum;
+    };
+    std::array<Level, levelCount> mLevels;
+    uint32_t mTakeId = 0;
+    int mLength = 0;                // samples summarised
+    mutable std::mutex mMutex;
+
+public:
+    // Not realtime safe. Sizes every level for takes of up to `capacity` samples.
+    void prepare(int capacity) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        int bucketSize = baseBucket;
+        for (Level& level : mLevels) {
+            const int buckets = (capacity + bucketSize - 1) / bucketSize;
+            level.bucketSize = bucketSize;
+            level.count = 0;
+            level.minimum.assign(buckets, 0.0f);
+            level.maximum.assign(buckets, 0.0f);
+            bucketSize *= levelFactor;
+        }
+        mLength = 0;
+    }
+
+    uint32_t takeId() const {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mTakeId;
+    }
+
+    int length() const {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mLength;
+    }
+
+    // Background thread. Forgets the summaries and starts on take `takeId`.
+    void reset(uint32_t takeId) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mTakeId = takeId;
+        mLength = 0;
+        for (Level& level : mLevels) {
+            level.count = 0;
+        }
+    }
+
+    // Background thread. `samples` holds the take so far, `length` samples long.
+    void extend(const float* samples, int length) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        length = std::min(length, (int)mLevels[0].minimum.size() * baseBucket);
+        if (length <= mLength) {
+            return;
+        }
+
+        // The bucket the previous extend() ended in may have been partial; redo it
+        Level& base = mLevels[0];
+        const int firstBucket = mLength / baseBucket;
+        const int endBucket = (length + baseBucket - 1) / baseBucket;
+        for (int bucket = firstBucket; bucket < endBucket; ++bucket) {
+            const int start = bucket * baseBucket;
+            const int count = std::min(baseBucket, length - start);
+            vDSP_minv(samples + start, 1, &base.minimum[bucket], count);
+            vDSP_maxv(samples + start, 1, &base.maximum[bucket], count);
+        }
+        base.count = endBucket;
+
+        int changedFrom = firstBucket;
+        for (int index = 1; index < levelCount; ++index) {
+            const Level& below = mLevels[index - 1];
+            Level& level = mLevels[index];
+            changedFrom /= levelFactor;
+            const int end = (below.count + levelFactor - 1) / levelFactor;
+            for (int bucket = changedFrom; bucket < end; ++bucket) {
+                const int first = bucket * levelFactor;
+                const int count = std::min(levelFactor, below.count - first);
+                vDSP_minv(&below.minimum[first], 1, &level.minimum[bucket], count);
+                vDSP_maxv(&below.maximum[first], 1, &level.maximum[bucket], count);
+            }
+            level.count = end;
+        }
+        mLength = length;
+    }
+
+    /*
+     Any thread but the render thread. Fills `minimum` and `maximum` with one pair per
+     pixel covering samples [start, end), cut down to the take, and returns how many pixels
+     hold data; pixels past what has been summarised are left alone. When a pixel spans
+     fewer than baseBucket samples it shows the level 0 bucket it falls in.
+     */
+    int read(int start, int end, int pixels, float* minimum, float* maximum) const {
+        std::lock_guard<std::mutex> lock(mMutex);
+        start = std::max(start, 0);
+        end = std::min(end, mLength);
+        if (pixels <= 0 || end <= start) {
+            return 0;
+        }
+        const double samplesPerPixel = double(end - start) / pixels;
+
+        int index = 0;
+        while (index + 1 < levelCount && mLevels[index + 1].bucketSize <= samplesPerPixel) {
+            ++index;
+        }
+        const Level& level = mLevels[index];
+
+        int filled = 0;
+        for (int pixel = 0; pixel < pixels; ++pixel) {
+            const int pixelStart = start + (int)(pixel * samplesPerPixel);
+            const int pixelEnd = std::max(pixelStart + 1, start + (int)((pixel + 1) * samplesPerPixel));
+            if (pixelStart >= end) {
+                break;
+            }
+            const int first = pixelStart / level.bucketSize;
+            const int last = std::min((pixelEnd - 1) / level.bucketSize, level.count - 1);
+            vDSP_minv(&level.minimum[first], 1, &minimum[pixel], last - first + 1);
+            vDSP_maxv(&level.maximum[first], 1, &maximum[pixel], last - first + 1);
+            filled = pixel + 1;
+        }
+        return filled;
+    }
+};
@@ -16,7 +16,25 @@ namespace BeatMachineExtensionParameterAddress {
 typedef NS_ENUM(AUParameterAddress, BeatMachineExtensionParameterAddress) {
     gain = 0,
     samplingMode = 1,
-    loopRecordMode = 2
+    loopRecordMode = 2,
+    filterCutoff = 3,
+    filterResonance = 4,
+    drive = 5,
+    compressorThreshold = 6,
+    compressorRatio = 7,
+    autoSlice = 8,
+    quantizeGrid = 9,
+    swing = 10,
+    sequencerEnabled = 11,
+    sequencerPattern = 12,
+    loopFeedback = 13,
+    inputLatency = 14,
+    takePreRoll = 15,
+    retrospectiveCapture = 16,
+    duckDepth = 17,
+    duckThreshold = 18,
+    duckRelease = 19,
+    reverbLevel = 20
 };
 
 #ifdef __cplusplus
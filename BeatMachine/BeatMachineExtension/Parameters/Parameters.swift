@@ -34,6 +34,162 @@ let BeatMachineExtensionParameterSpecs = ParameterTreeSpec {
             valueRange: 0.0...1.0,
             defaultValue: 0.0
         )
+        ParameterSpec(
+            address: .loopFeedback,
+            identifier: "loopFeedback",
+            name: "Loop Feedback",
+            units: .percent,
+            valueRange: 0.0...100.0,
+            defaultValue: 100.0
+        )
+        ParameterSpec(
+            address: .autoSlice,
+            identifier: "autoSlice",
+            name: "Auto Slice",
+            units: .boolean,
+            valueRange: 0.0...1.0,
+            defaultValue: 0.0
+        )
+        ParameterSpec(
+            address: .inputLatency,
+            identifier: "inputLatency",
+            name: "Input Latency",
+            units: .milliseconds,
+            valueRange: 0.0...250.0,
+            defaultValue: 0.0
+        )
+        ParameterSpec(
+            address: .takePreRoll,
+            identifier: "takePreRoll",
+            name: "Take Pre-Roll",
+            units: .milliseconds,
+            valueRange: 0.0...250.0,
+            defaultValue: 0.0
+        )
+        ParameterSpec(
+            address: .retrospectiveCapture,
+            identifier: "retrospectiveCapture",
+            name: "Retrospective Capture",
+            units: .boolean,
+            valueRange: 0.0...1.0,
+            defaultValue: 0.0
+        )
+    }
+    ParameterGroupSpec(identifier: "padEffects", name: "Pad Effects") {
+        ParameterSpec(
+            address: .filterCutoff,
+            identifier: "filterCutoff",
+            name: "Filter Cutoff",
+            units: .hertz,
+            valueRange: 20.0...20000.0,
+            defaultValue: 20000.0
+        )
+        ParameterSpec(
+            address: .filterResonance,
+            identifier: "filterResonance",
+            name: "Filter Resonance",
+            units: .generic,
+            valueRange: 0.5...10.0,
+            defaultValue: 0.707
+        )
+        ParameterSpec(
+            address: .drive,
+            identifier: "drive",
+            name: "Drive",
+            units: .decibels,
+            valueRange: 0.0...24.0,
+            defaultValue: 0.0
+        )
+        ParameterSpec(
+            address: .compressorThreshold,
+            identifier: "compressorThreshold",
+            name: "Compressor Threshold",
+            units: .decibels,
+            valueRange: -60.0...0.0,
+            defaultValue: 0.0
+        )
+        ParameterSpec(
+            address: .compressorRatio,
+            identifier: "compressorRatio",
+            name: "Compressor Ratio",
+            units: .ratio,
+            valueRange: 1.0...20.0,
+            defaultValue: 1.0
+        )
+    }
+    ParameterGroupSpec(identifier: "sidechain", name: "Sidechain") {
+        ParameterSpec(
+            address: .duckDepth,
+            identifier: "duckDepth",
+            name: "Duck Depth",
+            units: .decibels,
+            valueRange: 0.0...48.0,
+            defaultValue: 0.0
+        )
+        ParameterSpec(
+            address: .duckThreshold,
+            identifier: "duckThreshold",
+            name: "Duck Threshold",
+            units: .decibels,
+            valueRange: -60.0...0.0,
+            defaultValue: -30.0
+        )
+        ParameterSpec(
+            address: .duckRelease,
+            identifier: "duckRelease",
+            name: "Duck Release",
+            units: .milliseconds,
+            valueRange: 10.0...1000.0,
+            defaultValue: 150.0
+        )
+    }
+    ParameterGroupSpec(identifier: "reverb", name: "Reverb") {
+        ParameterSpec(
+            address: .reverbLevel,
+            identifier: "reverbLevel",
+            name: "Reverb Level",
+            units: .percent,
+            valueRange: 0.0...100.0,
+            defaultValue: 100.0
+        )
+    }
+    ParameterGroupSpec(identifier: "timing", name: "Timing") {
+        ParameterSpec(
+            address: .quantizeGrid,
+            identifier: "quantizeGrid",
+            name: "Quantize",
+            units: .indexed,
+            valueRange: 0.0...4.0,
+            defaultValue: 0.0,
+            valueStrings: ["Off", "1/4", "1/8", "1/16", "1/32"]
+        )
+        ParameterSpec(
+            address: .swing,
+            identifier: "swing",
+            name: "Swing",
+            units: .percent,
+            valueRange: 50.0...75.0,
+            defaultValue: 50.0
+        )
+    }
+    ParameterGroupSpec(identifier: "sequencer", name: "Sequencer") {
+        ParameterSpec(
+            address: .sequencerEnabled,
+            identifier: "sequencerEnabled",
+            name: "Sequencer",
+            units: .boolean,
+            valueRange: 0.0...1.0,
+            defaultValue: 0.0
+        )
+        ParameterSpec(
+            address: .sequencerPattern,
+            identifier: "sequencerPattern",
+            name: "Pattern",
+            units: .indexed,
+            valueRange: 0.0...7.0,
+            defaultValue: 0.0,
+            valueStrings: ["A", "B", "C", "D", "E", "F", "G", "H"]
+        )
     }
 }
 
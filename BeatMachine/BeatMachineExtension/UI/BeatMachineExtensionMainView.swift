@@ -20,6 +20,34 @@ struct BeatMachineExtensionMainView: View {
             ParameterSlider(param: parameterTree.global.gain)
             IsRecordingView(param: parameterTree.global.samplingMode)
             IsRecordingView(param: parameterTree.global.loopRecordMode)
+            ParameterSlider(param: parameterTree.global.loopFeedback)
+            HStack {
+                ParameterSlider(param: parameterTree.global.inputLatency)
+                ParameterSlider(param: parameterTree.global.takePreRoll)
+            }
+            HStack {
+                ParameterSlider(param: parameterTree.padEffects.filterCutoff)
+                ParameterSlider(param: parameterTree.padEffects.filterResonance)
+                ParameterSlider(param: parameterTree.padEffects.drive)
+            }
+            HStack {
+                ParameterSlider(param: parameterTree.padEffects.compressorThreshold)
+                ParameterSlider(param: parameterTree.padEffects.compressorRatio)
+            }
+            HStack {
+                ParameterSlider(param: parameterTree.sidechain.duckDepth)
+                ParameterSlider(param: parameterTree.sidechain.duckThreshold)
+                ParameterSlider(param: parameterTree.sidechain.duckRelease)
+            }
+            ParameterSlider(param: parameterTree.reverb.reverbLevel)
+            HStack {
+                ParameterSlider(param: parameterTree.timing.quantizeGrid)
+                ParameterSlider(param: parameterTree.timing.swing)
+            }
+            HStack {
+                ParameterSlider(param: parameterTree.sequencer.sequencerEnabled)
+                ParameterSlider(param: parameterTree.sequencer.sequencerPattern)
+            }
             //KeyboardView(midiNote: parameterTree.global.MIDINote, noteOn: parameterTree.global.NoteOn)
         }
     }
@@ -0,0 +1,220 @@
+//
+//  BenchmarkMain.cpp
+//  BeatMachineExtensionTests
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+#include "AllocationCounter.hpp"
+#include "BenchmarkSuite.hpp"
+
+/*
+ Runs every registered benchmark (or those matching --filter) for at least --min-time
+ seconds each, after a short warm-up, timing each iteration. A table goes to stderr as
+ results come in; the JSON goes to --json, or to stdout. The JSON follows Google
+ Benchmark's layout (context, then benchmarks with real_time, cpu_time and time_unit per
+ iteration), so its compare.py and CI dashboards that read that format work on it
+ unchanged. Each entry adds:
+
+   median_ns, p99_ns, max_ns    per-iteration wall time
+   load, p99_load               wall time over the audio an iteration renders (audio only);
+                                1.0 means it took as long as the audio lasts
+   bytes_per_second             throughput (kernels that report bytes)
+   allocations_per_iteration    heap allocations on the timing thread; 0 for the render path
+
+ followed by any counters the benchmark reports, under their own names.
+ */
+namespace {
+
+struct Options {
+    std::string filter;
+    double minimumSeconds = 0.5;
+    std::string jsonPath;
+    bool list = false;
+};
+
+struct Result {
+    std::string name;
+    long iterations = 0;
+    double meanNanoseconds = 0.0;
+    double cpuNanoseconds = 0.0;
+    double medianNanoseconds = 0.0;
+    double p99Nanoseconds = 0.0;
+    double maximumNanoseconds = 0.0;
+    double audioSeconds = 0.0;
+    double bytes = 0.0;
+    double allocations = 0.0;
+    std::vector<std::pair<std::string, double>> counters;
+};
+
+double threadCPUSeconds() {
+    timespec time {};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return double(time.tv_sec) + double(time.tv_nsec) * 1e-9;
+}
+
+Result measure(const BenchmarkSuite::Entry& entry, double minimumSeconds) {
+    using Clock = std::chrono::steady_clock;
+    Result result;
+    result.name = entry.name;
+    BenchmarkRun run = entry.setup();
+    result.audioSeconds = run.audioSeconds;
+    result.bytes = run.bytes;
+
+    // warm caches, the branch predictor and anything the first cycles set up
+    const auto warmUpEnd = Clock::now() + std::chrono::duration<double>(std::min(0.05, minimumSeconds));
+    for (int i = 0; i < 10 || Clock::now() < warmUpEnd; ++i) {
+        run.iteration();
+    }
+
+    std::vector<double> times;
+    times.reserve(1 << 20);
+    const double cpuStart = threadCPUSeconds();
+    const auto start = Clock::now();
+    long allocations = 0;
+    {
+        AllocationScope scope;
+        auto now = start;
+        while (times.size() < 10 || std::chrono::duration<double>(now - start).count() < minimumSeconds) {
+            const auto before = Clock::now();
+            run.iteration();
+            now = Clock::now();
+            if (times.size() < times.capacity()) {
+                times.push_back(std::chrono::duration<double, std::nano>(now - before).count());
+            }
+            result.iterations += 1;
+        }
+        allocations = scope.count();
+    }
+    const double wall = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    const double cpu = (threadCPUSeconds() - cpuStart) * 1e9;
+
+    std::sort(times.begin(), times.end());
+    result.meanNanoseconds = wall / double(result.iterations);
+    result.cpuNanoseconds = cpu / double(result.iterations);
+    result.medianNanoseconds = times[times.size() / 2];
+    result.p99Nanoseconds = times[std::min(times.size() - 1, times.size() * 99 / 100)];
+    result.maximumNanoseconds = times.back();
+    result.allocations = double(allocations) / double(result.iterations);
+    for (const auto& [name, counter] : run.counters) {
+        result.counters.emplace_back(name, counter());
+    }
+    return result;
+}
+
+std::string escaped(const std::string& text) {
+    std::string out;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += c;
+    }
+    return out;
+}
+
+std::string json(const std::vector<Result>& results, const char* executable) {
+    char date[64];
+    const std::time_t now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", std::localtime(&now));
+    char host[256] = "";
+    gethostname(host, sizeof(host) - 1);
+
+    std::ostringstream out;
+    out.precision(9);
+    out << "{\n  \"context\": {\n"
+        << "    \"date\": \"" << date << "\",\n"
+        << "    \"host_name\": \"" << escaped(host) << "\",\n"
+        << "    \"executable\": \"" << escaped(executable) << "\",\n"
+        << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n"
+        << "    \"library_build_type\": \"" << BEATMACHINE_BUILD_TYPE << "\",\n"
+        << "    \"accelerate\": \"" << BEATMACHINE_ACCELERATE << "\"\n"
+        << "  },\n  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& result = results[i];
+        out << (i == 0 ? "\n" : ",\n") << "    {\n"
+            << "      \"name\": \"" << escaped(result.name) << "\",\n"
+            << "      \"run_name\": \"" << escaped(result.name) << "\",\n"
+            << "      \"run_type\": \"iteration\",\n"
+            << "      \"iterations\": " << result.iterations << ",\n"
+            << "      \"real_time\": " << result.meanNanoseconds << ",\n"
+            << "      \"cpu_time\": " << result.cpuNanoseconds << ",\n"
+            << "      \"time_unit\": \"ns\",\n"
+            << "      \"median_ns\": " << result.medianNanoseconds << ",\n"
+            << "      \"p99_ns\": " << result.p99Nanoseconds << ",\n"
+            << "      \"max_ns\": " << result.maximumNanoseconds << ",\n";
+        if (result.audioSeconds > 0.0) {
+            out << "      \"load\": " << result.meanNanoseconds * 1e-9 / result.audioSeconds << ",\n"
+                << "      \"p99_load\": " << result.p99Nanoseconds * 1e-9 / result.audioSeconds << ",\n";
+        }
+        if (result.bytes > 0.0) {
+            out << "      \"bytes_per_second\": " << result.bytes / (result.meanNanoseconds * 1e-9) << ",\n";
+        }
+        out << "      \"allocations_per_iteration\": " << result.allocations;
+        for (const auto& [name, value] : result.counters) {
+            out << ",\n      \"" << escaped(name) << "\": " << value;
+        }
+        out << "\n    }";
+    }
+    out << "\n  ]\n}\n";
+    return out.str();
+}
+
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        const bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--filter") == 0 && hasValue) {
+            options.filter = argv[++i];
+        } else if (std::strcmp(argv[i], "--min-time") == 0 && hasValue) {
+            options.minimumSeconds = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--json") == 0 && hasValue) {
+            options.jsonPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--list") == 0) {
+            options.list = true;
+        } else {
+            std::fprintf(stderr, "usage: %s [--filter text] [--min-time seconds] [--json path] [--list]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    std::vector<Result> results;
+    std::fprintf(stderr, "%-44s %12s %12s %12s %10s %10s\n", "benchmark", "mean ns", "median ns", "p99 ns", "load", "GB/s");
+    for (const auto& entry : BenchmarkSuite::shared().entries()) {
+        if (!options.filter.empty() && entry.name.find(options.filter) == std::string::npos) {
+            continue;
+        }
+        if (options.list) {
+            std::printf("%s\n", entry.name.c_str());
+            continue;
+        }
+        const Result result = measure(entry, options.minimumSeconds);
+        std::fprintf(stderr, "%-44s %12.0f %12.0f %12.0f %10.4f %10.2f%s\n", result.name.c_str(),
+                     result.meanNanoseconds, result.medianNanoseconds, result.p99Nanoseconds,
+                     result.audioSeconds > 0.0 ? result.meanNanoseconds * 1e-9 / result.audioSeconds : 0.0,
+                     result.bytes > 0.0 ? result.bytes / result.meanNanoseconds : 0.0,
+                     result.allocations > 0.0 ? "  allocates" : "");
+        results.push_back(result);
+    }
+    if (options.list) {
+        return 0;
+    }
+
+    const std::string report = json(results, argv[0]);
+    if (options.jsonPath.empty()) {
+        std::fputs(report.c_str(), stdout);
+    } else {
+        std::ofstream(options.jsonPath) << report;
+    }
+    return 0;
+}
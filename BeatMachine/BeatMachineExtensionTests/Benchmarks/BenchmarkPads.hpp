@@ -0,0 +1,45 @@
+//
+//  BenchmarkPads.hpp
+//  BeatMachineExtensionTests
+//
+
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include "KernelRig.hpp"
+
+// One second of a few partials, copied into every pad so setup stays quick
+inline const std::vector<float>& padTone() {
+    static const std::vector<float> tone = [] {
+        std::vector<float> samples(44100);
+        for (size_t i = 0; i < samples.size(); ++i) {
+            const float phase = float(i) * 2.0f * float(M_PI) / 441.0f;
+            samples[i] = 0.1f * (std::sin(phase) + 0.5f * std::sin(3.0f * phase) + 0.25f * std::sin(7.0f * phase));
+        }
+        return samples;
+    }();
+    return tone;
+}
+
+// Loads `count` pads from note 2 up with takes that loop after their first 100 ms, past
+// the crossfade, and starts them all
+inline void startPads(KernelRig& rig, int count) {
+    const std::vector<float>& tone = padTone();
+    for (int pad = 0; pad < count; ++pad) {
+        const int note = 2 + pad;
+        float* take = makeTake(int(tone.size()), [&tone](int i) { return tone[size_t(i)]; });
+        rig.kernel.postCommand(KernelCommand::loadPadCommand(note, take, int(tone.size())));
+        rig.kernel.postCommand(KernelCommand::padSettingCommand(note, KernelCommand::PadSetting::Kind::Loop, int(tone.size()) / 10, int(tone.size())));
+        if (pad % 32 == 31) {
+            rig.render();
+        }
+    }
+    rig.render();
+
+    std::vector<AURenderEvent> notes;
+    for (int pad = 0; pad < count; ++pad) {
+        notes.push_back(noteEvent(rig.now, true, 2 + pad));
+    }
+    rig.render(notes);
+}
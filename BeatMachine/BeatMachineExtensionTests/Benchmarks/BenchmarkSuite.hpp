@@ -0,0 +1,60 @@
+//
+//  BenchmarkSuite.hpp
+//  BeatMachineExtensionTests
+//
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ BenchmarkSuite
+ The registry behind BeatMachineBenchmarks. A benchmark is a name and a setup function;
+ setup runs untimed and returns the iteration to time, along with how much audio or how
+ many bytes one iteration covers, so results can be reported as real-time load or
+ throughput, and any counters of its own to report alongside. Each source file in
+ Benchmarks/ registers its own from a static BenchmarkRegistration. Names are
+ slash-separated, family first, and --filter matches any part of them.
+ */
+struct BenchmarkRun {
+    std::function<void()> iteration;
+    double audioSeconds = 0.0;      // audio rendered per iteration; 0 when not audio
+    double bytes = 0.0;             // bytes processed per iteration; 0 when not meaningful
+    // read once timing is done and reported under their names
+    std::vector<std::pair<std::string, std::function<double()>>> counters;
+};
+
+class BenchmarkSuite {
+public:
+    using Setup = std::function<BenchmarkRun()>;
+
+    struct Entry {
+        std::string name;
+        Setup setup;
+    };
+
+    static BenchmarkSuite& shared() {
+        static BenchmarkSuite suite;
+        return suite;
+    }
+
+    void add(std::string name, Setup setup) {
+        mEntries.push_back({ std::move(name), std::move(setup) });
+    }
+
+    const std::vector<Entry>& entries() const {
+        return mEntries;
+    }
+
+private:
+    std::vector<Entry> mEntries;
+};
+
+struct BenchmarkRegistration {
+    explicit BenchmarkRegistration(const std::function<void(BenchmarkSuite&)>& registerBenchmarks) {
+        registerBenchmarks(BenchmarkSuite::shared());
+    }
+};
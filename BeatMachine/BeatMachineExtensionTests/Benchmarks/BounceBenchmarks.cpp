@@ -0,0 +1,103 @@
+//
+//  BounceBenchmarks.cpp
+//  BeatMachineExtensionTests
+//
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <unistd.h>
+#include "BenchmarkPads.hpp"
+#include "BenchmarkSuite.hpp"
+#include "OfflineBounce.hpp"
+
+/*
+ OfflineBounce::render, start to finish, into a stereo WAV file: a two-bar loop playing in
+ loop mode under a four-track sequencer pattern of kick, snare, hats and a syncopated
+ fourth, at 144 BPM, the tempo the loop was recorded at. Each iteration is a whole bounce,
+ so the time includes writing the file and the kernel's initialize and deInitialize.
+
+ Named Bounce/<bars>, at 44.1 kHz. Besides load, realtime_multiple reports the mean of what
+ the bounce itself measured, Result::realtimeMultiple().
+ */
+namespace {
+
+const double sampleRate = 44100.0;
+const double tempo = 144.0;
+const int tracks = 4;
+
+// Every track's pad, and pattern 0 with the tracks on them
+void loadPattern(BeatMachineExtensionDSPKernel& kernel) {
+    const std::vector<float>& tone = padTone();
+    const int hits[tracks][StepSequencer::minimumSteps] = {
+        { 1, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0 },
+        { 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1 },
+        { 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 },
+        { 0, 0, 1, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 1, 0, 1 },
+    };
+    for (int track = 0; track < tracks; ++track) {
+        const int note = StepSequencer::firstTrackNote + track;
+        // short hits, so steps overlap only on the hats
+        const int length = int(tone.size()) / (track == 2 ? 20 : 4);
+        kernel.postCommand(KernelCommand::loadPadCommand(note, makeTake(length, [&tone](int i) { return tone[size_t(i)]; }), length));
+        for (int step = 0; step < StepSequencer::minimumSteps; ++step) {
+            if (hits[track][step] == 0) {
+                continue;
+            }
+            StepSequencer::Edit edit;
+            edit.type = StepSequencer::Edit::Type::SetStep;
+            edit.track = uint8_t(track);
+            edit.step = uint8_t(step);
+            edit.velocity = uint8_t(step % 4 == 0 ? 127 : 90);
+            edit.probability = track == 2 ? 80 : 100;
+            kernel.postCommand(KernelCommand::sequencerEditCommand(edit));
+        }
+    }
+}
+
+// Two bars of the pad tone at the loop's tempo, in a buffer the kernel takes over
+void loadLoop(BeatMachineExtensionDSPKernel& kernel) {
+    const std::vector<float>& tone = padTone();
+    const int length = int(2.0 * 4.0 * 60.0 / tempo * sampleRate);
+    float* loop = new float[size_t(kernel.loopAllocation())]();
+    for (int i = 0; i < length; ++i) {
+        loop[i] = 0.5f * tone[size_t(i) % tone.size()];
+    }
+    kernel.postCommand(KernelCommand::loadLoopCommand(loop, length));
+}
+
+BenchmarkRun bounce(int bars) {
+    auto kernel = std::make_shared<BeatMachineExtensionDSPKernel>();
+    kernel->prepare(std::string());
+    loadPattern(*kernel);
+    loadLoop(*kernel);
+    kernel->setParameter(BeatMachineExtensionParameterAddress::sequencerEnabled, 1.0f);
+    kernel->setParameter(BeatMachineExtensionParameterAddress::loopRecordMode, 1.0f);
+
+    const std::string path = "/tmp/BounceBenchmarks." + std::to_string(getpid()) + ".wav";
+    // summed over every bounce, warm-up included, for the mean
+    auto multiples = std::make_shared<std::pair<double, long>>(0.0, 0);
+
+    BenchmarkRun run;
+    run.audioSeconds = bars * 4.0 * 60.0 / tempo;
+    run.iteration = [kernel, path, bars, multiples] {
+        const OfflineBounce::Result result = OfflineBounce::render(*kernel, 2, sampleRate, tempo, bars, path);
+        std::remove(path.c_str());
+        multiples->first += result.realtimeMultiple();
+        multiples->second += 1;
+    };
+    run.counters.emplace_back("realtime_multiple", [multiples] {
+        return multiples->second > 0 ? multiples->first / double(multiples->second) : 0.0;
+    });
+    return run;
+}
+
+BenchmarkRegistration registration([](BenchmarkSuite& suite) {
+    for (int bars : { 1, 4, 16 }) {
+        suite.add("Bounce/" + std::to_string(bars), [bars] {
+            return bounce(bars);
+        });
+    }
+});
+
+}
@@ -0,0 +1,101 @@
+//
+//  DuckerBenchmarks.cpp
+//  BeatMachineExtensionTests
+//
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "BenchmarkPads.hpp"
+#include "BenchmarkSuite.hpp"
+#include "SidechainDucker.hpp"
+
+/*
+ The sidechain ducker on its own, 24 dB deep, on a loud bus:
+
+   unpulled      no sidechain buffer, as when the bus fails to pull
+   quiet         a sidechain below the threshold, so the gain stays put
+   ducking       a loud sidechain, the gain moving every chunk
+
+ Then the whole render with eight pads playing, without the sidechain and with a loud one,
+ which adds the pull's mono mix and the ducker to the pads. bytes_per_second counts the
+ sidechain read and the bus read and written.
+
+ Named Ducker/<sidechain>/<frames> and Ducker/render/<off|on>, at 44.1 kHz.
+ */
+namespace {
+
+enum class Sidechain { Unpulled, Quiet, Ducking };
+
+const double sampleRate = 44100.0;
+const float depth = 24.0f;
+
+std::vector<float> sidechainSignal(Sidechain sidechain, int frames) {
+    // -40 dBFS sits under the default threshold of -30, -6 well over it
+    const float level = sidechain == Sidechain::Quiet ? 0.01f : 0.5f;
+    std::vector<float> samples(frames);
+    for (int i = 0; i < frames; ++i) {
+        samples[size_t(i)] = level * std::sin(float(i) * 0.03f);
+    }
+    return samples;
+}
+
+BenchmarkRun duck(Sidechain sidechain, int frames) {
+    auto ducker = std::make_shared<SidechainDucker>();
+    ducker->prepare(sampleRate);
+    ducker->setDepth(depth);
+
+    auto source = std::make_shared<std::vector<float>>(frames);
+    for (int i = 0; i < frames; ++i) {
+        (*source)[size_t(i)] = 0.8f * std::sin(float(i) * 0.05f);
+    }
+    auto bus = std::make_shared<std::vector<float>>(frames);
+    auto key = std::make_shared<std::vector<float>>(sidechainSignal(sidechain, frames));
+    const float* keyData = sidechain == Sidechain::Unpulled ? nullptr : key->data();
+
+    BenchmarkRun run;
+    run.audioSeconds = double(frames) / sampleRate;
+    run.bytes = double(frames) * sizeof(float) * 3.0;
+    run.iteration = [ducker, source, bus, key, keyData, frames] {
+        std::copy(source->begin(), source->end(), bus->begin());
+        ducker->process(keyData, bus->data(), frames);
+    };
+    return run;
+}
+
+BenchmarkRun render(bool ducking) {
+    const int frames = 512;
+    auto rig = std::make_shared<KernelRig>(frames, sampleRate);
+    startPads(*rig, 8);
+    rig->setParameter(BeatMachineExtensionParameterAddress::duckDepth, ducking ? depth : 0.0f);
+    auto key = std::make_shared<std::vector<float>>(ducking ? sidechainSignal(Sidechain::Ducking, frames) : std::vector<float>());
+
+    BenchmarkRun run;
+    run.audioSeconds = double(frames) / sampleRate;
+    run.iteration = [rig, key, frames] {
+        rig->render({}, frames, *key);
+    };
+    return run;
+}
+
+BenchmarkRegistration registration([](BenchmarkSuite& suite) {
+    const std::pair<const char*, Sidechain> sidechains[] = {
+        { "unpulled", Sidechain::Unpulled },
+        { "quiet", Sidechain::Quiet },
+        { "ducking", Sidechain::Ducking },
+    };
+    for (const auto& [name, sidechain] : sidechains) {
+        for (int frames : { 64, 256, 1024 }) {
+            suite.add(std::string("Ducker/") + name + "/" + std::to_string(frames), [sidechain, frames] {
+                return duck(sidechain, frames);
+            });
+        }
+    }
+    suite.add("Ducker/render/off", [] { return render(false); });
+    suite.add("Ducker/render/on", [] { return render(true); });
+});
+
+}
@@ -0,0 +1,74 @@
+//
+//  EffectBenchmarks.cpp
+//  BeatMachineExtensionTests
+//
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "BenchmarkSuite.hpp"
+#include "PadEffectChain.hpp"
+
+/*
+ The pad bus insert chain, one effect engaged at a time and then all three, on a loud
+ bus. The chain runs once on the mono bus however many pads play, so this is its whole
+ cost; what each extra voice adds is the slope of Render/pads/N.
+
+ Named Effects/<effect>/<frames>, at 44.1 kHz.
+ */
+namespace {
+
+enum class Effect { Bypassed, Filter, Drive, Compressor, Chain };
+
+BenchmarkRun effect(Effect engaged, int frames) {
+    auto chain = std::make_shared<PadEffectChain>();
+    if (engaged == Effect::Filter || engaged == Effect::Chain) {
+        chain->setCutoff(1000.0f);
+        chain->setResonance(2.0f);
+    }
+    if (engaged == Effect::Drive || engaged == Effect::Chain) {
+        chain->setDrive(12.0f);
+    }
+    if (engaged == Effect::Compressor || engaged == Effect::Chain) {
+        chain->setThreshold(-20.0f);
+        chain->setRatio(4.0f);
+    }
+    chain->allocate(AUAudioFrameCount(frames), 44100.0);
+
+    auto source = std::make_shared<std::vector<float>>(size_t(frames));
+    for (int i = 0; i < frames; ++i) {
+        (*source)[size_t(i)] = 0.8f * std::sin(float(i) * 0.05f);
+    }
+    auto bus = std::make_shared<std::vector<float>>(size_t(frames));
+
+    BenchmarkRun run;
+    run.audioSeconds = double(frames) / 44100.0;
+    run.bytes = double(frames) * sizeof(float) * 2.0;
+    run.iteration = [chain, source, bus, frames] {
+        std::copy(source->begin(), source->end(), bus->begin());
+        chain->process(bus->data(), AUAudioFrameCount(frames));
+    };
+    return run;
+}
+
+BenchmarkRegistration registration([](BenchmarkSuite& suite) {
+    const std::pair<const char*, Effect> effects[] = {
+        { "bypassed", Effect::Bypassed },
+        { "filter", Effect::Filter },
+        { "drive", Effect::Drive },
+        { "compressor", Effect::Compressor },
+        { "chain", Effect::Chain },
+    };
+    for (const auto& [name, engaged] : effects) {
+        for (int frames : { 64, 256, 1024 }) {
+            suite.add(std::string("Effects/") + name + "/" + std::to_string(frames), [engaged, frames] {
+                return effect(engaged, frames);
+            });
+        }
+    }
+});
+
+}
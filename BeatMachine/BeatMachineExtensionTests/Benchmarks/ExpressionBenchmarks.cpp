@@ -0,0 +1,106 @@
+//
+//  ExpressionBenchmarks.cpp
+//  BeatMachineExtensionTests
+//
+
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include "BenchmarkPads.hpp"
+#include "BenchmarkSuite.hpp"
+
+/*
+ MIDI 2.0 per-note expression: parsing it and rendering the eight pads it modulates, at
+ 0 to 4096 messages per 512-frame buffer. Messages arrive 32 to an event list, spread over
+ the buffer, round-robin over the sounding notes with fresh random values:
+
+   pressure      poly pressure
+   bend          per-note pitch bend, which moves every voice onto its interpolating path
+   controller    assignable per-note controller 74, brightness
+   mixed         all three in turn
+
+ Each event list splits the render at its sample time, so at 4096 messages the buffer
+ renders in 128 pieces and that shows in the time too. bytes_per_second counts the 8
+ bytes of each message; Expression/<kind>/0 is the cost of the pads alone.
+
+ Named Expression/<kind>/<messages>, at 44.1 kHz.
+ */
+namespace {
+
+enum class Kind { Pressure, Bend, Controller, Mixed };
+
+const int frames = 512;
+const int messagesPerEvent = 32;
+const int padCount = 8;
+
+uint32_t firstWord(Kind kind, int message, int note) {
+    if (kind == Kind::Mixed) {
+        const Kind kinds[] = { Kind::Pressure, Kind::Bend, Kind::Controller };
+        kind = kinds[message % 3];
+    }
+    uint32_t status = kMIDICVStatusPolyPressure;
+    uint32_t index = 0;
+    switch (kind) {
+        case Kind::Bend:
+            status = kMIDICVStatusPerNotePitchBend;
+            break;
+        case Kind::Controller:
+            status = kMIDICVStatusAssignablePNC;
+            index = 74;
+            break;
+        default:
+            break;
+    }
+    return (uint32_t(kMIDIMessageTypeChannelVoice2) << 28) | (status << 20) | (uint32_t(note) << 8) | index;
+}
+
+BenchmarkRun expression(Kind kind, int messages) {
+    auto rig = std::make_shared<KernelRig>(frames, 44100.0);
+    startPads(*rig, padCount);
+
+    // built once; each iteration only moves them into its own cycle
+    std::mt19937 random(1);
+    auto events = std::make_shared<std::vector<AURenderEvent>>();
+    auto offsets = std::make_shared<std::vector<AUEventSampleTime>>();
+    for (int first = 0; first < messages; first += messagesPerEvent) {
+        AURenderEvent event = midiEvent(0, 0, 0);
+        MIDIEventPacket& packet = event.MIDIEventsList.eventList.packet[0];
+        packet.wordCount = 2 * messagesPerEvent;
+        for (int message = 0; message < messagesPerEvent; ++message) {
+            packet.words[2 * message] = firstWord(kind, first + message, 2 + (first + message) % padCount);
+            packet.words[2 * message + 1] = uint32_t(random());
+        }
+        events->push_back(event);
+        offsets->push_back(AUEventSampleTime(first) * frames / messages);
+    }
+
+    BenchmarkRun run;
+    run.audioSeconds = double(frames) / 44100.0;
+    run.bytes = double(messages) * 2 * sizeof(uint32_t);
+    run.iteration = [rig, events, offsets] {
+        for (size_t i = 0; i < events->size(); ++i) {
+            (*events)[i].MIDIEventsList.eventSampleTime = rig->now + (*offsets)[i];
+        }
+        rig->render(*events);
+    };
+    return run;
+}
+
+BenchmarkRegistration registration([](BenchmarkSuite& suite) {
+    const std::pair<const char*, Kind> kinds[] = {
+        { "pressure", Kind::Pressure },
+        { "bend", Kind::Bend },
+        { "controller", Kind::Controller },
+        { "mixed", Kind::Mixed },
+    };
+    for (const auto& [name, kind] : kinds) {
+        for (int messages : { 0, 256, 1024, 4096 }) {
+            suite.add(std::string("Expression/") + name + "/" + std::to_string(messages), [kind, messages] {
+                return expression(kind, messages);
+            });
+        }
+    }
+});
+
+}
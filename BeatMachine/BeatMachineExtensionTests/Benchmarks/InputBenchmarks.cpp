@@ -0,0 +1,80 @@
+//
+//  InputBenchmarks.cpp
+//  BeatMachineExtensionTests
+//
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+#include "BenchmarkPads.hpp"
+#include "BenchmarkSuite.hpp"
+
+/*
+ What processing in place and skipping the input pull save during sampler playback, with
+ eight pads playing and the input copied in the way a pull from a connected source would:
+
+   separate      input pulled into its own buffers, output written to others
+   inplace       input pulled into the output buffers, which the kernel reads and writes
+   unpulled      no pull; the kernel renders straight into the output buffers
+
+ Named Input/<variant>/<channels>/<frames>, at 44.1 kHz.
+ */
+namespace {
+
+enum class Variant { Separate, InPlace, Unpulled };
+
+BenchmarkRun inputVariant(Variant variant, int channelCount, int frames) {
+    auto rig = std::make_shared<KernelRig>(frames, 44100.0, channelCount);
+    startPads(*rig, 8);
+
+    auto upstream = std::make_shared<std::vector<std::vector<float>>>(channelCount, std::vector<float>(size_t(frames)));
+    for (auto& channel : *upstream) {
+        for (int i = 0; i < frames; ++i) {
+            channel[size_t(i)] = 0.05f * std::sin(float(i) * 0.1f);
+        }
+    }
+
+    BenchmarkRun run;
+    run.audioSeconds = double(frames) / 44100.0;
+    switch (variant) {
+        case Variant::Separate:
+            run.iteration = [rig, upstream] {
+                for (size_t channel = 0; channel < upstream->size(); ++channel) {
+                    std::copy((*upstream)[channel].begin(), (*upstream)[channel].end(), rig->input[channel].begin());
+                }
+                rig->render();
+            };
+            break;
+        case Variant::InPlace:
+            // the rig copies the input into the output buffers, standing in for the pull
+            rig->inPlace = true;
+            rig->input = *upstream;
+            run.iteration = [rig] { rig->render(); };
+            break;
+        case Variant::Unpulled:
+            rig->pullInput = false;
+            run.iteration = [rig] { rig->render(); };
+            break;
+    }
+    return run;
+}
+
+BenchmarkRegistration registration([](BenchmarkSuite& suite) {
+    const std::pair<const char*, Variant> variants[] = {
+        { "separate", Variant::Separate },
+        { "inplace", Variant::InPlace },
+        { "unpulled", Variant::Unpulled },
+    };
+    for (const auto& [name, variant] : variants) {
+        for (int channelCount : { 1, 2 }) {
+            for (int frames : { 256, 1024 }) {
+                suite.add(std::string("Input/") + name + "/" + std::to_string(channelCount) + "/" + std::to_string(frames), [variant, channelCount, frames] {
+                    return inputVariant(variant, channelCount, frames);
+                });
+            }
+        }
+    }
+});
+
+}
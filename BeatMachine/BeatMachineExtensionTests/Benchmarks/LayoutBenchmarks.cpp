@@ -0,0 +1,96 @@
+//
+//  LayoutBenchmarks.cpp
+//  BeatMachineExtensionTests
+//
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "BenchmarkPads.hpp"
+#include "BenchmarkSuite.hpp"
+
+/*
+ What the render functions specialized per channel count save over the generic one, per
+ mode and layout, with the same eight pads and input in both:
+
+   specialized   the row initialize() picks for the layout
+   generic       the Channels == 0 row every other layout falls back to
+
+ play renders eight looping pads; sample records the input into eight held pads,
+ restarted every few seconds so they never fill up; loop overdubs the eight pads into
+ the loop. Named Layout/<path>/<mode>/<channels>/<frames>, at 44.1 kHz.
+ */
+namespace {
+
+enum class Mode { Play, Sample, Loop };
+
+BenchmarkRun layout(bool specialized, Mode mode, int channelCount, int frames) {
+    auto rig = std::make_shared<KernelRig>(frames, 44100.0, channelCount);
+    if (!specialized) {
+        rig->kernel.setSpecializedRendering(false);
+        rig->kernel.initialize(channelCount, channelCount, 44100.0);
+    }
+    for (auto& channel : rig->input) {
+        for (int i = 0; i < frames; ++i) {
+            channel[size_t(i)] = 0.05f * std::sin(float(i) * 0.1f);
+        }
+    }
+
+    BenchmarkRun run;
+    run.audioSeconds = double(frames) / 44100.0;
+    switch (mode) {
+        case Mode::Play:
+        case Mode::Loop:
+            startPads(*rig, 8);
+            rig->setParameter(2, mode == Mode::Loop ? 1.0f : 0.0f);
+            run.iteration = [rig] { rig->render(); };
+            break;
+        case Mode::Sample: {
+            rig->setParameter(1, 1.0f);
+            auto notes = std::make_shared<std::vector<AURenderEvent>>();
+            auto hold = [notes](KernelRig& rig, bool on) {
+                notes->clear();
+                for (int note = 2; note < 10; ++note) {
+                    notes->push_back(noteEvent(rig.now, on, note));
+                }
+                rig.render(*notes);
+            };
+            hold(*rig, true);
+            const long restartCycles = long(4.0 * 44100.0 / frames);
+            auto cycle = std::make_shared<long>(0);
+            run.iteration = [rig, hold, restartCycles, cycle] {
+                if (++*cycle % restartCycles == 0) {
+                    hold(*rig, false);
+                    hold(*rig, true);
+                } else {
+                    rig->render();
+                }
+            };
+        }
+            break;
+    }
+    return run;
+}
+
+BenchmarkRegistration registration([](BenchmarkSuite& suite) {
+    const std::pair<const char*, Mode> modes[] = {
+        { "play", Mode::Play },
+        { "sample", Mode::Sample },
+        { "loop", Mode::Loop },
+    };
+    for (bool specialized : { true, false }) {
+        for (const auto& [name, mode] : modes) {
+            for (int channelCount : { 1, 2, 4, 6, 8 }) {
+                for (int frames : { 64, 512 }) {
+                    const std::string path = specialized ? "specialized" : "generic";
+                    suite.add("Layout/" + path + "/" + name + "/" + std::to_string(channelCount) + "/" + std::to_string(frames), [specialized, mode, channelCount, frames] {
+                        return layout(specialized, mode, channelCount, frames);
+                    });
+                }
+            }
+        }
+    }
+});
+
+}
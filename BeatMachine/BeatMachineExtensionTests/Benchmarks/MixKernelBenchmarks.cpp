@@ -0,0 +1,89 @@
+//
+//  MixKernelBenchmarks.cpp
+//  BeatMachineExtensionTests
+//
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "BenchmarkSuite.hpp"
+#include "MixKernels.hpp"
+
+/*
+ Throughput of each MixKernels kernel, counting the bytes it reads and writes once per
+ sample: an accumulate reads its source and reads and writes the bus. 64 and 1024 samples
+ are the block sizes the sampler sees; 16384 no longer fits in L1, so the bandwidth there
+ is the cache's, not the kernel's.
+
+ Named MixKernels/<kernel>/<samples>.
+ */
+namespace {
+
+struct Buffers {
+    std::vector<float> a;
+    std::vector<float> b;
+    std::vector<float> out;
+    std::vector<int16_t> pcm;
+
+    explicit Buffers(int count)
+    : a(size_t(count)), b(size_t(count)), out(size_t(count)), pcm(size_t(count) * 2) {
+        for (int i = 0; i < count; ++i) {
+            a[size_t(i)] = 0.5f * std::sin(float(i) * 0.01f);
+            b[size_t(i)] = 0.5f * std::cos(float(i) * 0.03f);
+        }
+    }
+};
+
+BenchmarkRun kernel(const std::string& name, int count) {
+    auto buffers = std::make_shared<Buffers>(count);
+    const float step = 1.0f / float(count);
+    const double samples = double(count);
+
+    BenchmarkRun run;
+    if (name == "accumulateWithGain") {
+        run.iteration = [buffers, count] {
+            MixKernels::accumulateWithGain(buffers->a.data(), 0.5f, buffers->out.data(), count);
+        };
+        run.bytes = samples * 3 * sizeof(float);
+    } else if (name == "accumulateWithRamp") {
+        run.iteration = [buffers, count, step] {
+            MixKernels::accumulateWithRamp(buffers->a.data(), 0.0f, step, buffers->out.data(), count);
+        };
+        run.bytes = samples * 3 * sizeof(float);
+    } else if (name == "gainRamp") {
+        run.iteration = [buffers, count, step] {
+            MixKernels::gainRamp(buffers->a.data(), 1.0f, -step, buffers->out.data(), count);
+        };
+        run.bytes = samples * 2 * sizeof(float);
+    } else if (name == "crossfade") {
+        run.iteration = [buffers, count, step] {
+            MixKernels::crossfade(buffers->a.data(), buffers->b.data(), 0.0f, step, buffers->out.data(), count);
+        };
+        run.bytes = samples * 3 * sizeof(float);
+    } else if (name == "int16ToFloat") {
+        run.iteration = [buffers, count] {
+            MixKernels::int16ToFloat(buffers->pcm.data(), buffers->out.data(), count);
+        };
+        run.bytes = samples * (sizeof(int16_t) + sizeof(float));
+    } else {
+        // one channel of interleaved stereo, as WavWriter writes it
+        run.iteration = [buffers, count] {
+            MixKernels::floatToInt16(buffers->a.data(), buffers->pcm.data(), 2, buffers->out.data(), count);
+        };
+        run.bytes = samples * (sizeof(float) + sizeof(int16_t));
+    }
+    return run;
+}
+
+BenchmarkRegistration registration([](BenchmarkSuite& suite) {
+    for (const char* name : { "accumulateWithGain", "accumulateWithRamp", "gainRamp", "crossfade", "int16ToFloat", "floatToInt16" }) {
+        for (int count : { 64, 1024, 16384 }) {
+            suite.add(std::string("MixKernels/") + name + "/" + std::to_string(count), [name = std::string(name), count] {
+                return kernel(name, count);
+            });
+        }
+    }
+});
+
+}
@@ -0,0 +1,118 @@
+//
+//  RenderBenchmarks.cpp
+//  BeatMachineExtensionTests
+//
+
+#include <memory>
+#include <random>
+#include <string>
+#include "BenchmarkPads.hpp"
+#include "BenchmarkSuite.hpp"
+
+/*
+ Whole render cycles through AUProcessHelper, per scenario, block size and sample rate:
+
+   idle          nothing sounding, nothing recording
+   pads/N        N looping pads (8, 32, and 64 to fill the voice pool) through the insert
+                 effects
+   sampling      eight pads recording the input while it is monitored, restarted every few
+                 seconds so they never fill up
+   overdub       loop recording over eight pads, with the metronome
+   automation    eight pads with filter, drive, compressor and swing changing every cycle
+
+ Named Render/<scenario>/<sample rate>/<frames>. Load is the share of each cycle's audio
+ the cycle took to render.
+ */
+namespace {
+
+enum class Scenario { Idle, Pads, Sampling, Overdub, Automation };
+
+BenchmarkRun renderScenario(Scenario scenario, int pads, double sampleRate, int frames) {
+    auto rig = std::make_shared<KernelRig>(frames, sampleRate);
+    for (int i = 0; i < frames; ++i) {
+        rig->input[0][size_t(i)] = 0.05f * std::sin(float(i) * 0.1f);
+    }
+
+    BenchmarkRun run;
+    run.audioSeconds = double(frames) / sampleRate;
+    switch (scenario) {
+        case Scenario::Idle:
+        case Scenario::Pads:
+            startPads(*rig, pads);
+            run.iteration = [rig] { rig->render(); };
+            break;
+        case Scenario::Sampling: {
+            rig->setParameter(1, 1.0f);
+            // built once, so restarts allocate nothing on the timing thread
+            auto notes = std::make_shared<std::vector<AURenderEvent>>();
+            auto hold = [notes](KernelRig& rig, bool on) {
+                notes->clear();
+                for (int note = 2; note < 10; ++note) {
+                    notes->push_back(noteEvent(rig.now, on, note));
+                }
+                rig.render(*notes);
+            };
+            hold(*rig, true);
+            const long restartCycles = long(4.0 * sampleRate / frames);
+            auto cycle = std::make_shared<long>(0);
+            run.iteration = [rig, hold, restartCycles, cycle] {
+                if (++*cycle % restartCycles == 0) {
+                    hold(*rig, false);
+                    hold(*rig, true);
+                } else {
+                    rig->render();
+                }
+            };
+        }
+            break;
+        case Scenario::Overdub:
+            startPads(*rig, pads);
+            rig->setParameter(2, 1.0f);
+            run.iteration = [rig] { rig->render(); };
+            break;
+        case Scenario::Automation: {
+            startPads(*rig, pads);
+            auto random = std::make_shared<std::mt19937>(1);
+            run.iteration = [rig, random] {
+                std::mt19937& next = *random;
+                rig->setParameter(3, 200.0f + float(next() % 10000));
+                rig->setParameter(4, 0.5f + float(next() % 95) / 10.0f);
+                rig->setParameter(5, float(next() % 24));
+                rig->setParameter(6, -float(next() % 60));
+                rig->setParameter(10, 50.0f + float(next() % 25));
+                rig->render();
+            };
+        }
+            break;
+    }
+    return run;
+}
+
+BenchmarkRegistration registration([](BenchmarkSuite& suite) {
+    struct Case {
+        const char* name;
+        Scenario scenario;
+        int pads;
+    };
+    const Case cases[] = {
+        { "idle", Scenario::Idle, 0 },
+        { "pads/8", Scenario::Pads, 8 },
+        { "pads/32", Scenario::Pads, 32 },
+        { "pads/64", Scenario::Pads, 64 },
+        { "sampling", Scenario::Sampling, 0 },
+        { "overdub", Scenario::Overdub, 8 },
+        { "automation", Scenario::Automation, 8 },
+    };
+    for (const Case& entry : cases) {
+        for (double sampleRate : { 44100.0, 96000.0 }) {
+            for (int frames : { 64, 256, 1024 }) {
+                const std::string name = std::string("Render/") + entry.name + "/" + std::to_string(int(sampleRate)) + "/" + std::to_string(frames);
+                suite.add(name, [entry, sampleRate, frames] {
+                    return renderScenario(entry.scenario, entry.pads, sampleRate, frames);
+                });
+            }
+        }
+    }
+});
+
+}
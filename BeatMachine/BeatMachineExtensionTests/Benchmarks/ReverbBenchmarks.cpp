@@ -0,0 +1,107 @@
+//
+//  ReverbBenchmarks.cpp
+//  BeatMachineExtensionTests
+//
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "BenchmarkSuite.hpp"
+#include "ConvolutionReverb.hpp"
+
+/*
+ The convolution reverb over impulses of 0.25 to 6 seconds of decaying noise, the longest
+ it keeps. Reverb/<seconds>/busy convolves a send that never goes quiet, so every 256
+ samples cost a forward FFT, a multiply-add per partition and an inverse FFT;
+ Reverb/<seconds>/silent is the same reverb once its send has been quiet for longer than
+ the impulse, when it skips the FFT work. Reverb/prepare/<seconds> is what the background
+ worker spends on a new impulse: resampling it from 48 kHz, scaling it and transforming
+ every partition.
+
+ The convolution renders 512 frames at 44.1 kHz per iteration.
+ */
+namespace {
+
+const double sampleRate = 44100.0;
+const int frames = 512;
+
+// An impulse of `seconds` of noise decaying by 60 dB, held by the SampleCache
+const float* impulse(double seconds, uint32_t impulseRate, int& length) {
+    std::vector<float> samples(size_t(seconds * impulseRate));
+    std::mt19937 random(49);
+    std::uniform_real_distribution<float> noise(-1.0f, 1.0f);
+    for (size_t i = 0; i < samples.size(); ++i) {
+        samples[i] = noise(random) * std::pow(0.001f, float(i) / float(samples.size()));
+    }
+    length = int(samples.size());
+    return SampleCache::shared().acquire(samples.data(), length, impulseRate).samples;
+}
+
+BenchmarkRun convolve(double seconds, bool busy) {
+    auto reverb = std::make_shared<ConvolutionReverb>();
+    reverb->prepare();
+    reverb->reset(sampleRate);
+    int length = 0;
+    const float* samples = impulse(seconds, uint32_t(sampleRate), length);
+    reverb->load({ samples, length, uint32_t(sampleRate) });
+    reverb->poll();
+    reverb->update();
+
+    auto send = std::make_shared<std::vector<float>>(frames);
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> noise(-0.5f, 0.5f);
+    for (float& sample : *send) {
+        sample = busy ? noise(random) : 0.0f;
+    }
+    auto output = std::make_shared<std::vector<float>>(frames);
+    if (!busy) {
+        // let the tail die away first
+        for (double done = 0.0; done < seconds + 0.1; done += frames / sampleRate) {
+            reverb->process(send->data(), output->data(), frames, 0.5f);
+        }
+    }
+
+    BenchmarkRun run;
+    run.audioSeconds = double(frames) / sampleRate;
+    run.iteration = [reverb, send, output] {
+        std::fill(output->begin(), output->end(), 0.0f);
+        reverb->process(send->data(), output->data(), frames, 0.5f);
+    };
+    return run;
+}
+
+BenchmarkRun prepare(double seconds) {
+    auto reverb = std::make_shared<ConvolutionReverb>();
+    reverb->prepare();
+    reverb->reset(sampleRate);
+    int length = 0;
+    const float* samples = impulse(seconds, 48000, length);
+
+    BenchmarkRun run;
+    run.iteration = [reverb, samples, length] {
+        // each load hands the reverb a reference of its own
+        reverb->load({ SampleCache::shared().retain(samples).samples, length, 48000 });
+        reverb->poll();
+    };
+    return run;
+}
+
+BenchmarkRegistration registration([](BenchmarkSuite& suite) {
+    for (const char* seconds : { "0.25", "0.5", "1", "2", "4", "6" }) {
+        const double length = std::stod(seconds);
+        suite.add(std::string("Reverb/") + seconds + "/busy", [length] {
+            return convolve(length, true);
+        });
+        suite.add(std::string("Reverb/") + seconds + "/silent", [length] {
+            return convolve(length, false);
+        });
+        suite.add(std::string("Reverb/prepare/") + seconds, [length] {
+            return prepare(length);
+        });
+    }
+});
+
+}
@@ -0,0 +1,82 @@
+//
+//  SequencerBenchmarks.cpp
+//  BeatMachineExtensionTests
+//
+
+#include <memory>
+#include <string>
+#include "BenchmarkPads.hpp"
+#include "BenchmarkSuite.hpp"
+#include "HostTransport.hpp"
+
+/*
+ Whole render cycles with the step sequencer at its busiest: all 16 tracks, each on its
+ own looping pad, with all 64 steps set, at 240 BPM with swing and a probability on every
+ step, so each cycle schedules a step on every track up to several times over. The same
+ pads with the sequencer off are the baseline; the difference is what generating and
+ scheduling the steps costs.
+
+ Named Sequencer/<off|on>/<frames>, at 44.1 kHz.
+ */
+namespace {
+
+const double sampleRate = 44100.0;
+const double tempo = 240.0;
+
+// Binds every track of pattern 0 to one of the pads startPads() loads and fills all its steps
+void fillPattern(KernelRig& rig) {
+    StepSequencer::Edit length;
+    length.type = StepSequencer::Edit::Type::SetLength;
+    length.value = StepSequencer::maximumSteps;
+    rig.kernel.postCommand(KernelCommand::sequencerEditCommand(length));
+
+    for (int track = 0; track < StepSequencer::trackCount; ++track) {
+        StepSequencer::Edit note;
+        note.type = StepSequencer::Edit::Type::SetTrackNote;
+        note.track = uint8_t(track);
+        note.value = uint8_t(2 + track);
+        rig.kernel.postCommand(KernelCommand::sequencerEditCommand(note));
+
+        for (int step = 0; step < StepSequencer::maximumSteps; ++step) {
+            StepSequencer::Edit edit;
+            edit.type = StepSequencer::Edit::Type::SetStep;
+            edit.track = uint8_t(track);
+            edit.step = uint8_t(step);
+            edit.velocity = uint8_t(64 + (step * 7 + track) % 64);
+            edit.probability = 75;
+            rig.kernel.postCommand(KernelCommand::sequencerEditCommand(edit));
+        }
+        // the command queue holds fewer edits than the whole pattern
+        rig.render();
+    }
+}
+
+BenchmarkRun render(bool sequencing, int frames) {
+    auto rig = std::make_shared<KernelRig>(frames, sampleRate);
+    auto transport = std::make_shared<HostTransport>();
+    transport->tempo = tempo;
+    transport->attach(*rig, sampleRate);
+    startPads(*rig, StepSequencer::trackCount);
+    fillPattern(*rig);
+    rig->setParameter(BeatMachineExtensionParameterAddress::swing, 66.0f);
+    rig->setParameter(BeatMachineExtensionParameterAddress::sequencerEnabled, sequencing ? 1.0f : 0.0f);
+
+    BenchmarkRun run;
+    run.audioSeconds = double(frames) / sampleRate;
+    run.iteration = [rig, transport] {
+        rig->render();
+    };
+    return run;
+}
+
+BenchmarkRegistration registration([](BenchmarkSuite& suite) {
+    for (bool sequencing : { false, true }) {
+        for (int frames : { 64, 256, 1024 }) {
+            suite.add(std::string("Sequencer/") + (sequencing ? "on/" : "off/") + std::to_string(frames), [sequencing, frames] {
+                return render(sequencing, frames);
+            });
+        }
+    }
+});
+
+}
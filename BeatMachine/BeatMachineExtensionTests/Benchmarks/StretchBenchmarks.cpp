@@ -0,0 +1,82 @@
+//
+//  StretchBenchmarks.cpp
+//  BeatMachineExtensionTests
+//
+
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+#include "BenchmarkSuite.hpp"
+#include "LoopStretcher.hpp"
+
+/*
+ LoopStretcher on a two-bar loop at 120 BPM (4 s at 44.1 kHz):
+
+   Stretch/render/<speed>/<frames>   synthesis on the render thread, at host tempo over
+                                     loop tempo of 0.5 to 2
+   Stretch/analysis                  the worker's analysis of the whole loop
+
+ The loop is mono, as the kernel records it, so a stereo loop would cost twice the render
+ figures.
+ */
+namespace {
+
+const int loopLength = 4 * 44100;
+
+std::shared_ptr<std::vector<float>> makeLoop() {
+    auto loop = std::make_shared<std::vector<float>>(size_t(loopLength));
+    for (int i = 0; i < loopLength; ++i) {
+        // a decaying hit every beat over a steady tone
+        const float sinceBeat = float(i % 22050) / 44100.0f;
+        (*loop)[size_t(i)] = 0.3f * std::sin(float(i) * 0.0627f) + 0.5f * std::exp(-sinceBeat * 30.0f) * std::sin(float(i) * 0.31f);
+    }
+    return loop;
+}
+
+BenchmarkRun stretchRender(double speed, int frames) {
+    auto loop = makeLoop();
+    auto stretcher = std::make_shared<LoopStretcher>();
+    stretcher->prepare();
+    stretcher->requestAnalysis(loop->data(), loopLength);
+    stretcher->poll();
+    stretcher->seek(0.0);
+    auto output = std::make_shared<std::vector<float>>(size_t(frames));
+
+    BenchmarkRun run;
+    run.audioSeconds = double(frames) / 44100.0;
+    run.iteration = [loop, stretcher, output, speed, frames] {
+        stretcher->render(output->data(), AUAudioFrameCount(frames), speed);
+    };
+    return run;
+}
+
+BenchmarkRun stretchAnalysis() {
+    auto loop = makeLoop();
+    auto stretcher = std::make_shared<LoopStretcher>();
+    stretcher->prepare();
+
+    BenchmarkRun run;
+    run.audioSeconds = double(loopLength) / 44100.0;
+    run.iteration = [loop, stretcher] {
+        stretcher->requestAnalysis(loop->data(), loopLength);
+        stretcher->poll();
+    };
+    return run;
+}
+
+BenchmarkRegistration registration([](BenchmarkSuite& suite) {
+    for (const char* speed : { "0.5", "0.8", "1.0", "1.25", "2.0" }) {
+        for (int frames : { 256, 1024 }) {
+            suite.add(std::string("Stretch/render/") + speed + "/" + std::to_string(frames), [speed, frames] {
+                return stretchRender(std::atof(speed), frames);
+            });
+        }
+    }
+    suite.add("Stretch/analysis", [] {
+        return stretchAnalysis();
+    });
+});
+
+}
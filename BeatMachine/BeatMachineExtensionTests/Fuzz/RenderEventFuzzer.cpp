@@ -0,0 +1,117 @@
+//
+//  RenderEventFuzzer.cpp
+//  BeatMachineExtensionTests
+//
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include "KernelRig.hpp"
+#include "ParameterRanges.hpp"
+
+/*
+ Drives one long-lived kernel with render cycles decoded from the input, so malformed MIDI
+ reaches handleMIDIEventList the way a host delivers it. The input is read as cycles:
+
+   byte        frames, 1 + byte * 2
+   byte        event count, modulo 8
+   10 bytes    per event: frame offset, kind, two little-endian 32-bit words
+
+ Kind 0 passes the words on as a universal MIDI packet untouched; kind 1 makes them a
+ MIDI 2.0 note-on or note-off (any note byte, including the record and mute notes); kind 2
+ sets the parameter the first word picks to a value from the second, up to one range
+ width outside the parameter's range; kind 3 posts a pad or loop command. The input bus
+ carries a tone so takes and overdubs record something. Every output sample must stay
+ finite and within the loop's +12 dBFS headroom plus the pads and reverb on top.
+ */
+namespace {
+
+KernelRig& rig() {
+    static KernelRig* rig = [] {
+        KernelRig* made = new KernelRig(512);
+        for (size_t i = 0; i < made->input[0].size(); ++i) {
+            made->input[0][i] = 0.5f * std::sin(float(i) * 0.05f);
+        }
+        return made;
+    }();
+    return *rig;
+}
+
+uint32_t readWord(const uint8_t* bytes) {
+    return uint32_t(bytes[0]) | uint32_t(bytes[1]) << 8 | uint32_t(bytes[2]) << 16 | uint32_t(bytes[3]) << 24;
+}
+
+void postCommand(KernelRig& rig, uint32_t first, uint32_t second) {
+    const int note = int(first % 160) - 16;
+    switch ((first >> 8) % 4) {
+        case 0:
+            rig.kernel.postCommand(KernelCommand::clearPadCommand(note));
+            break;
+        case 1:
+            rig.kernel.postCommand(KernelCommand::setLoopLengthCommand(double(int(second % 24) - 4) * 0.5));
+            break;
+        case 2: {
+            const auto kind = KernelCommand::PadSetting::Kind((first >> 16) % 5);
+            rig.kernel.postCommand(KernelCommand::padSettingCommand(note, kind, int(second % 600000) - 1000, int(second >> 12) - 1000));
+        }
+            break;
+        default: {
+            float* take = makeTake(2048, [](int i) { return 0.25f * std::sin(float(i) * 0.01f); });
+            if (!rig.kernel.postCommand(KernelCommand::loadPadCommand(note, take, int(second % 600000) - 1000))) {
+                delete[] take;
+            }
+        }
+            break;
+    }
+}
+
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    KernelRig& kernelRig = rig();
+    size_t position = 0;
+    while (position + 2 <= size) {
+        const int frames = 1 + data[position] * 2 % kernelRig.maximumFrames();
+        const int eventCount = data[position + 1] % 8;
+        position += 2;
+
+        std::vector<AURenderEvent> events;
+        for (int i = 0; i < eventCount && position + 10 <= size; ++i, position += 10) {
+            const AUEventSampleTime time = kernelRig.now + data[position] % frames;
+            const uint8_t kind = data[position + 1] % 4;
+            const uint32_t first = readWord(data + position + 2);
+            const uint32_t second = readWord(data + position + 6);
+            switch (kind) {
+                case 0:
+                    events.push_back(midiEvent(time, first, second));
+                    break;
+                case 1:
+                    events.push_back(noteEvent(time, first & 1, int(first >> 8) & 0xFF, uint16_t(second)));
+                    break;
+                case 2: {
+                    const ParameterRange& range = parameterRanges[first % parameterCount];
+                    const float width = range.maximum - range.minimum;
+                    const float unit = float(second) / float(UINT32_MAX);
+                    kernelRig.setParameter(range.address, range.minimum - width + unit * 3.0f * width);
+                }
+                    break;
+                default:
+                    postCommand(kernelRig, first, second);
+                    break;
+            }
+        }
+        std::stable_sort(events.begin(), events.end(), [] (const AURenderEvent& a, const AURenderEvent& b) {
+            return a.head.eventSampleTime < b.head.eventSampleTime;
+        });
+
+        kernelRig.render(events, frames);
+        for (int i = 0; i < frames; ++i) {
+            const float sample = kernelRig.output[0][i];
+            if (!std::isfinite(sample) || std::fabs(sample) > 64.0f) {
+                std::abort();
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,107 @@
+//
+//  StandaloneFuzzMain.cpp
+//  BeatMachineExtensionTests
+//
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+ Runs a fuzz target without libFuzzer, for compilers that don't ship it: every file named
+ on the command line (or found in a named directory) is fed to the target once, then
+ -runs=N mutations of them are, seeded with -seed=S, so CTest gets a deterministic
+ regression run. Mutations flip bits, overwrite bytes and 32-bit fields (chunk sizes among
+ them), truncate, and insert runs of bytes or RIFF chunk tags.
+ */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+namespace {
+
+std::vector<uint8_t> readFile(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+void mutate(std::vector<uint8_t>& input, std::mt19937& random) {
+    static const char* const tags[] = { "RIFF", "WAVE", "fmt ", "data", "LIST" };
+    const int mutations = 1 + int(random() % 8);
+    for (int i = 0; i < mutations; ++i) {
+        if (input.empty()) {
+            input.push_back(uint8_t(random()));
+            continue;
+        }
+        const size_t position = random() % input.size();
+        switch (random() % 6) {
+            case 0:
+                input[position] ^= uint8_t(1u << (random() % 8));
+                break;
+            case 1:
+                input[position] = uint8_t(random());
+                break;
+            case 2:
+                input.resize(position);
+                break;
+            case 3: {
+                const char* tag = tags[random() % 5];
+                input.insert(input.begin() + position, tag, tag + 4);
+            }
+                break;
+            case 4:
+                if (position + 4 <= input.size()) {
+                    const uint32_t word = random() % 3 != 0 ? uint32_t(random()) : UINT32_MAX;
+                    std::memcpy(&input[position], &word, sizeof(word));
+                }
+                break;
+            default:
+                input.insert(input.begin() + position, random() % 64, uint8_t(random()));
+                break;
+        }
+    }
+}
+
+}
+
+int main(int argc, char** argv) {
+    long runs = 0;
+    unsigned seed = 1;
+    std::vector<std::vector<uint8_t>> corpus;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strncmp(argv[i], "-runs=", 6) == 0) {
+            runs = std::atol(argv[i] + 6);
+        } else if (std::strncmp(argv[i], "-seed=", 6) == 0) {
+            seed = unsigned(std::strtoul(argv[i] + 6, nullptr, 10));
+        } else if (std::filesystem::is_directory(argv[i])) {
+            std::vector<std::filesystem::path> paths;
+            for (const auto& entry : std::filesystem::directory_iterator(argv[i])) {
+                paths.push_back(entry.path());
+            }
+            std::sort(paths.begin(), paths.end());
+            for (const auto& path : paths) {
+                corpus.push_back(readFile(path));
+            }
+        } else {
+            corpus.push_back(readFile(argv[i]));
+        }
+    }
+
+    for (const auto& input : corpus) {
+        LLVMFuzzerTestOneInput(input.data(), input.size());
+    }
+    std::mt19937 random(seed);
+    for (long run = 0; run < runs; ++run) {
+        std::vector<uint8_t> input = corpus.empty() ? std::vector<uint8_t>() : corpus[random() % corpus.size()];
+        mutate(input, random);
+        LLVMFuzzerTestOneInput(input.data(), input.size());
+    }
+    std::printf("%zu corpus inputs and %ld mutations ran\n", corpus.size(), runs);
+    return 0;
+}
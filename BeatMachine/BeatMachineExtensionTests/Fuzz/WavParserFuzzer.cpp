@@ -0,0 +1,30 @@
+//
+//  WavParserFuzzer.cpp
+//  BeatMachineExtensionTests
+//
+
+#include <cstdint>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include "WavUtil.hpp"
+
+/*
+ Feeds arbitrary bytes to read_wav as a file. Beyond not crashing, hanging or reading out
+ of bounds (ASan and UBSan catch those), a decode must never produce more samples than the
+ file has 16-bit words, nor a sample outside [-1, 1].
+ */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    std::istringstream file(std::string(reinterpret_cast<const char*>(data), size));
+    uint32_t sampleRate = 0;
+    const std::vector<float> samples = read_wav(file, &sampleRate);
+    if (samples.size() > size / sizeof(int16_t)) {
+        std::abort();
+    }
+    for (float sample : samples) {
+        if (!(sample >= -1.0f && sample <= 1.0f)) {
+            std::abort();
+        }
+    }
+    return 0;
+}
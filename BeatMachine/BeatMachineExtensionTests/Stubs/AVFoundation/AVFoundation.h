@@ -0,0 +1,9 @@
+//
+//  AVFoundation.h
+//  BeatMachineExtensionTests
+//
+
+#pragma once
+
+// Nothing from AVFoundation is used by the C++ side of the extension
+#include "../AudioToolbox/AudioToolbox.h"
@@ -0,0 +1,381 @@
+//
+//  Accelerate.h
+//  BeatMachineExtensionTests
+//
+
+#pragma once
+
+/*
+ Scalar versions of the vDSP and vForce routines the DSP kernel uses, for building it on
+ Linux. Each follows the Accelerate documentation for argument order, strides and scaling,
+ including the packed format and the factor of 2 of vDSP_fft_zrip, so results agree with
+ the real framework up to rounding. None of them allocate: FFT twiddles are computed in
+ vDSP_create_fftsetup, as Accelerate does, so the render-thread allocation tests hold here
+ too. Speed is only indicative; benchmark numbers from this build compare revisions, not
+ platforms.
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <utility>
+
+typedef unsigned long vDSP_Length;
+typedef long vDSP_Stride;
+typedef int FFTDirection;
+typedef int FFTRadix;
+
+enum {
+    kFFTDirection_Forward = 1,
+    kFFTDirection_Inverse = -1
+};
+
+enum {
+    kFFTRadix2 = 0
+};
+
+#define vDSP_HANN_DENORM 0
+#define vDSP_HALF_WINDOW 1
+#define vDSP_HANN_NORM 2
+
+struct DSPComplex {
+    float real;
+    float imag;
+};
+
+struct DSPSplitComplex {
+    float* realp;
+    float* imagp;
+};
+
+// MARK: - Vector Arithmetic
+inline void vDSP_vclr(float* c, vDSP_Stride ic, vDSP_Length n) {
+    for (vDSP_Length i = 0; i < n; ++i) c[i * ic] = 0.f;
+}
+
+inline void vDSP_vadd(const float* a, vDSP_Stride ia, const float* b, vDSP_Stride ib, float* c, vDSP_Stride ic, vDSP_Length n) {
+    for (vDSP_Length i = 0; i < n; ++i) c[i * ic] = a[i * ia] + b[i * ib];
+}
+
+// c = a - b, with b first as in vDSP
+inline void vDSP_vsub(const float* b, vDSP_Stride ib, const float* a, vDSP_Stride ia, float* c, vDSP_Stride ic, vDSP_Length n) {
+    for (vDSP_Length i = 0; i < n; ++i) c[i * ic] = a[i * ia] - b[i * ib];
+}
+
+inline void vDSP_vmul(const float* a, vDSP_Stride ia, const float* b, vDSP_Stride ib, float* c, vDSP_Stride ic, vDSP_Length n) {
+    for (vDSP_Length i = 0; i < n; ++i) c[i * ic] = a[i * ia] * b[i * ib];
+}
+
+inline void vDSP_vsmul(const float* a, vDSP_Stride ia, const float* b, float* c, vDSP_Stride ic, vDSP_Length n) {
+    for (vDSP_Length i = 0; i < n; ++i) c[i * ic] = a[i * ia] * *b;
+}
+
+inline void vDSP_vsma(const float* a, vDSP_Stride ia, const float* b, const float* c, vDSP_Stride ic, float* d, vDSP_Stride id, vDSP_Length n) {
+    for (vDSP_Length i = 0; i < n; ++i) d[i * id] = a[i * ia] * *b + c[i * ic];
+}
+
+inline void vDSP_vma(const float* a, vDSP_Stride ia, const float* b, vDSP_Stride ib, const float* c, vDSP_Stride ic, float* d, vDSP_Stride id, vDSP_Length n) {
+    for (vDSP_Length i = 0; i < n; ++i) d[i * id] = a[i * ia] * b[i * ib] + c[i * ic];
+}
+
+inline void vDSP_vasm(const float* a, vDSP_Stride ia, const float* b, vDSP_Stride ib, const float* c, float* d, vDSP_Stride id, vDSP_Length n) {
+    for (vDSP_Length i = 0; i < n; ++i) d[i * id] = (a[i * ia] + b[i * ib]) * *c;
+}
+
+// d = a + c * (b - a)
+inline void vDSP_vintb(const float* a, vDSP_Stride ia, const float* b, vDSP_Stride ib, const float* c, float* d, vDSP_Stride id, vDSP_Length n) {
+    for (vDSP_Length i = 0; i < n; ++i) d[i * id] = a[i * ia] + *c * (b[i * ib] - a[i * ia]);
+}
+
+inline void vDSP_vabs(const float* a, vDSP_Stride ia, float* c, vDSP_Stride ic, vDSP_Length n) {
+    for (vDSP_Length i = 0; i < n; ++i) c[i * ic] = std::fabs(a[i * ia]);
+}
+
+inline void vDSP_vclip(const float* a, vDSP_Stride ia, const float* low, const float* high, float* c, vDSP_Stride ic, vDSP_Length n) {
+    for (vDSP_Length i = 0; i < n; ++i) {
+        const float value = a[i * ia];
+        c[i * ic] = value < *low ? *low : (value > *high ? *high : value);
+    }
+}
+
+// Values below the threshold are replaced by it
+inline void vDSP_vthres(const float* a, vDSP_Stride ia, const float* threshold, float* c, vDSP_Stride ic, vDSP_Length n) {
+    for (vDSP_Length i = 0; i < n; ++i) c[i * ic] = a[i * ia] >= *threshold ? a[i * ia] : *threshold;
+}
+
+// MARK: - Ramps
+inline void vDSP_vramp(const float* start, const float* step, float* c, vDSP_Stride ic, vDSP_Length n) {
+    for (vDSP_Length i = 0; i < n; ++i) c[i * ic] = *start + float(i) * *step;
+}
+
+// o = i * ramp; start is left one step past the last sample
+inline void vDSP_vrampmul(const float* in, vDSP_Stride ii, float* start, const float* step, float* o, vDSP_Stride io, vDSP_Length n) {
+    for (vDSP_Length i = 0; i < n; ++i) {
+        o[i * io] = in[i * ii] * *start;
+        *start += *step;
+    }
+}
+
+inline void vDSP_vrampmuladd(const float* in, vDSP_Stride ii, float* start, const float* step, float* o, vDSP_Stride io, vDSP_Length n) {
+    for (vDSP_Length i = 0; i < n; ++i) {
+        o[i * io] += in[i * ii] * *start;
+        *start += *step;
+    }
+}
+
+// c[i] = a[k] + f * (a[k + 1] - a[k]), with k and f the whole and fractional parts of b[i]
+inline void vDSP_vlint(const float* a, const float* b, vDSP_Stride ib, float* c, vDSP_Stride ic, vDSP_Length n, vDSP_Length m) {
+    for (vDSP_Length i = 0; i < n; ++i) {
+        const float position = b[i * ib];
+        const vDSP_Length k = vDSP_Length(position);
+        const float f = position - float(k);
+        c[i * ic] = k + 1 < m ? a[k] + f * (a[k + 1] - a[k]) : a[k];
+    }
+}
+
+// MARK: - Reductions
+inline void vDSP_maxv(const float* a, vDSP_Stride ia, float* c, vDSP_Length n) {
+    float result = -INFINITY;
+    for (vDSP_Length i = 0; i < n; ++i) result = std::fmax(result, a[i * ia]);
+    *c = result;
+}
+
+inline void vDSP_minv(const float* a, vDSP_Stride ia, float* c, vDSP_Length n) {
+    float result = INFINITY;
+    for (vDSP_Length i = 0; i < n; ++i) result = std::fmin(result, a[i * ia]);
+    *c = result;
+}
+
+inline void vDSP_maxmgv(const float* a, vDSP_Stride ia, float* c, vDSP_Length n) {
+    float result = 0.f;
+    for (vDSP_Length i = 0; i < n; ++i) result = std::fmax(result, std::fabs(a[i * ia]));
+    *c = result;
+}
+
+inline void vDSP_sve(const float* a, vDSP_Stride ia, float* c, vDSP_Length n) {
+    float result = 0.f;
+    for (vDSP_Length i = 0; i < n; ++i) result += a[i * ia];
+    *c = result;
+}
+
+inline void vDSP_svesq(const float* a, vDSP_Stride ia, float* c, vDSP_Length n) {
+    float result = 0.f;
+    for (vDSP_Length i = 0; i < n; ++i) result += a[i * ia] * a[i * ia];
+    *c = result;
+}
+
+inline void vDSP_meanv(const float* a, vDSP_Stride ia, float* c, vDSP_Length n) {
+    float sum = 0.f;
+    vDSP_sve(a, ia, &sum, n);
+    *c = n > 0 ? sum / float(n) : 0.f;
+}
+
+inline void vDSP_measqv(const float* a, vDSP_Stride ia, float* c, vDSP_Length n) {
+    float sum = 0.f;
+    vDSP_svesq(a, ia, &sum, n);
+    *c = n > 0 ? sum / float(n) : 0.f;
+}
+
+// MARK: - Conversion
+inline void vDSP_vflt16(const short* a, vDSP_Stride ia, float* c, vDSP_Stride ic, vDSP_Length n) {
+    for (vDSP_Length i = 0; i < n; ++i) c[i * ic] = float(a[i * ia]);
+}
+
+inline void vDSP_vfixr16(const float* a, vDSP_Stride ia, short* c, vDSP_Stride ic, vDSP_Length n) {
+    for (vDSP_Length i = 0; i < n; ++i) c[i * ic] = short(std::lrint(a[i * ia]));
+}
+
+// MARK: - Windows
+inline void vDSP_hann_window(float* c, vDSP_Length n, int flags) {
+    const vDSP_Length count = (flags & vDSP_HALF_WINDOW) ? (n + 1) / 2 : n;
+    const float scale = (flags & vDSP_HANN_NORM) ? 0.8165f : 1.f;
+    for (vDSP_Length i = 0; i < count; ++i) {
+        c[i] = scale * 0.5f * (1.f - std::cos(2.f * float(M_PI) * float(i) / float(n)));
+    }
+}
+
+// MARK: - vForce
+inline void vvtanhf(float* y, const float* x, const int* n) {
+    for (int i = 0; i < *n; ++i) y[i] = std::tanh(x[i]);
+}
+
+inline void vvexpf(float* y, const float* x, const int* n) {
+    for (int i = 0; i < *n; ++i) y[i] = std::exp(x[i]);
+}
+
+inline void vvlogf(float* y, const float* x, const int* n) {
+    for (int i = 0; i < *n; ++i) y[i] = std::log(x[i]);
+}
+
+inline void vvsincosf(float* s, float* c, const float* x, const int* n) {
+    for (int i = 0; i < *n; ++i) {
+        s[i] = std::sin(x[i]);
+        c[i] = std::cos(x[i]);
+    }
+}
+
+// z = remainder(y / x)
+inline void vvremainderf(float* z, const float* y, const float* x, const int* n) {
+    for (int i = 0; i < *n; ++i) z[i] = std::remainder(y[i], x[i]);
+}
+
+// MARK: - Split Complex
+// Strides are assumed contiguous: 2 for the interleaved side, 1 for the split side
+inline void vDSP_ctoz(const DSPComplex* c, vDSP_Stride, const DSPSplitComplex* z, vDSP_Stride, vDSP_Length n) {
+    for (vDSP_Length i = 0; i < n; ++i) {
+        z->realp[i] = c[i].real;
+        z->imagp[i] = c[i].imag;
+    }
+}
+
+inline void vDSP_ztoc(const DSPSplitComplex* z, vDSP_Stride, DSPComplex* c, vDSP_Stride, vDSP_Length n) {
+    for (vDSP_Length i = 0; i < n; ++i) {
+        c[i].real = z->realp[i];
+        c[i].imag = z->imagp[i];
+    }
+}
+
+inline void vDSP_zvabs(const DSPSplitComplex* a, vDSP_Stride, float* c, vDSP_Stride, vDSP_Length n) {
+    for (vDSP_Length i = 0; i < n; ++i) c[i] = std::hypot(a->realp[i], a->imagp[i]);
+}
+
+inline void vDSP_zvphas(const DSPSplitComplex* a, vDSP_Stride, float* c, vDSP_Stride, vDSP_Length n) {
+    for (vDSP_Length i = 0; i < n; ++i) c[i] = std::atan2(a->imagp[i], a->realp[i]);
+}
+
+// d = a * b + c
+inline void vDSP_zvma(const DSPSplitComplex* a, vDSP_Stride, const DSPSplitComplex* b, vDSP_Stride, const DSPSplitComplex* c, vDSP_Stride, const DSPSplitComplex* d, vDSP_Stride, vDSP_Length n) {
+    for (vDSP_Length i = 0; i < n; ++i) {
+        const float ar = a->realp[i], ai = a->imagp[i];
+        const float br = b->realp[i], bi = b->imagp[i];
+        const float cr = c->realp[i], ci = c->imagp[i];
+        d->realp[i] = ar * br - ai * bi + cr;
+        d->imagp[i] = ar * bi + ai * br + ci;
+    }
+}
+
+// MARK: - FFT
+struct OpaqueFFTSetup {
+    vDSP_Length log2n;
+    float* cosine;      // cos(2πj/N) and -sin(2πj/N) for j < N/2 of the largest size N
+    float* sine;
+};
+typedef OpaqueFFTSetup* FFTSetup;
+
+inline FFTSetup vDSP_create_fftsetup(vDSP_Length log2n, FFTRadix) {
+    const vDSP_Length half = (vDSP_Length(1) << log2n) / 2;
+    FFTSetup setup = new OpaqueFFTSetup { log2n, new float[half + 1], new float[half + 1] };
+    for (vDSP_Length j = 0; j <= half; ++j) {
+        const double angle = 2.0 * M_PI * double(j) / double(vDSP_Length(1) << log2n);
+        setup->cosine[j] = float(std::cos(angle));
+        setup->sine[j] = float(-std::sin(angle));
+    }
+    return setup;
+}
+
+inline void vDSP_destroy_fftsetup(FFTSetup setup) {
+    if (setup != nullptr) {
+        delete[] setup->cosine;
+        delete[] setup->sine;
+        delete setup;
+    }
+}
+
+// e^(-2πik/N) for a transform of 2^log2n points, from the setup's table
+inline void vDSPStubTwiddle(FFTSetup setup, vDSP_Length log2n, vDSP_Length k, bool inverse, float& real, float& imag) {
+    const vDSP_Length index = k << (setup->log2n - log2n);
+    real = setup->cosine[index];
+    imag = inverse ? -setup->sine[index] : setup->sine[index];
+}
+
+// Unscaled in-place radix-2 complex transform of 2^log2n split points
+inline void vDSPStubComplexFFT(FFTSetup setup, float* re, float* im, vDSP_Length log2n, bool inverse) {
+    const vDSP_Length n = vDSP_Length(1) << log2n;
+    for (vDSP_Length i = 1, j = 0; i < n; ++i) {
+        vDSP_Length bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            std::swap(re[i], re[j]);
+            std::swap(im[i], im[j]);
+        }
+    }
+    for (vDSP_Length stage = 1; stage <= log2n; ++stage) {
+        const vDSP_Length length = vDSP_Length(1) << stage;
+        const vDSP_Length half = length / 2;
+        for (vDSP_Length start = 0; start < n; start += length) {
+            for (vDSP_Length j = 0; j < half; ++j) {
+                float wr, wi;
+                vDSPStubTwiddle(setup, stage, j, inverse, wr, wi);
+                const vDSP_Length a = start + j, b = a + half;
+                const float vr = re[b] * wr - im[b] * wi;
+                const float vi = re[b] * wi + im[b] * wr;
+                re[b] = re[a] - vr;
+                im[b] = im[a] - vi;
+                re[a] += vr;
+                im[a] += vi;
+            }
+        }
+    }
+}
+
+/*
+ Real FFT of 2^log2n points packed as N/2 complex values: even samples in realp, odd in
+ imagp. Forward leaves 2·X[k] for k in 1..N/2-1, with 2·X[0] in realp[0] and 2·X[N/2] in
+ imagp[0]; inverse takes the same layout and returns N times the signal, so a round trip
+ scales by 2N. The N/2-point complex transform is split into the real one in place, a bin
+ and its mirror at a time.
+ */
+inline void vDSP_fft_zrip(FFTSetup setup, const DSPSplitComplex* z, vDSP_Stride, vDSP_Length log2n, FFTDirection direction) {
+    if (log2n == 0 || log2n > setup->log2n) {
+        return;
+    }
+    float* re = z->realp;
+    float* im = z->imagp;
+    const vDSP_Length half = (vDSP_Length(1) << log2n) / 2;
+
+    if (direction == kFFTDirection_Forward) {
+        vDSPStubComplexFFT(setup, re, im, log2n - 1, false);
+        for (vDSP_Length k = 1; k <= half / 2; ++k) {
+            const vDSP_Length mirror = half - k;
+            // E = (Z[k] + conj Z[mirror]) / 2, O = (Z[k] - conj Z[mirror]) / 2i
+            const float er = 0.5f * (re[k] + re[mirror]), ei = 0.5f * (im[k] - im[mirror]);
+            const float or_ = 0.5f * (im[k] + im[mirror]), oi = -0.5f * (re[k] - re[mirror]);
+            float wr, wi;
+            vDSPStubTwiddle(setup, log2n, k, false, wr, wi);
+            const float pr = or_ * wr - oi * wi, pi = or_ * wi + oi * wr;
+            // X[k] = E + W·O, X[mirror] = conj(E - W·O)
+            re[k] = 2.f * (er + pr);
+            im[k] = 2.f * (ei + pi);
+            re[mirror] = 2.f * (er - pr);
+            im[mirror] = -2.f * (ei - pi);
+        }
+        const float r0 = re[0], i0 = im[0];
+        re[0] = 2.f * (r0 + i0);
+        im[0] = 2.f * (r0 - i0);
+    } else {
+        for (vDSP_Length k = 1; k <= half / 2; ++k) {
+            const vDSP_Length mirror = half - k;
+            // E = (Y[k] + conj Y[mirror]) / 2, O = (Y[k] - conj Y[mirror]) / 2 · conj W
+            const float er = 0.5f * (re[k] + re[mirror]), ei = 0.5f * (im[k] - im[mirror]);
+            const float dr = 0.5f * (re[k] - re[mirror]), di = 0.5f * (im[k] + im[mirror]);
+            float wr, wi;
+            vDSPStubTwiddle(setup, log2n, k, true, wr, wi);
+            const float or_ = dr * wr - di * wi, oi = dr * wi + di * wr;
+            // Z[k] = E + i·O, Z[mirror] = conj(E) + i·conj(O)
+            re[k] = er - oi;
+            im[k] = ei + or_;
+            re[mirror] = er + oi;
+            im[mirror] = or_ - ei;
+        }
+        const float x0 = re[0], xh = im[0];
+        re[0] = 0.5f * (x0 + xh);
+        im[0] = 0.5f * (x0 - xh);
+        vDSPStubComplexFFT(setup, re, im, log2n - 1, true);
+        for (vDSP_Length k = 0; k < half; ++k) {
+            re[k] *= 2.f;
+            im[k] *= 2.f;
+        }
+    }
+}
@@ -0,0 +1,8 @@
+//
+//  AUParameters.h
+//  BeatMachineExtensionTests
+//
+
+#pragma once
+
+#include "AudioToolbox.h"
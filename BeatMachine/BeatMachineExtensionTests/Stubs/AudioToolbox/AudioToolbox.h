@@ -0,0 +1,129 @@
+//
+//  AudioToolbox.h
+//  BeatMachineExtensionTests
+//
+
+#pragma once
+
+/*
+ The slice of AudioToolbox the DSP kernel uses, declared for building it on Linux. Layouts
+ match the Apple headers for the fields the kernel reads; host blocks become std::function,
+ and AUParameter is a plain value, since the parameter tree is Objective-C and stays in
+ the audio unit.
+ */
+
+// The Apple headers bring these in, and the kernel relies on it
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+
+#include "../CoreMIDI/CoreMIDI.h"
+
+typedef uint8_t UInt8;
+typedef uint16_t UInt16;
+typedef int16_t SInt16;
+typedef uint32_t UInt32;
+typedef int32_t SInt32;
+typedef uint64_t UInt64;
+typedef long NSInteger;
+typedef unsigned long NSUInteger;
+typedef int32_t OSStatus;
+
+// After typedef, names the underlying type and declares the values in an enum beside it
+#define NS_ENUM(type, name) type name; enum name##Values : type
+
+#ifndef noErr
+#define noErr 0
+#endif
+
+typedef uint64_t AUParameterAddress;
+typedef float AUValue;
+typedef uint32_t AUAudioFrameCount;
+typedef int64_t AUEventSampleTime;
+typedef OSStatus AUAudioUnitStatus;
+typedef uint32_t AudioUnitRenderActionFlags;
+
+enum {
+    kAudioUnitErr_TooManyFramesToProcess = -10874,
+    kAudioUnitErr_FailedInitialization = -10875,
+    kAudioUnitErr_NoConnection = -10876
+};
+
+struct AudioBuffer {
+    UInt32 mNumberChannels;
+    UInt32 mDataByteSize;
+    void* mData;
+};
+
+struct AudioBufferList {
+    UInt32 mNumberBuffers;
+    AudioBuffer mBuffers[1];
+};
+
+struct AudioTimeStamp {
+    double mSampleTime;
+};
+
+struct AUParameter {
+    AUParameterAddress address;
+    AUValue value;
+};
+
+// MARK: - Host Blocks
+typedef NSUInteger AUHostTransportStateFlags;
+enum {
+    AUHostTransportStateChanged = 1,
+    AUHostTransportStateMoving = 2,
+    AUHostTransportStateRecording = 4,
+    AUHostTransportStateCycling = 8
+};
+
+// (currentTempo, timeSignatureNumerator, timeSignatureDenominator, currentBeatPosition,
+//  sampleOffsetToNextBeat, currentMeasureDownbeatPosition)
+typedef std::function<bool(double*, double*, NSInteger*, double*, NSInteger*, double*)> AUHostMusicalContextBlock;
+// (transportStateFlags, currentSamplePosition, cycleStartBeatPosition, cycleEndBeatPosition)
+typedef std::function<bool(AUHostTransportStateFlags*, double*, double*, double*)> AUHostTransportStateBlock;
+
+// MARK: - Render Events
+enum AURenderEventType : uint8_t {
+    AURenderEventParameter = 1,
+    AURenderEventParameterRamp = 2,
+    AURenderEventMIDI = 8,
+    AURenderEventMIDISysEx = 9,
+    AURenderEventMIDIEventList = 10
+};
+
+union AURenderEvent;
+
+struct AURenderEventHeader {
+    union AURenderEvent* next;
+    AUEventSampleTime eventSampleTime;
+    AURenderEventType eventType;
+    uint8_t reserved;
+};
+
+struct AUParameterEvent {
+    union AURenderEvent* next;
+    AUEventSampleTime eventSampleTime;
+    AURenderEventType eventType;
+    uint8_t reserved[3];
+    AUAudioFrameCount rampDurationSampleFrames;
+    AUParameterAddress parameterAddress;
+    AUValue value;
+};
+
+struct AUMIDIEventList {
+    union AURenderEvent* next;
+    AUEventSampleTime eventSampleTime;
+    AURenderEventType eventType;
+    uint8_t reserved;
+    uint8_t cable;
+    MIDIEventList eventList;
+};
+
+union AURenderEvent {
+    AURenderEventHeader head;
+    AUParameterEvent parameter;
+    AUMIDIEventList MIDIEventsList;
+};
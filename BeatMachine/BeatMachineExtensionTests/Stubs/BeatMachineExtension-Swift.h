@@ -0,0 +1,9 @@
+//
+//  BeatMachineExtension-Swift.h
+//  BeatMachineExtensionTests
+//
+
+#pragma once
+
+// Stands in for the header Xcode generates from the extension's Swift sources, which the
+// kernel includes but takes nothing from
@@ -0,0 +1,190 @@
+//
+//  CoreMIDI.h
+//  BeatMachineExtensionTests
+//
+
+#pragma once
+
+/*
+ The slice of CoreMIDI the DSP kernel uses, declared for building it on Linux.
+ MIDIEventListForEachEvent decodes MIDI 2.0 channel voice messages the way CoreMIDI
+ reports them; every other message type is passed on with only its type and group set.
+ */
+
+#include <cstdint>
+
+typedef uint64_t MIDITimeStamp;
+typedef int32_t MIDIProtocolID;
+
+enum {
+    kMIDIProtocol_1_0 = 1,
+    kMIDIProtocol_2_0 = 2
+};
+
+enum {
+    kMIDIMessageTypeUtility = 0x0,
+    kMIDIMessageTypeSystem = 0x1,
+    kMIDIMessageTypeChannelVoice1 = 0x2,
+    kMIDIMessageTypeSysEx = 0x3,
+    kMIDIMessageTypeChannelVoice2 = 0x4,
+    kMIDIMessageTypeData128 = 0x5
+};
+
+enum {
+    kMIDICVStatusRegisteredPNC = 0x0,
+    kMIDICVStatusAssignablePNC = 0x1,
+    kMIDICVStatusRegisteredControl = 0x2,
+    kMIDICVStatusAssignableControl = 0x3,
+    kMIDICVStatusRelRegisteredControl = 0x4,
+    kMIDICVStatusRelAssignableControl = 0x5,
+    kMIDICVStatusPerNotePitchBend = 0x6,
+    kMIDICVStatusNoteOff = 0x8,
+    kMIDICVStatusNoteOn = 0x9,
+    kMIDICVStatusPolyPressure = 0xA,
+    kMIDICVStatusControlChange = 0xB,
+    kMIDICVStatusProgramChange = 0xC,
+    kMIDICVStatusChannelPressure = 0xD,
+    kMIDICVStatusPitchBend = 0xE,
+    kMIDICVStatusPerNoteMgmt = 0xF
+};
+
+struct MIDIUniversalMessage {
+    uint8_t type;
+    uint8_t group;
+    struct {
+        uint8_t status;
+        uint8_t channel;
+        union {
+            struct {
+                uint8_t number;
+                uint8_t attributeType;
+                uint16_t velocity;
+                uint16_t attributeData;
+            } note;
+            struct {
+                uint8_t noteNumber;
+                uint32_t pressure;
+            } polyPressure;
+            struct {
+                uint8_t index;
+                uint32_t data;
+            } controlChange;
+            struct {
+                uint8_t noteNumber;
+                uint32_t data;
+            } perNotePitchBend;
+            struct {
+                uint8_t noteNumber;
+                uint8_t index;
+                uint32_t data;
+            } perNoteController;
+            struct {
+                uint8_t note;
+                bool detachControllers;
+                bool resetControllers;
+            } perNoteManagement;
+            uint32_t channelPressure;
+            uint32_t pitchBend;
+        };
+    } channelVoice2;
+};
+
+// Packets are packed to 4 bytes, as in CoreMIDI, so the next one starts right after the last word
+#pragma pack(push, 4)
+struct MIDIEventPacket {
+    MIDITimeStamp timeStamp;
+    uint32_t wordCount;
+    uint32_t words[64];
+};
+
+struct MIDIEventList {
+    MIDIProtocolID protocol;
+    uint32_t numPackets;
+    MIDIEventPacket packet[1];
+};
+#pragma pack(pop)
+
+typedef void (*MIDIEventVisitor)(void* context, MIDITimeStamp timeStamp, MIDIUniversalMessage message);
+
+// Words in a universal MIDI packet of each message type
+inline uint32_t MIDIStubMessageWordCount(uint8_t type) {
+    static const uint8_t wordCounts[16] = { 1, 1, 1, 2, 2, 4, 1, 1, 2, 2, 2, 3, 3, 4, 4, 4 };
+    return wordCounts[type & 0xF];
+}
+
+inline MIDIUniversalMessage MIDIStubDecodeChannelVoice2(uint32_t first, uint32_t second) {
+    MIDIUniversalMessage message {};
+    message.type = kMIDIMessageTypeChannelVoice2;
+    message.group = (first >> 24) & 0xF;
+    message.channelVoice2.status = (first >> 20) & 0xF;
+    message.channelVoice2.channel = (first >> 16) & 0xF;
+    const uint8_t index = (first >> 8) & 0xFF;
+    auto& voice = message.channelVoice2;
+    switch (voice.status) {
+        case kMIDICVStatusNoteOff:
+        case kMIDICVStatusNoteOn:
+            voice.note.number = index;
+            voice.note.attributeType = first & 0xFF;
+            voice.note.velocity = second >> 16;
+            voice.note.attributeData = second & 0xFFFF;
+            break;
+        case kMIDICVStatusPolyPressure:
+            voice.polyPressure.noteNumber = index;
+            voice.polyPressure.pressure = second;
+            break;
+        case kMIDICVStatusControlChange:
+            voice.controlChange.index = index;
+            voice.controlChange.data = second;
+            break;
+        case kMIDICVStatusPerNotePitchBend:
+            voice.perNotePitchBend.noteNumber = index;
+            voice.perNotePitchBend.data = second;
+            break;
+        case kMIDICVStatusRegisteredPNC:
+        case kMIDICVStatusAssignablePNC:
+            voice.perNoteController.noteNumber = index;
+            voice.perNoteController.index = first & 0xFF;
+            voice.perNoteController.data = second;
+            break;
+        case kMIDICVStatusPerNoteMgmt:
+            voice.perNoteManagement.note = index;
+            voice.perNoteManagement.detachControllers = (first >> 1) & 1;
+            voice.perNoteManagement.resetControllers = first & 1;
+            break;
+        case kMIDICVStatusChannelPressure:
+            voice.channelPressure = second;
+            break;
+        case kMIDICVStatusPitchBend:
+            voice.pitchBend = second;
+            break;
+        default:
+            break;
+    }
+    return message;
+}
+
+inline void MIDIEventListForEachEvent(const MIDIEventList* list, MIDIEventVisitor visitor, void* context) {
+    const MIDIEventPacket* packet = &list->packet[0];
+    for (uint32_t i = 0; i < list->numPackets; ++i) {
+        const uint32_t wordCount = packet->wordCount < 64 ? packet->wordCount : 64;
+        uint32_t word = 0;
+        while (word < wordCount) {
+            const uint32_t first = packet->words[word];
+            const uint8_t type = first >> 28;
+            const uint32_t size = MIDIStubMessageWordCount(type);
+            if (word + size > wordCount) {
+                break;
+            }
+            if (type == kMIDIMessageTypeChannelVoice2) {
+                visitor(context, packet->timeStamp, MIDIStubDecodeChannelVoice2(first, packet->words[word + 1]));
+            } else {
+                MIDIUniversalMessage message {};
+                message.type = type;
+                message.group = (first >> 24) & 0xF;
+                visitor(context, packet->timeStamp, message);
+            }
+            word += size;
+        }
+        packet = reinterpret_cast<const MIDIEventPacket*>(&packet->words[wordCount]);
+    }
+}
@@ -0,0 +1,74 @@
+//
+//  AllocationCounter.hpp
+//  BeatMachineExtensionTests
+//
+
+#pragma once
+
+#include <cstdlib>
+#include <new>
+
+/*
+ Counts heap allocations made while an AllocationScope is alive on the same thread, to
+ check that rendering doesn't allocate. Replaces the global operator new, so include it
+ from one translation unit of a test executable only.
+ */
+inline thread_local bool gCountAllocations = false;
+inline thread_local long gAllocationCount = 0;
+
+class AllocationScope {
+public:
+    AllocationScope() {
+        gAllocationCount = 0;
+        gCountAllocations = true;
+    }
+
+    ~AllocationScope() {
+        gCountAllocations = false;
+    }
+
+    long count() const {
+        return gAllocationCount;
+    }
+};
+
+// Every replaced operator new and delete goes through these two. They are kept out of line
+// so that GCC doesn't pair an inlined free() with the operator new that allocated, which
+// -Wmismatched-new-delete reports as a mismatch.
+[[gnu::noinline]] inline void* countedAllocate(size_t size) {
+    if (gCountAllocations) {
+        gAllocationCount += 1;
+    }
+    if (void* memory = std::malloc(size != 0 ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+[[gnu::noinline]] inline void countedFree(void* memory) noexcept {
+    std::free(memory);
+}
+
+void* operator new(size_t size) {
+    return countedAllocate(size);
+}
+
+void* operator new[](size_t size) {
+    return countedAllocate(size);
+}
+
+void operator delete(void* memory) noexcept {
+    countedFree(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+    countedFree(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    countedFree(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept {
+    countedFree(memory);
+}
@@ -0,0 +1,39 @@
+//
+//  HostTransport.hpp
+//  BeatMachineExtensionTests
+//
+
+#pragma once
+
+#include "KernelRig.hpp"
+
+/*
+ HostTransport
+ A simulated host timeline for a KernelRig: a fixed tempo with beat 0 at sample 0, and a
+ play state tests can flip. attach() installs it as the kernel's musical context and
+ transport state blocks; it must outlive the rig's rendering.
+ */
+struct HostTransport {
+    double tempo = 120.0;
+    bool moving = true;
+
+    double samplesPerBeat(double sampleRate) const {
+        return sampleRate * 60.0 / tempo;
+    }
+
+    void attach(KernelRig& rig, double sampleRate) {
+        rig.kernel.setMusicalContextBlock([this, &rig, sampleRate](double* currentTempo, double*, NSInteger*, double* beat, NSInteger*, double*) {
+            if (currentTempo != nullptr) {
+                *currentTempo = tempo;
+            }
+            if (beat != nullptr) {
+                *beat = double(rig.now) / samplesPerBeat(sampleRate);
+            }
+            return true;
+        });
+        rig.kernel.setTransportStateBlock([this](AUHostTransportStateFlags* flags, double*, double*, double*) {
+            *flags = moving ? AUHostTransportStateMoving : 0;
+            return true;
+        });
+    }
+};
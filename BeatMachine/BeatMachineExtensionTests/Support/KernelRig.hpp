@@ -0,0 +1,150 @@
+//
+//  KernelRig.hpp
+//  BeatMachineExtensionTests
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+#include "BeatMachineExtensionAUProcessHelper.hpp"
+
+/*
+ KernelRig
+ A kernel driven the way the audio unit drives it: prepared, initialized for one format,
+ and rendered a cycle at a time through AUProcessHelper, with the host's sample time
+ advancing by each cycle's frames. `input` is what the input bus delivers next cycle,
+ `output` what the last cycle produced; both are one vector per channel. Parameters set
+ here go straight to the kernel, as the parameter tree's observer would.
+
+ With `inPlace`, the input is copied into `output` and the kernel reads and writes there,
+ as when the host processes in place. Clearing `pullInput` renders as the audio unit does
+ when it skips the input pull: no input, and the output buffers passed as both buses.
+ */
+class KernelRig {
+public:
+    BeatMachineExtensionDSPKernel kernel;
+    std::vector<std::vector<float>> input;
+    std::vector<std::vector<float>> output;
+    AUEventSampleTime now = 0;
+    bool inPlace = false;
+    bool pullInput = true;
+
+    KernelRig(int maximumFrames = 512, double sampleRate = 44100.0, int channelCount = 1)
+    : input(channelCount, std::vector<float>(maximumFrames, 0.0f)),
+    output(channelCount, std::vector<float>(maximumFrames, 0.0f)),
+    mMaximumFrames(maximumFrames),
+    mInputList(makeList(channelCount)),
+    mOutputList(makeList(channelCount)) {
+        kernel.setMaximumFramesToRender(maximumFrames);
+        kernel.initialize(channelCount, channelCount, sampleRate);
+        mHelper = std::make_unique<AUProcessHelper>(kernel, channelCount, channelCount, 1);
+        mEvents.reserve(256);
+    }
+
+    void setParameter(AUParameterAddress address, AUValue value) {
+        kernel.setParameter(address, value);
+    }
+
+    // Renders one cycle of `frames` (the maximum by default), with the events in `events`
+    // in time order; an empty `sidechain` leaves the sidechain bus unpulled. Up to 256
+    // events render without allocating.
+    void render(const std::vector<AURenderEvent>& events = {}, int frames = -1, const std::vector<float>& sidechain = {}) {
+        frames = frames < 0 ? mMaximumFrames : frames;
+        mEvents.assign(events.begin(), events.end());
+        for (size_t i = 0; i + 1 < mEvents.size(); ++i) {
+            mEvents[i].head.next = &mEvents[i + 1];
+        }
+        for (size_t channel = 0; channel < input.size(); ++channel) {
+            float* inputData = input[channel].data();
+            if (!pullInput || inPlace) {
+                if (pullInput) {
+                    std::copy_n(inputData, frames, output[channel].data());
+                }
+                inputData = output[channel].data();
+            }
+            bind(*mInputList, channel, inputData, frames);
+            bind(*mOutputList, channel, output[channel].data(), frames);
+        }
+        kernel.setInputAvailable(pullInput);
+        AudioBufferList sidechainList { 1, { { 1, UInt32(frames * sizeof(float)), const_cast<float*>(sidechain.data()) } } };
+        const AudioTimeStamp timestamp { double(now) };
+        mHelper->processWithEvents(mInputList.get(), mOutputList.get(), &timestamp, AUAudioFrameCount(frames),
+                                   mEvents.empty() ? nullptr : &mEvents[0], sidechain.empty() ? nullptr : &sidechainList);
+        now += frames;
+    }
+
+    // Renders `seconds` of cycles, appending each cycle's first output channel to `recording`
+    void renderSeconds(double seconds, double sampleRate, std::vector<float>* recording = nullptr) {
+        const long cycles = long(std::ceil(seconds * sampleRate / mMaximumFrames));
+        for (long cycle = 0; cycle < cycles; ++cycle) {
+            render();
+            if (recording != nullptr) {
+                recording->insert(recording->end(), output[0].begin(), output[0].end());
+            }
+        }
+    }
+
+    int maximumFrames() const {
+        return mMaximumFrames;
+    }
+
+private:
+    struct ListDeleter {
+        void operator()(AudioBufferList* list) const {
+            ::operator delete(list);
+        }
+    };
+    using List = std::unique_ptr<AudioBufferList, ListDeleter>;
+
+    static List makeList(int channelCount) {
+        const size_t bytes = sizeof(AudioBufferList) + sizeof(AudioBuffer) * size_t(std::max(channelCount - 1, 0));
+        List list(static_cast<AudioBufferList*>(::operator new(bytes)));
+        list->mNumberBuffers = UInt32(channelCount);
+        return list;
+    }
+
+    static void bind(AudioBufferList& list, size_t channel, float* data, int frames) {
+        list.mBuffers[channel] = { 1, UInt32(frames * sizeof(float)), data };
+    }
+
+    int mMaximumFrames;
+    List mInputList;
+    List mOutputList;
+    std::unique_ptr<AUProcessHelper> mHelper;
+    std::vector<AURenderEvent> mEvents;
+};
+
+// MARK: - Events
+// One two-word universal MIDI packet at `time`
+inline AURenderEvent midiEvent(AUEventSampleTime time, uint32_t first, uint32_t second) {
+    AURenderEvent event {};
+    event.MIDIEventsList.eventSampleTime = time;
+    event.MIDIEventsList.eventType = AURenderEventMIDIEventList;
+    event.MIDIEventsList.eventList.protocol = kMIDIProtocol_2_0;
+    event.MIDIEventsList.eventList.numPackets = 1;
+    MIDIEventPacket& packet = event.MIDIEventsList.eventList.packet[0];
+    packet.wordCount = 2;
+    packet.words[0] = first;
+    packet.words[1] = second;
+    return event;
+}
+
+// A MIDI 2.0 note-on or note-off for `note` at `time`, velocity 16-bit
+inline AURenderEvent noteEvent(AUEventSampleTime time, bool on, int note, uint16_t velocity = 0x8000) {
+    const uint32_t status = on ? kMIDICVStatusNoteOn : kMIDICVStatusNoteOff;
+    return midiEvent(time, (uint32_t(kMIDIMessageTypeChannelVoice2) << 28) | (status << 20) | (uint32_t(note & 0xFF) << 8), uint32_t(velocity) << 16);
+}
+
+// A new[]'d pad take of SoundBuffer::capacity samples, the first `length` from `sample(i)`,
+// ready for KernelCommand::loadPadCommand
+template <typename Generator>
+float* makeTake(int length, Generator sample) {
+    float* take = new float[SoundBuffer::capacity]();
+    for (int i = 0; i < length; ++i) {
+        take[i] = sample(i);
+    }
+    return take;
+}
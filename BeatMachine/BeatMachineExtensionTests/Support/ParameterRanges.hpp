@@ -0,0 +1,41 @@
+//
+//  ParameterRanges.hpp
+//  BeatMachineExtensionTests
+//
+
+#pragma once
+
+#include "BeatMachineExtensionParameterAddresses.h"
+
+// The value range of every parameter, as Parameters.swift declares it, indexed by address
+struct ParameterRange {
+    AUParameterAddress address;
+    float minimum;
+    float maximum;
+};
+
+inline constexpr ParameterRange parameterRanges[] = {
+    { BeatMachineExtensionParameterAddress::gain, 0.0f, 1.0f },
+    { BeatMachineExtensionParameterAddress::samplingMode, 0.0f, 1.0f },
+    { BeatMachineExtensionParameterAddress::loopRecordMode, 0.0f, 1.0f },
+    { BeatMachineExtensionParameterAddress::filterCutoff, 20.0f, 20000.0f },
+    { BeatMachineExtensionParameterAddress::filterResonance, 0.5f, 10.0f },
+    { BeatMachineExtensionParameterAddress::drive, 0.0f, 24.0f },
+    { BeatMachineExtensionParameterAddress::compressorThreshold, -60.0f, 0.0f },
+    { BeatMachineExtensionParameterAddress::compressorRatio, 1.0f, 20.0f },
+    { BeatMachineExtensionParameterAddress::autoSlice, 0.0f, 1.0f },
+    { BeatMachineExtensionParameterAddress::quantizeGrid, 0.0f, 4.0f },
+    { BeatMachineExtensionParameterAddress::swing, 50.0f, 75.0f },
+    { BeatMachineExtensionParameterAddress::sequencerEnabled, 0.0f, 1.0f },
+    { BeatMachineExtensionParameterAddress::sequencerPattern, 0.0f, 7.0f },
+    { BeatMachineExtensionParameterAddress::loopFeedback, 0.0f, 100.0f },
+    { BeatMachineExtensionParameterAddress::inputLatency, 0.0f, 250.0f },
+    { BeatMachineExtensionParameterAddress::takePreRoll, 0.0f, 250.0f },
+    { BeatMachineExtensionParameterAddress::retrospectiveCapture, 0.0f, 1.0f },
+    { BeatMachineExtensionParameterAddress::duckDepth, 0.0f, 48.0f },
+    { BeatMachineExtensionParameterAddress::duckThreshold, -60.0f, 0.0f },
+    { BeatMachineExtensionParameterAddress::duckRelease, 10.0f, 1000.0f },
+    { BeatMachineExtensionParameterAddress::reverbLevel, 0.0f, 100.0f }
+};
+
+inline constexpr int parameterCount = int(sizeof(parameterRanges) / sizeof(parameterRanges[0]));
@@ -0,0 +1,40 @@
+//
+//  TestCheck.hpp
+//  BeatMachineExtensionTests
+//
+
+#pragma once
+
+#include <cstdio>
+#include <cmath>
+
+/*
+ Minimal checks for the test executables: each failed CHECK prints where it failed and is
+ counted, and main returns testResult(), so CTest sees a non-zero exit when anything failed.
+ */
+inline int& testFailureCount() {
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+            testFailureCount() += 1; \
+        } \
+    } while (0)
+
+#define CHECK_NEAR(actual, expected, tolerance) \
+    do { \
+        const double checkActual = (actual), checkExpected = (expected); \
+        if (!(std::fabs(checkActual - checkExpected) <= (tolerance))) { \
+            std::printf("%s:%d: CHECK_NEAR failed: %s = %g, expected %g ± %g\n", __FILE__, __LINE__, #actual, checkActual, checkExpected, double(tolerance)); \
+            testFailureCount() += 1; \
+        } \
+    } while (0)
+
+inline int testResult(const char* name) {
+    std::printf("%s: %s (%d failed)\n", name, testFailureCount() == 0 ? "passed" : "FAILED", testFailureCount());
+    return testFailureCount() == 0 ? 0 : 1;
+}
@@ -0,0 +1,85 @@
+//
+//  ChokeTests.cpp
+//  BeatMachineExtensionTests
+//
+
+#include "KernelRig.hpp"
+#include "TestCheck.hpp"
+
+/*
+ Choke groups at sample resolution. An open hat pad of constant 0.5 rings as a one-shot;
+ a closed hat pad of constant 0.25 in the same group chokes it at the note-on's sample
+ offset. Up to that sample the output is the open hat alone, and one crossfade later it is
+ the closed hat alone, wherever in the cycle the note lands. A pad outside the group
+ keeps ringing.
+ */
+namespace {
+
+const double sampleRate = 44100.0;
+const int openHat = 46;
+const int closedHat = 42;
+const int otherPad = 50;
+const int takeLength = 44100;
+const int fadeLength = int(0.01 * sampleRate);
+
+void setUp(KernelRig& rig) {
+    using Kind = KernelCommand::PadSetting::Kind;
+    rig.kernel.postCommand(KernelCommand::loadPadCommand(openHat, makeTake(takeLength, [](int) { return 0.5f; }), takeLength));
+    rig.kernel.postCommand(KernelCommand::loadPadCommand(closedHat, makeTake(takeLength, [](int) { return 0.25f; }), takeLength));
+    rig.kernel.postCommand(KernelCommand::loadPadCommand(otherPad, makeTake(takeLength, [](int) { return 0.125f; }), takeLength));
+    rig.kernel.postCommand(KernelCommand::padSettingCommand(openHat, Kind::ChokeGroup, 1));
+    rig.kernel.postCommand(KernelCommand::padSettingCommand(closedHat, Kind::ChokeGroup, 1));
+    rig.kernel.postCommand(KernelCommand::padSettingCommand(openHat, Kind::RetriggerMode, 1));
+    rig.kernel.postCommand(KernelCommand::padSettingCommand(closedHat, Kind::RetriggerMode, 1));
+    rig.render();
+}
+
+// Rings the open hat (and `other` with it), then chokes it `offset` samples into a cycle.
+// Returns that cycle's output.
+std::vector<float> choke(int offset, bool other) {
+    KernelRig rig(1024, sampleRate);
+    setUp(rig);
+    std::vector<AURenderEvent> hits { noteEvent(rig.now, true, openHat, 0xFFFF), noteEvent(rig.now, false, openHat) };
+    if (other) {
+        hits.push_back(noteEvent(rig.now, true, otherPad, 0xFFFF));
+    }
+    rig.render(hits);
+    rig.render();
+    rig.render({ noteEvent(rig.now + offset, true, closedHat, 0xFFFF) });
+    return rig.output[0];
+}
+
+void testChokeTiming() {
+    for (int offset : { 0, 37, 500 }) {
+        const std::vector<float> output = choke(offset, false);
+        // the one-shot rang on past its note-off, alone up to the choking note
+        bool untouched = true;
+        for (int i = 0; i < offset; ++i) {
+            untouched = untouched && output[size_t(i)] == 0.5f;
+        }
+        CHECK(untouched);
+        // both fades start on the choking sample, from full open hat and silent closed hat,
+        // and end one crossfade later
+        CHECK(output[size_t(offset)] == 0.5f);
+        CHECK(output[size_t(offset) + 1] != 0.5f);
+        CHECK(output[size_t(offset + fadeLength) - 1] != 0.25f);
+        bool choked = true;
+        for (size_t i = size_t(offset + fadeLength); i < output.size(); ++i) {
+            choked = choked && output[i] == 0.25f;
+        }
+        CHECK(choked);
+    }
+}
+
+void testOtherGroupsRing() {
+    const std::vector<float> output = choke(37, true);
+    CHECK_NEAR(output.back(), 0.25 + 0.125, 1e-6);
+}
+
+}
+
+int main() {
+    testChokeTiming();
+    testOtherGroupsRing();
+    return testResult("ChokeTests");
+}
@@ -0,0 +1,136 @@
+//
+//  CommandQueueTests.cpp
+//  BeatMachineExtensionTests
+//
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "KernelRig.hpp"
+#include "TestCheck.hpp"
+
+/*
+ The command channel under contention. Several producer threads hammer an MPSCQueue of
+ the kernel's capacity while one consumer drains it a render budget at a time: every item
+ must arrive exactly once, whole, and in order per producer. Then the same against the
+ kernel itself, with producers posting pad loads and settings while the render thread
+ runs, retrying whenever the queue is full: each pad must end up with the last take its
+ producer loaded. Worth running under the sanitizers.
+ */
+namespace {
+
+const int producerCount = 4;
+
+struct Item {
+    int producer;
+    int sequence;
+    uint64_t check;     // derived from the other two, so a torn read shows
+};
+
+uint64_t checkValue(int producer, int sequence) {
+    return (uint64_t(producer) << 32 | uint32_t(sequence)) * 0x9E3779B97F4A7C15ull;
+}
+
+void testQueue() {
+    const int itemsPerProducer = 50000;
+    MPSCQueue<Item, 256> queue;
+    std::atomic<int> finished { 0 };
+    std::vector<std::thread> producers;
+    for (int producer = 0; producer < producerCount; ++producer) {
+        producers.emplace_back([&queue, &finished, producer, itemsPerProducer] {
+            for (int sequence = 0; sequence < itemsPerProducer;) {
+                if (queue.push({ producer, sequence, checkValue(producer, sequence) })) {
+                    sequence += 1;
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+            finished += 1;
+        });
+    }
+
+    std::vector<int> next(producerCount, 0);
+    long received = 0;
+    bool ordered = true;
+    bool whole = true;
+    for (;;) {
+        const bool allFinished = finished.load() == producerCount;
+        // one render cycle's budget at a time
+        int popped = 0;
+        Item item;
+        while (popped < 32 && queue.pop(item)) {
+            ordered = ordered && item.sequence == next[size_t(item.producer)];
+            whole = whole && item.check == checkValue(item.producer, item.sequence);
+            next[size_t(item.producer)] = item.sequence + 1;
+            received += 1;
+            popped += 1;
+        }
+        if (popped == 0) {
+            if (allFinished) {
+                break;
+            }
+            std::this_thread::yield();
+        }
+    }
+    for (std::thread& producer : producers) {
+        producer.join();
+    }
+    CHECK(received == long(producerCount) * itemsPerProducer);
+    CHECK(ordered);
+    CHECK(whole);
+}
+
+void testKernel() {
+    const int padsPerProducer = 8;
+    const int loadsPerPad = 10;
+    KernelRig rig(256);
+    std::atomic<int> finished { 0 };
+    std::vector<std::thread> producers;
+    for (int producer = 0; producer < producerCount; ++producer) {
+        producers.emplace_back([&rig, &finished, producer, padsPerProducer, loadsPerPad] {
+            auto post = [&rig](const KernelCommand& command) {
+                while (!rig.kernel.postCommand(command)) {
+                    std::this_thread::yield();
+                }
+            };
+            for (int load = 0; load < loadsPerPad; ++load) {
+                for (int pad = 0; pad < padsPerProducer; ++pad) {
+                    const int note = 2 + producer * padsPerProducer + pad;
+                    // the take's length says which load it was
+                    const int length = 1000 + 100 * load + note;
+                    post(KernelCommand::loadPadCommand(note, makeTake(length, [](int) { return 0.1f; }), length));
+                    for (int setting = 0; setting < 50; ++setting) {
+                        post(KernelCommand::padSettingCommand(note, KernelCommand::PadSetting::Kind::VoiceLimit, 1 + setting % 8));
+                    }
+                }
+            }
+            finished += 1;
+        });
+    }
+    while (finished.load() < producerCount) {
+        rig.render();
+    }
+    for (std::thread& producer : producers) {
+        producer.join();
+    }
+    // drain what is still queued, a budget per cycle
+    rig.renderSeconds(1.0, 44100.0);
+
+    bool lastLoadWon = false;
+    for (int wait = 0; wait < 100 && !lastLoadWon; ++wait) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        lastLoadWon = true;
+        for (int note = 2; note < 2 + producerCount * padsPerProducer; ++note) {
+            lastLoadWon = lastLoadWon && rig.kernel.waveformLength(note) == 1000 + 100 * (loadsPerPad - 1) + note;
+        }
+    }
+    CHECK(lastLoadWon);
+}
+
+}
+
+int main() {
+    testQueue();
+    testKernel();
+    return testResult("CommandQueueTests");
+}
@@ -0,0 +1,110 @@
+//
+//  DuckerTests.cpp
+//  BeatMachineExtensionTests
+//
+
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "SidechainDucker.hpp"
+#include "TestCheck.hpp"
+
+/*
+ The SidechainDucker on a bus held at 1, so what comes out is its gain, rendered in
+ segments of random length so chunks are cut short at segment ends. A sidechain far over
+ the threshold may take the bus down by the depth and no further; once it stops, the gain
+ must be back at 1 within the release time. Throughout, the gain may move between
+ neighbouring samples no faster than the attack allows, at chunk and segment boundaries
+ alike.
+ */
+namespace {
+
+const double sampleRate = 44100.0;
+const float depth = 12.0f;
+const float releaseMilliseconds = 150.0f;
+const double pi = 3.14159265358979323846;
+
+std::mt19937 random(48);
+
+// Appends what the ducker makes of a bus of 1 under `sidechain` (null for none), in segments
+// of 1 to 300 frames
+void duck(SidechainDucker& ducker, const float* sidechain, int frames, std::vector<float>& gains) {
+    std::vector<float> bus;
+    for (int done = 0; done < frames;) {
+        const int count = std::min(frames - done, 1 + int(random() % 300));
+        bus.assign(count, 1.0f);
+        ducker.process(sidechain != nullptr ? sidechain + done : nullptr, bus.data(), count);
+        gains.insert(gains.end(), bus.begin(), bus.end());
+        done += count;
+    }
+}
+
+float largestStep(const std::vector<float>& gains) {
+    float result = 0.0f;
+    float previous = 1.0f;
+    for (float gain : gains) {
+        result = std::max(result, std::fabs(gain - previous));
+        previous = gain;
+    }
+    return result;
+}
+
+void testDuckAndRelease(float level) {
+    SidechainDucker ducker;
+    ducker.prepare(sampleRate);
+    ducker.setDepth(depth);
+    ducker.setRelease(releaseMilliseconds);
+
+    // a 220 Hz sidechain at `level`, for half a second
+    const int loud = int(0.5 * sampleRate);
+    std::vector<float> sidechain(loud);
+    for (int i = 0; i < loud; ++i) {
+        sidechain[i] = level * float(std::sin(2.0 * pi * 220.0 * i / sampleRate));
+    }
+    std::vector<float> gains;
+    duck(ducker, sidechain.data(), loud, gains);
+
+    const float floor = std::pow(10.0f, -depth / 20.0f);
+    CHECK(*std::min_element(gains.begin(), gains.end()) >= floor * 0.9999f);
+    CHECK(*std::max_element(gains.begin(), gains.end()) <= 1.0f);
+    CHECK_NEAR(gains.back(), floor, 0.01);
+
+    // then silence: back at 1 within the release time, give or take the chunk it ends in
+    const int release = int(std::ceil(releaseMilliseconds * 0.001 * sampleRate)) + SidechainDucker::chunkLength;
+    duck(ducker, nullptr, release + int(0.1 * sampleRate), gains);
+    CHECK(std::all_of(gains.begin() + loud + release, gains.end(), [](float gain) { return gain == 1.0f; }));
+
+    // No steps: the reduction moves at most depth / attack time dB per sample, and the gain
+    // at most ln(10) / 20 per dB
+    const float bound = float(depth * std::log(10.0) / 20.0 / (SidechainDucker::attackSeconds * sampleRate)) * 1.01f;
+    CHECK(largestStep(gains) <= bound);
+}
+
+void testDepthTurnedOff() {
+    SidechainDucker ducker;
+    ducker.prepare(sampleRate);
+    ducker.setDepth(depth);
+    ducker.setRelease(releaseMilliseconds);
+    const std::vector<float> sidechain(16384, 0.9f);
+    std::vector<float> gains;
+    duck(ducker, sidechain.data(), 4096, gains);
+    CHECK(ducker.gain() < 0.5f);
+
+    // ducking switched off mid-duck still lets go within the release time
+    ducker.setDepth(0.0f);
+    CHECK(ducker.isActive());
+    const int release = int(std::ceil(releaseMilliseconds * 0.001 * sampleRate)) + SidechainDucker::chunkLength;
+    duck(ducker, sidechain.data(), release, gains);
+    CHECK(ducker.gain() == 1.0f);
+    CHECK(!ducker.isActive());
+}
+
+}
+
+int main() {
+    // just over the threshold plus the depth, and far over it
+    testDuckAndRelease(0.15f);
+    testDuckAndRelease(0.9f);
+    testDepthTurnedOff();
+    return testResult("DuckerTests");
+}
@@ -0,0 +1,179 @@
+//
+//  LoopbackTests.cpp
+//  BeatMachineExtensionTests
+//
+
+#include <chrono>
+#include <random>
+#include <thread>
+#include "KernelRig.hpp"
+#include "TestCheck.hpp"
+
+/*
+ Input latency compensation against a simulated loopback, at round trips of 37 to 10000
+ samples and with block sizes that change every cycle. The latency probe, its output fed
+ back into its input that many samples later, must measure the round trip exactly, and the
+ unit must stop pulling input once it has: nothing else wants it by default.
+
+ A take is then recorded with clicks played along with it, 1000 and 3000 samples after the
+ note-on and one halfway into the pre-roll, each arriving a round trip late. With Input
+ Latency set to the round trip the take, played back, must have its clicks on the exact
+ samples they were played on, with and without pre-roll; without compensation they must
+ land a round trip late, so the test shows it is measuring something. Clicks are found by
+ standing out from their neighbours, since the playback fades in.
+
+ When the input pull fails in sampling mode, the output buffers double as the input and
+ still hold the last cycle; the unit must output silence rather than monitor them again.
+ */
+namespace {
+
+const double sampleRate = 44100.0;
+const int pad = 60;
+const int takeLength = 6000;
+const float floorLevel = 0.01f;     // keeps the analyzer from trimming the take's start
+const int roundTrips[] = { 37, 300, 1234, 5000, 10000 };
+
+std::mt19937 random(46);
+
+float samplesToMilliseconds(int samples) {
+    return float(double(samples) * 1000.0 / sampleRate);
+}
+
+// Renders up to `until` in blocks of random size, none longer than `largestBlock`, with
+// each block's input from `inputAt(time)` and the events in `events` on their samples,
+// appending each block's first output channel to `recording` as it goes
+template <typename Input>
+void run(KernelRig& rig, AUEventSampleTime until, int largestBlock, Input inputAt, const std::vector<AURenderEvent>& events = {}, std::vector<float>* recording = nullptr) {
+    std::vector<AURenderEvent> blockEvents;
+    size_t next = 0;
+    while (rig.now < until) {
+        const int smallest = std::min(32, largestBlock);
+        const int frames = smallest + int(random() % uint32_t(largestBlock - smallest + 1));
+        for (int i = 0; i < frames; ++i) {
+            rig.input[0][size_t(i)] = inputAt(rig.now + i);
+        }
+        blockEvents.clear();
+        while (next < events.size() && events[next].head.eventSampleTime < rig.now + frames) {
+            blockEvents.push_back(events[next++]);
+        }
+        rig.render(blockEvents, frames);
+        if (recording != nullptr) {
+            recording->insert(recording->end(), rig.output[0].begin(), rig.output[0].begin() + frames);
+        }
+    }
+}
+
+void testProbe(int roundTrip) {
+    KernelRig rig(512, sampleRate);
+    rig.kernel.measureInputLatency();
+    // the output comes back a round trip later, so no block may be longer than that
+    std::vector<float> sent;
+    run(rig, 30000, std::min(roundTrip, rig.maximumFrames()), [&sent, roundTrip](AUEventSampleTime time) {
+        const AUEventSampleTime source = time - roundTrip;
+        return source >= 0 && source < AUEventSampleTime(sent.size()) ? sent[size_t(source)] : 0.0f;
+    }, {}, &sent);
+    const int measured = rig.kernel.measuredInputLatency();
+    if (measured != roundTrip) {
+        std::printf("round trip %d: the probe measured %d\n", roundTrip, measured);
+    }
+    CHECK(measured == roundTrip);
+    CHECK(!rig.kernel.needsInput());
+}
+
+// Where the clicks are in the pad's take, by playing it back: the samples far louder than
+// both neighbours, which the input's floor keeps from being silent
+std::vector<int> clicks(KernelRig& rig) {
+    rig.setParameter(BeatMachineExtensionParameterAddress::samplingMode, 0.0f);
+    for (int i = 0; i < rig.maximumFrames(); ++i) {
+        rig.input[0][size_t(i)] = 0.0f;
+    }
+    rig.render({ noteEvent(rig.now, true, pad, 0xFFFF) });
+    std::vector<float> played(rig.output[0]);
+    rig.renderSeconds(0.3, sampleRate, &played);
+    rig.render({ noteEvent(rig.now, false, pad) });
+
+    std::vector<int> result;
+    for (size_t i = 1; i + 1 < played.size(); ++i) {
+        if (played[i] > 10.0f * played[i - 1] && played[i] > 10.0f * played[i + 1]) {
+            result.push_back(int(i));
+        }
+    }
+    return result;
+}
+
+void testTake(int roundTrip, int preRoll, bool compensated) {
+    KernelRig rig(512, sampleRate);
+    rig.setParameter(BeatMachineExtensionParameterAddress::samplingMode, 1.0f);
+    rig.setParameter(BeatMachineExtensionParameterAddress::inputLatency, compensated ? samplesToMilliseconds(roundTrip) : 0.0f);
+    rig.setParameter(BeatMachineExtensionParameterAddress::takePreRoll, samplesToMilliseconds(preRoll));
+
+    const AUEventSampleTime noteOn = 20000;
+    const AUEventSampleTime noteOff = noteOn + takeLength;
+    std::vector<AUEventSampleTime> played { noteOn + 1000, noteOn + 3000 };
+    if (preRoll > 0) {
+        played.insert(played.begin(), noteOn - preRoll / 2);
+    }
+    run(rig, noteOff + roundTrip + 2000, rig.maximumFrames(), [&played, roundTrip](AUEventSampleTime time) {
+        for (AUEventSampleTime click : played) {
+            if (time == click + roundTrip) {
+                return 1.0f;
+            }
+        }
+        return floorLevel;
+    }, { noteEvent(noteOn, true, pad), noteEvent(noteOff, false, pad) });
+
+    // the finished take is analyzed off the render thread
+    const int length = takeLength + preRoll;
+    for (int wait = 0; wait < 100 && rig.kernel.waveformLength(pad) != length; ++wait) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        rig.render();
+    }
+    CHECK(rig.kernel.waveformLength(pad) == length);
+
+    std::vector<int> expected;
+    const int late = compensated ? 0 : roundTrip;
+    for (AUEventSampleTime click : played) {
+        const int position = int(click - (noteOn - preRoll)) + late;
+        if (position < length) {
+            expected.push_back(position);
+        }
+    }
+    const std::vector<int> found = clicks(rig);
+    if (found != expected) {
+        std::printf("round trip %d, pre-roll %d%s: clicks at", roundTrip, preRoll, compensated ? "" : ", uncompensated");
+        for (int position : found) {
+            std::printf(" %d", position);
+        }
+        std::printf("\n");
+    }
+    CHECK(found == expected);
+}
+
+void testFailedPull() {
+    KernelRig rig(512, sampleRate);
+    rig.setParameter(BeatMachineExtensionParameterAddress::samplingMode, 1.0f);
+    std::fill(rig.input[0].begin(), rig.input[0].end(), 0.5f);
+    rig.render({ noteEvent(rig.now, true, pad) });
+    CHECK(std::any_of(rig.output[0].begin(), rig.output[0].end(), [](float sample) { return sample != 0.0f; }));
+
+    rig.pullInput = false;
+    for (int cycle = 0; cycle < 3; ++cycle) {
+        rig.render();
+        CHECK(std::all_of(rig.output[0].begin(), rig.output[0].end(), [](float sample) { return sample == 0.0f; }));
+    }
+    rig.render({ noteEvent(rig.now, false, pad) });
+}
+
+}
+
+int main() {
+    for (int roundTrip : roundTrips) {
+        testProbe(roundTrip);
+        for (int preRoll : { 0, 100, 2000 }) {
+            testTake(roundTrip, preRoll, true);
+        }
+        testTake(roundTrip, 0, false);
+    }
+    testFailedPull();
+    return testResult("LoopbackTests");
+}
@@ -0,0 +1,99 @@
+//
+//  MeterTests.cpp
+//  BeatMachineExtensionTests
+//
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include "KernelRig.hpp"
+#include "TestCheck.hpp"
+
+/*
+ Level metering across a render cycle that events split into segments. A sine pad plays
+ through cycles whose last segment is a single frame, or starts silent and is triggered
+ part way through; the output meter must report the whole cycle's peak and RMS, as
+ computed from the rendered output, and the pad meter the pad's level over the cycle.
+
+ The pad's waveform overview is read with ranges that start before the take or lie past
+ its end; only the part inside the take may be drawn.
+ */
+namespace {
+
+const double sampleRate = 44100.0;
+const int padNote = 40;
+const int otherNote = 41;
+const int takeLength = 88200;
+const double pi = 3.14159265358979323846;
+
+float take(int i) {
+    return 0.5f * float(std::sin(2.0 * pi * 220.0 * i / sampleRate));
+}
+
+void checkOutputMeter(const KernelRig& rig) {
+    const std::vector<float>& output = rig.output[0];
+    float peak = 0.0f;
+    double squares = 0.0;
+    for (float sample : output) {
+        peak = std::max(peak, std::fabs(sample));
+        squares += double(sample) * sample;
+    }
+    const LevelMeter& meter = rig.kernel.outputMeter(0);
+    CHECK(peak > 0.1f);
+    CHECK_NEAR(meter.peak(), peak, 1e-6);
+    CHECK_NEAR(meter.rms(), std::sqrt(squares / double(output.size())), 1e-4);
+}
+
+void testSplitCycles() {
+    KernelRig rig(512, sampleRate);
+    rig.kernel.postCommand(KernelCommand::loadPadCommand(padNote, makeTake(takeLength, take), takeLength));
+    rig.render();
+
+    // triggered part way through the cycle: the first segment is silent
+    rig.render({ noteEvent(rig.now + 300, true, padNote, 0xFFFF) });
+    checkOutputMeter(rig);
+    CHECK(rig.kernel.padMeter(padNote).peak() > 0.1f);
+
+    // an event on the last frame leaves a one-frame segment at the end
+    for (int cycle = 0; cycle < 4; ++cycle) {
+        rig.render({ noteEvent(rig.now + rig.maximumFrames() - 1, false, otherNote) });
+        checkOutputMeter(rig);
+        CHECK_NEAR(rig.kernel.padMeter(padNote).peak(), 0.5, 0.05);
+        CHECK_NEAR(rig.kernel.padMeter(padNote).rms(), 0.5 / std::sqrt(2.0), 0.05);
+    }
+}
+
+void testWaveformRanges() {
+    KernelRig rig(512, sampleRate);
+    rig.kernel.postCommand(KernelCommand::loadPadCommand(padNote, makeTake(takeLength, take), takeLength));
+    for (int wait = 0; wait < 100 && rig.kernel.waveformLength(padNote) != takeLength; ++wait) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        rig.render();
+    }
+    CHECK(rig.kernel.waveformLength(padNote) == takeLength);
+
+    const int pixels = 100;
+    std::vector<float> minimum(pixels, 0.0f);
+    std::vector<float> maximum(pixels, 0.0f);
+
+    // starting before the take: drawn from its first sample
+    const int filled = rig.kernel.readWaveform(padNote, -takeLength, takeLength, pixels, minimum.data(), maximum.data());
+    CHECK(filled == pixels);
+    CHECK(*std::min_element(minimum.begin(), minimum.end()) >= -0.5f);
+    CHECK(*std::max_element(maximum.begin(), maximum.end()) <= 0.5f);
+    CHECK(maximum.front() > 0.4f);
+
+    // wholly before or after it: nothing
+    CHECK(rig.kernel.readWaveform(padNote, -5000, -10, pixels, minimum.data(), maximum.data()) == 0);
+    CHECK(rig.kernel.readWaveform(padNote, takeLength + 10, takeLength + 5000, pixels, minimum.data(), maximum.data()) == 0);
+    // running past the end: the pixels beyond it are left alone
+    CHECK(rig.kernel.readWaveform(padNote, takeLength - 1000, takeLength + 1000, pixels, minimum.data(), maximum.data()) == pixels);
+}
+
+}
+
+int main() {
+    testSplitCycles();
+    testWaveformRanges();
+    return testResult("MeterTests");
+}
@@ -0,0 +1,140 @@
+//
+//  MixKernelTests.cpp
+//  BeatMachineExtensionTests
+//
+
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "MixKernels.hpp"
+#include "TestCheck.hpp"
+
+/*
+ Each MixKernels kernel against its MixKernels::Reference version, on random blocks of
+ odd and even lengths, with the output in its own buffer and aliased onto each input the
+ kernel allows. The vDSP ramps step their gain by repeated addition where the reference
+ multiplies, so the two agree to within float rounding, not exactly.
+ */
+namespace {
+
+const int counts[] = { 1, 3, 16, 63, 512, 1000 };
+const float tolerance = 1e-4f;
+
+std::vector<float> randomBlock(std::mt19937& random, int count) {
+    std::uniform_real_distribution<float> sample(-1.0f, 1.0f);
+    std::vector<float> block(count);
+    for (float& value : block) {
+        value = sample(random);
+    }
+    return block;
+}
+
+float largestDifference(const std::vector<float>& a, const std::vector<float>& b) {
+    float result = 0.0f;
+    for (size_t i = 0; i < a.size(); ++i) {
+        result = std::max(result, std::fabs(a[i] - b[i]));
+    }
+    return result;
+}
+
+void testAccumulate(std::mt19937& random) {
+    for (int count : counts) {
+        const std::vector<float> src = randomBlock(random, count);
+        const std::vector<float> bus = randomBlock(random, count);
+
+        std::vector<float> vector = bus;
+        std::vector<float> reference = bus;
+        MixKernels::accumulateWithGain(src.data(), 0.7f, vector.data(), count);
+        MixKernels::Reference::accumulateWithGain(src.data(), 0.7f, reference.data(), count);
+        CHECK(largestDifference(vector, reference) <= tolerance);
+
+        vector = bus;
+        reference = bus;
+        const float step = 1.0f / float(count);
+        const float next = MixKernels::accumulateWithRamp(src.data(), 0.0f, step, vector.data(), count);
+        const float referenceNext = MixKernels::Reference::accumulateWithRamp(src.data(), 0.0f, step, reference.data(), count);
+        CHECK(largestDifference(vector, reference) <= tolerance);
+        CHECK_NEAR(next, referenceNext, tolerance);
+    }
+}
+
+void testGainRamp(std::mt19937& random) {
+    for (int count : counts) {
+        const std::vector<float> src = randomBlock(random, count);
+        const float step = -0.5f / float(count);
+
+        std::vector<float> vector(count);
+        std::vector<float> reference(count);
+        const float next = MixKernels::gainRamp(src.data(), 1.0f, step, vector.data(), count);
+        const float referenceNext = MixKernels::Reference::gainRamp(src.data(), 1.0f, step, reference.data(), count);
+        CHECK(largestDifference(vector, reference) <= tolerance);
+        CHECK_NEAR(next, referenceNext, tolerance);
+
+        // in place
+        std::vector<float> inPlace = src;
+        MixKernels::gainRamp(inPlace.data(), 1.0f, step, inPlace.data(), count);
+        CHECK(largestDifference(inPlace, reference) <= tolerance);
+    }
+}
+
+void testCrossfade(std::mt19937& random) {
+    for (int count : counts) {
+        const std::vector<float> from = randomBlock(random, count);
+        const std::vector<float> to = randomBlock(random, count);
+        const float startMix = 0.1f;
+        const float step = 0.8f / float(count);
+
+        std::vector<float> reference(count);
+        MixKernels::Reference::crossfade(from.data(), to.data(), startMix, step, reference.data(), count);
+
+        std::vector<float> separate(count);
+        MixKernels::crossfade(from.data(), to.data(), startMix, step, separate.data(), count);
+        CHECK(largestDifference(separate, reference) <= tolerance);
+
+        std::vector<float> ontoFrom = from;
+        MixKernels::crossfade(ontoFrom.data(), to.data(), startMix, step, ontoFrom.data(), count);
+        CHECK(largestDifference(ontoFrom, reference) <= tolerance);
+
+        std::vector<float> ontoTo = to;
+        MixKernels::crossfade(from.data(), ontoTo.data(), startMix, step, ontoTo.data(), count);
+        CHECK(largestDifference(ontoTo, reference) <= tolerance);
+    }
+}
+
+void testInt16(std::mt19937& random) {
+    for (int count : counts) {
+        // past full scale, so the clip is exercised
+        std::vector<float> src = randomBlock(random, count);
+        for (float& sample : src) {
+            sample *= 1.5f;
+        }
+        std::vector<float> scratch(count);
+        std::vector<int16_t> vector(size_t(count) * 2, 0);
+        std::vector<int16_t> reference(size_t(count) * 2, 0);
+        // every other sample, as into one channel of an interleaved stereo frame
+        MixKernels::floatToInt16(src.data(), vector.data() + 1, 2, scratch.data(), count);
+        MixKernels::Reference::floatToInt16(src.data(), reference.data() + 1, 2, count);
+        CHECK(vector == reference);
+
+        std::vector<float> back(count);
+        std::vector<float> referenceBack(count);
+        std::vector<int16_t> packed(count);
+        for (int i = 0; i < count; ++i) {
+            packed[size_t(i)] = vector[size_t(i) * 2 + 1];
+        }
+        MixKernels::int16ToFloat(packed.data(), back.data(), count);
+        MixKernels::Reference::int16ToFloat(packed.data(), referenceBack.data(), count);
+        CHECK(back == referenceBack);
+    }
+}
+
+}
+
+int main() {
+    std::mt19937 random(3);
+    testAccumulate(random);
+    testGainRamp(random);
+    testCrossfade(random);
+    testInt16(random);
+    return testResult("MixKernelTests");
+}
@@ -0,0 +1,92 @@
+//
+//  PadLoopTests.cpp
+//  BeatMachineExtensionTests
+//
+
+#include <algorithm>
+#include "KernelRig.hpp"
+#include "TestCheck.hpp"
+
+/*
+ Discontinuities in pad playback. A 220 Hz sine pad is looped between points that land on
+ different phases of the wave, so a plain jump back to the loop start would step by most
+ of the wave's height; with the crossfade, no sample may step further than the sine itself
+ does at its steepest. Retriggers and releases are held to the same bound, and a release
+ must be silent once its fade is over.
+ */
+namespace {
+
+const double sampleRate = 44100.0;
+const int padNote = 40;
+const int takeLength = 88200;
+const int loopStart = 10000;
+const int loopEnd = 30123;
+const double pi = 3.14159265358979323846;
+const double radiansPerSample = 2.0 * pi * 220.0 / sampleRate;
+
+float take(int i) {
+    return 0.5f * float(std::sin(radiansPerSample * i));
+}
+
+// The largest step between neighbouring samples of `samples`, starting from `previous`
+float largestStep(const std::vector<float>& samples, float previous) {
+    float result = 0.0f;
+    for (float sample : samples) {
+        result = std::max(result, std::fabs(sample - previous));
+        previous = sample;
+    }
+    return result;
+}
+
+float peak(const std::vector<float>& samples) {
+    float result = 0.0f;
+    for (float sample : samples) {
+        result = std::max(result, std::fabs(sample));
+    }
+    return result;
+}
+
+// The most a sine of this peak steps between samples, with room for float rounding
+float sineStepBound(float peak) {
+    return float(peak * radiansPerSample * 1.05) + 1e-4f;
+}
+
+void testSeams() {
+    // the loop points really are on different phases
+    CHECK(std::fabs(take(loopEnd) - take(loopStart)) > 0.2f);
+
+    KernelRig rig(512, sampleRate);
+    rig.kernel.postCommand(KernelCommand::loadPadCommand(padNote, makeTake(takeLength, take), takeLength));
+    rig.kernel.postCommand(KernelCommand::padSettingCommand(padNote, KernelCommand::PadSetting::Kind::Loop, loopStart, loopEnd));
+    rig.render();
+
+    rig.render({ noteEvent(rig.now, true, padNote, 0xFFFF) });
+    std::vector<float> played = rig.output[0];
+    // several times round the loop
+    rig.renderSeconds(4.0, sampleRate, &played);
+
+    const float level = peak(played);
+    CHECK(level > 0.1f);
+    CHECK(largestStep(played, 0.0f) <= sineStepBound(level));
+    // still looping at the end
+    CHECK(peak(std::vector<float>(played.end() - 1000, played.end())) > 0.5f * level);
+
+    // a retrigger part way through a cycle
+    const float before = rig.output[0].back();
+    rig.render({ noteEvent(rig.now + 200, true, padNote, 0xFFFF) });
+    CHECK(largestStep(rig.output[0], before) <= sineStepBound(level));
+
+    // a release, faded out within 10 ms
+    const float held = rig.output[0].back();
+    rig.render({ noteEvent(rig.now + 50, false, padNote) });
+    CHECK(largestStep(rig.output[0], held) <= sineStepBound(level));
+    const int fadeEnd = 50 + int(std::ceil(0.01 * sampleRate)) + 1;
+    CHECK(peak(std::vector<float>(rig.output[0].begin() + fadeEnd, rig.output[0].end())) == 0.0f);
+}
+
+}
+
+int main() {
+    testSeams();
+    return testResult("PadLoopTests");
+}
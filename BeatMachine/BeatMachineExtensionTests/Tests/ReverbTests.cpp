@@ -0,0 +1,177 @@
+//
+//  ReverbTests.cpp
+//  BeatMachineExtensionTests
+//
+
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "ConvolutionReverb.hpp"
+#include "TestCheck.hpp"
+
+/*
+ The convolution reverb against direct convolution, with the send fed in chunks that don't
+ line up with its partitions. A unit impulse must return the send exactly partitionLength
+ samples late, and an impulse several partitions long must match direct convolution of
+ the send with the impulse scaled to unit energy. An impulse swapped in mid-stream must
+ take over from the next partition on, with nothing of the old tail left; and a send that
+ resumes after the reverb has stopped convolving silence must ring without ghosts of what
+ came before.
+ */
+namespace {
+
+const double sampleRate = 44100.0;
+const int partition = ConvolutionReverb::partitionLength;
+const float level = 0.5f;
+const float tolerance = 1e-4f;
+
+std::mt19937 random(49);
+
+std::vector<float> noise(int length) {
+    std::uniform_real_distribution<float> sample(-0.5f, 0.5f);
+    std::vector<float> result(length);
+    for (float& value : result) {
+        value = sample(random);
+    }
+    return result;
+}
+
+// A decaying noise impulse
+std::vector<float> tail(int length) {
+    std::vector<float> result = noise(length);
+    for (int i = 0; i < length; ++i) {
+        result[i] *= std::pow(0.001f, float(i) / float(length));
+    }
+    return result;
+}
+
+void load(ConvolutionReverb& reverb, const std::vector<float>& impulse) {
+    const SampleCache::Sample cached = SampleCache::shared().acquire(impulse.data(), (int)impulse.size(), uint32_t(sampleRate));
+    CHECK(reverb.load({ cached.samples, (int)impulse.size(), uint32_t(sampleRate) }));
+    reverb.poll();
+    CHECK(reverb.update());
+}
+
+// The reverb's return for `send`: direct convolution with `impulse` scaled to unit
+// energy, partitionLength samples late
+std::vector<float> convolve(const std::vector<float>& send, const std::vector<float>& impulse) {
+    double energy = 0.0;
+    for (float sample : impulse) {
+        energy += double(sample) * sample;
+    }
+    const double scale = level / std::sqrt(energy);
+    std::vector<float> result(send.size(), 0.0f);
+    for (size_t t = partition; t < send.size(); ++t) {
+        double sum = 0.0;
+        for (size_t k = 0; k < impulse.size() && k + partition <= t; ++k) {
+            sum += double(impulse[k]) * send[t - partition - k];
+        }
+        result[t] = float(sum * scale);
+    }
+    return result;
+}
+
+// Renders `send` in chunks of `chunk` frames and returns the reverb alone
+std::vector<float> process(ConvolutionReverb& reverb, const std::vector<float>& send, int chunk) {
+    std::vector<float> output(send.size(), 0.0f);
+    for (size_t done = 0; done < send.size(); done += size_t(chunk)) {
+        const int count = (int)std::min(send.size() - done, size_t(chunk));
+        reverb.process(send.data() + done, output.data() + done, count, level);
+    }
+    return output;
+}
+
+float largestDifference(const std::vector<float>& a, const std::vector<float>& b, size_t from = 0) {
+    float result = 0.0f;
+    for (size_t i = from; i < a.size(); ++i) {
+        result = std::max(result, std::fabs(a[i] - b[i]));
+    }
+    return result;
+}
+
+void testUnitImpulse() {
+    ConvolutionReverb reverb;
+    reverb.prepare();
+    reverb.reset(sampleRate);
+    load(reverb, { 1.0f });
+
+    const std::vector<float> send = noise(8 * partition + 77);
+    const std::vector<float> output = process(reverb, send, 100);
+    std::vector<float> expected(send.size(), 0.0f);
+    for (size_t t = partition; t < send.size(); ++t) {
+        expected[t] = send[t - partition] * level;
+    }
+    CHECK(largestDifference(output, expected) <= tolerance);
+}
+
+void testPartitions() {
+    const std::vector<float> impulse = tail(3 * partition + 37);
+    for (int chunk : { 1, 100, partition, 1000 }) {
+        ConvolutionReverb reverb;
+        reverb.prepare();
+        reverb.reset(sampleRate);
+        load(reverb, impulse);
+
+        const std::vector<float> send = noise(10 * partition);
+        const std::vector<float> output = process(reverb, send, chunk);
+        CHECK(largestDifference(output, convolve(send, impulse)) <= tolerance);
+    }
+}
+
+void testSwap() {
+    ConvolutionReverb reverb;
+    reverb.prepare();
+    reverb.reset(sampleRate);
+    load(reverb, tail(6 * partition));
+
+    // mid-stream, between partitions, to a unit impulse
+    const std::vector<float> before = noise(9 * partition);
+    process(reverb, before, 64);
+    load(reverb, { 1.0f });
+    const std::vector<float> send = noise(6 * partition);
+    const std::vector<float> output = process(reverb, send, 64);
+
+    // the partition already convolved plays out; from the next one on, only the new impulse
+    std::vector<float> expected(send.size(), 0.0f);
+    for (size_t t = partition; t < send.size(); ++t) {
+        expected[t] = send[t - partition] * level;
+    }
+    CHECK(largestDifference(output, expected, partition) <= tolerance);
+}
+
+void testSilenceSkip() {
+    const std::vector<float> impulse = tail(4 * partition + 5);
+    ConvolutionReverb reverb;
+    reverb.prepare();
+    reverb.reset(sampleRate);
+    load(reverb, impulse);
+
+    // a burst, then silence long enough for the reverb to stop convolving, then another burst
+    const int burst = 3 * partition + 11;
+    const int silence = 12 * partition - 11;    // so the second burst starts a partition
+    std::vector<float> send = noise(burst);
+    send.resize(size_t(burst + silence), 0.0f);
+    const std::vector<float> second = noise(burst);
+    send.insert(send.end(), second.begin(), second.end());
+    send.resize(send.size() + size_t(8 * partition), 0.0f);
+
+    const std::vector<float> output = process(reverb, send, 100);
+    const std::vector<float> expected = convolve(send, impulse);
+    CHECK(largestDifference(output, expected) <= tolerance);
+
+    // once the tail has died away the reverb stops convolving, and is exactly silent until the
+    // second burst
+    const auto quiet = output.begin() + burst + 8 * partition;
+    const auto resumed = output.begin() + burst + silence + partition;
+    CHECK(std::all_of(quiet, resumed, [](float sample) { return sample == 0.0f; }));
+}
+
+}
+
+int main() {
+    testUnitImpulse();
+    testPartitions();
+    testSwap();
+    testSilenceSkip();
+    return testResult("ReverbTests");
+}
@@ -0,0 +1,142 @@
+//
+//  SampleRateTests.cpp
+//  BeatMachineExtensionTests
+//
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <unistd.h>
+#include "KernelRig.hpp"
+#include "OfflineBounce.hpp"
+#include "TestCheck.hpp"
+
+/*
+ Musical timing at every supported sample rate. At 143 BPM a beat is a fractional number
+ of samples at each rate, so truncating it anywhere would drift. A bounce of sequencer
+ hits on every beat and one of the metronome while loop recording must each put every
+ event within a sample or two of its exact time, from the first bar to the last. A pad
+ held past SoundBuffer::takeSeconds must stop recording at that length, whatever the rate.
+ */
+namespace {
+
+const double rates[] = { 44100.0, 48000.0, 88200.0, 96000.0, 176400.0, 192000.0 };
+const double tempo = 143.0;
+const int bars = 16;
+
+std::string temporaryPath(const char* name) {
+    return "/tmp/" + std::string(name) + "." + std::to_string(getpid()) + ".wav";
+}
+
+// The sample each sound in `samples` starts on: its first audible sample, less `lead`
+// for sounds that fade in from silence on their first sample
+std::vector<long> onsets(const std::vector<float>& samples, long lead) {
+    std::vector<long> result;
+    for (size_t i = 0; i < samples.size(); ++i) {
+        if (samples[i] != 0.0f && (i == 0 || samples[i - 1] == 0.0f)) {
+            result.push_back(long(i) - lead);
+        }
+    }
+    return result;
+}
+
+// The furthest any onset is from the beat it falls on, in samples
+double largestError(const std::vector<long>& starts, double samplesPerBeat) {
+    double result = 0.0;
+    for (size_t beat = 0; beat < starts.size(); ++beat) {
+        result = std::max(result, std::fabs(double(starts[beat]) - double(beat) * samplesPerBeat));
+    }
+    return result;
+}
+
+void testSequencer(double sampleRate) {
+    const std::string path = temporaryPath("SampleRateTestsSequencer");
+    BeatMachineExtensionDSPKernel kernel;
+    kernel.prepare(std::string());
+    kernel.postCommand(KernelCommand::loadPadCommand(StepSequencer::firstTrackNote, makeTake(200, [](int) { return 0.5f; }), 200));
+    for (int step = 0; step < 16; step += 4) {
+        StepSequencer::Edit edit;
+        edit.type = StepSequencer::Edit::Type::SetStep;
+        edit.step = step;
+        edit.velocity = 127;
+        kernel.postCommand(KernelCommand::sequencerEditCommand(edit));
+    }
+    kernel.setParameter(BeatMachineExtensionParameterAddress::sequencerEnabled, 1.0f);
+    CHECK(OfflineBounce::render(kernel, 1, sampleRate, tempo, bars, path).succeeded);
+
+    const std::vector<long> hits = onsets(load_wav_file(path), 1);
+    std::remove(path.c_str());
+    CHECK(hits.size() == size_t(bars * 4));
+    const double error = largestError(hits, sampleRate * 60.0 / tempo);
+    if (error > 1.0) {
+        std::printf("%.0f Hz: a sequencer hit is %.2f samples off its beat\n", sampleRate, error);
+    }
+    CHECK(error <= 1.0);
+}
+
+void testMetronome(double sampleRate, const std::string& clickPath) {
+    const std::string path = temporaryPath("SampleRateTestsMetronome");
+    BeatMachineExtensionDSPKernel kernel;
+    kernel.prepare(clickPath);
+    kernel.setParameter(BeatMachineExtensionParameterAddress::loopRecordMode, 1.0f);
+    CHECK(OfflineBounce::render(kernel, 1, sampleRate, tempo, bars, path).succeeded);
+
+    // the click starts at full level
+    const std::vector<long> clicks = onsets(load_wav_file(path), 0);
+    std::remove(path.c_str());
+    // the click on the downbeat after the last bar may just make it into the bounce
+    const double samplesPerBeat = sampleRate * 60.0 / tempo;
+    const size_t beats = size_t(bars * 4);
+    CHECK(clicks.size() == beats || (clicks.size() == beats + 1 && clicks.back() >= long(double(beats) * samplesPerBeat) - 2));
+    const double error = largestError(clicks, samplesPerBeat);
+    if (error > 2.0) {
+        std::printf("%.0f Hz: a click is %.2f samples off its beat\n", sampleRate, error);
+    }
+    CHECK(error <= 2.0);
+}
+
+void testTakeLength(double sampleRate) {
+    const int pad = 40;
+    KernelRig rig(4096, sampleRate);
+    rig.setParameter(BeatMachineExtensionParameterAddress::samplingMode, 1.0f);
+    std::fill(rig.input[0].begin(), rig.input[0].end(), 0.25f);
+    rig.render({ noteEvent(rig.now, true, pad) });
+    rig.renderSeconds(SoundBuffer::takeSeconds + 0.5, sampleRate);
+    rig.render({ noteEvent(rig.now, false, pad) });
+
+    const int length = int(SoundBuffer::takeSeconds * sampleRate);
+    for (int wait = 0; wait < 100 && rig.kernel.waveformLength(pad) != length; ++wait) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        rig.render();
+    }
+    if (rig.kernel.waveformLength(pad) != length) {
+        std::printf("%.0f Hz: a held pad recorded %d samples, not %d\n", sampleRate, rig.kernel.waveformLength(pad), length);
+    }
+    CHECK(rig.kernel.waveformLength(pad) == length);
+}
+
+}
+
+int main() {
+    // a 10 ms decaying click at 44.1 kHz, resampled by the kernel to each rate
+    const std::string clickPath = temporaryPath("SampleRateTestsClick");
+    {
+        std::vector<float> click(441);
+        for (size_t i = 0; i < click.size(); ++i) {
+            click[i] = 0.5f * std::exp(-float(i) / 60.0f);
+        }
+        const float* channels[] = { click.data() };
+        WavWriter writer;
+        writer.open(clickPath, 1, 44100.0);
+        writer.write(channels, int(click.size()));
+        writer.close();
+    }
+
+    for (double sampleRate : rates) {
+        testSequencer(sampleRate);
+        testMetronome(sampleRate, clickPath);
+        testTakeLength(sampleRate);
+    }
+    std::remove(clickPath.c_str());
+    return testResult("SampleRateTests");
+}
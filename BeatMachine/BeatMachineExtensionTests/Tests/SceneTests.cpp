@@ -0,0 +1,199 @@
+//
+//  SceneTests.cpp
+//  BeatMachineExtensionTests
+//
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "KernelRig.hpp"
+#include "TestCheck.hpp"
+
+/*
+ Scene captures against a kernel that keeps rendering. Between the render thread filling a
+ capture and the capture being finished, Scene::capture copies the pads' and loop's own
+ buffers, so nothing may be recorded over them in place:
+
+   a pad that starts a new take records it into a spare buffer, and the scene keeps the
+   old take whole;
+   the loop stops overdubbing, yet sounds exactly as it would have, and overdubs again
+   once the capture is finished.
+
+ A scene switch still pending when the stream changes rate drops the scene's loop rather
+ than play it at the wrong speed. The worker reports each switch through the scene switch
+ handler once the render thread has made it, and not before.
+ */
+namespace {
+
+const double sampleRate = 44100.0;
+const int pad = 36;
+const int takeLength = 44100;
+
+// Requests a capture and renders the cycle that fills it
+const SceneCapture* fillCapture(KernelRig& rig) {
+    CHECK(rig.kernel.requestSceneCapture());
+    rig.render();
+    const SceneCapture* capture = rig.kernel.sceneCapture();
+    CHECK(capture != nullptr);
+    return capture;
+}
+
+// Loads the pad with a take of constant `level`, and waits for the worker's spare takes
+void loadPad(KernelRig& rig, float level) {
+    rig.kernel.postCommand(KernelCommand::loadPadCommand(pad, makeTake(takeLength, [level](int) { return level; }), takeLength));
+    rig.render();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+}
+
+void testPadRecording() {
+    KernelRig rig(512, sampleRate);
+    loadPad(rig, 0.25f);
+    rig.setParameter(BeatMachineExtensionParameterAddress::samplingMode, 1.0f);
+    const SceneCapture* capture = fillCapture(rig);
+    if (capture == nullptr) {
+        return;
+    }
+    const float* captured = capture->pads[pad].take.samples;
+    CHECK(capture->pads[pad].take.length == takeLength);
+
+    // a new take, recorded while the capture is still being copied
+    std::fill(rig.input[0].begin(), rig.input[0].end(), 0.75f);
+    rig.render({ noteEvent(rig.now, true, pad) });
+    rig.render();
+    rig.render({ noteEvent(rig.now, false, pad) });
+
+    bool whole = true;
+    for (int i = 0; i < takeLength; ++i) {
+        whole = whole && captured[i] == 0.25f;
+    }
+    CHECK(whole);
+    const std::shared_ptr<const Scene> scene = Scene::capture(*capture, {});
+    rig.kernel.finishSceneCapture();
+    CHECK(scene->pads[pad].take.length == takeLength);
+    CHECK(scene->pads[pad].take.length == takeLength && scene->pads[pad].take.samples[takeLength - 1] == 0.25f);
+
+    // the new take went somewhere else, and is the pad's now
+    bool recorded = false;
+    for (int wait = 0; wait < 100 && !recorded; ++wait) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        rig.render();
+        recorded = rig.kernel.waveformLength(pad) == 2 * rig.maximumFrames();
+    }
+    CHECK(recorded);
+}
+
+// The loop buffer as a capture filled after a second of loop recording saw it: when it was
+// filled, a second later, and a second after the capture was finished
+struct LoopSnapshots {
+    std::vector<float> filled;
+    std::vector<float> copied;
+    std::vector<float> finished;
+};
+
+// Loop recording with a pad held, for a second before the capture, if `snapshots` asks for
+// one, and a second after. Returns the output of that second second.
+std::vector<float> overdub(LoopSnapshots* snapshots) {
+    KernelRig rig(512, sampleRate);
+    loadPad(rig, 0.25f);
+    rig.kernel.postCommand(KernelCommand::padSettingCommand(pad, KernelCommand::PadSetting::Kind::Loop, takeLength / 10, takeLength));
+    rig.setParameter(BeatMachineExtensionParameterAddress::loopRecordMode, 1.0f);
+    rig.render({ noteEvent(rig.now, true, pad, 0xFFFF) });
+    rig.renderSeconds(1.0, sampleRate);
+
+    const SceneCapture* capture = nullptr;
+    if (snapshots != nullptr) {
+        capture = fillCapture(rig);
+    } else {
+        rig.render();
+    }
+    const float* loop = capture != nullptr ? capture->loop.samples : nullptr;
+    const int length = capture != nullptr ? capture->loop.length : 0;
+    if (loop != nullptr) {
+        snapshots->filled.assign(loop, loop + length);
+    }
+    std::vector<float> output;
+    rig.renderSeconds(1.0, sampleRate, &output);
+    if (loop != nullptr) {
+        snapshots->copied.assign(loop, loop + length);
+        rig.kernel.finishSceneCapture();
+        rig.renderSeconds(1.0, sampleRate);
+        snapshots->finished.assign(loop, loop + length);
+    }
+    return output;
+}
+
+void testLoopOverdub() {
+    LoopSnapshots snapshots;
+    const std::vector<float> captured = overdub(&snapshots);
+    CHECK(!snapshots.filled.empty());
+    // the loop buffer held still through the capture and moved on after it
+    CHECK(snapshots.copied == snapshots.filled);
+    CHECK(snapshots.finished != snapshots.filled);
+    // and sounded the same as without a capture
+    CHECK(captured == overdub(nullptr));
+}
+
+void testPendingSwitchAcrossRates() {
+    KernelRig rig(512, sampleRate);
+    loadPad(rig, 0.25f);
+    rig.setParameter(BeatMachineExtensionParameterAddress::loopRecordMode, 1.0f);
+    rig.render({ noteEvent(rig.now, true, pad, 0xFFFF), noteEvent(rig.now + 256, false, pad) });
+    rig.renderSeconds(0.5, sampleRate);
+    const SceneCapture* capture = fillCapture(rig);
+    if (capture == nullptr) {
+        return;
+    }
+    const std::shared_ptr<const Scene> scene = Scene::capture(*capture, {});
+    rig.kernel.finishSceneCapture();
+    CHECK(scene->loop.samples != nullptr);
+
+    // queued at 44.1 kHz and made after the stream restarts at 48 kHz
+    rig.kernel.queueSceneChange(scene, false);
+    rig.kernel.initialize(1, 1, 48000.0);
+    const uint64_t sequence = rig.kernel.appliedSceneChange();
+    std::vector<float> output;
+    rig.renderSeconds(8.0, 48000.0, &output);
+    CHECK(rig.kernel.appliedSceneChange() == sequence + 1);
+    float peak = 0.0f;
+    for (float sample : output) {
+        peak = std::max(peak, std::fabs(sample));
+    }
+    CHECK(peak == 0.0f);
+}
+
+void testSwitchReported() {
+    std::atomic<uint64_t> reported { 0 };     // outlives the rig and its worker
+    KernelRig rig(512, sampleRate);
+    rig.kernel.setSceneSwitchHandler([&reported](uint64_t applied) {
+        reported.store(applied);
+    });
+    loadPad(rig, 0.25f);
+    const SceneCapture* capture = fillCapture(rig);
+    if (capture == nullptr) {
+        return;
+    }
+    const std::shared_ptr<const Scene> scene = Scene::capture(*capture, {});
+    rig.kernel.finishSceneCapture();
+
+    // queued while nothing renders: the worker has nothing to report
+    const uint64_t sequence = rig.kernel.queueSceneChange(scene, false);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    CHECK(reported.load() < sequence);
+
+    // made at the start of the next cycle, with the transport stopped
+    rig.render();
+    for (int wait = 0; wait < 100 && reported.load() != sequence; ++wait) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    CHECK(reported.load() == sequence);
+}
+
+}
+
+int main() {
+    testPadRecording();
+    testLoopOverdub();
+    testPendingSwitchAcrossRates();
+    testSwitchReported();
+    return testResult("SceneTests");
+}
@@ -0,0 +1,147 @@
+//
+//  SequencerTests.cpp
+//  BeatMachineExtensionTests
+//
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include "AllocationCounter.hpp"
+#include "HostTransport.hpp"
+#include "TestCheck.hpp"
+
+/*
+ Sequencer steps and note velocity. Steps are gated for one step and never hold their
+ pad, so a looping pad stops between hits, nothing allocates on the render thread, and
+ switching to sampling with the sequencer running leaves every pad's take alone. MIDI
+ note-on velocity scales the pad, whether the note plays at once or on the grid.
+ */
+namespace {
+
+const double sampleRate = 44100.0;
+const int trackNote = StepSequencer::firstTrackNote;   // track 0's pad
+const int takeLength = 44100;
+
+float peak(const std::vector<float>& samples) {
+    float result = 0.0f;
+    for (float sample : samples) {
+        result = std::max(result, std::fabs(sample));
+    }
+    return result;
+}
+
+// Loads `note` with a one-second take of 0.5 that loops after its first 100 ms
+void loadLoopingPad(KernelRig& rig, int note) {
+    rig.kernel.postCommand(KernelCommand::loadPadCommand(note, makeTake(takeLength, [](int) { return 0.5f; }), takeLength));
+    rig.kernel.postCommand(KernelCommand::padSettingCommand(note, KernelCommand::PadSetting::Kind::Loop, takeLength / 10, takeLength));
+    rig.render();
+}
+
+// Sets a single step on the first beat of track 0 in pattern 0
+void setFirstStep(KernelRig& rig) {
+    StepSequencer::Edit edit;
+    edit.type = StepSequencer::Edit::Type::SetStep;
+    edit.step = 0;
+    edit.velocity = 127;
+    rig.kernel.postCommand(KernelCommand::sequencerEditCommand(edit));
+    rig.render();
+}
+
+void testStepsAreGated() {
+    KernelRig rig(512, sampleRate);
+    HostTransport transport;
+    transport.attach(rig, sampleRate);
+    loadLoopingPad(rig, trackNote);
+    setFirstStep(rig);
+    rig.setParameter(BeatMachineExtensionParameterAddress::sequencerEnabled, 1.0f);
+
+    // 16 steps a bar at 120 BPM; the step sounds during its 1/16 and is gone by beat 2
+    const AUEventSampleTime bar = AUEventSampleTime(4 * transport.samplesPerBeat(sampleRate));
+    float firstBeat = 0.0f;
+    float afterGate = 0.0f;
+    long allocations = 0;
+    while (rig.now < 3 * bar) {
+        const AUEventSampleTime position = rig.now % bar;
+        {
+            AllocationScope scope;
+            rig.render();
+            allocations += scope.count();
+        }
+        if (position < bar / 8) {
+            firstBeat = std::max(firstBeat, peak(rig.output[0]));
+        } else if (position >= bar / 4 && position + rig.maximumFrames() < bar) {
+            afterGate = std::max(afterGate, peak(rig.output[0]));
+        }
+    }
+    CHECK(firstBeat > 0.05f);
+    CHECK(afterGate == 0.0f);
+    CHECK(allocations == 0);
+}
+
+void testSamplingLeavesStepPadsAlone() {
+    KernelRig rig(512, sampleRate);
+    HostTransport transport;
+    transport.attach(rig, sampleRate);
+    loadLoopingPad(rig, trackNote);
+    setFirstStep(rig);
+    rig.setParameter(BeatMachineExtensionParameterAddress::sequencerEnabled, 1.0f);
+    // past the step on the second bar line, at 2 s
+    rig.renderSeconds(2.5, sampleRate);
+
+    std::fill(rig.input[0].begin(), rig.input[0].end(), 0.25f);
+    rig.setParameter(BeatMachineExtensionParameterAddress::samplingMode, 1.0f);
+    rig.renderSeconds(2.0, sampleRate);
+    rig.setParameter(BeatMachineExtensionParameterAddress::samplingMode, 0.0f);
+    rig.renderSeconds(0.5, sampleRate);
+
+    // the waveform overview is built on the worker; give it time to catch up
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    CHECK(rig.kernel.waveformLength(trackNote) == takeLength);
+    float minimum = 0.0f;
+    float maximum = 0.0f;
+    CHECK(rig.kernel.readWaveform(trackNote, 0, takeLength, 1, &minimum, &maximum) == 1);
+    CHECK(minimum == 0.5f && maximum == 0.5f);
+}
+
+// Peak output of a pad hit at `velocity`, from MIDI note-on at the start of a cycle
+float hitPeak(KernelRig& rig, uint16_t velocity) {
+    rig.render({ noteEvent(rig.now, true, trackNote, velocity) });
+    float result = peak(rig.output[0]);
+    for (int cycle = 0; cycle < 20; ++cycle) {
+        rig.render();
+        result = std::max(result, peak(rig.output[0]));
+    }
+    rig.render({ noteEvent(rig.now, false, trackNote) });
+    rig.renderSeconds(0.1, sampleRate);
+    return result;
+}
+
+void testVelocity() {
+    KernelRig rig(512, sampleRate);
+    HostTransport transport;
+    transport.attach(rig, sampleRate);
+    loadLoopingPad(rig, trackNote);
+
+    const float full = hitPeak(rig, 0xFFFF);
+    CHECK(full > 0.1f);
+    CHECK_NEAR(hitPeak(rig, 0x8000) / full, 0.5, 0.01);
+
+    // quantized notes keep their velocity until they play
+    rig.setParameter(BeatMachineExtensionParameterAddress::quantizeGrid, 3.0f);
+    rig.render({ noteEvent(rig.now + 1, true, trackNote, 0x4000) });
+    float quarter = peak(rig.output[0]);
+    for (int cycle = 0; cycle < 40; ++cycle) {
+        rig.render();
+        quarter = std::max(quarter, peak(rig.output[0]));
+    }
+    CHECK_NEAR(quarter / full, 0.25, 0.01);
+}
+
+}
+
+int main() {
+    testStepsAreGated();
+    testSamplingLeavesStepPadsAlone();
+    testVelocity();
+    return testResult("SequencerTests");
+}
@@ -0,0 +1,126 @@
+//
+//  SoakTests.cpp
+//  BeatMachineExtensionTests
+//
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include "KernelRig.hpp"
+#include "TestCheck.hpp"
+
+/*
+ Long loop overdubs, rendered for --minutes of audio each (10 by default; give it hours
+ before touching the loop or the denormal guard). A looping pad of constant 0.5 is held
+ while the loop overdubs it:
+
+   for the whole run at 100 % feedback, where every pass adds another 0.5 and the loop
+   must stay finite and pinned at the overdub bound;
+   for 20 seconds at 25 %, after which the loop decays and must reach exact silence
+   without one subnormal sample.
+
+ Either way, no minute may take much more CPU than the typical one: denormals reaching
+ the render path would show as a slowdown while the loop decays.
+ */
+namespace {
+
+const double sampleRate = 44100.0;
+const int frames = 512;
+const int padNote = 40;
+
+double threadCPUSeconds() {
+    timespec time {};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return double(time.tv_sec) + double(time.tv_nsec) * 1e-9;
+}
+
+struct Soak {
+    bool finite = true;
+    bool subnormal = false;
+    float peak = 0.0f;
+    float last = 0.0f;                  // peak of the final minute
+    std::vector<double> minutes;        // CPU seconds per minute of audio
+};
+
+Soak soak(double minutes, float feedback, double holdSeconds) {
+    KernelRig rig(frames, sampleRate);
+    const int takeLength = 44100;
+    rig.kernel.postCommand(KernelCommand::loadPadCommand(padNote, makeTake(takeLength, [](int) { return 0.5f; }), takeLength));
+    rig.kernel.postCommand(KernelCommand::padSettingCommand(padNote, KernelCommand::PadSetting::Kind::Loop, takeLength / 10, takeLength));
+    rig.render();
+    rig.setParameter(BeatMachineExtensionParameterAddress::gain, 1.0f);
+    rig.setParameter(BeatMachineExtensionParameterAddress::loopRecordMode, 1.0f);
+    rig.setParameter(BeatMachineExtensionParameterAddress::loopFeedback, feedback);
+
+    Soak result;
+    const long cycles = long(minutes * 60.0 * sampleRate / frames);
+    const long cyclesPerMinute = long(60.0 * sampleRate / frames);
+    const long releaseCycle = long(holdSeconds * sampleRate / frames);
+    double minuteStart = threadCPUSeconds();
+    float minutePeak = 0.0f;
+    for (long cycle = 0; cycle < cycles; ++cycle) {
+        if (cycle == 0) {
+            rig.render({ noteEvent(rig.now, true, padNote, 0xFFFF) });
+        } else if (cycle == releaseCycle) {
+            rig.render({ noteEvent(rig.now, false, padNote) });
+        } else {
+            rig.render();
+        }
+        for (float sample : rig.output[0]) {
+            result.finite = result.finite && std::isfinite(sample);
+            result.subnormal = result.subnormal || std::fpclassify(sample) == FP_SUBNORMAL;
+            minutePeak = std::max(minutePeak, std::fabs(sample));
+        }
+        if ((cycle + 1) % cyclesPerMinute == 0) {
+            const double now = threadCPUSeconds();
+            result.minutes.push_back(now - minuteStart);
+            minuteStart = now;
+            result.peak = std::max(result.peak, minutePeak);
+            result.last = minutePeak;
+            minutePeak = 0.0f;
+        }
+    }
+    return result;
+}
+
+// No minute more than twice the median, after the first, which includes the overdub
+void checkSteady(std::vector<double> minutes) {
+    if (minutes.size() < 3) {
+        return;
+    }
+    minutes.erase(minutes.begin());
+    const double slowest = *std::max_element(minutes.begin(), minutes.end());
+    std::nth_element(minutes.begin(), minutes.begin() + minutes.size() / 2, minutes.end());
+    const double median = minutes[minutes.size() / 2];
+    if (slowest > 2.0 * median) {
+        std::printf("slowest minute took %.3f s of CPU, the median %.3f s\n", slowest, median);
+    }
+    CHECK(slowest <= 2.0 * median);
+}
+
+}
+
+int main(int argc, char** argv) {
+    double minutes = 10.0;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--minutes") == 0) {
+            minutes = std::atof(argv[i + 1]);
+        }
+    }
+
+    const Soak endless = soak(minutes, 100.0f, minutes * 60.0);
+    CHECK(endless.finite);
+    // the overdub sum is held to +12 dBFS
+    CHECK(endless.peak <= 4.0f);
+    CHECK(endless.last > 3.9f);
+    checkSteady(endless.minutes);
+
+    const Soak decaying = soak(minutes, 25.0f, 20.0);
+    CHECK(decaying.finite);
+    CHECK(!decaying.subnormal);
+    CHECK(decaying.last == 0.0f);
+    checkSteady(decaying.minutes);
+
+    return testResult("SoakTests");
+}
@@ -0,0 +1,113 @@
+//
+//  StressTests.cpp
+//  BeatMachineExtensionTests
+//
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include "KernelRig.hpp"
+#include "ParameterRanges.hpp"
+#include "TestCheck.hpp"
+
+/*
+ Randomized stress of record, play and loop transitions: random block sizes, note-ons and
+ note-offs on every note (the record and mute notes included), mode and parameter changes,
+ and pad and loop commands, rendered for --seconds of audio (30 by default; run it for
+ hours under the sanitizers before touching the render path). The output must stay finite
+ and bounded throughout. --seed picks the sequence, so a failure can be replayed.
+ */
+int main(int argc, char** argv) {
+    double seconds = 30.0;
+    unsigned seed = 7;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--seconds") == 0) {
+            seconds = std::atof(argv[i + 1]);
+        } else if (std::strcmp(argv[i], "--seed") == 0) {
+            seed = unsigned(std::strtoul(argv[i + 1], nullptr, 10));
+        }
+    }
+
+    const double sampleRate = 44100.0;
+    KernelRig rig(512, sampleRate);
+    std::mt19937 random(seed);
+    auto uniform = [&random] (float low, float high) {
+        return std::uniform_real_distribution<float>(low, high)(random);
+    };
+
+    long frames = 0;
+    long events = 0;
+    float peak = 0.0f;
+    bool failed = false;
+    while (frames < long(seconds * sampleRate) && !failed) {
+        // the input is silent a quarter of the time
+        const bool silent = random() % 4 == 0;
+        for (float& sample : rig.input[0]) {
+            sample = silent ? 0.0f : uniform(-1.0f, 1.0f);
+        }
+
+        const int blockFrames = 1 + int(random() % rig.maximumFrames());
+        std::vector<AURenderEvent> blockEvents;
+        const int eventCount = int(random() % 6);
+        for (int i = 0; i < eventCount; ++i) {
+            const AUEventSampleTime time = rig.now + AUEventSampleTime(random() % blockFrames);
+            if (random() % 4 == 0) {
+                blockEvents.push_back(midiEvent(time, uint32_t(random()), uint32_t(random())));
+            } else {
+                blockEvents.push_back(noteEvent(time, random() % 2 == 0, int(random() % 256), uint16_t(random())));
+            }
+            events += 1;
+        }
+        std::stable_sort(blockEvents.begin(), blockEvents.end(), [] (const AURenderEvent& a, const AURenderEvent& b) {
+            return a.head.eventSampleTime < b.head.eventSampleTime;
+        });
+
+        if (random() % 50 == 0) {
+            const ParameterRange& range = parameterRanges[random() % parameterCount];
+            const float width = range.maximum - range.minimum;
+            rig.setParameter(range.address, uniform(range.minimum - width, range.maximum + width));
+        }
+        if (random() % 200 == 0) {
+            const int note = int(random() % 300) - 100;
+            switch (random() % 5) {
+                case 0:
+                    rig.kernel.postCommand(KernelCommand::clearPadCommand(note));
+                    break;
+                case 1:
+                    rig.kernel.postCommand(KernelCommand::clearLoopCommand());
+                    break;
+                case 2:
+                    rig.kernel.postCommand(KernelCommand::setLoopLengthCommand(uniform(-4.0f, 12.0f)));
+                    break;
+                case 3: {
+                    const auto kind = KernelCommand::PadSetting::Kind(random() % 5);
+                    rig.kernel.postCommand(KernelCommand::padSettingCommand(note, kind, int(random() % 100000) - 1000, int(random() % 500000) - 1000));
+                }
+                    break;
+                default: {
+                    float* take = makeTake(2000, [&uniform](int) { return uniform(-1.0f, 1.0f); });
+                    if (!rig.kernel.postCommand(KernelCommand::loadPadCommand(note, take, int(random() % 600000) - 1000))) {
+                        delete[] take;
+                    }
+                }
+                    break;
+            }
+        }
+
+        rig.render(blockEvents, blockFrames);
+        for (int i = 0; i < blockFrames; ++i) {
+            const float sample = rig.output[0][i];
+            if (!std::isfinite(sample) || std::fabs(sample) > 64.0f) {
+                std::printf("sample %g at frame %ld\n", sample, frames + i);
+                failed = true;
+                break;
+            }
+            peak = std::max(peak, std::fabs(sample));
+        }
+        frames += blockFrames;
+    }
+    CHECK(!failed);
+    std::printf("%.0f s of audio, %ld MIDI events, peak %.2f\n", double(frames) / sampleRate, events, peak);
+    return testResult("StressTests");
+}
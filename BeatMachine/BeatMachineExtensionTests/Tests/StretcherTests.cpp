@@ -0,0 +1,133 @@
+//
+//  StretcherTests.cpp
+//  BeatMachineExtensionTests
+//
+
+#include <algorithm>
+#include <vector>
+#include "LoopStretcher.hpp"
+#include "TestCheck.hpp"
+
+/*
+ The LoopStretcher on sine loops, driven the way the kernel drives it, with the worker's
+ poll() called in between. Stretched either way, a loop must keep its pitch and level. A
+ loop shrunk while its analysis is still being made must never play the stale analysis,
+ and once the shorter one lands the stretch must carry on inside it, at its pitch.
+ */
+namespace {
+
+const double sampleRate = 48000.0;
+const int blockFrames = 512;
+const double pi = 3.14159265358979323846;
+
+// A whole number of cycles of `frequency`, so the loop is seamless
+std::vector<float> sineLoop(int length, double frequency) {
+    std::vector<float> loop(length);
+    for (int i = 0; i < length; ++i) {
+        loop[i] = 0.5f * float(std::sin(2.0 * pi * frequency * i / sampleRate));
+    }
+    return loop;
+}
+
+std::vector<float> render(LoopStretcher& stretcher, int frames, double speed) {
+    std::vector<float> output(frames);
+    for (int done = 0; done < frames; done += blockFrames) {
+        stretcher.render(output.data() + done, std::min(blockFrames, frames - done), speed);
+    }
+    return output;
+}
+
+// Frequency from the first to the last rising zero crossing, each placed between samples
+double frequency(const std::vector<float>& samples) {
+    double first = -1.0;
+    double last = -1.0;
+    int crossings = 0;
+    for (size_t i = 1; i < samples.size(); ++i) {
+        if (samples[i - 1] < 0.0f && samples[i] >= 0.0f) {
+            const double time = double(i - 1) + samples[i - 1] / (samples[i - 1] - samples[i]);
+            first = first < 0.0 ? time : first;
+            last = time;
+            crossings += 1;
+        }
+    }
+    return crossings > 1 ? (crossings - 1) * sampleRate / (last - first) : 0.0;
+}
+
+float peak(const std::vector<float>& samples) {
+    float result = 0.0f;
+    for (float sample : samples) {
+        result = std::isfinite(sample) ? std::max(result, std::fabs(sample)) : INFINITY;
+    }
+    return result;
+}
+
+void testPitchHolds() {
+    const std::vector<float> loop = sineLoop(48000, 480.0);
+    for (double speed : { 0.8, 1.25 }) {
+        LoopStretcher stretcher;
+        stretcher.prepare();
+        stretcher.requestAnalysis(loop.data(), (int)loop.size());
+        stretcher.poll();
+        CHECK(stretcher.isReady());
+
+        stretcher.seek(0.0);
+        // several times round the loop, skipping the first hops while they overlap in
+        const std::vector<float> output = render(stretcher, 3 * 48000, speed);
+        const std::vector<float> settled(output.begin() + LoopStretcher::fftSize, output.end());
+        CHECK_NEAR(frequency(settled), 480.0, 2.0);
+        CHECK(peak(settled) <= 0.6f);
+        CHECK(peak(settled) >= 0.4f);
+        CHECK_NEAR(stretcher.position(), std::fmod(3 * 48000 * speed, 48000.0), 1.0);
+    }
+}
+
+void testStaleAnalysisDropped() {
+    const std::vector<float> loop = sineLoop(48000, 480.0);
+    LoopStretcher stretcher;
+    stretcher.prepare();
+
+    // requested, then the loop changes before the worker gets to it
+    stretcher.requestAnalysis(loop.data(), (int)loop.size());
+    stretcher.invalidate();
+    stretcher.poll();
+    CHECK(!stretcher.isReady());
+    CHECK(!stretcher.isAnalysisPending());
+
+    // a request after the change is published
+    stretcher.requestAnalysis(loop.data(), (int)loop.size());
+    stretcher.poll();
+    CHECK(stretcher.isReady());
+}
+
+void testLoopShrinksMidStretch() {
+    const std::vector<float> longLoop = sineLoop(48000, 480.0);
+    const std::vector<float> shortLoop = sineLoop(12000, 600.0);
+    const double speed = 1.25;
+    LoopStretcher stretcher;
+    stretcher.prepare();
+    stretcher.requestAnalysis(longLoop.data(), (int)longLoop.size());
+    stretcher.poll();
+
+    // stretching near the end of the long loop, far past the end of the short one
+    stretcher.seek(40000.0);
+    render(stretcher, 4 * blockFrames, speed);
+
+    // the shorter loop's analysis lands mid-stretch
+    stretcher.requestAnalysis(shortLoop.data(), (int)shortLoop.size());
+    CHECK(stretcher.isAnalysisPending());
+    stretcher.poll();
+    const std::vector<float> output = render(stretcher, 48000, speed);
+    CHECK(stretcher.position() < 12000.0);
+    const std::vector<float> settled(output.begin() + LoopStretcher::fftSize, output.end());
+    CHECK_NEAR(frequency(settled), 600.0, 2.0);
+    CHECK(peak(output) <= 0.6f);
+}
+
+}
+
+int main() {
+    testPitchHolds();
+    testStaleAnalysisDropped();
+    testLoopShrinksMidStretch();
+    return testResult("StretcherTests");
+}
@@ -0,0 +1,114 @@
+//
+//  TransportTests.cpp
+//  BeatMachineExtensionTests
+//
+
+#include <chrono>
+#include <thread>
+#include "HostTransport.hpp"
+#include "TestCheck.hpp"
+
+/*
+ Quantized pad triggers and record start/stop against a simulated host transport at
+ 120 BPM, beat 0 at sample 0: a 1/16 step is 5512.5 samples and a bar 88200. Each case
+ sends one note at a known sample and checks the sample the kernel acts on it.
+ */
+namespace {
+
+const double sampleRate = 44100.0;
+const double samplesPerBeat = sampleRate * 60.0 / 120.0;
+const AUEventSampleTime bar = AUEventSampleTime(4 * samplesPerBeat);
+const int padNote = 40;
+
+// Renders whole cycles up to the one that contains `time`
+void renderUntil(KernelRig& rig, AUEventSampleTime time) {
+    while (rig.now + rig.maximumFrames() <= time) {
+        rig.render();
+    }
+}
+
+// Plays the pad with a note-on at `time` and returns the sample its voice started on, or
+// -1. Its fade-in starts from silence, so that is one before the first one it is heard on.
+// The pad is released and left a beat to fall silent.
+AUEventSampleTime voiceStart(KernelRig& rig, AUEventSampleTime time) {
+    renderUntil(rig, time);
+    AUEventSampleTime first = -1;
+    rig.render({ noteEvent(time, true, padNote) });
+    for (int cycle = 0; cycle < 100 && first < 0; ++cycle) {
+        for (int i = 0; i < rig.maximumFrames(); ++i) {
+            if (std::fabs(rig.output[0][size_t(i)]) > 1e-6f) {
+                first = rig.now - rig.maximumFrames() + i - 1;
+                break;
+            }
+        }
+        if (first < 0) {
+            rig.render();
+        }
+    }
+    rig.render({ noteEvent(rig.now, false, padNote) });
+    renderUntil(rig, rig.now + AUEventSampleTime(samplesPerBeat));
+    return first;
+}
+
+void testTriggers() {
+    KernelRig rig(512, sampleRate);
+    HostTransport transport;
+    transport.attach(rig, sampleRate);
+    rig.kernel.postCommand(KernelCommand::loadPadCommand(padNote, makeTake(44100, [](int) { return 0.5f; }), 44100));
+    rig.render();
+
+    // quantization off: the note plays where it was sent
+    CHECK(voiceStart(rig, bar + 1000) == bar + 1000);
+
+    rig.setParameter(BeatMachineExtensionParameterAddress::quantizeGrid, 3.0f);
+    // straight 1/16: the next step, 5512.5 samples into the bar
+    CHECK(voiceStart(rig, 2 * bar + 1000) == 2 * bar + 5513);
+    // within the 5 ms tolerance after a grid line: played at once
+    CHECK(voiceStart(rig, 3 * bar + 100) == 3 * bar + 100);
+    // 1/4: the next beat
+    rig.setParameter(BeatMachineExtensionParameterAddress::quantizeGrid, 1.0f);
+    CHECK(voiceStart(rig, 4 * bar + 1000) == 4 * bar + 22050);
+
+    // swing 2:1 pushes the second 1/16 of each pair to 2/3 of the pair
+    rig.setParameter(BeatMachineExtensionParameterAddress::quantizeGrid, 3.0f);
+    rig.setParameter(BeatMachineExtensionParameterAddress::swing, 200.0f / 3.0f);
+    CHECK(voiceStart(rig, 5 * bar + 6000) == 5 * bar + 7350);
+    // and leaves the first of the next pair on the grid
+    CHECK(voiceStart(rig, 6 * bar + 8000) == 6 * bar + 11025);
+    rig.setParameter(BeatMachineExtensionParameterAddress::swing, 50.0f);
+
+    // a stopped transport has no grid
+    transport.moving = false;
+    CHECK(voiceStart(rig, 7 * bar + 1000) == 7 * bar + 1000);
+}
+
+// A take recorded with 1/16 quantization starts and stops on the grid, so its length is
+// a whole number of steps whatever the timing of the notes
+void testRecording() {
+    KernelRig rig(512, sampleRate);
+    HostTransport transport;
+    transport.attach(rig, sampleRate);
+    std::fill(rig.input[0].begin(), rig.input[0].end(), 0.25f);
+    rig.setParameter(BeatMachineExtensionParameterAddress::quantizeGrid, 3.0f);
+    rig.setParameter(BeatMachineExtensionParameterAddress::samplingMode, 1.0f);
+
+    renderUntil(rig, bar + 1000);
+    rig.render({ noteEvent(bar + 1000, true, padNote) });
+    renderUntil(rig, bar + 20000);
+    rig.render({ noteEvent(bar + 20000, false, padNote) });
+    renderUntil(rig, 2 * bar);
+
+    // the waveform overview follows the take from the worker thread
+    for (int wait = 0; wait < 100 && rig.kernel.waveformLength(padNote) != 22050 - 5513; ++wait) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    CHECK(rig.kernel.waveformLength(padNote) == 22050 - 5513);
+}
+
+}
+
+int main() {
+    testTriggers();
+    testRecording();
+    return testResult("TransportTests");
+}
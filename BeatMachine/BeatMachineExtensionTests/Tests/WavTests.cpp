@@ -0,0 +1,142 @@
+//
+//  WavTests.cpp
+//  BeatMachineExtensionTests
+//
+
+#include <cstdio>
+#include <sstream>
+#include <unistd.h>
+#include "KernelRig.hpp"
+#include "OfflineBounce.hpp"
+#include "TestCheck.hpp"
+#include "WavWriter.hpp"
+
+/*
+ WAV files round-tripped through WavWriter and load_wav_file. Mono comes back as written;
+ stereo, as the bounce writes it, comes back as one sample per frame, the mean of the two
+ channels. A stereo bounce reads back at its length in frames, with the step it played
+ where it played it.
+ */
+namespace {
+
+const double sampleRate = 44100.0;
+const float quantum = 1.0f / 32767.0f;
+
+std::string temporaryPath(const char* name) {
+    return "/tmp/" + std::string(name) + "." + std::to_string(getpid()) + ".wav";
+}
+
+void testMono() {
+    const std::string path = temporaryPath("WavTestsMono");
+    std::vector<float> samples(1000);
+    for (size_t i = 0; i < samples.size(); ++i) {
+        samples[i] = 0.5f * std::sin(float(i) * 0.05f);
+    }
+    const float* channels[] = { samples.data() };
+    WavWriter writer;
+    CHECK(writer.open(path, 1, 48000.0));
+    CHECK(writer.write(channels, int(samples.size())));
+    CHECK(writer.close());
+
+    uint32_t fileRate = 0;
+    const std::vector<float> read = load_wav_file(path, &fileRate);
+    std::remove(path.c_str());
+    CHECK(fileRate == 48000);
+    CHECK(read.size() == samples.size());
+    float error = 0.0f;
+    for (size_t i = 0; i < std::min(read.size(), samples.size()); ++i) {
+        error = std::max(error, std::fabs(read[i] - samples[i]));
+    }
+    CHECK(error <= quantum);
+}
+
+void testStereo() {
+    const std::string path = temporaryPath("WavTestsStereo");
+    std::vector<float> left(1000);
+    std::vector<float> right(1000);
+    for (size_t i = 0; i < left.size(); ++i) {
+        left[i] = 0.5f * std::sin(float(i) * 0.05f);
+        right[i] = i % 2 == 0 ? 0.25f : -0.75f;
+    }
+    const float* channels[] = { left.data(), right.data() };
+    WavWriter writer;
+    CHECK(writer.open(path, 2, sampleRate));
+    CHECK(writer.write(channels, int(left.size())));
+    CHECK(writer.close());
+
+    const std::vector<float> read = load_wav_file(path);
+    std::remove(path.c_str());
+    CHECK(read.size() == left.size());
+    float error = 0.0f;
+    for (size_t i = 0; i < std::min(read.size(), left.size()); ++i) {
+        error = std::max(error, std::fabs(read[i] - 0.5f * (left[i] + right[i])));
+    }
+    CHECK(error <= quantum);
+}
+
+// A data chunk that ends part way through a frame keeps only the whole frames
+void testPartialFrame() {
+    std::string file;
+    auto append = [&file](const void* bytes, size_t size) {
+        file.append(static_cast<const char*>(bytes), size);
+    };
+    const int16_t samples[] = { 16384, -16384, 8192, 8192, 4096 };
+    RiffChunk riff { { 'R', 'I', 'F', 'F' }, 0, { 'W', 'A', 'V', 'E' } };
+    ChunkInfo format { { 'f', 'm', 't', ' ' }, sizeof(FmtData) };
+    FmtData data { 1, 2, 44100, 44100 * 4, 4, 16 };
+    ChunkInfo samplesChunk { { 'd', 'a', 't', 'a' }, sizeof(samples) };
+    append(&riff, sizeof(riff));
+    append(&format, sizeof(format));
+    append(&data, sizeof(data));
+    append(&samplesChunk, sizeof(samplesChunk));
+    append(samples, sizeof(samples));
+
+    std::istringstream stream(file);
+    const std::vector<float> read = read_wav(stream);
+    CHECK(read.size() == 2);
+    CHECK(read.size() == 2 && read[0] == 0.0f && read[1] == 0.25f);
+}
+
+void testBounce() {
+    const std::string path = temporaryPath("WavTestsBounce");
+    const int note = StepSequencer::firstTrackNote;
+    BeatMachineExtensionDSPKernel kernel;
+    kernel.prepare(std::string());
+    kernel.postCommand(KernelCommand::loadPadCommand(note, makeTake(44100, [](int) { return 0.5f; }), 44100));
+    StepSequencer::Edit edit;
+    edit.type = StepSequencer::Edit::Type::SetStep;
+    edit.step = 0;
+    edit.velocity = 127;
+    kernel.postCommand(KernelCommand::sequencerEditCommand(edit));
+    kernel.setParameter(BeatMachineExtensionParameterAddress::sequencerEnabled, 1.0f);
+
+    // one bar at 120 BPM, with the first step's pad in both channels
+    const OfflineBounce::Result result = OfflineBounce::render(kernel, 2, sampleRate, 120.0, 1.0, path);
+    CHECK(result.succeeded);
+    CHECK(result.frames == 88200);
+
+    const std::vector<float> read = load_wav_file(path);
+    std::remove(path.c_str());
+    CHECK(read.size() == 88200);
+    float step = 0.0f;
+    float rest = 0.0f;
+    for (size_t i = 0; i < read.size(); ++i) {
+        if (i < read.size() / 16) {
+            step = std::max(step, std::fabs(read[i]));
+        } else if (i >= read.size() / 4) {
+            rest = std::max(rest, std::fabs(read[i]));
+        }
+    }
+    CHECK(step > 0.05f);
+    CHECK(rest == 0.0f);
+}
+
+}
+
+int main() {
+    testMono();
+    testStereo();
+    testPartialFrame();
+    testBounce();
+    return testResult("WavTests");
+}